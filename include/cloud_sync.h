@@ -0,0 +1,83 @@
+#pragma once
+
+// include/cloud_sync.h
+// Keeps SinricPro in step with relays switched locally (WS, HTTP, MQTT,
+// remote), including changes made while the cloud was unreachable. Owned by
+// the cloud task.
+//
+// Pending reports are a set of relays, not a queue of events: a relay
+// toggled a hundred times during an outage is still one report, and what is
+// sent is its state at send time. A relay that ends up where the cloud last
+// saw it sends nothing. Memory is fixed (a few words per relay) however long
+// the outage lasts. Reports go out oldest change first, at most
+// CLOUD_REPORT_BURST back to back, then one per CLOUD_REPORT_INTERVAL_MS; an
+// event the client refuses (link down, its own per-device rate limit) stays
+// pending and is retried after CLOUD_REPORT_RETRY_MS.
+//
+// Conflicts: a cloud command for a relay whose local change the cloud has
+// not heard about yet was issued against stale state. It is refused unless
+// it asks for the state the relay is already in, and that relay's report
+// jumps the queue so the cloud catches up. Once the report is out, cloud
+// commands apply as usual (the last command wins, wherever it came from).
+// On the first connection after boot every cloud relay is reported, since
+// the cloud cannot know the state restored from the journal.
+
+#include <atomic>
+#include <stdint.h>
+
+const uint32_t CLOUD_REPORT_BURST = 4;
+const uint32_t CLOUD_REPORT_INTERVAL_MS = 250;
+const uint32_t CLOUD_REPORT_RETRY_MS = 1000;
+
+class CloudSync {
+public:
+  static const int MAX_RELAYS = 32;
+  typedef bool (*SendFn)(int relay, bool on);   // false: not sent, retry later
+
+  // cloudRelays: bit n-1 set = relay n has a SinricPro device
+  explicit CloudSync(uint32_t cloudRelays) : cloudRelays_(cloudRelays) {}
+
+  // changed: relays switched locally since the last tick (bit n-1 = relay
+  // n); state: every relay now
+  void tick(uint32_t nowMs, bool online, uint32_t changed, uint32_t state, SendFn send);
+  // A cloud command for `relay` while the relays are in `state`: true if it
+  // should be applied.
+  bool acceptCommand(int relay, bool on, uint32_t state, uint32_t nowMs);
+
+  uint32_t pendingMask() const { return pending_; }
+
+  struct Stats {
+    uint32_t sent;        // events the client accepted
+    uint32_t coalesced;   // local changes folded into a report already pending
+    uint32_t dropped;     // reports dropped: the relay was back where the cloud saw it
+    uint32_t retries;     // events the client refused
+    uint32_t refused;     // cloud commands refused as stale
+    uint32_t resyncs;     // reconnects with reports pending
+  };
+  Stats stats() const;
+
+private:
+  int oldestDue(uint32_t nowMs) const;
+  void addPending(uint32_t relays, uint32_t nowMs);
+
+  uint32_t cloudRelays_;
+  uint32_t pending_ = 0;
+  uint32_t known_ = 0;        // what the cloud last saw, for relays in knownValid_
+  uint32_t knownValid_ = 0;
+  uint32_t sinceMs_[MAX_RELAYS] = {};    // when the pending change was made (queue order)
+  uint32_t retryAtMs_[MAX_RELAYS] = {};
+  bool online_ = false;
+  bool everOnline_ = false;
+  uint32_t offlineSinceMs_ = 0;
+  uint32_t tokens_ = CLOUD_REPORT_BURST;
+  uint32_t refillMs_ = 0;
+  std::atomic<uint32_t> sent_{0}, coalesced_{0}, dropped_{0}, retries_{0}, refused_{0}, resyncs_{0};
+};
+
+// The firmware's instance (cloud task). Tick takes the local changes from
+// takeCloudReportMask(); the SinricPro power-state callback asks before
+// submitting a command.
+void cloudSyncTick(bool online, CloudSync::SendFn send);
+bool cloudSyncAcceptCommand(int relay, bool on);
+uint32_t cloudSyncPending();           // relays with a report pending (safe from any task)
+CloudSync::Stats cloudSyncStats();
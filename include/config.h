@@ -0,0 +1,278 @@
+#pragma once
+
+// include/config.h
+// Board wiring and account settings, shared by the firmware and the native
+// (host) build.
+
+#include <Arduino.h>
+
+#include <utility>
+
+// -------- USER CONFIG --------
+const char* const FALLBACK_SSID = "WIFI_SSID"; //change with your config (it will be used as default wifi can be changed later)
+const char* const FALLBACK_PASS = "WIFI_PASSWORD";
+
+const char* const APP_KEY = "YOUR_APP_KEY";
+const char* const APP_SECRET = "YOUR_APP_SECRET";
+
+// Local MQTT broker (e.g. mosquitto on the home server). Off while MQTT_HOST
+// is "": set the broker's address here, or with
+//   build_flags = '-DMQTT_HOST_BUILD="192.168.1.10"'
+// Topics: <base>/relay/<n>/set|state, <base>/relay4_mode/set|state, <base>/status
+#ifndef MQTT_HOST_BUILD
+#define MQTT_HOST_BUILD ""
+#endif
+const char* const MQTT_HOST = MQTT_HOST_BUILD;
+const uint16_t MQTT_PORT = 1883;
+const char* const MQTT_USER = "";  // "" = anonymous
+const char* const MQTT_PASS = "";
+const char* const MQTT_BASE_TOPIC = "home/esp32-relays";
+
+// Firmware updates over HTTP (POST /update, see ota_update.h) need HTTP
+// Basic auth as OTA_USER / OTA_PASSWORD. While OTA_PASSWORD is "", /update
+// answers 403: set it here, or keep it out of the source with
+//   build_flags = '-DOTA_PASSWORD_BUILD="..."'
+#ifndef OTA_PASSWORD_BUILD
+#define OTA_PASSWORD_BUILD ""
+#endif
+const char* const OTA_USER = "ota";
+const char* const OTA_PASSWORD = OTA_PASSWORD_BUILD;
+
+constexpr const char* DEVICE_ID_1 = "XXXXXXXXXXXXXXXXXXXXXXXX";  // put device IDs from sinric pro
+constexpr const char* DEVICE_ID_2 = "XXXXXXXXXXXXXXXXXXXXXXXX";
+constexpr const char* DEVICE_ID_3 = "XXXXXXXXXXXXXXXXXXXXXXXX";
+
+// SinricPro switches that apply a saved scene (scenes.h) when turned on;
+// one row per scene device. A row with deviceId nullptr is not registered
+// (as in RELAYS), which is how the table ships: put the switch's ID in,
+// e.g. {"5f1e...", "evening"}, or build with
+//   build_flags = '-DSCENE_DEVICE_ID_BUILD="..."'
+struct SceneDeviceDef {
+  const char* deviceId;  // nullptr: none
+  const char* scene;     // scene name
+};
+#ifndef SCENE_DEVICE_ID_BUILD
+#define SCENE_DEVICE_ID_BUILD nullptr
+#endif
+constexpr SceneDeviceDef SCENE_DEVICES[] = {
+  {SCENE_DEVICE_ID_BUILD, "evening"},
+};
+
+// Relay backend (relay_bank.h), chosen at build time, e.g.
+//   build_flags = -DRELAY_BACKEND=RELAY_BACKEND_MCP23017 -DRELAY_COUNT=32
+#define RELAY_BACKEND_GPIO 0       // relays on ESP32 GPIOs (RELAYS table below)
+#define RELAY_BACKEND_74HC595 1    // a chain of 74HC595 shift registers on SPI
+#define RELAY_BACKEND_MCP23017 2   // MCP23017 port expanders on I2C, 16 relays each
+#ifndef RELAY_BACKEND
+#define RELAY_BACKEND RELAY_BACKEND_GPIO
+#endif
+
+const int RELAY_PIN_1 = 16;
+const int RELAY_PIN_2 = 17;
+const int RELAY_PIN_3 = 18;
+const int RELAY_PIN_4 = 19; // local-only
+
+// 74HC595 chain: SER <- MOSI, SRCLK <- SCK, RCLK <- CS (latches when a
+// transfer ends). /OE is held high by a pull-up and driven low through
+// RELAY_OE_PIN once the first state is latched (-1 = /OE tied low).
+const int RELAY_SPI_SCK = 18;
+const int RELAY_SPI_MOSI = 23;
+const int RELAY_SPI_CS = 5;
+const int RELAY_OE_PIN = 4;
+const uint32_t RELAY_SPI_HZ = 10000000;
+// MCP23017s at RELAY_I2C_ADDR, +1, ... (A2..A0 strapped); relay outputs
+// GPA0..GPA7 then GPB0..GPB7 on each.
+const int RELAY_I2C_SDA = 21;
+const int RELAY_I2C_SCL = 22;
+const uint8_t RELAY_I2C_ADDR = 0x20;
+const uint32_t RELAY_I2C_HZ = 400000;
+
+// Relay n is RELAYS[n-1]. pin is the GPIO for RELAY_BACKEND_GPIO, the
+// expander output (0-based, chip 0 first) otherwise; deviceId is the
+// SinricPro switch it answers to, nullptr for local-only.
+struct RelayDef {
+  int pin;
+  const char* deviceId;
+};
+#if RELAY_BACKEND == RELAY_BACKEND_GPIO
+// Add a row to add a relay (up to 32).
+constexpr RelayDef RELAYS[] = {
+  {RELAY_PIN_1, DEVICE_ID_1},
+  {RELAY_PIN_2, DEVICE_ID_2},
+  {RELAY_PIN_3, DEVICE_ID_3},
+  {RELAY_PIN_4, nullptr},
+};
+#else
+// Expander banks are uniform: relay n drives output n-1, and the first
+// relays answer to these SinricPro switches in order.
+#ifndef RELAY_COUNT
+#define RELAY_COUNT 16
+#endif
+constexpr const char* RELAY_DEVICE_IDS[] = {DEVICE_ID_1, DEVICE_ID_2, DEVICE_ID_3};
+
+struct RelayTable {
+  RelayDef def[RELAY_COUNT];
+  constexpr const RelayDef& operator[](int i) const { return def[i]; }
+  constexpr const RelayDef* begin() const { return def; }
+  constexpr const RelayDef* end() const { return def + RELAY_COUNT; }
+};
+constexpr RelayDef bankRelay(int i) {
+  return {i, i < (int)(sizeof(RELAY_DEVICE_IDS) / sizeof(RELAY_DEVICE_IDS[0])) ? RELAY_DEVICE_IDS[i] : nullptr};
+}
+template <int... I>
+constexpr RelayTable bankRelays(std::integer_sequence<int, I...>) { return {{bankRelay(I)...}}; }
+constexpr RelayTable RELAYS = bankRelays(std::make_integer_sequence<int, RELAY_COUNT>());
+#endif
+const int IR_RELAY = 4;  // follows the IR sensor in AUTO mode
+
+// *** NEW: IR proximity sensor analog pin & thresholds
+const int IR_PIN = 34;                  // ADC pin for IR sensor (change if needed)
+const int IR_ON_MIN = 2600;             // 2800 - 200
+const int IR_ON_MAX = 3000;             // 2800 + 200
+const uint32_t IR_SAMPLE_RATE_HZ = 20000; // continuous (I2S DMA) sampling rate
+const uint16_t IR_DECIMATE = 20;        // -> 1 kHz into the filter
+const uint8_t IR_EMA_SHIFT = 3;         // EMA weight 1/8 per filter sample (~8 ms)
+const uint16_t IR_HYSTERESIS = 150;     // band widened by this much once ON
+const uint16_t IR_MIN_DWELL_MS = 20;    // new state must hold this long before relay 4 follows
+
+// IR remote (ir_remote.h): a TSOP1838 on IR_REMOTE_PIN (-1 = not fitted),
+// captured by the RMT peripheral. Defaults to -1: without the receiver the
+// pin floats, and the decoder (and, on battery, the light-sleep wake on
+// that pin) would take its noise for key presses. Boards with one opt in,
+// e.g.
+//   build_flags = -DIR_REMOTE_GPIO=27
+// Keys are 32-bit NEC codes as IRremoteESP8266's IRrecvDumpV2 prints them;
+// unknown codes show up in the event log ("remote: code 0x... (no key)"),
+// which is how to learn a remote.
+#ifndef IR_REMOTE_GPIO
+#define IR_REMOTE_GPIO -1
+#endif
+const int IR_REMOTE_PIN = IR_REMOTE_GPIO;
+enum IrKeyAction : uint8_t {
+  IR_KEY_TOGGLE,   // arg = relay
+  IR_KEY_MODE,     // arg = relay 4 mode: 0 off, 1 on, 2 auto
+  IR_KEY_SCENE,    // arg = relays to switch on (bit n-1 = relay n); the rest go off
+  IR_KEY_SAVED_SCENE,  // arg = saved scene slot (scenes.h, "slot" in GET /scenes)
+  IR_KEY_PEER_TOGGLE,  // arg = node << 8 | relay: a relay on another controller (peer_link.h)
+};
+struct IrKey {
+  uint32_t code;
+  IrKeyAction action;
+  uint32_t arg;
+};
+// Defaults for the common 21-key NEC "car MP3" remote
+const IrKey IR_REMOTE_KEYS[] = {
+  {0x00FF30CF, IR_KEY_TOGGLE, 1},      // 1
+  {0x00FF18E7, IR_KEY_TOGGLE, 2},      // 2
+  {0x00FF7A85, IR_KEY_TOGGLE, 3},      // 3
+  {0x00FF10EF, IR_KEY_TOGGLE, 4},      // 4
+  {0x00FF6897, IR_KEY_SCENE, 0x0},     // 0: all off
+  {0x00FF9867, IR_KEY_SCENE, 0x7},     // 100+: relays 1-3 on, 4 off
+  {0x00FFB04F, IR_KEY_SAVED_SCENE, 0}, // 200+: saved scene in slot 0
+  {0x00FFA25D, IR_KEY_MODE, 0},        // CH-: relay 4 off
+  {0x00FF629D, IR_KEY_MODE, 2},        // CH:  relay 4 auto
+  {0x00FFE21D, IR_KEY_MODE, 1},        // CH+: relay 4 on
+};
+const uint32_t IR_REMOTE_HOLD_MS = 150; // the same code again within this = key held, not pressed again
+
+const bool RELAY_ACTIVE_LOW = true;  // for active low relays
+
+// Relay state journal (NVS): a change is committed once toggling has been
+// quiet this long, at most this late under constant toggling, and never
+// more often than the minimum interval.
+const uint32_t JOURNAL_QUIET_MS = 1500;
+const uint32_t JOURNAL_MAX_DEFER_MS = 10000;
+const uint32_t JOURNAL_MIN_INTERVAL_MS = 3000;
+
+// Timed relay actions (relay_timers.h): timers held at once (one-shots,
+// auto-offs in progress and daily schedules together), the wheel tick, and
+// the local time zone (POSIX TZ string) daily schedules follow once SNTP has
+// set the clock.
+const int RELAY_TIMER_MAX = 32;
+const uint32_t RELAY_TIMER_TICK_MS = 100;
+const uint32_t RELAY_TIMER_SAVE_QUIET_MS = 2000;   // changes are written to NVS once quiet this long
+const char* const TIME_ZONE = "CET-1CEST,M3.5.0,M10.5.0/3";
+const char* const NTP_SERVER = "pool.ntp.org";
+
+// Named scenes (scenes.h) kept in NVS.
+const int SCENE_MAX = 8;
+
+// Automation rules (rules.h) kept in NVS. A rule fires at most
+// RULE_BURST_MAX times within RULE_BURST_WINDOW_MS; triggered once more
+// (rules undoing each other) it is switched off instead, until the rules
+// change or the board restarts.
+const int RULES_MAX = 20;
+const uint8_t RULE_BURST_MAX = 10;
+const uint32_t RULE_BURST_WINDOW_MS = 1000;
+
+// Peer link (peer_link.h): controllers on the same WiFi channel command each
+// other's relays over ESP-NOW, no router needed. Give every board the same
+// PEER_NETWORK_ID and its own node number (0 = the last two bytes of its
+// MAC). Without a router the setup AP comes up on the router's last channel,
+// or PEER_CHANNEL if none was ever joined, so set that alike on all boards.
+// PEER_KEY signs every frame (peer_link.h); a board obeys only frames
+// signed with its own key. "" leaves the link off. Set it alike on all
+// boards, here or with build_flags = '-DPEER_KEY_BUILD="..."'.
+#ifndef PEER_KEY_BUILD
+#define PEER_KEY_BUILD ""
+#endif
+const char* const PEER_KEY = PEER_KEY_BUILD;
+const uint8_t PEER_NETWORK_ID = 1;
+const uint16_t PEER_NODE_ID = 0;
+const uint8_t PEER_CHANNEL = 1;
+const uint32_t PEER_HEARTBEAT_MS = 2000;   // state broadcast this often, and on every change
+const uint32_t PEER_TIMEOUT_MS = 7000;     // a node silent this long is gone
+const uint8_t PEER_MAX_HOPS = 2;           // times a frame is passed on by nodes in between
+const uint32_t PEER_RETRY_MS = 40;         // an unanswered command is sent again after this...
+const uint8_t PEER_RETRIES = 4;            // ...this many times, then given up
+
+// Firmware updates (ota_update.h): a new image must run with STA connected
+// or the setup AP up for OTA_CONFIRM_MS to be kept. It is rolled back if it
+// has not managed that within OTA_TRIAL_TIMEOUT_MS, or after OTA_TRIAL_BOOTS
+// boots without it.
+const uint32_t OTA_CONFIRM_MS = 60000;
+const uint32_t OTA_TRIAL_TIMEOUT_MS = 300000;
+const uint8_t OTA_TRIAL_BOOTS = 3;
+
+// Backup supply (power_manager.h). POWER_SENSE_PIN reads the HLK-5M05 5 V
+// rail through a divider: HIGH = mains, LOW = running on the Li-ion cell.
+// BATTERY_SENSE_PIN reads the cell through a 1:2 divider. -1 = not wired
+// (no sense pin: always mains). Both default to -1: GPIO35/39 are input-only
+// with no pull-up, so without the dividers they float. Boards that have them
+// opt in, e.g.
+//   build_flags = -DPOWER_SENSE_GPIO=35 -DBATTERY_SENSE_GPIO=39
+#ifndef POWER_SENSE_GPIO
+#define POWER_SENSE_GPIO -1
+#endif
+#ifndef BATTERY_SENSE_GPIO
+#define BATTERY_SENSE_GPIO -1
+#endif
+const int POWER_SENSE_PIN = POWER_SENSE_GPIO;
+const int BATTERY_SENSE_PIN = BATTERY_SENSE_GPIO;
+const uint32_t POWER_BACKUP_DEBOUNCE_MS = 200;   // rail low this long -> battery profile
+const uint32_t POWER_MAINS_DEBOUNCE_MS = 2000;   // rail back this long -> mains profile
+// On battery, tasks poll this often (bounds MQTT/SinricPro command latency
+// and WS stream updates; HTTP/WS commands are event-driven and not affected)
+// and the IR sensor is read in a short burst this often instead of by DMA
+// (relay 4 follows within two periods).
+const uint32_t POWER_BACKUP_POLL_MS = 50;
+const uint32_t POWER_BACKUP_IR_PERIOD_MS = 25;
+
+#define BOOT_BUTTON_PIN 0
+const unsigned long WIFI_CONNECT_TIMEOUT_MS = 20000UL; // 20s per STA attempt (non-blocking, see wifi_manager.h)
+const uint32_t WIFI_AP_FALLBACK_MS = 5000;   // STA down this long -> setup AP comes up alongside it
+const uint32_t WIFI_AP_LINGER_MS = 10000;    // AP kept this long after STA (re)connects
+const uint32_t WIFI_BACKOFF_MIN_MS = 1000;   // pause after a failed round, doubled per round...
+const uint32_t WIFI_BACKOFF_MAX_MS = 60000;  // ...up to this
+// Fast reconnect: the BSSID and channel of the last good join are kept next
+// to the credentials ("wifi" namespace) and the next join of that network
+// goes straight to them, skipping the channel scan. If the router is not
+// there (moved channel, replaced) the join fails fast and a full scan follows.
+const uint32_t WIFI_FAST_CONNECT_TIMEOUT_MS = 3000;
+// Also reuse the last DHCP address on those joins (static config, no DHCP
+// exchange). Only with a DHCP reservation for the board: an address the
+// router has since given to another device would clash silently.
+const bool WIFI_REUSE_IP = false;
+const char* const AP_PREFIX = "ESP32-Setup-";
+const int LED_PIN = LED_BUILTIN; // GPIO2
+// -------------------------------
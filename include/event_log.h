@@ -0,0 +1,112 @@
+#pragma once
+
+// include/event_log.h
+// Deferred event log. Code on the control path records a fixed-size binary
+// event instead of calling Serial.printf (at 115200 baud a 50-byte line
+// blocks its caller for ~4 ms once the UART FIFO is full). logEvent() is a
+// slot claim, a clock read and a few stores into a ring of the last
+// EVENT_LOG_SIZE events: no locks, no allocation, safe from any task or ISR.
+// A low-priority task formats new events and writes them to Serial; the
+// ring keeps the recent history for a dump on demand:
+//   Serial: type "log" + Enter
+//   HTTP:   GET /log (text), GET /log?format=bin (LogDumpHeader + records,
+//           decoded on a PC by tools/decode_log.py)
+// When the writer outruns the output task the oldest events are overwritten;
+// the task prints how many it missed.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// On-the-wire numbers: append new types at the end (tools/decode_log.py
+// reads this enum to name them).
+enum LogEventType : uint8_t {
+  LOG_BOOT,            // v1 = free heap
+  LOG_RESTORED,        // journal restored: v1 = relay mask, a = relay 4 mode
+  LOG_BOOT_BUTTON,     // BOOT held: forced setup AP
+  LOG_RELAY,           // a = relay, v1 = source, v2 = old << 1 | new
+  LOG_CLOUD_STARTED,
+  LOG_CLOUD_COMMAND,   // SinricPro power state: a = relay, v1 = on
+  LOG_WS_CONNECT,      // v1 = client id, v2 = IP (first octet in the low byte)
+  LOG_WS_DISCONNECT,   // v1 = client id
+  LOG_WS_STALLED,      // closed: v1 = client id, v2 = ms stalled
+  LOG_IR_FALLBACK,     // no ADC DMA: 1 kHz analogRead
+  LOG_WIFI_AP_UP,      // v1 = last two MAC bytes (the SSID suffix)
+  LOG_WIFI_AP_DOWN,
+  LOG_WIFI_JOIN,       // a = candidate (0 saved, 1 fallback), v1 = cached channel (0 = scan)
+  LOG_WIFI_BACKOFF,    // v1 = ms until the next round
+  LOG_WIFI_CONNECTED,  // a = 1 if joined without a scan, v1 = ms offline, v2 = IP
+  LOG_WIFI_LOST,
+  LOG_MQTT_CONNECTED,
+  LOG_MQTT_FAILED,     // v1 = PubSubClient state (signed), v2 = retry ms
+  LOG_POWER_BACKUP,    // battery profile: v1 = ms the 5 V rail had been down
+  LOG_POWER_MAINS,     // mains profile: v1 = ms the rail had been back
+  LOG_REMOTE_KEY,      // IR remote press: v1 = NEC code, a = key index + 1 (0 = not in the table)
+  LOG_CLOUD_RESYNC,    // SinricPro back: a = reports pending, v1 = ms offline
+  LOG_CLOUD_CONFLICT,  // stale SinricPro command refused: a = relay, v1 = state asked for
+  LOG_OTA_START,       // firmware upload: v1 = image bytes
+  LOG_OTA_DONE,        // image verified, boots next: v1 = bytes, v2 = ms taken
+  LOG_OTA_FAILED,      // upload abandoned: a = OtaError, v1 = bytes written
+  LOG_OTA_CONFIRMED,   // image on trial kept: v1 = ms after boot
+  LOG_OTA_ROLLBACK,    // image on trial dropped: a = boots (0 = timed out), v1 = ms after boot, v2 = 1 if the old one boots next
+  LOG_BOOT_MILESTONE,  // a = BootMilestone (metrics.h), v1 = ms after reset
+  LOG_TIMER_FIRED,     // relay_timers.h: a = relay, v1 = timer id, v2 = kind << 8 | RelayOp
+  LOG_SCENE,           // scenes.h: a = slot, v1 = CommandSource that asked, v2 = relays set (0 = queue full)
+  LOG_PEER,            // peer_link.h: a = 1 node heard / 0 node silent / 2 ESP-NOW failed to start / 3 off (no PEER_KEY), v1 = node
+  LOG_PEER_COMMAND,    // another node's command applied here: a = relay, v1 = that node, v2 = RelayOp
+  LOG_PEER_ANSWER,     // our command to a node answered: a = PeerError, v1 = node, v2 = relay << 16 | ms taken
+  LOG_RULE,            // rules.h: a = rule id, v1 = 0 fired / 1 fired, queue full / 2 switched off (looping), v2 = relay << 8 | RelayOp
+  LOG_TYPE_COUNT
+};
+
+// One event, 16 bytes, little-endian (ESP32 and x86 alike).
+struct LogRecord {
+  uint32_t timeMs;     // hal::millis()
+  uint16_t seq;        // low bits of the event number: a gap = events lost
+  uint8_t type;        // LogEventType
+  uint8_t a;
+  uint32_t v1;
+  uint32_t v2;
+};
+static_assert(sizeof(LogRecord) == 16, "LogRecord is a wire format");
+
+// Header of a binary dump; `count` LogRecords follow, oldest first.
+struct LogDumpHeader {
+  char magic[4];       // "EVL1"
+  uint16_t recordSize; // sizeof(LogRecord)
+  uint16_t count;
+  uint32_t nowMs;      // clock at the dump, to turn timeMs into "ago"
+  uint32_t total;      // events logged since boot
+};
+static_assert(sizeof(LogDumpHeader) == 16, "LogDumpHeader is a wire format");
+
+const int EVENT_LOG_SIZE = 256;       // events kept (power of two)
+const uint32_t EVENT_LOG_FLUSH_MS = 20;
+const size_t EVENT_LOG_LINE_MAX = 96;
+const size_t EVENT_LOG_DUMP_MAX = sizeof(LogDumpHeader) + EVENT_LOG_SIZE * sizeof(LogRecord);
+
+// Records BOOT and starts the output task (core 0, lowest priority). Events
+// logged before this are kept and printed once it runs.
+void eventLogBegin();
+
+void logEvent(LogEventType type, uint8_t a = 0, uint32_t v1 = 0, uint32_t v2 = 0);
+// An IPAddress as one field, first octet in the low byte.
+template <typename Ip> uint32_t logIp(const Ip& ip) {
+  return ip[0] | ip[1] << 8 | ip[2] << 16 | (uint32_t)ip[3] << 24;
+}
+
+// The recent history, oldest first (records being written are skipped).
+// Returns the number copied; `total` gets the number of events ever logged.
+size_t eventLogSnapshot(LogRecord* out, size_t max, uint32_t* total = nullptr);
+// The same as a binary dump (header + records) into a 4-byte aligned
+// buffer of up to EVENT_LOG_DUMP_MAX bytes; returns its length.
+size_t eventLogDump(uint8_t* out, size_t cap);
+
+// One event as text, no newline: "  12.345 relay 2 off -> on (ws)".
+size_t eventLogFormat(char* out, size_t cap, const LogRecord& r);
+
+struct EventLogStats {
+  uint32_t logged;     // logEvent() calls
+  uint32_t printed;    // lines the output task wrote
+  uint32_t lost;       // overwritten before the output task got to them
+};
+EventLogStats eventLogStats();
@@ -0,0 +1,127 @@
+#pragma once
+
+// include/hal.h
+// Thin hardware abstraction for the firmware. Everything in src/ that touches
+// pins, the ADC or the clock goes through here so the same application code
+// runs on the board (src/hal_esp32.cpp) and on Linux (src/native/, `pio run -e native`).
+//
+// Network (WiFi / ESPAsyncWebServer / PubSubClient) and cloud (SinricPro) are used
+// through their normal library APIs; the native env swaps in the stand-in
+// headers from src/native/include, so main.cpp does not need to change for them.
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hal {
+
+enum PinMode : uint8_t { PIN_MODE_OUTPUT, PIN_MODE_INPUT, PIN_MODE_INPUT_PULLUP };
+
+// -------- GPIO / ADC --------
+void pinSetup(int pin, PinMode mode);
+void gpioWrite(int pin, bool high);
+// Drive several outputs at once: bit n of highMask/lowMask = GPIO n. On the
+// ESP32 this is one write to each of the W1TS/W1TC set/clear registers.
+void gpioWriteMask(uint64_t highMask, uint64_t lowMask);
+bool gpioRead(int pin);
+int adcRead(int pin);           // raw 12-bit reading (0..4095)
+
+// Continuous ADC sampling into DMA buffers (I2S built-in ADC mode on the
+// ESP32, so ADC1 pins only; one stream at a time). Read blocks until
+// maxSamples are available or the timeout hits; returns samples copied.
+bool adcStreamStart(int pin, uint32_t sampleRateHz);
+size_t adcStreamRead(uint16_t* buf, size_t maxSamples, uint32_t timeoutMs);
+void adcStreamStop();           // frees the ADC for adcRead() again
+
+// -------- SPI / I2C (relay expanders, relay_bank.h) --------
+// SPI is write-only, mode 0, MSB first. csPin goes low for each transaction
+// and back high when it ends (a 74HC595 chain latches on that edge).
+void spiBegin(int sckPin, int mosiPin, int csPin, uint32_t hz);
+void spiWrite(const uint8_t* data, size_t len);   // one transaction
+void i2cBegin(int sdaPin, int sclPin, uint32_t hz);
+// One write transaction: START, address, `len` bytes, STOP. False on NACK.
+bool i2cWrite(uint8_t addr, const uint8_t* data, size_t len);
+
+// -------- IR receiver (ir_remote.h) --------
+// Demodulated IR (a TSOP-style receiver: output low while a carrier burst is
+// seen) captured by the RMT peripheral, which times every edge in hardware.
+// A frame ends once the line has been idle for idleUs. One receiver.
+bool irRxBegin(int pin, uint32_t idleUs);
+// Blocks until a frame is captured or the timeout hits. Stores alternating
+// mark/space durations in µs, starting with a mark (the trailing idle is not
+// included), and returns how many; 0 on timeout. A longer frame is cut short.
+size_t irRxRead(uint16_t* durations, size_t maxDurations, uint32_t timeoutMs);
+
+// -------- ESP-NOW (peer_link.h) --------
+// Connectionless frames straight to other boards on the same WiFi channel,
+// no router in between. Needs WiFi started (STA, AP or both); frames go out
+// on whatever channel the radio is on. mac ff:ff:ff:ff:ff:ff = broadcast.
+// onRecv runs on the WiFi task: keep it short.
+const size_t PEER_RADIO_FRAME_MAX = 250;
+typedef void (*PeerRecvFn)(const uint8_t mac[6], const uint8_t* data, size_t len);
+bool peerRadioBegin(PeerRecvFn onRecv);
+// Queued for the air; false if the driver refused it. Unicast frames are
+// retried by the MAC until the receiver acknowledges them or gives up.
+bool peerRadioSend(const uint8_t mac[6], const uint8_t* data, size_t len);
+
+// -------- firmware update (ota_update.h) --------
+// The app partition that is not running, written front to back while the
+// running image carries on; each sector is erased as the writes reach it.
+// Flash writes stall both cores on the ESP32 (the cache is off meanwhile),
+// so callers hand over about a sector at a time. One update at a time.
+bool otaBegin(uint32_t imageSize);   // false: no spare partition, or the image does not fit
+// Appends; false on a flash error or if the first bytes are not an app image.
+bool otaWrite(const uint8_t* data, size_t len);
+bool otaEnd();                      // checks the image and boots it from the next reset
+void otaAbort();
+void otaConfirm();                  // the running image is good: cancel the bootloader's rollback
+// Boot the other app partition from the next reset; false if it holds no
+// valid image.
+bool otaRollback();
+void restart();
+
+// -------- SHA-256 --------
+// One hash at a time (mbedtls on the ESP32's SHA accelerator).
+void sha256Begin();
+void sha256Update(const uint8_t* data, size_t len);
+void sha256Finish(uint8_t digest[32]);
+// HMAC-SHA256 in one call, independent of the hash above: safe from any task.
+void hmacSha256(const uint8_t* key, size_t keyLen, const uint8_t* data, size_t len, uint8_t mac[32]);
+
+// -------- clock --------
+uint32_t millis();
+uint32_t micros();
+void delayMs(uint32_t ms);     // yields to other tasks
+// Free-running CPU cycle counter for timing short stretches of code. Per
+// core on the ESP32 (CCOUNT), so start and stop on the same pinned task;
+// wraps every ~18 s at 240 MHz. Counts at the current CPU clock, so timings
+// taken while powerConfigure() lets it scale are approximate.
+uint32_t cycleCount();
+uint32_t cyclesPerUs();
+// Wall clock: UTC seconds once SNTP has set it, 0 until then. clockSync()
+// starts SNTP (call it once the network is up) and sets the time zone
+// (POSIX TZ string) that localtime_r()/mktime() use.
+void clockSync(const char* tz, const char* server);
+uint32_t wallClock();
+
+// -------- power --------
+// CPU clock and automatic light sleep. With lightSleep the clock scales
+// between minMhz and maxMhz and the chip light-sleeps whenever every task is
+// blocked (WiFi, in modem sleep, stays associated). Returns false if the
+// build has no power management (CONFIG_PM_ENABLE): the CPU then just runs
+// at maxMhz.
+bool powerConfigure(uint32_t maxMhz, uint32_t minMhz, bool lightSleep);
+
+// -------- memory --------
+uint32_t heapFree();
+uint32_t heapLargestBlock();   // biggest single allocation that would succeed
+
+// -------- tasks --------
+// FreeRTOS tasks pinned to a core on the board, plain threads on the host.
+typedef void* TaskHandle;
+typedef void (*TaskFn)(void* arg);
+
+TaskHandle taskSpawn(const char* name, TaskFn fn, void* arg, uint32_t stackBytes, uint8_t priority, int core);
+void taskNotify(TaskHandle task);   // wake a task blocked in taskWait (safe from any task)
+bool taskWait(uint32_t timeoutMs);  // block the calling task until notified; false on timeout
+
+} // namespace hal
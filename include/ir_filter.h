@@ -0,0 +1,97 @@
+#pragma once
+
+// include/ir_filter.h
+// Presence detector for the IR proximity sensor (relay 4 AUTO mode).
+//
+//   raw ADC @ sampleRateHz -> boxcar decimate -> median-of-5 -> EMA (Q8)
+//     -> band check with hysteresis -> minimum dwell -> present()
+//
+// Integer-only and allocation-free so it can run per DMA block on the IR task;
+// it counts time in samples, which keeps trace replays on the host exact.
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct IrFilterConfig {
+  uint32_t sampleRateHz;   // raw ADC rate fed to push()
+  uint16_t decimate;       // raw samples averaged into one filter sample
+  uint8_t emaShift;        // EMA weight = 1 / 2^emaShift per filter sample
+  uint16_t onMin, onMax;   // presence band (raw 12-bit)
+  uint16_t hysteresis;     // band widened by this much while present
+  uint16_t minDwellMs;     // a new state must hold this long before it is reported
+};
+
+class IrFilter {
+public:
+  explicit IrFilter(const IrFilterConfig& cfg) : cfg_(cfg) {
+    if (cfg_.decimate == 0) cfg_.decimate = 1;
+    uint32_t outRate = cfg_.sampleRateHz / cfg_.decimate;
+    dwellTicks_ = (uint32_t)cfg_.minDwellMs * outRate / 1000;
+  }
+
+  // Feed a block of raw samples; returns true if present() changed.
+  bool push(const uint16_t* raw, size_t n) {
+    bool changed = false;
+    for (size_t i = 0; i < n; i++) {
+      acc_ += raw[i];
+      if (++accCount_ < cfg_.decimate) continue;
+      changed |= step((uint16_t)(acc_ / cfg_.decimate));
+      acc_ = 0;
+      accCount_ = 0;
+    }
+    return changed;
+  }
+
+  bool present() const { return present_; }
+  // Start out reporting `present` (a filter rebuilt for another sample rate
+  // keeps the old answer until its own readings disagree for the dwell time).
+  void assume(bool present) { present_ = present; }
+  uint16_t value() const { return (uint16_t)(ema_ >> 8); }   // smoothed reading
+  uint32_t outputRateHz() const { return cfg_.sampleRateHz / cfg_.decimate; }
+
+private:
+  bool step(uint16_t v) {
+    // median-of-5 rejects single-sample spikes before they reach the EMA
+    hist_[histPos_] = v;
+    histPos_ = (histPos_ + 1) % 5;
+    if (histFill_ < 5) histFill_++;
+    uint16_t m = histFill_ < 5 ? v : median5();
+
+    if (!primed_) { ema_ = (int32_t)m << 8; primed_ = true; }
+    else ema_ += (((int32_t)m << 8) - ema_) >> cfg_.emaShift;
+
+    int32_t e = ema_ >> 8;
+    int32_t lo = cfg_.onMin, hi = cfg_.onMax;
+    if (present_) { lo -= cfg_.hysteresis; hi += cfg_.hysteresis; }
+    bool inBand = e >= lo && e <= hi;
+
+    if (inBand == present_) { pendingTicks_ = 0; return false; }
+    if (++pendingTicks_ < dwellTicks_) return false;
+    present_ = inBand;
+    pendingTicks_ = 0;
+    return true;
+  }
+
+  uint16_t median5() const {
+    uint16_t a[5] = {hist_[0], hist_[1], hist_[2], hist_[3], hist_[4]};
+    for (int i = 1; i < 5; i++) {          // insertion sort, 5 elements
+      uint16_t x = a[i];
+      int j = i - 1;
+      while (j >= 0 && a[j] > x) { a[j + 1] = a[j]; j--; }
+      a[j + 1] = x;
+    }
+    return a[2];
+  }
+
+  IrFilterConfig cfg_;
+  uint32_t dwellTicks_ = 0;
+  uint32_t acc_ = 0;
+  uint16_t accCount_ = 0;
+  uint16_t hist_[5] = {};
+  uint8_t histPos_ = 0;
+  uint8_t histFill_ = 0;
+  bool primed_ = false;
+  int32_t ema_ = 0;         // Q8
+  bool present_ = false;
+  uint32_t pendingTicks_ = 0;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+// include/ir_remote.h
+// IR remote input. The RMT peripheral times the receiver's edges in hardware
+// and hands over whole frames (hal::irRxRead); the remote task (core 1)
+// blocks on it, decodes each frame (NEC) and maps the code through
+// IR_REMOTE_KEYS in config.h. The resulting relay commands reach the control
+// task through its command queue, like every other input path: nothing is
+// decoded in an ISR or in loop().
+//
+// A NEC frame is ~68 ms on air. From its last edge the key reaches the relay
+// after the RMT idle threshold (IR_RX_IDLE_US), one decode and one control
+// task batch: a few ms, inside the 50 ms budget. Holding a key sends repeat
+// frames (or, on some remotes, the full code again); both count as the same
+// press, so a held toggle key switches once.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+
+const uint32_t IR_RX_IDLE_US = 6000;   // > the longest NEC space (4.5 ms header)
+const size_t IR_FRAME_MAX = 100;       // durations kept per frame (NEC needs 67)
+
+enum IrFrameType : uint8_t { IR_FRAME_NONE, IR_FRAME_CODE, IR_FRAME_REPEAT };
+struct IrFrame {
+  IrFrameType type;
+  uint32_t code;        // IR_FRAME_CODE only
+};
+
+// One captured frame (alternating mark/space µs, mark first) as NEC: the
+// code is the 32 bits in the order sent, first bit in the MSB, which is the
+// value IRremoteESP8266 reports. Header timings may be off by 25% (+100 µs
+// for the receiver's slow edges) and the header mark cut short by up to half
+// (light-sleep wakeup); data bits are read from their space length. NONE for
+// anything else, including a command byte that does not match its inverse.
+IrFrame irDecodeNec(const uint16_t* durations, size_t n);
+
+// Turns decoded frames into key presses: a code is a new press unless it
+// repeats the previous code within IR_REMOTE_HOLD_MS of the previous frame;
+// repeat frames only keep the hold going.
+class IrKeyTracker {
+public:
+  // true (and *code) when `frame`, received at nowMs, is a new press
+  bool press(const IrFrame& frame, uint32_t nowMs, uint32_t* code);
+
+private:
+  uint32_t lastCode_ = 0;
+  uint32_t lastMs_ = 0;
+  bool active_ = false;
+};
+
+int irRemoteKey(uint32_t code);        // index into IR_REMOTE_KEYS, -1 if not mapped
+// Queues the key's relay commands (source SRC_REMOTE); a scene goes in as
+// one batch per RELAY_BATCH_MAX relays, a saved scene through sceneApplySlot,
+// another controller's relay over the peer link (peer_link.h). False if the
+// key names no relay, scene or node, or the queue stayed full.
+bool irRemoteApply(const IrKey& key);
+
+// Starts the receiver and the remote task; does nothing if IR_REMOTE_PIN < 0.
+void irRemoteStart();
+
+struct IrRemoteStats {
+  uint32_t frames;      // captured by the RMT
+  uint32_t undecoded;   // not NEC (noise, other protocols, cut-off frames)
+  uint32_t presses;     // new key presses, mapped or not
+};
+IrRemoteStats irRemoteStats();
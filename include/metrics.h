@@ -0,0 +1,92 @@
+#pragma once
+
+// include/metrics.h
+// Runtime metrics: a fixed-bucket duration histogram per firmware stage,
+// fed from the CPU cycle counter, plus relay command counts per source.
+// Served as Prometheus text on /metrics and as JSON to WS clients that
+// subscribe with "metrics:<ms>" (ws_stream.h).
+//
+// Each stage is timed on one task only, so recording is a cycle-counter
+// read, a short bucket scan and a few relaxed stores: no locks, no RMW.
+// metricsBegin() measures that cost once (metrics_record_seconds) so the
+// overhead can be checked against the time the stages themselves take.
+//
+// Boot milestones record, once per boot, how long after reset the board got
+// to each point that matters to a user (esp32_boot_milestone_seconds).
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hal.h"
+#include "relay_control.h"
+
+enum MetricStage : uint8_t {
+  STAGE_NET_TICK,     // net task: WiFi manager, WS stream, journal, scan push (one tick)
+  STAGE_HTTP,         // AsyncTCP task: one HTTP handler
+  STAGE_WS_EVENT,     // AsyncTCP task: one WS event (commands parsed and queued)
+  STAGE_CLOUD,        // cloud task: SinricPro.handle() + state reports
+  STAGE_MQTT,         // MQTT task: client loop + state publishes
+  STAGE_IR_BLOCK,     // IR task: filter one sample block + AUTO decision
+  STAGE_RELAY_WRITE,  // control task: apply a command batch and write the pins
+  STAGE_COUNT
+};
+
+// Buckets (upper bounds, us); a last +Inf bucket catches the rest.
+const uint32_t METRICS_BUCKET_US[] = {5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 50000};
+const int METRICS_BUCKETS = sizeof(METRICS_BUCKET_US) / sizeof(METRICS_BUCKET_US[0]) + 1;
+
+const size_t METRICS_TEXT_MAX = 10240;  // Prometheus exposition, worst case
+const size_t METRICS_JSON_MAX = 2048;
+
+enum BootMilestone : uint8_t {
+  BOOT_RELAYS_RESTORED,  // journaled relay state driven, control task running
+  BOOT_SETUP_DONE,       // setup() returned: HTTP server and tasks up
+  BOOT_STA_CONNECTED,    // first STA join (IP address)
+  BOOT_FIRST_COMMAND,    // first relay command applied that did not come from the IR sensor
+  BOOT_CLOUD_READY,      // SinricPro first connected
+  BOOT_MILESTONE_COUNT
+};
+
+// Values the metrics module cannot see for itself.
+struct MetricsGauges {
+  uint32_t wsClients = 0;
+  int irValue = 0;
+};
+
+// Converts bucket bounds to cycles and measures the recording cost.
+void metricsBegin();
+
+void metricsRecord(MetricStage stage, uint32_t startCycles);
+void metricsCountCommand(CommandSource source, uint32_t n = 1);
+// Records hal::millis() for the milestone (and logs it) the first time only.
+void metricsBootMark(BootMilestone m);
+uint32_t metricsBootMs(BootMilestone m);   // 0 = not reached yet
+const char* metricsBootName(BootMilestone m);
+
+// Times the enclosing scope.
+class StageTimer {
+public:
+  explicit StageTimer(MetricStage stage) : stage_(stage), start_(hal::cycleCount()) {}
+  ~StageTimer() { metricsRecord(stage_, start_); }
+  StageTimer(const StageTimer&) = delete;
+  StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+  MetricStage stage_;
+  uint32_t start_;
+};
+
+// Snapshot of one stage (buckets are per-bucket counts, not cumulative;
+// count is their total).
+struct StageStats {
+  uint32_t count;
+  uint64_t sumCycles;
+  uint32_t bucket[METRICS_BUCKETS];
+};
+void metricsStage(MetricStage stage, StageStats& out);
+const char* metricsStageName(MetricStage stage);
+uint32_t metricsRecordNs();   // cost of one metricsRecord(), measured at begin
+
+// Both write NUL-terminated text and return its length (0 if cap is too small).
+size_t metricsPrometheus(char* out, size_t cap, const MetricsGauges& gauges);
+size_t metricsJson(char* out, size_t cap, const MetricsGauges& gauges);
@@ -0,0 +1,86 @@
+#pragma once
+
+// include/mpsc_ring.h
+// Bounded lock-free multi-producer / single-consumer ring (Vyukov's
+// sequence-per-cell scheme). push() may be called from any task on either
+// core; pop() only from the one consuming task. Never blocks, never allocates.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, size_t N>
+class MpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "MpscRing size must be a power of two");
+
+public:
+  MpscRing() {
+    for (size_t i = 0; i < N; i++) cells_[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  // false when the ring is full
+  bool push(const T& v) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    Cell* c;
+    for (;;) {
+      c = &cells_[pos & (N - 1)];
+      size_t seq = c->seq.load(std::memory_order_acquire);
+      intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+      if (dif == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+    c->value = v;
+    c->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Pushes n values as one unit: the consumer sees none of them until all are
+  // in, so a drain never splits the batch. false (nothing pushed) when fewer
+  // than n cells are free.
+  bool pushBatch(const T* v, size_t n) {
+    if (n == 0) return true;
+    if (n > N) return false;
+    size_t pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      size_t seq = cells_[pos & (N - 1)].seq.load(std::memory_order_acquire);
+      intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+      if (dif < 0) return false;
+      if (dif > 0) { pos = head_.load(std::memory_order_relaxed); continue; }
+      // the last cell of the range is the last one the consumer frees
+      size_t last = pos + n - 1;
+      if ((intptr_t)cells_[last & (N - 1)].seq.load(std::memory_order_acquire) - (intptr_t)last < 0) return false;
+      if (head_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) break;
+    }
+    for (size_t i = n; i-- > 0;) {   // first cell last: it gates the consumer
+      Cell& c = cells_[(pos + i) & (N - 1)];
+      c.value = v[i];
+      c.seq.store(pos + i + 1, std::memory_order_release);
+    }
+    return true;
+  }
+
+  // false when the ring is empty
+  bool pop(T& out) {
+    Cell& c = cells_[tail_ & (N - 1)];
+    size_t seq = c.seq.load(std::memory_order_acquire);
+    if ((intptr_t)seq - (intptr_t)(tail_ + 1) < 0) return false;
+    out = c.value;
+    c.seq.store(tail_ + N, std::memory_order_release);
+    tail_++;
+    return true;
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+  Cell cells_[N];
+  std::atomic<size_t> head_{0};
+  size_t tail_ = 0;
+};
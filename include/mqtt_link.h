@@ -0,0 +1,18 @@
+#pragma once
+
+// include/mqtt_link.h
+// MQTT transport to a local broker, next to SinricPro. Commands arrive on
+//   <base>/relay/<n>/set      ON | OFF | TOGGLE
+//   <base>/relay4_mode/set    off | on | auto
+// and go through submitRelayCommand() like every other input. State goes
+// out retained on <base>/relay/<n>/state and <base>/relay4_mode/state,
+// whatever changed it (WS, HTTP, SinricPro, IR or MQTT itself); <base>/status
+// is "online", or "offline" via the last will.
+//
+// Published state follows relayStateMask() rather than each command, so a
+// burst of toggles turns into one publish per relay that ended up different,
+// sent back to back without waiting on the broker.
+
+// Start the MQTT task (core 0). No-op if MQTT_HOST is empty or already started.
+void mqttLinkStart();
+bool mqttLinkConnected();
@@ -0,0 +1,85 @@
+#pragma once
+
+// include/ota_update.h
+// Firmware updates over the local HTTP server:
+//   POST /update   body = the .bin (application/octet-stream, Content-Length)
+//                  X-Firmware-SHA256: 64 hex digits (required)
+//                  Authorization: Basic OTA_USER:OTA_PASSWORD (config.h;
+//                  403 while OTA_PASSWORD is empty)
+// tools/ota_upload.py does this for one board or a list of them.
+//
+// The image is never held in RAM. The HTTP handler (AsyncTCP task) copies
+// the body into one of OTA_BUFFERS sector-sized buffers as it arrives; the
+// ota task (core 0, below the net task) hashes each full buffer and writes
+// it to the spare app partition, so the flash write for one sector overlaps
+// receiving the next. The handler only waits when both buffers are still
+// being written: a sector erase + program (~50 ms) is the longest WS clients and
+// HTTP requests queue behind an upload. Relay control (core 1) is not
+// involved, beyond the cache stall of each flash operation.
+//
+// When the last byte is written the SHA-256 of the body must match the
+// header; only then is the image checked by the bootloader's rules and
+// selected for the next boot. The response goes out and the board restarts
+// OTA_RESTART_DELAY_MS later. A mismatch, an upload that stalls for
+// OTA_STALL_MS or a flash error abandons the partition and leaves the
+// running image selected.
+//
+// Rollback: the new image runs on trial. It is confirmed once it has run
+// for OTA_CONFIRM_MS with its tasks up and reachable for another update
+// (STA connected or the setup AP up), so a router that is down does not
+// cost a good image. If it has not managed that within OTA_TRIAL_TIMEOUT_MS
+// (no network at all), or at its (OTA_TRIAL_BOOTS + 1)-th boot (crash or
+// watchdog loops, or people power-cycling it), the previous image is
+// selected again and the board restarts. With the bootloader's rollback
+// enabled the IDF's pending-verify state is honoured as well.
+
+#include <stddef.h>
+#include <stdint.h>
+
+const size_t OTA_CHUNK = 4096;              // one flash sector
+const int OTA_BUFFERS = 2;
+const uint32_t OTA_STALL_MS = 10000;        // no body data this long: the upload is abandoned
+const uint32_t OTA_RESTART_DELAY_MS = 500;  // lets the response reach the client
+
+enum OtaError : uint8_t {
+  OTA_OK,
+  OTA_ERR_BUSY,          // another upload is running, or the board is about to restart
+  OTA_ERR_SIZE,          // empty, or no spare partition it fits in
+  OTA_ERR_DIGEST,        // the body does not hash to X-Firmware-SHA256
+  OTA_ERR_IMAGE,         // not an app image, or rejected by the image check
+  OTA_ERR_FLASH,         // a flash write failed or took too long
+  OTA_ERR_STALLED,       // no data for OTA_STALL_MS
+  OTA_ERR_ABORTED,       // the upload ended early
+};
+const char* otaErrorName(OtaError e);
+
+// "sha256" hex (64 digits, either case) to bytes; false if malformed.
+bool otaParseDigest(const char* hex, uint8_t digest[32]);
+
+// Run in setup() before WiFi: counts a trial boot (rolling back and
+// restarting if it is one too many), then starts the ota task.
+void otaUpdateBegin();
+
+// HTTP handler side (AsyncTCP task). `owner` is the request; the first
+// upload to start owns the partition until it finishes.
+OtaError otaUploadStart(const void* owner, uint32_t size, const uint8_t digest[32]);
+OtaError otaUploadData(const void* owner, const uint8_t* data, size_t len);
+// After the last byte: waits for the ota task to write and verify it.
+// OTA_OK = the image boots from the next restart (the ota task asks for it).
+OtaError otaUploadFinish(const void* owner);
+
+// Net task, every tick. `healthy` = STA connected or the setup AP up (the
+// net task calling this at all is the "tasks running" part). Confirms a trial image
+// or rolls it back; true when the board should restart now (after an
+// update or a rollback). On the board hal::restart() does not return.
+bool otaUpdateTick(bool healthy);
+
+struct OtaStats {
+  uint32_t uploads;     // finished and verified
+  uint32_t failures;
+  uint32_t bytes;       // written to flash by the current or last upload
+  uint32_t stallMs;     // time the HTTP handler waited for a free buffer (last upload)
+  uint32_t lastMs;      // first byte to verified (last good upload)
+  bool trial;           // the running image is not confirmed yet
+};
+OtaStats otaStats();
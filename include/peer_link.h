@@ -0,0 +1,206 @@
+#pragma once
+
+// include/peer_link.h
+// Controller-to-controller link over ESP-NOW (hal::peerRadio*): relay
+// commands and state go straight between boards on the same WiFi channel,
+// with no router, broker or cloud in between. Each controller is a node,
+// numbered by PEER_NODE_ID (config.h).
+//
+// Every node broadcasts its relay state when it changes and every
+// PEER_HEARTBEAT_MS; the nodes heard within PEER_TIMEOUT_MS are its peers.
+// A command for a relay on another node (HTTP, WS or an IR key on any of
+// them) goes to the node that owns the relay: unicast if that node was
+// heard first hand, broadcast otherwise. Nodes pass on frames they have not
+// seen before, up to PEER_MAX_HOPS times (unicast to the destination if they
+// hear it directly), so two nodes out of each other's range still reach
+// each other through one in between. The owner applies the command (source
+// SRC_PEER), acknowledges it, and its new state goes out as the usual state
+// broadcast. An unacknowledged command is sent again, broadcast, every
+// PEER_RETRY_MS up to PEER_RETRIES times; the owner remembers the commands
+// it has applied, so a resent toggle still toggles once.
+//
+// Frames carry PEER_NETWORK_ID, which keeps separate installations apart,
+// and end in a tag: HMAC-SHA256 with PEER_KEY over the whole frame (node
+// and seq included), cut to 8 bytes. A frame whose tag does not check out
+// is dropped before anything else looks at it, so only boards that know
+// PEER_KEY are obeyed or passed on. Each node numbers its frames with a
+// 32-bit seq that only grows: the firmware keeps it in NVS (Hooks::reserve),
+// so a reboot does not start it over. A node takes a frame only if its seq
+// is past the last one it took from that origin, so a recorded frame played
+// back later is dropped however long after. The one gap: a node that just
+// restarted takes the first frame it hears from each origin, until that
+// origin's next heartbeat. With PEER_KEY empty the firmware does not start
+// the link at all.
+//
+// PeerLink is the protocol on its own, over a send function, so one process
+// can run several nodes (src/native/bench_peers.cpp). It is not thread-safe:
+// the firmware's node below is behind a mutex.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "relay_control.h"
+
+enum PeerError : uint8_t {
+  PEER_OK,
+  PEER_UNKNOWN_NODE,   // not heard from within PEER_TIMEOUT_MS
+  PEER_BAD_RELAY,      // beyond the node's relays, or not on/off/toggle
+  PEER_BUSY,           // MAX_PENDING commands unanswered here, or the owner's queue was full
+  PEER_NO_ANSWER,      // no acknowledgement after PEER_RETRIES resends
+};
+const char* peerErrorName(PeerError e);
+
+class PeerLink {
+public:
+  static const int MAX_PEERS = 16;
+  static const int MAX_PENDING = 8;
+
+  struct Hooks {
+    void* ctx;
+    // hand a frame to the radio (mac ff:.. = broadcast); false if refused
+    bool (*send)(void* ctx, const uint8_t mac[6], const uint8_t* frame, size_t len);
+    // a command for one of this node's relays, from node `from`
+    PeerError (*apply)(void* ctx, uint16_t from, uint8_t relay, RelayOp op);
+    // optional: a command of ours answered (or PEER_NO_ANSWER), `ms` after command()
+    void (*done)(void* ctx, uint16_t node, uint8_t relay, PeerError result, uint32_t ms);
+    // optional: a node first heard from (up), or silent for PEER_TIMEOUT_MS
+    void (*peer)(void* ctx, uint16_t node, bool up);
+    // optional: seq numbers below `upTo` are about to go out; keep it and
+    // pass it back to the constructor after a restart
+    void (*reserve)(void* ctx, uint32_t upTo);
+  };
+
+  struct Peer {
+    uint16_t node;
+    uint8_t relays;
+    uint8_t hops;         // forwards on the way here (0 while direct)
+    bool direct;          // heard first hand within PEER_TIMEOUT_MS: mac is its address
+    uint32_t state;       // bit n-1 = relay n on
+    uint32_t heardMs;     // last frame from it
+    uint32_t directMs;    // last frame straight from it
+    uint8_t mac[6];
+  };
+
+  struct Stats {
+    uint32_t sent;        // frames handed to the radio
+    uint32_t received;    // frames of this network
+    uint32_t forwarded;
+    uint32_t duplicates;  // frames seen before (via another node, or resent)
+    uint32_t foreign;     // other networks, or not a frame at all
+    uint32_t forged;      // this network's frames with a wrong tag (another key, or tampered with)
+    uint32_t stale;       // signed, but no newer than the last taken from that origin (replayed)
+    uint32_t commands;    // command() calls sent
+    uint32_t resends;
+    uint32_t answered;
+    uint32_t unanswered;
+    uint32_t applied;     // commands from other nodes applied here
+    uint32_t repeats;     // resends of commands applied already: acknowledged again only
+  };
+
+  // node: 1..65535, unique on the network; key: signs and checks every frame;
+  // seq: the first frame number, the last Hooks::reserve value if any
+  PeerLink(uint16_t node, const Hooks& hooks, const char* key = PEER_KEY, uint32_t seq = 0)
+      : node_(node), seq_(seq), reserved_(seq), hooks_(hooks), key_((const uint8_t*)key), keyLen_(strlen(key)) {}
+
+  void receive(const uint8_t mac[6], const uint8_t* frame, size_t len, uint32_t nowMs);
+  // Send a command for `relay` on `node` (not this one); the answer comes
+  // through Hooks::done.
+  PeerError command(uint16_t node, uint8_t relay, RelayOp op, uint32_t nowMs);
+  // Broadcasts this node's state if it changed or the heartbeat is due,
+  // resends unanswered commands, forgets silent peers. Call every few ms.
+  void tick(uint32_t nowMs, uint32_t state, uint8_t relays);
+
+  uint16_t node() const { return node_; }
+  const Peer* peer(uint16_t node) const;   // nullptr if not a peer
+  int peers(Peer* out, int max) const;
+  const Stats& stats() const { return stats_; }
+
+private:
+  struct Pending {
+    bool used;
+    uint16_t node;
+    uint32_t id;          // seq of the first send; the owner dedups on it
+    uint8_t relay;
+    RelayOp op;
+    uint8_t tries;
+    uint32_t issuedMs;
+    uint32_t sentMs;
+  };
+  struct Seen {           // frames already handled, by origin and seq
+    uint16_t origin;
+    uint32_t seq;
+    uint32_t ms;
+  };
+  struct Origin {         // the last seq taken from a node
+    bool used;
+    uint16_t node;
+    uint32_t seq;
+    uint32_t ms;
+  };
+  struct Applied {        // commands from other nodes already applied
+    uint16_t origin;
+    uint32_t id;
+    PeerError result;
+    uint32_t ms;
+  };
+  static const int SEEN_MAX = 64;
+  static const int ORIGIN_MAX = 2 * MAX_PEERS;
+  static const int APPLIED_MAX = 16;
+
+  bool seen(uint16_t origin, uint32_t seq, uint32_t nowMs);
+  bool fresh(uint16_t origin, uint32_t seq, uint32_t nowMs);
+  uint32_t nextSeq();
+  Peer* heard(uint16_t node, const uint8_t mac[6], uint8_t hops, uint32_t nowMs);
+  const Applied* findApplied(uint16_t origin, uint32_t id, uint32_t nowMs) const;
+  void sign(const uint8_t* frame, size_t len, uint8_t* tag) const;
+  void sendFrame(const uint8_t mac[6], const void* frame, size_t len);
+  void route(uint16_t dst, const void* frame, size_t len, bool unicast);
+  void forward(uint16_t dst, uint8_t* frame, size_t len);
+  void sendCommand(Pending& p);
+  void sendAck(uint16_t dst, uint32_t id, PeerError result);
+
+  uint16_t node_;
+  uint32_t seq_;
+  uint32_t reserved_;     // seq_ may reach this before Hooks::reserve is called again
+  Hooks hooks_;
+  const uint8_t* key_;
+  size_t keyLen_;
+  Peer peers_[MAX_PEERS] = {};
+  int peerCount_ = 0;
+  Pending pending_[MAX_PENDING] = {};
+  Seen seen_[SEEN_MAX] = {};
+  int seenNext_ = 0;
+  Origin origins_[ORIGIN_MAX] = {};
+  Applied applied_[APPLIED_MAX] = {};
+  int appliedNext_ = 0;
+  bool stateSent_ = false;
+  uint32_t sentState_ = 0;
+  uint8_t sentRelays_ = 0;
+  uint32_t sentMs_ = 0;
+  Stats stats_ = {};
+};
+
+// The firmware's node. peerLinkBegin() once WiFi has a mode
+// (wifiManagerBegin); peerLinkTick() from the net task.
+void peerLinkBegin();
+void peerLinkTick();
+uint16_t peerLinkNode();
+// A relay on any node, this one included (queued here directly). Safe from
+// any task; a remote node's answer goes to the event log.
+PeerError peerCommand(uint16_t node, uint8_t relay, RelayOp op, CommandSource source);
+PeerLink::Stats peerLinkStats();
+
+// {"node":48879,"peers":[{"node":4660,"relays":4,"on":[1,3],"age_ms":420,"hops":0},..]}
+const size_t PEERS_JSON_MAX = 128 + PeerLink::MAX_PEERS * (64 + 3 * 32);
+size_t peersJson(char* out, size_t cap);
+
+// WS text commands:
+//   "peers"                               the list above
+//   "peer:<node>:<relay>[:on|off|toggle]" a relay on a node (default toggle)
+// A command is answered with {"peer_sent":<node>} once it is on its way
+// (the node's new state shows in the list), a refusal with
+// {"peer_error":"<why>"}. Returns the reply length, 0 if `text` is not a
+// peer command.
+size_t peersCommand(const char* text, size_t len, char* reply, size_t cap);
@@ -0,0 +1,40 @@
+#pragma once
+
+// include/power_manager.h
+// Mains / Li-ion backup detection and the matching power profile.
+//
+//   mains:  CPU at 240 MHz, WiFi power save off, tasks at their own cadence.
+//   backup: CPU scales 80..40 MHz with automatic light sleep whenever every
+//           task is blocked; WiFi in modem sleep (radio off between DTIM
+//           beacons, still associated); polling tasks stretch their period
+//           to POWER_BACKUP_POLL_MS (powerPollMs) so the CPU can stay asleep;
+//           the IR task drops DMA for a short adcRead burst every
+//           POWER_BACKUP_IR_PERIOD_MS; the status LED goes dark.
+//
+// Worst-case wake-to-actuation on backup: HTTP/WS commands are event-driven
+// (radio wake at the next DTIM beacon, then immediate); MQTT and SinricPro
+// commands wait at most one POWER_BACKUP_POLL_MS on top of that; relay 4
+// follows the IR sensor within two POWER_BACKUP_IR_PERIOD_MS.
+//
+// POWER_SENSE_PIN is debounced (POWER_BACKUP_DEBOUNCE_MS to switch to
+// battery, POWER_MAINS_DEBOUNCE_MS to switch back) so a brown-out glitch
+// does not flap the profile. Owned by the net task: Begin before
+// startTasks(), Tick from that task only; the getters are safe anywhere.
+
+#include <stdint.h>
+
+#include "config.h"
+
+enum PowerSource : uint8_t { POWER_MAINS, POWER_BACKUP };
+
+void powerManagerBegin();
+void powerManagerTick();
+
+PowerSource powerSource();
+// Last battery reading (read once a second while on backup), 0 = not yet.
+uint32_t batteryMillivolts();
+
+// Poll period for a task whose mains period is `mainsMs`.
+inline uint32_t powerPollMs(uint32_t mainsMs) {
+  return powerSource() == POWER_BACKUP && mainsMs < POWER_BACKUP_POLL_MS ? POWER_BACKUP_POLL_MS : mainsMs;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+// include/relay_bank.h
+// Relay output backends. relay_control.cpp owns one, picked by RELAY_BACKEND
+// in config.h, and hands it every batch of changes as two masks (bit o =
+// output o): the outputs to drive high and those to drive low. Each backend
+// keeps a shadow of all its outputs and turns a batch into as few bus
+// operations as it can:
+//
+//   GpioBank      one gpioWriteMask (set + clear registers)
+//   Hc595Bank     one SPI transfer of the whole chain; the chip-select edge
+//                 latches every output at once
+//   Mcp23017Bank  one I2C write (OLATA + OLATB) per chip whose outputs
+//                 changed; a 16-relay bank is one transaction
+//
+// Not thread-safe: the control task is the only caller.
+
+#include <stdint.h>
+
+#include "config.h"
+
+class GpioBank {
+public:
+  // output o = GPIO defs[o].pin
+  GpioBank(const RelayDef* defs, int outputs) : defs_(defs), outputs_(outputs) {}
+  // drives every output to its bit of `high`, then makes the pins outputs
+  void begin(uint32_t high);
+  void write(uint32_t highMask, uint32_t lowMask);
+
+private:
+  uint64_t pinBits(uint32_t outputs) const;
+
+  const RelayDef* defs_;
+  int outputs_;
+};
+
+class Hc595Bank {
+public:
+  static const int MAX_OUTPUTS = 32;
+  explicit Hc595Bank(int outputs) : chips_((outputs + 7) / 8) {}
+  // latches `high` into the chain, then enables the outputs (RELAY_OE_PIN)
+  void begin(uint32_t high);
+  void write(uint32_t highMask, uint32_t lowMask);
+
+private:
+  void shiftOut();
+
+  int chips_;
+  uint32_t shadow_ = 0;
+};
+
+class Mcp23017Bank {
+public:
+  static const int MAX_OUTPUTS = 32;
+  explicit Mcp23017Bank(int outputs, uint8_t firstAddr = RELAY_I2C_ADDR)
+      : chips_((outputs + 15) / 16), firstAddr_(firstAddr) {}
+  // writes `high` to the output latches, then switches the pins to outputs
+  // (latch first, so no relay glitches at boot)
+  void begin(uint32_t high);
+  void write(uint32_t highMask, uint32_t lowMask);
+  uint32_t errors() const { return errors_; }   // NACKed transactions
+
+private:
+  void writeChip(int chip, uint8_t reg, uint16_t value);
+
+  int chips_;
+  uint8_t firstAddr_;
+  uint32_t shadow_ = 0;
+  uint32_t errors_ = 0;
+};
+
+#if RELAY_BACKEND == RELAY_BACKEND_74HC595
+typedef Hc595Bank RelayBank;
+#elif RELAY_BACKEND == RELAY_BACKEND_MCP23017
+typedef Mcp23017Bank RelayBank;
+#else
+typedef GpioBank RelayBank;
+#endif
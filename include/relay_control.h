@@ -0,0 +1,64 @@
+#pragma once
+
+// include/relay_control.h
+// Single owner of the relay outputs. Every input path (WS, HTTP, MQTT, SinricPro, IR)
+// submits a RelayCommand into a lock-free queue; the control task drains it,
+// drives the pins and publishes the result as one atomic bitmask, so readers
+// on either core never see a half-applied update. Relays are numbered 1..N
+// after the RELAYS table in config.h.
+
+#include <stdint.h>
+
+#include "config.h"
+
+const int NUM_RELAYS = sizeof(RELAYS) / sizeof(RELAYS[0]);
+static_assert(NUM_RELAYS <= 32, "relay state is a 32-bit mask");
+
+// RELAY_OP_AUTO is for IR_RELAY only: hands it back to the IR task (mode AUTO),
+// in order with the commands around it.
+enum RelayOp : uint8_t { RELAY_OP_OFF, RELAY_OP_ON, RELAY_OP_TOGGLE, RELAY_OP_AUTO };
+enum CommandSource : uint8_t { SRC_WS, SRC_HTTP, SRC_CLOUD, SRC_IR, SRC_MQTT, SRC_REMOTE, SRC_TIMER, SRC_SCENE,
+                              SRC_PEER, SRC_RULE };
+const int NUM_COMMAND_SOURCES = SRC_RULE + 1;
+const char* commandSourceName(CommandSource source);   // "ws", "http", ...
+enum Relay4Mode : uint8_t { RELAY4_MODE_OFF, RELAY4_MODE_ON, RELAY4_MODE_AUTO };
+const char* relay4ModeName(Relay4Mode mode);           // "off", "on", "auto"
+
+struct RelayCommand {
+  uint8_t relay;        // 1..NUM_RELAYS
+  RelayOp op;
+  CommandSource source;
+};
+
+// Drive the relays to `initialMask` (bit n-1 = relay n; restored state, or all
+// off) and start the control task (core 1, highest priority).
+void relayControlStart(uint32_t initialMask = 0, Relay4Mode initialMode = RELAY4_MODE_OFF);
+
+// Queue a command and wake the control task. Safe from any task; returns
+// false if the relay number is out of range or the queue is full.
+bool submitRelayCommand(uint8_t relay, RelayOp op, CommandSource source);
+// Queue up to RELAY_BATCH_MAX commands that the control task applies
+// together (one GPIO write, one state update). All or nothing: false if any
+// relay number is out of range or the queue lacks room.
+const int RELAY_BATCH_MAX = 16;
+bool submitRelayBatch(const RelayCommand* cmds, int n);
+
+uint32_t relayStateMask();             // bit (n-1) set = relay n on
+inline bool relayIsOn(int relay) { return (relayStateMask() >> (relay - 1)) & 1u; }
+
+// SinricPro routing: relay for a device ID (hashed lookup, -1 if unknown) and
+// back (nullptr for local-only relays).
+int relayForDeviceId(const char* deviceId);
+const char* relayDeviceId(int relay);
+
+// Relay 4 (IR_RELAY) mode. A manual (WS/HTTP/MQTT/remote/timer/scene/peer/rule) command on it forces
+// ON/OFF; IR commands are only applied while the mode is AUTO.
+Relay4Mode relay4Mode();
+void setRelay4Mode(Relay4Mode m);
+// Mode change requested by a user: OFF/ON also drive the relay, AUTO leaves
+// it to the IR task.
+void commandRelay4Mode(Relay4Mode m, CommandSource source);
+
+// Side effect of applied commands, collected by the cloud task (which owns
+// SinricPro). WS clients and MQTT poll relayStateMask() instead.
+uint32_t takeCloudReportMask();        // relays changed locally that SinricPro should hear about
@@ -0,0 +1,94 @@
+#pragma once
+
+// include/relay_timers.h
+// Timed relay actions:
+//   one-shot   "relay 2 off in 600 s", "relay 1 on in 30 s" (delayed on)
+//   auto-off   per relay: whenever it goes on, from any input, it goes off
+//              again after its auto-off time (turning it off early cancels)
+//   daily      "relay 1 on at 07:30 on weekdays", local time (TIME_ZONE)
+//              once SNTP has set the clock; waits for the clock until then
+// All of them are entries in one hierarchical timer wheel (timer_wheel.h)
+// that the net task advances every RELAY_TIMER_TICK_MS: adding, cancelling
+// and expiring a timer are O(1), and a tick with nothing due costs a slot
+// check. A timer that comes due queues its command like every other input
+// path (source SRC_TIMER, treated as manual: it forces the relay 4 mode and
+// is reported to SinricPro).
+//
+// Timers and auto-off settings are kept in NVS ("timers" namespace), written
+// once changes have been quiet for RELAY_TIMER_SAVE_QUIET_MS. A one-shot is
+// saved with its UTC due time when the clock is set, so time spent powered
+// off counts: after a reboot it runs from the time left at the save, and is
+// moved to its UTC due time (at once if that has passed) as soon as SNTP
+// answers. A clock step (first sync, large correction) re-plans the daily
+// schedules.
+//
+// HTTP: GET /timers, POST /timers, POST /timers/cancel, POST /auto_off
+// (main.cpp); WS text: see relayTimersCommand().
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "relay_control.h"
+
+enum RelayTimerKind : uint8_t { RELAY_TIMER_ONCE, RELAY_TIMER_AUTO_OFF, RELAY_TIMER_DAILY };
+enum RelayTimerError : uint8_t {
+  RELAY_TIMER_OK,
+  RELAY_TIMER_BAD_RELAY,
+  RELAY_TIMER_BAD_OP,      // on, off or toggle
+  RELAY_TIMER_BAD_TIME,    // delay beyond RELAY_TIMER_MAX_DELAY_S, not HH:MM, or no weekday
+  RELAY_TIMER_FULL,        // RELAY_TIMER_MAX timers already
+  RELAY_TIMER_NOT_FOUND,
+};
+const char* relayTimerErrorName(RelayTimerError e);
+
+const uint32_t RELAY_TIMER_MAX_DELAY_S = 31 * 86400;
+const uint8_t RELAY_TIMER_EVERY_DAY = 0x7F;   // days: bit d = weekday d, 0 = Sunday
+const size_t RELAY_TIMERS_JSON_MAX = 4096;
+
+// setup(), after relayControlStart(): loads the saved timers and settings.
+// Running it again starts over from NVS (a reboot, as far as timers go).
+void relayTimersBegin();
+// Net task: advances the wheel, fires what is due, arms/cancels auto-offs
+// for relays that changed, and saves when due.
+void relayTimersTick();
+// Writes pending changes now (before a restart).
+void relayTimersFlush();
+
+// Safe from any task. `id` gets the new timer's id (ids are never 0).
+RelayTimerError relayTimerAddOnce(uint8_t relay, RelayOp op, uint32_t delayS, uint32_t* id);
+// minute = minute of the day (local time), days = weekday mask.
+RelayTimerError relayTimerAddDaily(uint8_t relay, RelayOp op, uint16_t minute, uint8_t days, uint32_t* id);
+RelayTimerError relayTimerCancel(uint32_t id);
+// 0 turns auto-off off for the relay (and cancels one in progress).
+RelayTimerError relayTimerSetAutoOff(uint8_t relay, uint32_t seconds);
+uint32_t relayTimerAutoOff(uint8_t relay);
+
+// "on"/"off"/"toggle"; decimal digits only (no sign, blank or trailing
+// text), up to 2^32-1; "HH:MM" -> minute of the day.
+bool relayTimerParseOp(const char* s, RelayOp& out);
+bool relayTimerParseUint(const char* s, uint32_t& out);
+bool relayTimerParseTime(const char* s, uint16_t& minute);
+
+// {"timers":[{"id":1,"kind":"once","relay":2,"op":"off","in_s":42},
+//            {"id":2,"kind":"daily","relay":1,"op":"on","at":"07:30","days":62,"in_s":null}, ..],
+//  "auto_off_s":[0,600,..],"clock":true}
+// in_s is null for a daily schedule still waiting for the clock.
+size_t relayTimersJson(char* out, size_t cap);
+
+// WS text commands:
+//   "timers"                                 the list above
+//   "timer:<relay>:<on|off|toggle>:<s>"      one-shot
+//   "daily:<relay>:<op>:<HH:MM>[:<days>]"    daily schedule (days: mask, default every day)
+//   "cancel:<id>"
+//   "autooff:<relay>:<s>"
+// A change is answered with the list, a refusal with {"timers_error":"<why>"}.
+// Returns the reply length, 0 if `text` is not a timer command.
+size_t relayTimersCommand(const char* text, size_t len, char* reply, size_t cap);
+
+struct RelayTimerStats {
+  uint32_t pending;    // timers in the wheel
+  uint32_t fired;      // since boot
+  uint32_t saves;      // NVS writes since boot
+};
+RelayTimerStats relayTimerStats();
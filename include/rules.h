@@ -0,0 +1,248 @@
+#pragma once
+
+// include/rules.h
+// User-defined automation rules, e.g.
+//   if ir and not relay1 then relay3 on for 5m
+//   if not cloud then relay2 off
+// Inputs (RuleSignal) are on/off: each relay, IR presence (the filtered
+// band check relay 4 follows in AUTO), STA joined, SinricPro connected, MQTT
+// connected, running on the battery. A condition combines them with not /
+// and / or and parentheses; the action switches one relay on, off or over,
+// optionally "for <n>[s|m|h]" (a one-shot timer, relay_timers.h, switches it
+// back). A rule fires when its condition turns true, not while it stays
+// true, and not for conditions already true when the rules are loaded.
+// Commands have source SRC_RULE, which counts as manual: a rule that
+// switches IR_RELAY takes it out of AUTO (mode ON or OFF, as for a WS
+// toggle), and a "for" timer then leaves it in that mode. Relay 4 already
+// follows IR presence in AUTO; rules are for the other relays.
+//
+// Rules are compiled on the board to a small stack bytecode (a few bytes
+// per input) and the program is what NVS keeps ("rules" namespace); the
+// listing is decompiled from it. The engine keeps, for every input, the
+// rules that read it: a tick re-runs only the rules whose inputs changed,
+// so a tick with nothing changed costs one compare however many rules there
+// are, and a change costs the rules that read that input.
+//
+// HTTP: GET /rules, POST /rules (text), POST /rules/delete (id) (main.cpp);
+// WS text: see rulesCommand().
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "relay_control.h"
+
+// Input bits: relay n is bit n-1.
+enum RuleSignal : uint8_t {
+  RULE_SIG_RELAY1 = 0,
+  RULE_SIG_IR = 32,        // IR presence
+  RULE_SIG_WIFI,           // STA joined
+  RULE_SIG_CLOUD,          // SinricPro connected
+  RULE_SIG_MQTT,           // MQTT broker connected
+  RULE_SIG_BATTERY,        // running on the backup cell
+  RULE_SIGNALS
+};
+static_assert(RULE_SIGNALS <= 64, "inputs are a 64-bit word");
+
+enum RuleError : uint8_t {
+  RULE_OK,
+  RULE_SYNTAX,             // not "if <condition> then <action>"
+  RULE_BAD_INPUT,          // unknown input, or a relay beyond the board's
+  RULE_BAD_ACTION,         // relay<n> on|off|toggle [for <n>[s|m|h]], at most RELAY_TIMER_MAX_DELAY_S
+  RULE_TOO_LONG,           // over RULE_TEXT_MAX, or nested deeper than RULE_STACK_MAX
+  RULE_FULL,               // RULES_MAX rules, or RULES_CODE_MAX bytes of program
+  RULE_NOT_FOUND,
+};
+const char* ruleErrorName(RuleError e);
+
+// Bytecode. A rule is [condition length][condition][action]; the condition
+// is postfix: RULE_OP_INPUT | signal pushes an input, the others pop their
+// operands and push the result. The action is [op | RULE_ACT_FOR][relay]
+// and, with RULE_ACT_FOR, the seconds as a LEB128 varint. A program is
+// RULES_CODE_VERSION followed by its rules.
+const uint8_t RULE_OP_NOT = 1;
+const uint8_t RULE_OP_AND = 2;
+const uint8_t RULE_OP_OR = 3;
+const uint8_t RULE_OP_INPUT = 0x80;
+const uint8_t RULE_ACT_FOR = 0x80;
+const uint8_t RULES_CODE_VERSION = 1;
+const int RULE_STACK_MAX = 32;
+const size_t RULE_CODE_MAX = 64;     // one compiled rule
+const size_t RULE_TEXT_MAX = 96;     // one rule, as listed
+const size_t RULES_CODE_MAX = 1024;  // the firmware's program
+
+struct RuleAction {
+  uint8_t relay;
+  RelayOp op;              // off, on or toggle
+  uint32_t forS;           // 0 = stays
+};
+
+// One rule decoded from a program.
+struct RuleInfo {
+  size_t at;               // offset of the rule
+  size_t size;             // its bytes
+  uint64_t inputs;         // signals the condition reads
+  RuleAction action;
+};
+
+// Compiles one rule for a board with `relays` relays. `len` gets the
+// compiled size.
+RuleError ruleCompile(const char* text, uint8_t* out, size_t cap, size_t* len, int relays = NUM_RELAYS);
+// The rule at `at` of `code`, checked: a well-formed condition (no
+// underflow, one result, RULE_STACK_MAX deep at most), known inputs and a
+// valid action. False if it is not.
+bool ruleDecode(const uint8_t* code, size_t len, size_t at, int relays, RuleInfo& out);
+// Evaluates a checked rule's condition.
+bool ruleEvaluate(const uint8_t* rule, uint64_t signals);
+// The rule as text (canonical form of what was compiled). Returns its length.
+size_t ruleFormat(const uint8_t* rule, char* out, size_t cap);
+// "relay4", "ir", ...
+const char* ruleSignalName(int signal, char* buf, size_t cap);
+
+// A loaded program with its input index. N rules and CODE bytes at most.
+// Not thread-safe: the owner serialises calls.
+template <int N, size_t CODE>
+class RuleEngine {
+  static_assert(N >= 1 && N < 0xFFFF && CODE < 0xFFFF, "rules and inputs are indexed with 16 bits");
+
+public:
+  explicit RuleEngine(int relays = NUM_RELAYS) : relays_(relays) {}
+
+  // Replaces the rules with `program` (version byte first). Conditions are
+  // taken as they stand with `signals`: none fires for being true already.
+  RuleError load(const uint8_t* program, size_t len, uint64_t signals) {
+    count_ = 0;
+    len_ = 0;
+    if (!len || program[0] != RULES_CODE_VERSION) return len ? RULE_SYNTAX : RULE_OK;
+    if (len > CODE) return RULE_FULL;
+    for (size_t at = 1; at < len;) {
+      RuleInfo info;
+      if (!ruleDecode(program, len, at, relays_, info)) {
+        count_ = 0;
+        return RULE_SYNTAX;
+      }
+      if (count_ == N) {
+        count_ = 0;
+        return RULE_FULL;
+      }
+      rule_[count_++] = {(uint16_t)at, info.inputs, false, info.action};
+      at += info.size;
+    }
+    memcpy(code_, program, len);
+    len_ = len;
+
+    // input -> rules reading it, as one array in input order
+    uint16_t refs[RULE_SIGNALS] = {};
+    for (int i = 0; i < count_; i++) {
+      for (uint64_t m = rule_[i].inputs; m; m &= m - 1) refs[__builtin_ctzll(m)]++;
+    }
+    first_[0] = 0;
+    for (int s = 0; s < RULE_SIGNALS; s++) first_[s + 1] = first_[s] + refs[s];
+    for (int s = 0; s < RULE_SIGNALS; s++) refs[s] = first_[s];
+    for (int i = 0; i < count_; i++) {
+      for (uint64_t m = rule_[i].inputs; m; m &= m - 1) readers_[refs[__builtin_ctzll(m)]++] = (uint16_t)i;
+    }
+
+    signals_ = signals;
+    for (int i = 0; i < count_; i++) rule_[i].on = ruleEvaluate(code_ + rule_[i].at, signals);
+    return RULE_OK;
+  }
+
+  // Re-evaluates the rules reading an input that changed since the last
+  // update (or load), and calls fire(id, action) for each whose condition
+  // turned true, in rule order. Returns the rules evaluated.
+  template <typename Fire>
+  int update(uint64_t signals, Fire&& fire) {
+    uint64_t changed = signals ^ signals_;
+    if (!changed) return 0;
+    signals_ = signals;
+    if (++pass_ == 0) {
+      memset(mark_, 0, sizeof(mark_));
+      pass_ = 1;
+    }
+    int n = 0;
+    for (uint64_t m = changed; m; m &= m - 1) {
+      int s = __builtin_ctzll(m);
+      for (int k = first_[s]; k < first_[s + 1]; k++) {
+        uint16_t i = readers_[k];
+        if (mark_[i] == pass_) continue;
+        mark_[i] = pass_;
+        // insertion keeps rule order; a change touches few rules
+        int j = n++;
+        for (; j > 0 && dirty_[j - 1] > i; j--) dirty_[j] = dirty_[j - 1];
+        dirty_[j] = i;
+      }
+    }
+    for (int k = 0; k < n; k++) {
+      Rule& r = rule_[dirty_[k]];
+      bool on = ruleEvaluate(code_ + r.at, signals);
+      if (on && !r.on) fire(dirty_[k], r.action);
+      r.on = on;
+    }
+    return n;
+  }
+
+  int count() const { return count_; }
+  const uint8_t* rule(int id) const { return code_ + rule_[id].at; }
+  const RuleAction& action(int id) const { return rule_[id].action; }
+  bool active(int id) const { return rule_[id].on; }   // condition true at the last update
+  uint64_t signals() const { return signals_; }
+  const uint8_t* program() const { return code_; }
+  size_t programSize() const { return len_; }
+
+private:
+  struct Rule {
+    uint16_t at;
+    uint64_t inputs;
+    bool on;
+    RuleAction action;
+  };
+
+  int relays_;
+  Rule rule_[N];
+  int count_ = 0;
+  uint8_t code_[CODE];
+  size_t len_ = 0;
+  uint16_t first_[RULE_SIGNALS + 1] = {};
+  uint16_t readers_[CODE];          // an input reference takes at least a code byte
+  uint16_t dirty_[N];
+  uint32_t mark_[N] = {};
+  uint32_t pass_ = 0;
+  uint64_t signals_ = 0;
+};
+
+// The firmware's rules. rulesBegin() in setup() after relayTimersBegin();
+// rulesTick() from the net task.
+void rulesBegin();
+void rulesTick();
+// IR presence and the SinricPro link, from the tasks that own them (the
+// other inputs are read by rulesTick()). Safe from any task.
+void rulesSetInput(RuleSignal signal, bool on);
+
+// Safe from any task. A new rule gets the next id; deleting one moves the
+// ones after it down.
+RuleError ruleAdd(const char* text, int* id);
+RuleError ruleDelete(int id);
+
+// {"rules":[{"id":0,"rule":"if ir and not relay1 then relay3 on for 5m","active":false,"fired":2},..],
+//  "code_bytes":23,"inputs":["relay1","ir","wifi"]}
+// A rule switched off for looping has "off":true; inputs lists those on now.
+const size_t RULES_JSON_MAX = 128 + RULES_MAX * (RULE_TEXT_MAX + 64) + 8 * RULE_SIGNALS;
+size_t rulesJson(char* out, size_t cap);
+
+// WS text commands:
+//   "rules"               the list above
+//   "rule:<text>"         add a rule
+//   "rule_delete:<id>"
+// A change is answered with the list, a refusal with {"rule_error":"<why>"}.
+// Returns the reply length, 0 if `text` is not a rule command.
+size_t rulesCommand(const char* text, size_t len, char* reply, size_t cap);
+
+struct RuleStats {
+  uint32_t rules;
+  uint32_t evaluated;      // rule evaluations since boot
+  uint32_t fired;
+  uint32_t changes;        // ticks with an input changed
+};
+RuleStats rulesStats();
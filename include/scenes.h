@@ -0,0 +1,70 @@
+#pragma once
+
+// include/scenes.h
+// Named scenes: a set of relays and the state each should be in ("evening":
+// 1 and 3 on, 2 off; 4 left alone). Applying one queues all of its relays as
+// a single relay_control batch, so the control task switches them in one
+// GPIO write (or bus transaction) and one state update: WS clients get one
+// delta, MQTT and the journal see one change, and the cloud relays that
+// changed are reported to SinricPro together on the next cloud tick. Scene
+// commands have source SRC_SCENE (manual; the trigger is in the event log).
+//
+// Scenes live in SCENE_MAX slots, saved to NVS ("scenes" namespace) when
+// they change. Triggers: HTTP (main.cpp: GET /scenes, POST /scenes,
+// /scenes/apply, /scenes/delete), WS (scenesCommand), the SinricPro
+// switches in SCENE_DEVICES, and IR remote keys (IR_KEY_SAVED_SCENE).
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "relay_control.h"
+
+enum SceneError : uint8_t {
+  SCENE_OK,
+  SCENE_BAD_NAME,      // 1..SCENE_NAME_MAX of [A-Za-z0-9_-]
+  SCENE_BAD_RELAYS,    // no relay, a relay out of range, or on not within relays
+  SCENE_TOO_BIG,       // more than RELAY_BATCH_MAX relays: would not switch in one batch
+  SCENE_FULL,          // SCENE_MAX scenes already
+  SCENE_NOT_FOUND,
+  SCENE_BUSY,          // the relay command queue stayed full
+};
+const char* sceneErrorName(SceneError e);
+
+const size_t SCENE_NAME_MAX = 15;
+const size_t SCENES_JSON_MAX = 1024;
+// A save without a relay list covers these: every relay, or the first
+// RELAY_BATCH_MAX on builds with more. Only an explicit list can be too big.
+const uint32_t SCENE_DEFAULT_RELAYS =
+    (uint32_t)((1ull << (NUM_RELAYS < RELAY_BATCH_MAX ? NUM_RELAYS : RELAY_BATCH_MAX)) - 1);
+
+// setup(): loads the saved scenes.
+void scenesBegin();
+
+// Creates or replaces `name`: the relays in `relays` (bit n-1 = relay n) go
+// on if their bit in `on` is set, off otherwise.
+SceneError sceneSave(const char* name, uint32_t relays, uint32_t on);
+SceneError sceneDelete(const char* name);
+
+// Queue the scene as one batch. Safe from any task; `trigger` is the input
+// that asked, for the event log. Never blocks.
+SceneError sceneApply(const char* name, CommandSource trigger);
+SceneError sceneApplySlot(int slot, CommandSource trigger);
+
+// "1,3" -> relay mask; "" -> 0. False on anything else.
+bool sceneParseRelays(const char* s, uint32_t& mask);
+
+// {"scenes":[{"slot":0,"name":"evening","relays":[1,2,3],"on":[1,3]},..]}
+size_t scenesJson(char* out, size_t cap);
+
+// WS text commands:
+//   "scenes"                                  the list above
+//   "scene:<name>"                            apply
+//   "scene_save:<name>[:<on>[:<relays>]]"     relay lists as above; relays
+//                                             defaults to SCENE_DEFAULT_RELAYS,
+//                                             on to the relays on right now
+//   "scene_delete:<name>"
+// Applying is answered with {"scene_applied":"<name>"}, saving and deleting
+// with the list, a refusal with {"scene_error":"<why>"}. Returns the reply
+// length, 0 if `text` is not a scene command.
+size_t scenesCommand(const char* text, size_t len, char* reply, size_t cap);
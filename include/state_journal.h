@@ -0,0 +1,32 @@
+#pragma once
+
+// include/state_journal.h
+// Persists relay state to NVS so a power cut does not turn every load off.
+// Changes are not written as they happen: a burst of toggles is coalesced
+// into one deferred commit once things go quiet (JOURNAL_QUIET_MS), with
+// JOURNAL_MAX_DEFER_MS as the bound under a continuous storm and
+// JOURNAL_MIN_INTERVAL_MS between commits. A commit whose state matches the
+// last one is skipped. Each commit is a single 64-bit NVS entry
+// (relay mask | relay 4 mode | sequence), and NVS itself rotates entries
+// across its pages.
+//
+// journalRestore() runs in setup() before the relays and WiFi start;
+// journalTick() runs on the net task.
+
+#include <stdint.h>
+
+#include "relay_control.h"
+
+struct JournalState {
+  uint32_t relayMask = 0;
+  Relay4Mode relay4Mode = RELAY4_MODE_OFF;
+};
+
+// Last committed state; false (and `out` left at defaults) if none saved.
+bool journalRestore(JournalState& out);
+// Notice relay state changes and commit when due. Cheap when nothing changed.
+void journalTick();
+// Commit the current state now if it differs from NVS (before a restart).
+void journalFlush();
+
+uint32_t journalCommitCount();   // commits since boot
@@ -0,0 +1,125 @@
+#pragma once
+
+// include/state_json.h
+// Allocation-free JSON for device state: /status goes through serializeState();
+// the WS stream (ws_stream.cpp) and scan results use the same Writer.
+// The relay count and field layout are compile-time constants, so the worst
+// case output size is known and callers can size a stack buffer for it.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "relay_control.h"
+
+enum StateFields : uint8_t {
+  STATE_RELAYS = 1 << 0,   // "relay_states":[...]
+  STATE_STATUS = 1 << 1,   // mode, wifi, IPs, IR, relay 4 mode
+  STATE_FULL = STATE_RELAYS | STATE_STATUS,
+};
+
+struct StateSnapshot {
+  uint32_t relayMask = 0;
+  // STATE_STATUS only
+  const char* mode = "";      // "AP" / "STA" / "UNKNOWN"
+  bool wifiConnected = false;
+  const char* staIp = "";
+  const char* apSsid = "";
+  int irValue = 0;
+  Relay4Mode relay4Mode = RELAY4_MODE_OFF;
+};
+
+namespace state_json {
+
+const size_t MAX_SSID = 32;
+const size_t MAX_IP = 15;
+
+constexpr size_t lit(const char* s) { return *s ? 1 + lit(s + 1) : 0; }
+
+// every string field may double in size when escaped
+constexpr size_t maxSize(int relays) {
+  return lit("{") +
+         lit("\"mode\":\"UNKNOWN\",") +
+         lit("\"wifi_connected\":false,") +
+         lit("\"sta_ip\":\"\",") + MAX_IP +
+         lit("\"ap_ssid\":\"\",") + 2 * MAX_SSID +
+         lit("\"ir_value\":-2147483648,") +
+         lit("\"relay4_mode\":\"auto\",") +
+         lit("\"relay_states\":[]") + relays * lit("false,") +
+         lit("}") + 1;
+}
+
+// Bounded appender; on overflow further writes are dropped and ok() is false.
+class Writer {
+public:
+  Writer(char* out, size_t cap) : out_(out), cap_(cap) {}
+
+  void raw(const char* s) { while (*s) put(*s++); }
+  void boolean(bool b) { raw(b ? "true" : "false"); }
+  void integer(int v) {
+    if (v < 0) put('-');
+    uinteger(v < 0 ? 0u - (unsigned)v : (unsigned)v);
+  }
+  void uinteger(uint32_t u) {
+    char tmp[10];
+    int n = 0;
+    do { tmp[n++] = (char)('0' + u % 10); u /= 10; } while (u);
+    while (n) put(tmp[--n]);
+  }
+  void string(const char* s) {
+    put('"');
+    for (; *s; s++) {
+      if (*s == '"' || *s == '\\') put('\\');
+      if ((unsigned char)*s < 0x20) continue;   // control chars never appear in our fields
+      put(*s);
+    }
+    put('"');
+  }
+
+  bool ok() const { return len_ < cap_; }
+  size_t finish() {
+    if (!ok()) { if (cap_) out_[0] = 0; return 0; }
+    out_[len_] = 0;
+    return len_;
+  }
+
+private:
+  void put(char c) {
+    if (cap_ && len_ < cap_ - 1) out_[len_] = c;
+    len_++;
+  }
+  char* out_;
+  size_t cap_;
+  size_t len_ = 0;
+};
+
+} // namespace state_json
+
+const size_t STATE_JSON_MAX = state_json::maxSize(NUM_RELAYS);
+
+// Writes the selected fields as one JSON object into out (NUL-terminated).
+// Returns the length, or 0 if cap was too small.
+template <int NRelays = NUM_RELAYS>
+size_t serializeState(char* out, size_t cap, const StateSnapshot& s, uint8_t fields) {
+  static_assert(NRelays > 0 && NRelays <= 32, "relay mask is 32 bits");
+  state_json::Writer w(out, cap);
+  w.raw("{");
+  if (fields & STATE_STATUS) {
+    w.raw("\"mode\":"); w.string(s.mode);
+    w.raw(",\"wifi_connected\":"); w.boolean(s.wifiConnected);
+    w.raw(",\"sta_ip\":"); w.string(s.staIp);
+    w.raw(",\"ap_ssid\":"); w.string(s.apSsid);
+    w.raw(",\"ir_value\":"); w.integer(s.irValue);
+    w.raw(",\"relay4_mode\":"); w.string(relay4ModeName(s.relay4Mode));
+    if (fields & STATE_RELAYS) w.raw(",");
+  }
+  if (fields & STATE_RELAYS) {
+    w.raw("\"relay_states\":[");
+    for (int i = 0; i < NRelays; i++) {
+      if (i) w.raw(",");
+      w.boolean((s.relayMask >> i) & 1u);
+    }
+    w.raw("]");
+  }
+  w.raw("}");
+  return w.finish();
+}
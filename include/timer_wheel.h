@@ -0,0 +1,183 @@
+#pragma once
+
+// include/timer_wheel.h
+// Hierarchical timer wheel (Varghese & Lauck; the classic Linux layout) over
+// a fixed pool of N timers. Time is a 32-bit tick count. Level 0 has 256
+// slots of one tick, levels 1..3 have 64 slots of 256, 16384 and 1048576
+// ticks. A timer goes in the slot of the coarsest level that still
+// separates it from the current tick; when the level below wraps around, the
+// next slot up is emptied into it ("cascade"). add() and cancel() are O(1)
+// (doubly-linked slot lists, links are pool indices), and a tick fires one
+// level-0 slot plus a rare cascade. Timers beyond 2^26 ticks wait in the last
+// level-3 slot and are re-placed as they cascade.
+//
+// Not thread-safe: the owner serialises calls.
+
+#include <stddef.h>
+#include <stdint.h>
+
+template <int N>
+class TimerWheel {
+  static_assert(N >= 1 && N < 0xFFFF, "TimerWheel pool is indexed with 16 bits");
+
+public:
+  // (generation << 16) | pool index; 0 is never a valid handle
+  typedef uint32_t Handle;
+
+  explicit TimerWheel(uint32_t nowTick = 0) { reset(nowTick); }
+
+  void reset(uint32_t nowTick) {
+    for (int s = 0; s < SLOTS; s++) head_[s] = NIL;
+    for (int i = 0; i < N; i++) {
+      node_[i].next = i + 1 < N ? (uint16_t)(i + 1) : NIL;
+      node_[i].slot = NIL;
+      node_[i].gen = 1;
+    }
+    free_ = 0;
+    count_ = 0;
+    cur_ = nowTick;
+  }
+
+  // Fires at the first advance() that reaches dueTick (at once if it has
+  // passed). 0 if the pool is full.
+  Handle add(uint32_t dueTick, uint32_t payload) {
+    if (free_ == NIL) return 0;
+    uint16_t i = free_;
+    free_ = node_[i].next;
+    node_[i].due = dueTick;
+    node_[i].payload = payload;
+    place(i);
+    count_++;
+    return (Handle)node_[i].gen << 16 | i;
+  }
+
+  bool cancel(Handle h) {
+    uint16_t i = index(h);
+    if (i == NIL) return false;
+    unlink(i);
+    release(i);
+    return true;
+  }
+
+  bool pending(Handle h) const { return index(h) != NIL; }
+  uint32_t due(Handle h) const { return index(h) == NIL ? 0 : node_[index(h)].due; }
+
+  // Runs every tick up to and including nowTick, calling fire(payload) for
+  // each timer that comes due (timers of one tick in no set order). A timer
+  // may be added or cancelled from inside fire().
+  template <typename F>
+  int advance(uint32_t nowTick, F fire) {
+    int fired = 0;
+    while ((int32_t)(nowTick - cur_) >= 0) {
+      if (!count_) { cur_ = nowTick + 1; break; }   // nothing to run: skip the empty ticks
+      uint32_t slot = cur_ & L0_MASK;
+      if (!slot) {
+        // level 0 wrapped: refill it from level 1, and so on up
+        for (int level = 1; level < LEVELS; level++) {
+          uint32_t s = (cur_ >> shift(level)) & LN_MASK;
+          cascade(L0_SLOTS + (level - 1) * LN_SLOTS + s);
+          if (s) break;
+        }
+      }
+      while (head_[slot] != NIL) {
+        uint16_t i = head_[slot];
+        unlink(i);
+        uint32_t payload = node_[i].payload;
+        release(i);
+        fire(payload);
+        fired++;
+      }
+      cur_++;
+    }
+    return fired;
+  }
+
+  int size() const { return count_; }
+  uint32_t now() const { return cur_; }   // the next tick advance() will run
+
+  // Calls f(handle, dueTick, payload) for every pending timer.
+  template <typename F>
+  void forEach(F f) const {
+    for (int s = 0; s < SLOTS; s++) {
+      for (uint16_t i = head_[s]; i != NIL; i = node_[i].next) f((Handle)node_[i].gen << 16 | i, node_[i].due, node_[i].payload);
+    }
+  }
+
+private:
+  static const uint16_t NIL = 0xFFFF;
+  static const int LEVELS = 4;
+  static const int L0_BITS = 8, LN_BITS = 6;
+  static const int L0_SLOTS = 1 << L0_BITS, LN_SLOTS = 1 << LN_BITS;
+  static const uint32_t L0_MASK = L0_SLOTS - 1, LN_MASK = LN_SLOTS - 1;
+  static const int SLOTS = L0_SLOTS + (LEVELS - 1) * LN_SLOTS;
+  static const uint32_t MAX_SPAN = (1u << (L0_BITS + (LEVELS - 1) * LN_BITS)) - 1;
+
+  struct Node {
+    uint16_t next, prev;
+    uint16_t slot;          // NIL while free
+    uint16_t gen;
+    uint32_t due;
+    uint32_t payload;
+  };
+
+  static int shift(int level) { return L0_BITS + (level - 1) * LN_BITS; }
+
+  uint16_t index(Handle h) const {
+    uint16_t i = h & 0xFFFF;
+    if (i >= N || node_[i].slot == NIL || node_[i].gen != (uint16_t)(h >> 16)) return NIL;
+    return i;
+  }
+
+  void place(uint16_t i) {
+    uint32_t due = node_[i].due;
+    uint32_t span = due - cur_;
+    if ((int32_t)span < 0) { due = cur_; span = 0; }
+    if (span > MAX_SPAN) { span = MAX_SPAN; due = cur_ + MAX_SPAN; }
+    int slot;
+    if (span < L0_SLOTS) {
+      slot = due & L0_MASK;
+    } else {
+      int level = 1;
+      while (level < LEVELS - 1 && span >= (1u << shift(level + 1))) level++;
+      slot = L0_SLOTS + (level - 1) * LN_SLOTS + ((due >> shift(level)) & LN_MASK);
+    }
+    Node& n = node_[i];
+    n.slot = (uint16_t)slot;
+    n.prev = NIL;
+    n.next = head_[slot];
+    if (n.next != NIL) node_[n.next].prev = i;
+    head_[slot] = i;
+  }
+
+  void unlink(uint16_t i) {
+    Node& n = node_[i];
+    if (n.prev != NIL) node_[n.prev].next = n.next;
+    else head_[n.slot] = n.next;
+    if (n.next != NIL) node_[n.next].prev = n.prev;
+  }
+
+  void release(uint16_t i) {
+    Node& n = node_[i];
+    n.slot = NIL;
+    n.gen = n.gen == 0xFFFF ? 1 : n.gen + 1;
+    n.next = free_;
+    free_ = i;
+    count_--;
+  }
+
+  void cascade(int slot) {
+    uint16_t i = head_[slot];
+    head_[slot] = NIL;
+    while (i != NIL) {
+      uint16_t next = node_[i].next;
+      place(i);
+      i = next;
+    }
+  }
+
+  Node node_[N];
+  uint16_t head_[SLOTS];
+  uint16_t free_;
+  int count_;
+  uint32_t cur_;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+// include/wifi_manager.h
+// Non-blocking STA/AP connection manager. STA is always the goal: attempts
+// cycle through the saved credentials and FALLBACK_SSID with exponential
+// backoff between rounds, forever, so the device rejoins the router on its
+// own after an outage. While STA is down for longer than WIFI_AP_FALLBACK_MS
+// the setup AP runs alongside it (AP+STA), and it lingers for
+// WIFI_AP_LINGER_MS after STA comes back so a browser on the AP sees the
+// result. Nothing here waits: wifiManagerTick() polls WiFi.status() and
+// returns at once.
+//
+// Each good join records the router's BSSID and channel (and, with
+// WIFI_REUSE_IP, the lease) in NVS. Later joins of that network, after a
+// reboot or a drop, go straight there without a channel scan. A join that
+// does not work out within WIFI_FAST_CONNECT_TIMEOUT_MS falls back to a
+// normal scanning join of the same network.
+//
+// Owned by the net task: Begin before startTasks(), then Tick from that task
+// only. Connect/State/ApUp/ApSsid may be called from anywhere.
+
+#include <stdint.h>
+
+enum WifiState : uint8_t {
+  WIFI_STATE_AP_ONLY,      // setup AP forced (BOOT held); STA waits for /save
+  WIFI_STATE_CONNECTING,   // STA attempt in flight
+  WIFI_STATE_BACKOFF,      // every candidate failed; next round is scheduled
+  WIFI_STATE_CONNECTED,
+};
+
+// Load credentials (empty ssid = none saved) and start: the first STA
+// attempt, or the AP if forceAp.
+void wifiManagerBegin(const char* ssid, const char* pass, bool forceAp);
+// New credentials from the setup page: saved as the first candidate and
+// tried from the next tick on, with the AP kept up until they work.
+void wifiManagerConnect(const char* ssid, const char* pass);
+void wifiManagerTick();
+
+WifiState wifiManagerState();
+
+struct WifiJoinStats {
+  uint32_t lastJoinMs;      // begin() to connected, last join
+  uint32_t directed;        // joins to the cached BSSID/channel
+  uint32_t scanned;         // joins after a full scan
+  uint32_t directedMisses;  // cached router not found: fell back to a scan
+  bool lastDirected;
+};
+WifiJoinStats wifiManagerJoinStats();
+bool wifiManagerApUp();
+const char* wifiManagerApSsid();
@@ -0,0 +1,38 @@
+#pragma once
+
+// include/wifi_scan.h
+// Background WiFi scan with a TTL'd result cache. The scan runs in the WiFi
+// driver (WiFi.scanNetworks(async)); nothing here blocks. wifiScanPoll()
+// belongs to the net task, which starts scans and fills the cache; the rest
+// may be called from any task (the web server answers /scan from its own).
+
+#include <stddef.h>
+#include <stdint.h>
+
+const int SCAN_MAX_RESULTS = 20;
+const uint32_t SCAN_CACHE_TTL_MS = 30000;
+
+struct ScanEntry {
+  char ssid[33];
+  int32_t rssi;
+  bool secure;
+};
+
+// Ask for a scan unless the cache is younger than the TTL; the next
+// wifiScanPoll() starts it. True if a scan is running or now pending.
+bool wifiScanRequest();
+// Start a requested scan / harvest a finished one into the cache; true when
+// new results just landed.
+bool wifiScanPoll();
+
+bool wifiScanRunning();   // running or about to start
+int wifiScanCount();
+
+// Cached results as a JSON array (the /scan body). Returns 0 if cap is too small.
+size_t wifiScanJson(char* out, size_t cap);
+// One cached result as a WS push: {"scan":{...},"i":i,"n":count}; 0 if i is out of range
+size_t wifiScanEntryJson(char* out, size_t cap, int i);
+
+// worst case for wifiScanJson: every SSID char escaped
+const size_t SCAN_ENTRY_JSON_MAX = 96 + 2 * 32;
+const size_t SCAN_JSON_MAX = 2 + SCAN_MAX_RESULTS * SCAN_ENTRY_JSON_MAX;
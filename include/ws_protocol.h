@@ -0,0 +1,70 @@
+#pragma once
+
+// include/ws_protocol.h
+// Binary WebSocket command frames, read in place from the payload buffer.
+// Little-endian, fixed 4-byte commands:
+//   command frame  C1 n { seq:u16 op:u8 arg:u8 } x n          n = 1..WS_CMD_BATCH_MAX
+//   ack frame      A1 status n { seq:u16 result:u8 } x n      same order as the commands
+//   ops            01 OFF, 02 ON, 03 TOGGLE (arg = relay 1..N)
+//                  04 MODE (arg = Relay4Mode: 0 off, 1 on, 2 auto)
+// seq is the client's; it is echoed so acks can be matched to commands.
+//
+// Every valid command of a frame is queued as one relay batch, so the
+// control task applies them together: a frame that switches several relays
+// is one GPIO write and one state frame on the stream (ws_stream.h). An ack
+// says a command was queued or why not, not that it has been applied.
+// A malformed frame gets status 1 and no entries.
+//
+// Text commands stay for the bundled UI: "toggle:<n>" here, "status" and
+// "ir:<ms>" in ws_stream, timers in relay_timers, scenes in scenes, other
+// controllers in peer_link, automation rules in rules.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "relay_control.h"
+
+const uint8_t WS_CMD_MAGIC = 0xC1;
+const uint8_t WS_ACK_MAGIC = 0xA1;
+const int WS_CMD_BATCH_MAX = RELAY_BATCH_MAX;
+const size_t WS_CMD_SIZE = 4;
+const size_t WS_ACK_MAX = 3 + 3 * WS_CMD_BATCH_MAX;
+
+enum WsOp : uint8_t { WS_OP_OFF = 1, WS_OP_ON, WS_OP_TOGGLE, WS_OP_MODE };
+enum WsFrameStatus : uint8_t { WS_FRAME_OK, WS_FRAME_MALFORMED };
+enum WsAckResult : uint8_t { WS_ACK_OK, WS_ACK_BAD_ARG, WS_ACK_BAD_OP, WS_ACK_BUSY };
+
+struct WsCommand {
+  uint16_t seq;
+  uint8_t op;
+  uint8_t arg;
+};
+
+namespace ws_protocol {
+
+// Number of commands in a well-formed frame, or -1. Checks the magic byte,
+// the count and that the length is exactly what the count implies.
+inline int frameCount(const uint8_t* data, size_t len) {
+  if (len < 2 || data[0] != WS_CMD_MAGIC) return -1;
+  int n = data[1];
+  if (n < 1 || n > WS_CMD_BATCH_MAX || len != 2 + n * WS_CMD_SIZE) return -1;
+  return n;
+}
+
+// Command i of a frame frameCount() accepted.
+inline WsCommand frameCommand(const uint8_t* data, int i) {
+  const uint8_t* p = data + 2 + i * WS_CMD_SIZE;
+  return {(uint16_t)(p[0] | p[1] << 8), p[2], p[3]};
+}
+
+// Relay command for a binary command; WS_ACK_OK or why it was refused.
+WsAckResult toRelayCommand(const WsCommand& cmd, RelayCommand& out);
+
+// "toggle:<n>" (n = 1..NUM_RELAYS) -> a TOGGLE command with seq 0.
+bool parseText(const char* text, size_t len, WsCommand& out);
+
+// Queues a binary frame's commands as one batch and writes its ack into
+// `ack` (WS_ACK_MAX is always enough). Returns the ack length.
+size_t execute(const uint8_t* data, size_t len, uint8_t* ack, size_t cap);
+
+} // namespace ws_protocol
@@ -0,0 +1,40 @@
+#pragma once
+
+// include/ws_stream.h
+// Relay state + IR telemetry streamed to WebSocket clients by the net task.
+// Frames (JSON text):
+//   {"seq":S,"relay_states":[..],"relay4_mode":"auto"}  snapshot: on connect, on "status", after a resync
+//   {"seq":S,"d":{"2":true},"relay4_mode":"on"}         delta: what changed since frame S-1 (mode only if it did)
+//   {"ir":V}                                            IR value, to clients that sent "ir:<period ms>"
+//   {"metrics":{..}}                                    metricsJson(), to clients that sent "metrics:<period ms>"
+// A client that sees a gap in seq sends "status" to get a fresh snapshot.
+//
+// State is compared once per tick, so any number of applied commands (an IR
+// AUTO flip-flop, a burst of toggles) costs each client at most one frame per
+// tick, and none if it ended where it started. Each client has its own send
+// queue (AsyncWebSocket's): one that is full gets nothing until it drains and
+// then a snapshot; one that stays full for WS_STALL_DROP_MS is closed.
+
+#include <stddef.h>
+#include <stdint.h>
+
+class AsyncWebSocket;
+
+const uint32_t WS_IR_MIN_PERIOD_MS = 50;
+const uint32_t WS_IR_MAX_PERIOD_MS = 60000;       // also the longest metrics period
+const uint32_t WS_METRICS_MIN_PERIOD_MS = 250;
+const uint32_t WS_STALL_DROP_MS = 5000;
+const int WS_STREAM_MAX_CLIENTS = 16;    // cleanupClients() trims to 8, once a second
+
+void wsStreamBegin(AsyncWebSocket* ws);
+
+// WS events (AsyncTCP task)
+bool wsStreamConnected(uint32_t clientId);   // false: no free slot, close the client
+void wsStreamDisconnected(uint32_t clientId);
+// "status", "ir:<ms>" or "metrics:<ms>" (0 = stop); false if text is none of them
+bool wsStreamCommand(uint32_t clientId, const char* text, size_t len);
+
+// Net task: send each client what it is due, at most one state frame.
+void wsStreamTick(int irValue);
+
+uint32_t wsStreamSeq();
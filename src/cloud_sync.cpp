@@ -0,0 +1,145 @@
+// src/cloud_sync.cpp
+// SinricPro reconciliation: pending local reports and stale cloud commands
+// (see include/cloud_sync.h).
+
+#include "cloud_sync.h"
+#include "event_log.h"
+#include "hal.h"
+#include "relay_control.h"
+
+void CloudSync::addPending(uint32_t relays, uint32_t nowMs) {
+  for (int i = 0; i < MAX_RELAYS; i++) {
+    uint32_t bit = 1u << i;
+    if (!(relays & bit)) continue;
+    if (pending_ & bit) {
+      coalesced_.fetch_add(1, std::memory_order_relaxed);   // keeps its place in the queue
+      continue;
+    }
+    pending_ |= bit;
+    sinceMs_[i] = nowMs;
+    retryAtMs_[i] = nowMs;
+  }
+}
+
+// the pending relay changed longest ago whose retry time has come, -1 if none
+int CloudSync::oldestDue(uint32_t nowMs) const {
+  int best = -1;
+  uint32_t bestAge = 0;
+  for (int i = 0; i < MAX_RELAYS; i++) {
+    if (!(pending_ & (1u << i)) || (int32_t)(nowMs - retryAtMs_[i]) < 0) continue;
+    uint32_t age = nowMs - sinceMs_[i];
+    if (best < 0 || age > bestAge) {
+      best = i;
+      bestAge = age;
+    }
+  }
+  return best;
+}
+
+void CloudSync::tick(uint32_t nowMs, bool online, uint32_t changed, uint32_t state, SendFn send) {
+  addPending(changed & cloudRelays_, nowMs);
+  if (!online) {
+    if (online_) offlineSinceMs_ = nowMs;
+    online_ = false;
+    return;
+  }
+  if (!online_) {
+    online_ = true;
+    if (!everOnline_) {
+      // the cloud has not seen the state restored at boot
+      everOnline_ = true;
+      addPending(cloudRelays_ & ~pending_, nowMs);
+    } else if (pending_) {
+      resyncs_.fetch_add(1, std::memory_order_relaxed);
+      logEvent(LOG_CLOUD_RESYNC, (uint8_t)__builtin_popcount(pending_), nowMs - offlineSinceMs_);
+    }
+    tokens_ = CLOUD_REPORT_BURST;
+    refillMs_ = nowMs;
+  }
+
+  while (tokens_ < CLOUD_REPORT_BURST && nowMs - refillMs_ >= CLOUD_REPORT_INTERVAL_MS) {
+    tokens_++;
+    refillMs_ += CLOUD_REPORT_INTERVAL_MS;
+  }
+  if (tokens_ == CLOUD_REPORT_BURST) refillMs_ = nowMs;
+
+  for (int i; tokens_ && (i = oldestDue(nowMs)) >= 0;) {
+    uint32_t bit = 1u << i;
+    bool on = state & bit;
+    if ((knownValid_ & bit) && ((known_ & bit) != 0) == on) {
+      pending_ &= ~bit;
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    if (!send(i + 1, on)) {
+      retryAtMs_[i] = nowMs + CLOUD_REPORT_RETRY_MS;
+      retries_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    tokens_--;
+    pending_ &= ~bit;
+    known_ = on ? (known_ | bit) : (known_ & ~bit);
+    knownValid_ |= bit;
+    sent_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+bool CloudSync::acceptCommand(int relay, bool on, uint32_t state, uint32_t nowMs) {
+  if (relay < 1 || relay > MAX_RELAYS) return false;
+  int i = relay - 1;
+  uint32_t bit = 1u << i;
+  bool cur = state & bit;
+  if (pending_ & bit) {
+    if (on != cur) {
+      // issued against state the cloud had not caught up with: refuse, and
+      // send the report first (oldest in the queue, due now)
+      sinceMs_[i] = nowMs - 0x7FFFFFFF;
+      retryAtMs_[i] = nowMs;
+      refused_.fetch_add(1, std::memory_order_relaxed);
+      logEvent(LOG_CLOUD_CONFLICT, (uint8_t)relay, on);
+      return false;
+    }
+    pending_ &= ~bit;   // the cloud already asks for the local state
+  }
+  known_ = on ? (known_ | bit) : (known_ & ~bit);
+  knownValid_ |= bit;
+  return true;
+}
+
+CloudSync::Stats CloudSync::stats() const {
+  return {sent_.load(std::memory_order_relaxed), coalesced_.load(std::memory_order_relaxed),
+          dropped_.load(std::memory_order_relaxed), retries_.load(std::memory_order_relaxed),
+          refused_.load(std::memory_order_relaxed), resyncs_.load(std::memory_order_relaxed)};
+}
+
+// -------- the firmware's instance --------
+
+namespace {
+
+uint32_t cloudRelays() {
+  uint32_t m = 0;
+  for (int r = 1; r <= NUM_RELAYS; r++) {
+    if (relayDeviceId(r)) m |= 1u << (r - 1);
+  }
+  return m;
+}
+
+CloudSync cloud(cloudRelays());
+std::atomic<uint32_t> pendingNow{0};
+
+} // namespace
+
+void cloudSyncTick(bool online, CloudSync::SendFn send) {
+  cloud.tick(hal::millis(), online, takeCloudReportMask(), relayStateMask(), send);
+  pendingNow.store(cloud.pendingMask(), std::memory_order_relaxed);
+}
+
+bool cloudSyncAcceptCommand(int relay, bool on) {
+  bool ok = cloud.acceptCommand(relay, on, relayStateMask(), hal::millis());
+  pendingNow.store(cloud.pendingMask(), std::memory_order_relaxed);
+  return ok;
+}
+
+uint32_t cloudSyncPending() { return pendingNow.load(std::memory_order_relaxed); }
+
+CloudSync::Stats cloudSyncStats() { return cloud.stats(); }
@@ -0,0 +1,314 @@
+// src/event_log.cpp
+// Event ring + Serial output task (see include/event_log.h).
+
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "event_log.h"
+#include "hal.h"
+#include "metrics.h"
+#include "ota_update.h"
+#include "peer_link.h"
+#include "power_manager.h"
+#include "relay_control.h"
+
+namespace {
+
+static_assert((EVENT_LOG_SIZE & (EVENT_LOG_SIZE - 1)) == 0, "EVENT_LOG_SIZE must be a power of two");
+
+const uint32_t LOG_TASK_STACK = 3072;
+const uint8_t LOG_TASK_PRIO = 1;
+const int LOG_TASK_CORE = 0;
+
+// Writers claim a sequence number and fill that slot; `stamp` is seq + 1 once
+// the record is complete and 0 while it is being (re)written, so a reader can
+// tell a finished record from a torn or overwritten one. The payload is kept
+// as atomic words for the same reason.
+struct Slot {
+  std::atomic<uint32_t> stamp;
+  std::atomic<uint32_t> word[sizeof(LogRecord) / 4];
+};
+Slot ring[EVENT_LOG_SIZE];
+std::atomic<uint32_t> head{0};               // next sequence number = events logged
+std::atomic<uint32_t> printedCount{0}, lostCount{0};
+hal::TaskHandle logTask = nullptr;
+
+enum SlotState { SLOT_READY, SLOT_PENDING, SLOT_GONE };
+
+SlotState readSlot(uint32_t seq, LogRecord& out) {
+  const Slot& s = ring[seq & (EVENT_LOG_SIZE - 1)];
+  uint32_t stamp = s.stamp.load(std::memory_order_acquire);
+  if (stamp != seq + 1) return stamp && (int32_t)(stamp - (seq + 1)) > 0 ? SLOT_GONE : SLOT_PENDING;
+  uint32_t w[sizeof(LogRecord) / 4];
+  for (size_t i = 0; i < sizeof(w) / 4; i++) w[i] = s.word[i].load(std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (s.stamp.load(std::memory_order_relaxed) != stamp) return SLOT_GONE;   // overwritten while copying
+  memcpy(&out, w, sizeof(out));
+  return SLOT_READY;
+}
+
+void printSnapshot() {
+  static LogRecord snap[EVENT_LOG_SIZE];   // log task only
+  uint32_t total;
+  size_t n = eventLogSnapshot(snap, EVENT_LOG_SIZE, &total);
+  Serial.printf("---- last %u of %lu events ----\n", (unsigned)n, (unsigned long)total);
+  char line[EVENT_LOG_LINE_MAX];
+  for (size_t i = 0; i < n; i++) {
+    eventLogFormat(line, sizeof(line), snap[i]);
+    Serial.println(line);
+  }
+  Serial.println("----");
+}
+
+// "log" + Enter on the serial console dumps the history
+void pollSerialCommand(char* cmd, size_t& len, size_t cap) {
+  while (Serial.available() > 0) {
+    int c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      if (len == 3 && !memcmp(cmd, "log", 3)) printSnapshot();
+      len = 0;
+    } else {
+      if (len < cap) cmd[len] = (char)c;
+      len++;   // a longer line never matches
+    }
+  }
+}
+
+// Prints what was logged since the last round, at its own pace: a slow UART
+// only delays this task, and if it falls a whole ring behind the oldest
+// events are skipped and counted.
+void logTaskFn(void*) {
+  uint32_t next = 0;
+  char line[EVENT_LOG_LINE_MAX];
+  char cmd[8];
+  size_t cmdLen = 0;
+  for (;;) {
+    uint32_t h = head.load(std::memory_order_acquire);
+    uint32_t missed = 0;
+    if (h - next > (uint32_t)EVENT_LOG_SIZE) {
+      missed = h - EVENT_LOG_SIZE - next;
+      next = h - EVENT_LOG_SIZE;
+    }
+    for (; next != h; next++) {
+      LogRecord r;
+      SlotState st = readSlot(next, r);
+      if (st == SLOT_PENDING) break;   // its writer is still at it: next round
+      if (st == SLOT_GONE) { missed++; continue; }
+      if (missed) {
+        Serial.printf("log: %lu events lost\n", (unsigned long)missed);
+        lostCount.fetch_add(missed, std::memory_order_relaxed);
+        missed = 0;
+      }
+      eventLogFormat(line, sizeof(line), r);
+      Serial.println(line);
+      printedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (missed) {
+      Serial.printf("log: %lu events lost\n", (unsigned long)missed);
+      lostCount.fetch_add(missed, std::memory_order_relaxed);
+    }
+    pollSerialCommand(cmd, cmdLen, sizeof(cmd));
+    hal::delayMs(powerPollMs(EVENT_LOG_FLUSH_MS));
+  }
+}
+
+} // namespace
+
+void eventLogBegin() {
+  if (logTask) return;
+  logEvent(LOG_BOOT, 0, hal::heapFree());
+  logTask = hal::taskSpawn("log", logTaskFn, nullptr, LOG_TASK_STACK, LOG_TASK_PRIO, LOG_TASK_CORE);
+}
+
+void logEvent(LogEventType type, uint8_t a, uint32_t v1, uint32_t v2) {
+  uint32_t seq = head.fetch_add(1, std::memory_order_relaxed);
+  LogRecord r = {hal::millis(), (uint16_t)seq, type, a, v1, v2};
+  uint32_t w[sizeof(LogRecord) / 4];
+  memcpy(w, &r, sizeof(w));
+  Slot& s = ring[seq & (EVENT_LOG_SIZE - 1)];
+  s.stamp.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < sizeof(w) / 4; i++) s.word[i].store(w[i], std::memory_order_relaxed);
+  s.stamp.store(seq + 1, std::memory_order_release);
+}
+
+size_t eventLogSnapshot(LogRecord* out, size_t max, uint32_t* total) {
+  uint32_t h = head.load(std::memory_order_acquire);
+  uint32_t n = h < (uint32_t)EVENT_LOG_SIZE ? h : EVENT_LOG_SIZE;
+  if (n > max) n = (uint32_t)max;
+  size_t copied = 0;
+  for (uint32_t seq = h - n; seq != h; seq++) {
+    if (readSlot(seq, out[copied]) == SLOT_READY) copied++;
+  }
+  if (total) *total = h;
+  return copied;
+}
+
+size_t eventLogDump(uint8_t* out, size_t cap) {
+  if (cap < sizeof(LogDumpHeader)) return 0;
+  LogRecord* records = (LogRecord*)(out + sizeof(LogDumpHeader));
+  LogDumpHeader hdr = {{'E', 'V', 'L', '1'}, (uint16_t)sizeof(LogRecord), 0, 0, 0};
+  hdr.count = (uint16_t)eventLogSnapshot(records, (cap - sizeof(LogDumpHeader)) / sizeof(LogRecord), &hdr.total);
+  hdr.nowMs = hal::millis();
+  memcpy(out, &hdr, sizeof(hdr));
+  return sizeof(hdr) + hdr.count * sizeof(LogRecord);
+}
+
+size_t eventLogFormat(char* out, size_t cap, const LogRecord& r) {
+  int n = snprintf(out, cap, "%5lu.%03lu ", (unsigned long)(r.timeMs / 1000), (unsigned long)(r.timeMs % 1000));
+  if (n < 0 || (size_t)n >= cap) return 0;
+  char* p = out + n;
+  size_t left = cap - n;
+  unsigned ip[4] = {r.v2 & 0xFF, (r.v2 >> 8) & 0xFF, (r.v2 >> 16) & 0xFF, r.v2 >> 24};
+  switch (r.type) {
+    case LOG_BOOT:
+      n = snprintf(p, left, "boot, %lu bytes free", (unsigned long)r.v1);
+      break;
+    case LOG_RESTORED:
+      n = snprintf(p, left, "restored relay state 0x%02lX, relay 4 %s", (unsigned long)r.v1,
+                   relay4ModeName((Relay4Mode)r.a));
+      break;
+    case LOG_BOOT_BUTTON:
+      n = snprintf(p, left, "BOOT pressed -> forced AP mode for setup");
+      break;
+    case LOG_RELAY:
+      n = snprintf(p, left, "relay %u %s -> %s (%s)", r.a, (r.v2 & 2) ? "on" : "off", (r.v2 & 1) ? "on" : "off",
+                   commandSourceName((CommandSource)r.v1));
+      break;
+    case LOG_CLOUD_STARTED:
+      n = snprintf(p, left, "SinricPro started");
+      break;
+    case LOG_CLOUD_COMMAND:
+      n = snprintf(p, left, "SinricPro: relay %u -> %s", r.a, r.v1 ? "ON" : "OFF");
+      break;
+    case LOG_WS_CONNECT:
+      n = snprintf(p, left, "WS client %lu connected from %u.%u.%u.%u", (unsigned long)r.v1, ip[0], ip[1], ip[2], ip[3]);
+      break;
+    case LOG_WS_DISCONNECT:
+      n = snprintf(p, left, "WS client %lu disconnected", (unsigned long)r.v1);
+      break;
+    case LOG_WS_STALLED:
+      n = snprintf(p, left, "WS client %lu stalled for %lu ms, closing", (unsigned long)r.v1, (unsigned long)r.v2);
+      break;
+    case LOG_IR_FALLBACK:
+      n = snprintf(p, left, "IR: ADC DMA unavailable, falling back to 1 kHz analogRead");
+      break;
+    case LOG_WIFI_AP_UP:
+      n = snprintf(p, left, "WiFi: AP '%s%02X%02X' up", AP_PREFIX, (unsigned)(r.v1 >> 8) & 0xFF, (unsigned)r.v1 & 0xFF);
+      break;
+    case LOG_WIFI_AP_DOWN:
+      n = snprintf(p, left, "WiFi: AP down");
+      break;
+    case LOG_WIFI_JOIN:
+      if (r.v1) n = snprintf(p, left, "WiFi: joining the %s network on channel %lu (cached)", r.a ? "fallback" : "saved", (unsigned long)r.v1);
+      else n = snprintf(p, left, "WiFi: joining the %s network", r.a ? "fallback" : "saved");
+      break;
+    case LOG_WIFI_BACKOFF:
+      n = snprintf(p, left, "WiFi: no network, retry in %lu ms", (unsigned long)r.v1);
+      break;
+    case LOG_WIFI_CONNECTED:
+      n = snprintf(p, left, "WiFi: STA connected after %lu ms offline%s, IP: %u.%u.%u.%u", (unsigned long)r.v1,
+                   r.a ? " (no scan)" : "", ip[0], ip[1], ip[2], ip[3]);
+      break;
+    case LOG_WIFI_LOST:
+      n = snprintf(p, left, "WiFi: STA lost");
+      break;
+    case LOG_MQTT_CONNECTED:
+      n = snprintf(p, left, "MQTT connected to %s:%u", MQTT_HOST, MQTT_PORT);
+      break;
+    case LOG_MQTT_FAILED:
+      n = snprintf(p, left, "MQTT connect failed (%ld), retry in %lu ms", (long)(int32_t)r.v1, (unsigned long)r.v2);
+      break;
+    case LOG_POWER_BACKUP:
+      n = snprintf(p, left, "power: mains lost for %lu ms -> battery profile", (unsigned long)r.v1);
+      break;
+    case LOG_POWER_MAINS:
+      n = snprintf(p, left, "power: mains back for %lu ms -> mains profile", (unsigned long)r.v1);
+      break;
+    case LOG_REMOTE_KEY:
+      if (r.a) n = snprintf(p, left, "remote: code 0x%08lX (key %u)", (unsigned long)r.v1, r.a);
+      else n = snprintf(p, left, "remote: code 0x%08lX (no key)", (unsigned long)r.v1);
+      break;
+    case LOG_CLOUD_RESYNC:
+      n = snprintf(p, left, "SinricPro: back after %lu ms, %u relay report(s) pending", (unsigned long)r.v1, r.a);
+      break;
+    case LOG_CLOUD_CONFLICT:
+      n = snprintf(p, left, "SinricPro: relay %u -> %s refused, local change not reported yet", r.a,
+                   r.v1 ? "ON" : "OFF");
+      break;
+    case LOG_OTA_START:
+      n = snprintf(p, left, "update: receiving %lu bytes", (unsigned long)r.v1);
+      break;
+    case LOG_OTA_DONE:
+      n = snprintf(p, left, "update: %lu bytes verified in %lu ms, restarting into it", (unsigned long)r.v1,
+                   (unsigned long)r.v2);
+      break;
+    case LOG_OTA_FAILED:
+      n = snprintf(p, left, "update: failed (%s) after %lu bytes", otaErrorName((OtaError)r.a), (unsigned long)r.v1);
+      break;
+    case LOG_OTA_CONFIRMED:
+      n = snprintf(p, left, "update: new firmware confirmed %lu ms after boot", (unsigned long)r.v1);
+      break;
+    case LOG_OTA_ROLLBACK: {
+      char after[24];
+      if (r.a) snprintf(after, sizeof(after), "%u boots", r.a);
+      else snprintf(after, sizeof(after), "%lu ms", (unsigned long)r.v1);
+      n = snprintf(p, left, "update: new firmware unconfirmed after %s, %s", after,
+                   r.v2 ? "rolling back" : "no previous image to roll back to");
+      break;
+    }
+    case LOG_TIMER_FIRED: {
+      static const char* const KINDS[] = {"timer", "auto-off", "schedule"};
+      static const char* const OPS[] = {"off", "on", "toggle"};
+      unsigned kind = (r.v2 >> 8) & 0xFF, op = r.v2 & 0xFF;
+      n = snprintf(p, left, "%s %lu: relay %u %s", kind < 3 ? KINDS[kind] : "timer", (unsigned long)r.v1, r.a,
+                   op < 3 ? OPS[op] : "?");
+      break;
+    }
+    case LOG_SCENE:
+      if (r.v2) n = snprintf(p, left, "scene %u applied (%s): relays 0x%02lX", r.a, commandSourceName((CommandSource)r.v1), (unsigned long)r.v2);
+      else n = snprintf(p, left, "scene %u (%s): refused, queue full", r.a, commandSourceName((CommandSource)r.v1));
+      break;
+    case LOG_PEER: {
+      static const char* const WHAT[] = {"silent, dropped", "heard", "ESP-NOW failed to start", "link off: no PEER_KEY"};
+      n = snprintf(p, left, "peer %lu: %s", (unsigned long)r.v1, r.a < 4 ? WHAT[r.a] : "?");
+      break;
+    }
+    case LOG_PEER_COMMAND: {
+      static const char* const OPS[] = {"off", "on", "toggle"};
+      n = snprintf(p, left, "peer %lu: relay %u %s", (unsigned long)r.v1, r.a, r.v2 < 3 ? OPS[r.v2] : "?");
+      break;
+    }
+    case LOG_PEER_ANSWER:
+      n = snprintf(p, left, "peer %lu relay %lu: %s after %lu ms", (unsigned long)r.v1, (unsigned long)(r.v2 >> 16),
+                   peerErrorName((PeerError)r.a), (unsigned long)(r.v2 & 0xFFFF));
+      break;
+    case LOG_RULE: {
+      static const char* const OPS[] = {"off", "on", "toggle"};
+      unsigned relay = r.v2 >> 8, op = r.v2 & 0xFF;
+      if (r.v1 == 2) n = snprintf(p, left, "rule %u: switched off, already fired %u times within %lu ms", r.a,
+                                  RULE_BURST_MAX, (unsigned long)RULE_BURST_WINDOW_MS);
+      else n = snprintf(p, left, "rule %u: relay %u %s%s", r.a, relay, op < 3 ? OPS[op] : "?",
+                        r.v1 ? " refused, queue full" : "");
+      break;
+    }
+    case LOG_BOOT_MILESTONE:
+      n = snprintf(p, left, "boot: %s at %lu ms", metricsBootName((BootMilestone)r.a), (unsigned long)r.v1);
+      break;
+    default:
+      n = snprintf(p, left, "event %u a=%u v1=%lu v2=%lu", r.type, r.a, (unsigned long)r.v1, (unsigned long)r.v2);
+      break;
+  }
+  if (n < 0) return 0;
+  return (size_t)n < left ? (p - out) + n : cap - 1;
+}
+
+EventLogStats eventLogStats() {
+  EventLogStats s;
+  s.logged = head.load(std::memory_order_relaxed);
+  s.printed = printedCount.load(std::memory_order_relaxed);
+  s.lost = lostCount.load(std::memory_order_relaxed);
+  return s;
+}
@@ -0,0 +1,330 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <WiFi.h>
+#include <Wire.h>
+
+// src/hal_esp32.cpp
+// ESP32 (Arduino core) implementation of include/hal.h.
+
+#include <driver/adc.h>
+#include <driver/i2s.h>
+#include <driver/rmt.h>
+#include <esp_heap_caps.h>
+#include <esp_now.h>
+#include <esp_ota_ops.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <mbedtls/md.h>
+#include <mbedtls/sha256.h>
+#include <soc/gpio_struct.h>
+
+#include "hal.h"
+
+namespace hal {
+
+void pinSetup(int pin, PinMode mode) {
+  switch (mode) {
+    case PIN_MODE_OUTPUT:       pinMode(pin, OUTPUT); break;
+    case PIN_MODE_INPUT_PULLUP: pinMode(pin, INPUT_PULLUP); break;
+    default:                    pinMode(pin, INPUT); break;
+  }
+}
+
+void gpioWrite(int pin, bool high) { digitalWrite(pin, high ? HIGH : LOW); }
+
+void gpioWriteMask(uint64_t highMask, uint64_t lowMask) {
+  // GPIO 0..31 and 32..39 sit in separate set/clear registers
+  if ((uint32_t)highMask) GPIO.out_w1ts = (uint32_t)highMask;
+  if ((uint32_t)lowMask) GPIO.out_w1tc = (uint32_t)lowMask;
+  if (highMask >> 32) GPIO.out1_w1ts.val = (uint32_t)(highMask >> 32);
+  if (lowMask >> 32) GPIO.out1_w1tc.val = (uint32_t)(lowMask >> 32);
+}
+bool gpioRead(int pin) { return digitalRead(pin) == HIGH; }
+int adcRead(int pin) { return analogRead(pin); }
+
+bool adcStreamStart(int pin, uint32_t sampleRateHz) {
+  int ch = digitalPinToAnalogChannel(pin);
+  if (ch < 0 || ch >= ADC1_CHANNEL_MAX) return false;  // I2S DMA reads ADC1 only
+
+  i2s_config_t cfg = {};
+  cfg.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+  cfg.sample_rate = sampleRateHz;
+  cfg.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+  cfg.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+  cfg.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+  cfg.dma_buf_count = 4;
+  cfg.dma_buf_len = 256;
+  if (i2s_driver_install(I2S_NUM_0, &cfg, 0, nullptr) != ESP_OK) return false;
+
+  adc1_config_width(ADC_WIDTH_BIT_12);
+  adc1_config_channel_atten((adc1_channel_t)ch, ADC_ATTEN_DB_11);  // same range as analogRead
+  i2s_set_adc_mode(ADC_UNIT_1, (adc1_channel_t)ch);
+  return i2s_adc_enable(I2S_NUM_0) == ESP_OK;
+}
+
+size_t adcStreamRead(uint16_t* buf, size_t maxSamples, uint32_t timeoutMs) {
+  size_t bytes = 0;
+  i2s_read(I2S_NUM_0, buf, maxSamples * sizeof(uint16_t), &bytes, pdMS_TO_TICKS(timeoutMs));
+  size_t n = bytes / sizeof(uint16_t);
+  for (size_t i = 0; i < n; i++) buf[i] &= 0x0FFF;  // top 4 bits carry the channel number
+  return n;
+}
+
+void adcStreamStop() {
+  i2s_adc_disable(I2S_NUM_0);
+  i2s_driver_uninstall(I2S_NUM_0);
+}
+
+// VSPI; the chip select is driven by the peripheral so the latch edge follows
+// the last clock without a task switch in between
+SPIClass spi(VSPI);
+SPISettings spiSettings;
+
+void spiBegin(int sckPin, int mosiPin, int csPin, uint32_t hz) {
+  spi.begin(sckPin, -1, mosiPin, csPin);
+  spi.setHwCs(true);
+  spiSettings = SPISettings(hz, MSBFIRST, SPI_MODE0);
+}
+
+void spiWrite(const uint8_t* data, size_t len) {
+  spi.beginTransaction(spiSettings);
+  spi.writeBytes(data, len);
+  spi.endTransaction();
+}
+
+void i2cBegin(int sdaPin, int sclPin, uint32_t hz) { Wire.begin(sdaPin, sclPin, hz); }
+
+bool i2cWrite(uint8_t addr, const uint8_t* data, size_t len) {
+  Wire.beginTransmission(addr);
+  Wire.write(data, len);
+  return Wire.endTransmission() == 0;
+}
+
+// IR receiver on an RMT channel clocked from REF_TICK (1 MHz), which keeps
+// its rate while the power manager scales the APB clock. With light sleep
+// enabled the RMT stops too, so the first mark of a frame wakes the chip
+// (GPIO wakeup) and takes a no-light-sleep lock until irRxRead has the
+// frame; the 9 ms NEC header mark covers the wakeup.
+const rmt_channel_t IR_RMT_CHANNEL = RMT_CHANNEL_4;
+// The RX filter counts APB (80 MHz) ticks whatever clk_div is: 255, its
+// maximum, drops glitches under ~3.2 µs. Longer noise is left to the NEC
+// decoder's timing tolerances.
+const uint8_t IR_RMT_FILTER_TICKS = 255;
+RingbufHandle_t irRing = nullptr;
+int irPin = -1;
+
+#if CONFIG_PM_ENABLE
+esp_pm_lock_handle_t irAwakeLock = nullptr;
+volatile bool irAwake = false;
+
+void IRAM_ATTR irWakeIsr(void*) {
+  gpio_intr_disable((gpio_num_t)irPin);
+  esp_pm_lock_acquire(irAwakeLock);
+  irAwake = true;
+}
+
+void irAwakeRelease() {
+  if (!irAwake) return;
+  irAwake = false;
+  esp_pm_lock_release(irAwakeLock);
+  gpio_intr_enable((gpio_num_t)irPin);
+}
+#else
+void irAwakeRelease() {}
+#endif
+
+bool irRxBegin(int pin, uint32_t idleUs) {
+  rmt_config_t cfg = RMT_DEFAULT_CONFIG_RX((gpio_num_t)pin, IR_RMT_CHANNEL);
+  cfg.clk_div = 1;                           // REF_TICK: 1 tick = 1 µs
+  cfg.flags = RMT_CHANNEL_FLAGS_AWARE_DFS;
+  cfg.rx_config.idle_threshold = (uint16_t)idleUs;
+  cfg.rx_config.filter_en = true;
+  cfg.rx_config.filter_ticks_thresh = IR_RMT_FILTER_TICKS;
+  if (rmt_config(&cfg) != ESP_OK || rmt_driver_install(IR_RMT_CHANNEL, 1024, 0) != ESP_OK) return false;
+  rmt_get_ringbuf_handle(IR_RMT_CHANNEL, &irRing);
+  irPin = pin;
+#if CONFIG_PM_ENABLE
+  if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "ir_rx", &irAwakeLock) == ESP_OK) {
+    gpio_install_isr_service(0);             // ESP_ERR_INVALID_STATE if already there
+    gpio_wakeup_enable((gpio_num_t)pin, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+    gpio_isr_handler_add((gpio_num_t)pin, irWakeIsr, nullptr);
+    gpio_intr_enable((gpio_num_t)pin);
+  }
+#endif
+  return rmt_rx_start(IR_RMT_CHANNEL, true) == ESP_OK;
+}
+
+size_t irRxRead(uint16_t* durations, size_t maxDurations, uint32_t timeoutMs) {
+  if (!irRing) { ::delay(timeoutMs); return 0; }
+  size_t bytes = 0;
+  rmt_item32_t* items = (rmt_item32_t*)xRingbufferReceive(irRing, &bytes, pdMS_TO_TICKS(timeoutMs));
+  irAwakeRelease();
+  if (!items) return 0;
+  // the receiver output is low during a burst: level 0 = mark
+  size_t n = 0;
+  for (size_t i = 0; i < bytes / sizeof(rmt_item32_t); i++) {
+    const uint32_t dur[2] = {items[i].duration0, items[i].duration1};
+    const bool mark[2] = {items[i].level0 == 0, items[i].level1 == 0};
+    for (int h = 0; h < 2; h++) {
+      if (!dur[h]) goto done;                // end of frame (the idle)
+      if (!n && !mark[h]) continue;          // idle before the first mark
+      if ((n % 2 == 0) != mark[h]) {         // same level as the last half: one pulse
+        uint32_t sum = durations[n - 1] + dur[h];
+        durations[n - 1] = sum > 0xFFFF ? 0xFFFF : (uint16_t)sum;
+      } else if (n < maxDurations) {
+        durations[n++] = (uint16_t)dur[h];
+      } else {
+        goto done;
+      }
+    }
+  }
+done:
+  vRingbufferReturnItem(irRing, items);
+  return n;
+}
+
+// ESP-NOW on the STA interface while it is joined (or no AP is up), on the
+// AP otherwise; both share the radio's one channel. The driver sends only
+// to registered peers (20 at most), so addresses are registered on first
+// use and the one registered longest ago makes room when the list is full.
+PeerRecvFn peerRecv = nullptr;
+
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+void onEspNowRecv(const esp_now_recv_info_t* info, const uint8_t* data, int len) {
+  if (peerRecv && len > 0) peerRecv(info->src_addr, data, (size_t)len);
+}
+#else
+void onEspNowRecv(const uint8_t* mac, const uint8_t* data, int len) {
+  if (peerRecv && len > 0) peerRecv(mac, data, (size_t)len);
+}
+#endif
+
+bool peerRadioBegin(PeerRecvFn onRecv) {
+  peerRecv = onRecv;
+  return esp_now_init() == ESP_OK && esp_now_register_recv_cb(onEspNowRecv) == ESP_OK;
+}
+
+bool peerRadioSend(const uint8_t mac[6], const uint8_t* data, size_t len) {
+  esp_now_peer_info_t peer = {};
+  memcpy(peer.peer_addr, mac, 6);
+  peer.channel = 0;   // the current one
+  bool ap = (WiFi.getMode() & WIFI_MODE_AP) && WiFi.status() != WL_CONNECTED;
+  peer.ifidx = ap ? WIFI_IF_AP : WIFI_IF_STA;
+  if (esp_now_is_peer_exist(mac)) {
+    esp_now_peer_info_t cur;
+    if (esp_now_get_peer(mac, &cur) == ESP_OK && cur.ifidx != peer.ifidx) esp_now_mod_peer(&peer);
+  } else if (esp_now_add_peer(&peer) == ESP_ERR_ESPNOW_FULL) {
+    esp_now_peer_info_t oldest;
+    if (esp_now_fetch_peer(true, &oldest) != ESP_OK) return false;
+    esp_now_del_peer(oldest.peer_addr);
+    if (esp_now_add_peer(&peer) != ESP_OK) return false;
+  }
+  return esp_now_send(mac, data, len) == ESP_OK;
+}
+
+// Firmware update through the IDF OTA API. OTA_WITH_SEQUENTIAL_WRITES
+// erases each sector when the writes reach it instead of the whole image
+// up front (a 1.25 MB erase would stall both cores for seconds).
+esp_ota_handle_t otaHandle = 0;
+const esp_partition_t* otaPartition = nullptr;
+
+bool otaBegin(uint32_t imageSize) {
+  otaPartition = esp_ota_get_next_update_partition(nullptr);
+  if (!otaPartition || imageSize > otaPartition->size) return false;
+  return esp_ota_begin(otaPartition, OTA_WITH_SEQUENTIAL_WRITES, &otaHandle) == ESP_OK;
+}
+
+bool otaWrite(const uint8_t* data, size_t len) {
+  return otaHandle && esp_ota_write(otaHandle, data, len) == ESP_OK;
+}
+
+bool otaEnd() {
+  if (!otaHandle) return false;
+  esp_err_t err = esp_ota_end(otaHandle);   // verifies the image (and its appended hash)
+  otaHandle = 0;
+  return err == ESP_OK && esp_ota_set_boot_partition(otaPartition) == ESP_OK;
+}
+
+void otaAbort() {
+  if (otaHandle) esp_ota_abort(otaHandle);
+  otaHandle = 0;
+}
+
+void otaConfirm() { esp_ota_mark_app_valid_cancel_rollback(); }
+
+bool otaRollback() {
+  // with two OTA slots the "next" partition is the one we came from
+  const esp_partition_t* other = esp_ota_get_next_update_partition(nullptr);
+  esp_app_desc_t desc;
+  return other && esp_ota_get_partition_description(other, &desc) == ESP_OK &&
+         esp_ota_set_boot_partition(other) == ESP_OK;
+}
+
+void restart() { ESP.restart(); }
+
+mbedtls_sha256_context shaCtx;
+
+void sha256Begin() {
+  mbedtls_sha256_init(&shaCtx);
+  mbedtls_sha256_starts_ret(&shaCtx, 0);
+}
+
+void sha256Update(const uint8_t* data, size_t len) { mbedtls_sha256_update_ret(&shaCtx, data, len); }
+
+void sha256Finish(uint8_t digest[32]) {
+  mbedtls_sha256_finish_ret(&shaCtx, digest);
+  mbedtls_sha256_free(&shaCtx);
+}
+
+void hmacSha256(const uint8_t* key, size_t keyLen, const uint8_t* data, size_t len, uint8_t mac[32]) {
+  mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), key, keyLen, data, len, mac);
+}
+
+uint32_t millis() { return ::millis(); }
+uint32_t micros() { return ::micros(); }
+void delayMs(uint32_t ms) { ::delay(ms); }
+uint32_t cycleCount() { return ESP.getCycleCount(); }
+uint32_t cyclesPerUs() { return getCpuFrequencyMhz(); }
+
+void clockSync(const char* tz, const char* server) { configTzTime(tz, server); }
+
+uint32_t wallClock() {
+  time_t t = time(nullptr);
+  return t > 1600000000 ? (uint32_t)t : 0;   // 1970 + uptime until SNTP has answered
+}
+
+bool powerConfigure(uint32_t maxMhz, uint32_t minMhz, bool lightSleep) {
+#if CONFIG_PM_ENABLE
+  esp_pm_config_esp32_t cfg = {};
+  cfg.max_freq_mhz = (int)maxMhz;
+  cfg.min_freq_mhz = (int)(lightSleep ? minMhz : maxMhz);
+  cfg.light_sleep_enable = lightSleep;
+  if (esp_pm_configure(&cfg) == ESP_OK) return true;
+#endif
+  setCpuFrequencyMhz(maxMhz);
+  return false;
+}
+
+uint32_t heapFree() { return ESP.getFreeHeap(); }
+uint32_t heapLargestBlock() { return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT); }
+
+TaskHandle taskSpawn(const char* name, TaskFn fn, void* arg, uint32_t stackBytes, uint8_t priority, int core) {
+  TaskHandle_t h = nullptr;
+  if (xTaskCreatePinnedToCore(fn, name, stackBytes, arg, priority, &h, core) != pdPASS) return nullptr;
+  return h;
+}
+
+void taskNotify(TaskHandle task) {
+  if (task) xTaskNotifyGive((TaskHandle_t)task);
+}
+
+bool taskWait(uint32_t timeoutMs) {
+  return ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs)) > 0;
+}
+
+} // namespace hal
+
+// With the bootloader's rollback enabled, keep a new image pending until
+// ota_update.cpp confirms it (the core would otherwise confirm it at boot).
+extern "C" bool verifyRollbackLater() { return true; }
@@ -0,0 +1,167 @@
+// src/ir_remote.cpp
+// IR remote: NEC decoding and key mapping (see include/ir_remote.h).
+
+#include <atomic>
+
+#include "config.h"
+#include "event_log.h"
+#include "hal.h"
+#include "ir_remote.h"
+#include "peer_link.h"
+#include "relay_control.h"
+#include "scenes.h"
+
+namespace {
+
+const uint32_t REMOTE_TASK_STACK = 2048;
+const uint8_t REMOTE_TASK_PRIO = 4;        // above IR sampling, below the control task
+const int REMOTE_TASK_CORE = 1;
+const uint32_t REMOTE_READ_TIMEOUT_MS = 1000;
+const uint32_t SUBMIT_WAIT_MS = 20;        // queue full: wait this long before dropping a key
+
+// NEC timings (µs)
+const uint16_t NEC_HDR_MARK = 9000;
+const uint16_t NEC_HDR_SPACE = 4500;
+const uint16_t NEC_RPT_SPACE = 2250;
+const uint16_t NEC_BIT_MARK = 560;
+const uint16_t NEC_ONE_SPACE = 1690;
+const uint16_t NEC_ZERO_SPACE = 560;
+const int NEC_BITS = 32;
+const size_t NEC_CODE_LEN = 2 + 2 * NEC_BITS + 1;   // header, bits, stop mark
+const size_t NEC_REPEAT_LEN = 3;
+const uint16_t TOLERANCE_PCT = 25;
+const uint16_t EDGE_SLACK_US = 100;
+
+std::atomic<uint32_t> framesSeen{0}, undecoded{0}, presses{0};
+
+bool near(uint16_t measured, uint16_t expected) {
+  uint32_t slack = (uint32_t)expected * TOLERANCE_PCT / 100 + EDGE_SLACK_US;
+  return measured + slack >= expected && measured <= expected + slack;
+}
+
+// the receiver may still be waking up for the first part of the header
+bool headerMark(uint16_t measured) {
+  return measured >= NEC_HDR_MARK / 2 && measured <= NEC_HDR_MARK + NEC_HDR_MARK * TOLERANCE_PCT / 100;
+}
+
+// Data bits are told apart by their space alone, split halfway between a
+// zero and a one, so jitter that would push either out of a tight window
+// still decodes; the inverted command byte catches what slips through.
+const uint16_t NEC_BIT_SPLIT = (NEC_ZERO_SPACE + NEC_ONE_SPACE) / 2;
+bool bitMark(uint16_t measured) { return measured >= NEC_BIT_MARK / 4 && measured <= 2 * NEC_BIT_MARK; }
+bool bitSpace(uint16_t measured) { return measured >= NEC_ZERO_SPACE / 4 && measured <= 2 * NEC_ONE_SPACE; }
+
+// a burst of keys can outrun the control task; this task can wait
+bool submitWaiting(const RelayCommand* cmds, int n) {
+  for (uint32_t t = 0; !submitRelayBatch(cmds, n); t++) {
+    if (t == SUBMIT_WAIT_MS) return false;
+    hal::delayMs(1);
+  }
+  return true;
+}
+
+void remoteTask(void*) {
+  static uint16_t frame[IR_FRAME_MAX];
+  IrKeyTracker keys;
+  for (;;) {
+    size_t n = hal::irRxRead(frame, IR_FRAME_MAX, REMOTE_READ_TIMEOUT_MS);
+    if (!n) continue;
+    framesSeen.fetch_add(1, std::memory_order_relaxed);
+    IrFrame f = irDecodeNec(frame, n);
+    if (f.type == IR_FRAME_NONE) undecoded.fetch_add(1, std::memory_order_relaxed);
+    uint32_t code;
+    if (!keys.press(f, hal::millis(), &code)) continue;
+    presses.fetch_add(1, std::memory_order_relaxed);
+    int k = irRemoteKey(code);
+    if (k >= 0) irRemoteApply(IR_REMOTE_KEYS[k]);
+    logEvent(LOG_REMOTE_KEY, (uint8_t)(k + 1), code);
+  }
+}
+
+} // namespace
+
+IrFrame irDecodeNec(const uint16_t* d, size_t n) {
+  IrFrame none = {IR_FRAME_NONE, 0};
+  if (n < NEC_REPEAT_LEN || !headerMark(d[0])) return none;
+  if (n == NEC_REPEAT_LEN) {
+    if (near(d[1], NEC_RPT_SPACE) && near(d[2], NEC_BIT_MARK)) return {IR_FRAME_REPEAT, 0};
+    return none;
+  }
+  if (n != NEC_CODE_LEN || !near(d[1], NEC_HDR_SPACE)) return none;
+  uint32_t code = 0;
+  for (int i = 0; i < NEC_BITS; i++) {
+    uint16_t mark = d[2 + 2 * i], space = d[3 + 2 * i];
+    if (!bitMark(mark) || !bitSpace(space)) return none;
+    code = code << 1 | (space >= NEC_BIT_SPLIT);
+  }
+  if (!bitMark(d[NEC_CODE_LEN - 1])) return none;
+  // the command byte is followed by its inverse (the address need not be:
+  // extended NEC uses all 16 bits)
+  if ((((code >> 8) ^ code) & 0xFF) != 0xFF) return none;
+  return {IR_FRAME_CODE, code};
+}
+
+bool IrKeyTracker::press(const IrFrame& frame, uint32_t nowMs, uint32_t* code) {
+  bool held = active_ && nowMs - lastMs_ < IR_REMOTE_HOLD_MS;
+  if (frame.type == IR_FRAME_REPEAT) {
+    if (held) lastMs_ = nowMs;
+    return false;
+  }
+  if (frame.type != IR_FRAME_CODE) return false;
+  bool fresh = !held || frame.code != lastCode_;
+  active_ = true;
+  lastCode_ = frame.code;
+  lastMs_ = nowMs;
+  if (fresh) *code = frame.code;
+  return fresh;
+}
+
+int irRemoteKey(uint32_t code) {
+  for (size_t i = 0; i < sizeof(IR_REMOTE_KEYS) / sizeof(IR_REMOTE_KEYS[0]); i++) {
+    if (IR_REMOTE_KEYS[i].code == code) return (int)i;
+  }
+  return -1;
+}
+
+bool irRemoteApply(const IrKey& key) {
+  switch (key.action) {
+    case IR_KEY_TOGGLE: {
+      if (key.arg < 1 || key.arg > (uint32_t)NUM_RELAYS) return false;
+      RelayCommand cmd = {(uint8_t)key.arg, RELAY_OP_TOGGLE, SRC_REMOTE};
+      return submitWaiting(&cmd, 1);
+    }
+    case IR_KEY_MODE:
+      if (key.arg > RELAY4_MODE_AUTO) return false;
+      commandRelay4Mode((Relay4Mode)key.arg, SRC_REMOTE);
+      return true;
+    case IR_KEY_SCENE: {
+      RelayCommand cmds[RELAY_BATCH_MAX];
+      for (int first = 1; first <= NUM_RELAYS; first += RELAY_BATCH_MAX) {
+        int n = 0;
+        for (int r = first; r <= NUM_RELAYS && n < RELAY_BATCH_MAX; r++, n++) {
+          cmds[n] = {(uint8_t)r, (key.arg >> (r - 1)) & 1 ? RELAY_OP_ON : RELAY_OP_OFF, SRC_REMOTE};
+        }
+        if (!submitWaiting(cmds, n)) return false;
+      }
+      return true;
+    }
+    case IR_KEY_SAVED_SCENE:
+      return sceneApplySlot((int)key.arg, SRC_REMOTE) == SCENE_OK;
+    case IR_KEY_PEER_TOGGLE:
+      return peerCommand((uint16_t)(key.arg >> 8), (uint8_t)key.arg, RELAY_OP_TOGGLE, SRC_REMOTE) == PEER_OK;
+  }
+  return false;
+}
+
+void irRemoteStart() {
+  static bool started = false;
+  if (started || IR_REMOTE_PIN < 0) return;
+  started = true;
+  if (!hal::irRxBegin(IR_REMOTE_PIN, IR_RX_IDLE_US)) return;
+  hal::taskSpawn("remote", remoteTask, nullptr, REMOTE_TASK_STACK, REMOTE_TASK_PRIO, REMOTE_TASK_CORE);
+}
+
+IrRemoteStats irRemoteStats() {
+  return {framesSeen.load(std::memory_order_relaxed), undecoded.load(std::memory_order_relaxed),
+          presses.load(std::memory_order_relaxed)};
+}
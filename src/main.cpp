@@ -1,69 +1,61 @@
 #include <Arduino.h>
 
 // src/main.cpp
-// ESP32: STA-first, AP-fallback (exclusive) + SinricPro (3 cloud switches) + 4 relays
-// IMPORTANT: HTTP server + WebSocket are ONLY started in AP mode (setup). When STA connects, servers are NOT running.
+// ESP32: STA-first, AP-fallback + SinricPro (3 cloud switches) + 4 relays
+// HTTP + WebSocket (/ws) are served by ESPAsyncWebServer on port 80 in every WiFi mode:
+// on the setup AP while it is up (wifi_manager.h decides when) and on the LAN once STA joins.
+// Work is split into FreeRTOS tasks (see "Tasks" below); relay pins are owned by relay_control.cpp.
 
 #include <WiFi.h>
-#include <WebServer.h>
+#include <ESPAsyncWebServer.h>
 #include <Preferences.h>
 #include <SinricPro.h>
 #include <SinricProSwitch.h>
-#include <WebSocketsServer.h>
 
-// -------- USER CONFIG --------
-const char* FALLBACK_SSID = "WIFI_SSID"; //change with your config (it will be used as default wifi can be changed later)
-const char* FALLBACK_PASS = "WIFI_PASSWORD";
-
-const char* APP_KEY = "YOUR_APP_KEY";
-const char* APP_SECRET = "YOUR_APP_SECRET";
-
-const String DEVICE_ID_1 = "XXXXXXXXXXXXXXXXXXXXXXXX";  // put device IDs from sinric pro
-const String DEVICE_ID_2 = "XXXXXXXXXXXXXXXXXXXXXXXX";
-const String DEVICE_ID_3 = "XXXXXXXXXXXXXXXXXXXXXXXX";
-
-const int RELAY_PIN_1 = 16;
-const int RELAY_PIN_2 = 17;
-const int RELAY_PIN_3 = 18;
-const int RELAY_PIN_4 = 19; // local-only
-
-// *** NEW: IR proximity sensor analog pin & thresholds
-const int IR_PIN = 34;                  // ADC pin for IR sensor (change if needed)
-const int IR_ON_MIN = 2600;             // 2800 - 200
-const int IR_ON_MAX = 3000;             // 2800 + 200
-
-const bool RELAY_ACTIVE_LOW = true;  // for active low relays
-
-#define BOOT_BUTTON_PIN 0
-const unsigned long WIFI_CONNECT_TIMEOUT_MS = 20000UL; // 20s
-const char* AP_PREFIX = "ESP32-Setup-";
-const int LED_PIN = LED_BUILTIN; // GPIO2
-// -------------------------------
-
-// HTTP server (AP-mode setup)
-WebServer server(80);
+#include "cloud_sync.h"
+#include "config.h"
+#include "event_log.h"
+#include "hal.h"
+#include "ir_filter.h"
+#include "ir_remote.h"
+#include "metrics.h"
+#include "mqtt_link.h"
+#include "ota_update.h"
+#include "peer_link.h"
+#include "power_manager.h"
+#include "relay_control.h"
+#include "relay_timers.h"
+#include "rules.h"
+#include "scenes.h"
+#include "state_journal.h"
+#include "state_json.h"
+#include "web_ui_gz.h"
+#include "wifi_manager.h"
+#include "wifi_scan.h"
+#include "ws_protocol.h"
+#include "ws_stream.h"
+
+// HTTP + WebSocket server. Handlers run in the AsyncTCP task, not in netTask:
+// they only queue relay commands and read state that is safe to share.
+AsyncWebServer server(80);
+AsyncWebSocket ws("/ws");
 Preferences prefs;
 
-// WebSocket server (only started in AP mode)
-WebSocketsServer webSocket = WebSocketsServer(81);
-
-// state
-String apSSID;
-bool serverRunning = false;   // true when AP server (HTTP) is running
-bool wsRunning = false;       // true when websocket started (AP)
-volatile int wsClients = 0;   // connected WS clients
+// relay states + relay 4 mode live in relay_control (single writer: control task)
 
-bool relayState1 = false;
-bool relayState2 = false;
-bool relayState3 = false;
-bool relayState4 = false;
+// *** NEW: last IR reading (filtered, see irTask)
+volatile int irRaw = 0;
+volatile bool cloudRunning = false;  // set once SinricPro.begin() has run
 
-// *** NEW: mode for local relay 4
-enum Relay4Mode { RELAY4_MODE_OFF, RELAY4_MODE_ON, RELAY4_MODE_AUTO };
-Relay4Mode relay4Mode = RELAY4_MODE_OFF;
-
-// *** NEW: last IR raw value
-int irRaw = 0;
+// Task layout: network + cloud + MQTT (mqtt_link.cpp) on core 0 (next to the
+// WiFi stack), relay control (relay_control.cpp) + IR sampling + the IR
+// remote (ir_remote.cpp) on core 1.
+// On battery the polling periods stretch to POWER_BACKUP_POLL_MS (power_manager.h).
+const uint32_t NET_POLL_MS = 2;
+const uint32_t CLOUD_POLL_MS = 5;
+const uint32_t LED_TICK_MS = 20;
+const int SCAN_PUSH_PER_TICK = 4;     // scan results streamed to WS per net tick
+const uint32_t WS_CLEANUP_MS = 1000;  // drop closed / surplus WS clients this often
 
 // LED: simple status indicator (kept for local indication)
 enum LedMode { LED_OFF, LED_SOLID, LED_FAST, LED_SLOW, LED_PATTERN };
@@ -77,73 +69,68 @@ bool patternLedState = false;
 const unsigned long PATTERN_ON_MS = 200;
 const unsigned long PATTERN_OFF_MS = 200;
 
-String generateAPSSID() {
-  uint8_t mac[6];
-  WiFi.macAddress(mac);
-  char tail[8];
-  sprintf(tail, "%02X%02X", mac[4], mac[5]);
-  return String(AP_PREFIX) + String(tail);
-}
-
-inline void writeRelay(int pin, bool on) {
-  if (RELAY_ACTIVE_LOW) digitalWrite(pin, on ? LOW : HIGH);
-  else digitalWrite(pin, on ? HIGH : LOW);
-}
-
-int deviceIdToPin(const String &deviceId) {
-  if (deviceId == DEVICE_ID_1) return RELAY_PIN_1;
-  if (deviceId == DEVICE_ID_2) return RELAY_PIN_2;
-  if (deviceId == DEVICE_ID_3) return RELAY_PIN_3;
-  return -1;
-}
-bool* deviceIdToState(const String &deviceId) {
-  if (deviceId == DEVICE_ID_1) return &relayState1;
-  if (deviceId == DEVICE_ID_2) return &relayState2;
-  if (deviceId == DEVICE_ID_3) return &relayState3;
-  return nullptr;
-}
-
-// *** NEW: helper to broadcast relay state array over WS
-void broadcastRelayStates() {
-  if (!wsRunning) return;
-  String msg = String("{\"relay_states\":[") +
-               (relayState1 ? "true" : "false") + "," +
-               (relayState2 ? "true" : "false") + "," +
-               (relayState3 ? "true" : "false") + "," +
-               (relayState4 ? "true" : "false") + "]}";
-  webSocket.broadcastTXT(msg);
+// State JSON for /status (WS clients get the seq/delta stream from ws_stream.cpp).
+// Writes into the caller's buffer (size it with STATE_JSON_MAX); no heap use.
+size_t buildStateJson(char* out, size_t cap, uint8_t fields) {
+  StateSnapshot st;
+  st.relayMask = relayStateMask();
+  char ip[16] = "";
+  if (fields & STATE_STATUS) {
+    st.wifiConnected = (WiFi.status() == WL_CONNECTED);
+    if (st.wifiConnected) {
+      IPAddress a = WiFi.localIP();
+      snprintf(ip, sizeof(ip), "%u.%u.%u.%u", a[0], a[1], a[2], a[3]);
+    }
+    wifi_mode_t m = WiFi.getMode();
+    if (m == WIFI_AP) st.mode = "AP";
+    else if (m == WIFI_AP_STA) st.mode = "AP+STA";
+    else if (st.wifiConnected) st.mode = "STA";
+    else st.mode = "UNKNOWN";
+    st.staIp = ip;
+    st.apSsid = wifiManagerApSsid();
+    st.irValue = irRaw;
+    st.relay4Mode = relay4Mode();
+  }
+  return serializeState(out, cap, st, fields);
 }
 
-// SinricPro callback
+// SinricPro callback (cloud task). The control task applies it; the net task streams it to WS clients.
+// Refused while a local change to the relay has not been reported yet (cloud_sync.h).
 bool onPowerState(const String &deviceId, bool &state) {
-  int pin = deviceIdToPin(deviceId);
-  bool *pState = deviceIdToState(deviceId);
-  if (pin < 0 || pState == nullptr) return false;
-  writeRelay(pin, state);
-  *pState = state;
-  Serial.printf("[SinricPro] %s -> %s (pin %d)\n", deviceId.c_str(), state ? "ON":"OFF", pin);
-
-  // If somehow WS running (shouldn't be in STA mode), broadcast state
-  broadcastRelayStates();
+  int r = relayForDeviceId(deviceId.c_str());
+  if (r < 0) return false;
+  if (!cloudSyncAcceptCommand(r, state)) return false;
+  if (!submitRelayCommand(r, state ? RELAY_OP_ON : RELAY_OP_OFF, SRC_CLOUD)) return false;
+  logEvent(LOG_CLOUD_COMMAND, r, state);
   return true;
 }
 
+// SinricPro callback for the SCENE_DEVICES switches: "on" applies the scene,
+// "off" does nothing (the relays are switched on their own).
+bool onScenePowerState(const String &deviceId, bool &state) {
+  if (!state) return true;
+  for (const SceneDeviceDef& def : SCENE_DEVICES) {
+    if (def.deviceId && deviceId == def.deviceId) return sceneApply(def.scene, SRC_CLOUD) == SCENE_OK;
+  }
+  return false;
+}
+
 // LED helpers
 void setLedMode(LedMode m) {
   ledMode = m;
-  patternBlinkCount = 0; patternBlinkTarget = 0; patternLedState = false; patternLastChange = millis(); lastLedToggle = millis();
-  if (m == LED_SOLID) { digitalWrite(LED_PIN, HIGH); ledOnState = true; }
-  if (m == LED_OFF) { digitalWrite(LED_PIN, LOW); ledOnState = false; }
+  patternBlinkCount = 0; patternBlinkTarget = 0; patternLedState = false; patternLastChange = hal::millis(); lastLedToggle = hal::millis();
+  if (m == LED_SOLID) { hal::gpioWrite(LED_PIN, true); ledOnState = true; }
+  if (m == LED_OFF) { hal::gpioWrite(LED_PIN, false); ledOnState = false; }
 }
 
 void updateLed() {
-  unsigned long now = millis();
+  unsigned long now = hal::millis();
   if (ledMode == LED_PATTERN) {
     if (patternBlinkCount < patternBlinkTarget) {
       if (now - patternLastChange >= (patternLedState ? PATTERN_ON_MS : PATTERN_OFF_MS)) {
         patternLastChange = now;
         patternLedState = !patternLedState;
-        digitalWrite(LED_PIN, patternLedState ? HIGH : LOW);
+        hal::gpioWrite(LED_PIN, patternLedState);
         if (!patternLedState) patternBlinkCount++;
       }
     } else {
@@ -151,415 +138,579 @@ void updateLed() {
     }
     return;
   }
-  if (ledMode == LED_SOLID) { digitalWrite(LED_PIN, HIGH); return; }
-  if (ledMode == LED_OFF) { digitalWrite(LED_PIN, LOW); return; }
+  if (ledMode == LED_SOLID) { hal::gpioWrite(LED_PIN, true); return; }
+  if (ledMode == LED_OFF) { hal::gpioWrite(LED_PIN, false); return; }
   unsigned long interval = (ledMode == LED_FAST) ? 120 : 800;
   if (now - lastLedToggle >= interval) {
     lastLedToggle = now;
     ledOnState = !ledOnState;
-    digitalWrite(LED_PIN, ledOnState ? HIGH : LOW);
+    hal::gpioWrite(LED_PIN, ledOnState);
   }
 }
 
-// Try to connect STA only (no AP here)
-bool attemptWiFiConnectSTA(const char* ssid, const char* pass, unsigned long timeout_ms) {
-  Serial.printf("Attempting STA WiFi '%s' (timeout %lu ms)\n", ssid, timeout_ms);
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, pass);
-  unsigned long start = millis();
-  setLedMode(LED_FAST);
-  while (millis() - start < timeout_ms) {
-    if (WiFi.status() == WL_CONNECTED) {
-      Serial.print("STA connected, IP: "); Serial.println(WiFi.localIP());
-      setLedMode(LED_SOLID);
-      return true;
-    }
-    updateLed();
-    delay(30);
-  }
-  Serial.println("STA connect timed out");
-  return false;
+// LED follows the connection manager: solid = STA up, slow = setup AP, fast = joining
+LedMode wifiLedMode() {
+  if (wifiManagerState() == WIFI_STATE_CONNECTED) return LED_SOLID;
+  return wifiManagerApUp() ? LED_SLOW : LED_FAST;
 }
 
 // Forward declarations
 void setupRoutes();
 void startSinricIfConnected();
-void startAPModeAndServer(); // start AP + HTTP server + WS
-void stopAPModeAndServer();  // stop AP + servers
-
-// ------------------ WebSocket event handler (AP mode only) ------------------
-void handleWsEvent(uint8_t num, WStype_t type, uint8_t * payload, size_t length) {
-  if (type == WStype_CONNECTED) {
-    wsClients++;
-    IPAddress ip = webSocket.remoteIP(num);
-    Serial.printf("WS Client %u connected from %d.%d.%d.%d\n", num, ip[0], ip[1], ip[2], ip[3]);
-    // send current state immediately
-    String msg = String("{\"relay_states\":[") +
-                 (relayState1?"true":"false") + "," +
-                 (relayState2?"true":"false") + "," +
-                 (relayState3?"true":"false") + "," +
-                 (relayState4?"true":"false") + "]}";
-    webSocket.sendTXT(num, msg);
+
+// ------------------ WebSocket event handler (AsyncTCP task) ------------------
+void handleWsEvent(AsyncWebSocket*, AsyncWebSocketClient* client, AwsEventType type,
+                   void* arg, uint8_t* data, size_t len) {
+  StageTimer t(STAGE_WS_EVENT);
+  if (type == WS_EVT_CONNECT) {
+    logEvent(LOG_WS_CONNECT, 0, client->id(), logIp(client->remoteIP()));
+    // the net task sends it a snapshot on its next tick
+    if (!wsStreamConnected(client->id())) client->close();
     return;
   }
-  if (type == WStype_DISCONNECTED) {
-    wsClients = max(0, wsClients - 1);
-    Serial.printf("WS Client %u disconnected\n", num);
+  if (type == WS_EVT_DISCONNECT) {
+    logEvent(LOG_WS_DISCONNECT, 0, client->id());
+    wsStreamDisconnected(client->id());
     return;
   }
-  if (type == WStype_TEXT) {
-    String s((char*)payload, length);
-    Serial.printf("WS msg from %u: %s\n", num, s.c_str());
-    if (s.startsWith("toggle:")) {
-      int r = s.substring(7).toInt();
-      if (r >=1 && r <=4) {
-        int pin = (r==1?RELAY_PIN_1: r==2?RELAY_PIN_2: r==3?RELAY_PIN_3:RELAY_PIN_4);
-        bool *ptr = (r==1?&relayState1: r==2?&relayState2: r==3?&relayState3:&relayState4);
-        *ptr = !(*ptr);
-        writeRelay(pin, *ptr);
-
-        // *** NEW: if we manually toggle relay 4 via WS, force mode to ON/OFF
-        if (r == 4) {
-          relay4Mode = (*ptr ? RELAY4_MODE_ON : RELAY4_MODE_OFF);
-        }
-
-        if (WiFi.status() == WL_CONNECTED && r >=1 && r<=3) {
-          SinricProSwitch &sw = SinricPro[(r==1?DEVICE_ID_1: r==2?DEVICE_ID_2: DEVICE_ID_3)];
-          sw.sendPowerStateEvent(*ptr);
-        }
-        // broadcast to all WS clients
-        broadcastRelayStates();
-      }
-    } else if (s == "status") {
-      String msg = String("{\"relay_states\":[") +
-                   (relayState1?"true":"false") + "," +
-                   (relayState2?"true":"false") + "," +
-                   (relayState3?"true":"false") + "," +
-                   (relayState4?"true":"false") + "]}";
-      webSocket.sendTXT(num, msg);
+  if (type == WS_EVT_DATA) {
+    // commands fit in a single frame and are parsed in place (ws_protocol.h)
+    AwsFrameInfo* info = (AwsFrameInfo*)arg;
+    if (!info->final || info->index != 0 || info->len != len) return;
+    if (info->opcode == WS_BINARY) {
+      uint8_t ack[WS_ACK_MAX];
+      size_t n = ws_protocol::execute(data, len, ack, sizeof(ack));
+      client->binary(ack, n);
+      return;
+    }
+    if (info->opcode != WS_TEXT) return;
+    const char* text = (const char*)data;
+    WsCommand cmd;
+    static char reply[RELAY_TIMERS_JSON_MAX];   // AsyncTCP task only; text() copies it
+    static_assert(SCENES_JSON_MAX <= RELAY_TIMERS_JSON_MAX && PEERS_JSON_MAX <= RELAY_TIMERS_JSON_MAX &&
+                  RULES_JSON_MAX <= RELAY_TIMERS_JSON_MAX, "scene, peer and rule replies share the buffer");
+    if (ws_protocol::parseText(text, len, cmd)) {
+      // control task applies it (and forces relay 4 mode ON/OFF); the net task
+      // streams it and the cloud task reports relays 1..3 to SinricPro
+      submitRelayCommand(cmd.arg, RELAY_OP_TOGGLE, SRC_WS);
+    } else if (size_t n = relayTimersCommand(text, len, reply, sizeof(reply))) {
+      client->text(reply, n);   // "timers", "timer:..", "daily:..", "cancel:..", "autooff:.."
+    } else if (size_t n = scenesCommand(text, len, reply, sizeof(reply))) {
+      client->text(reply, n);   // "scenes", "scene:..", "scene_save:..", "scene_delete:.."
+    } else if (size_t n = peersCommand(text, len, reply, sizeof(reply))) {
+      client->text(reply, n);   // "peers", "peer:<node>:<relay>[:op]"
+    } else if (size_t n = rulesCommand(text, len, reply, sizeof(reply))) {
+      client->text(reply, n);   // "rules", "rule:<text>", "rule_delete:<id>"
+    } else {
+      wsStreamCommand(client->id(), text, len);   // "status", "ir:<ms>", "metrics:<ms>"
     }
   }
 }
 
-// ------------------ HTTP endpoints (AP mode only) ------------------
-void setupRoutes() {
-  server.on("/", HTTP_GET, [](){
-    String html = R"rawliteral(
-<!doctype html><html><head><meta charset="utf-8"><meta name="viewport" content="width=device-width,initial-scale=1">
-<title>ESP32 Setup</title>
-<style>
-body{background:#071018;color:#e6eef6;font-family:system-ui;padding:12px}
-.btn{padding:8px 12px;margin:6px;border-radius:8px;background:#1f2937;border:none;color:#e6eef6;cursor:pointer}
-.card{border-radius:10px;background:#0b1522;padding:10px;margin-top:10px}
-</style>
-</head><body>
-<h2>ESP32 Setup (AP)</h2>
-<div id="info">Connecting websocket...</div>
-
-<div class="card">
-  <h3>Relays</h3>
-  <div id="relays"></div>
-</div>
-
-<div class="card">
-  <h3>IR Proximity / Local Relay 4</h3>
-  <div id="ir"></div>
-</div>
-
-<div class="card" id="networks">
-  <h3>WiFi Setup</h3>
-  <button class="btn" onclick="scan()">Scan</button>
-  <div id="ss"></div>
-</div>
-
-<script>
-let ws;
-
-function buildRelays(states){
-  const container = document.getElementById('relays');
-  container.innerHTML = '';
-  for(let i=0;i<4;i++){
-    const b = document.createElement('button');
-    b.className='btn';
-    b.innerText = 'Relay ' + (i+1) + ': ' + (states[i] ? 'ON' : 'OFF');
-    b.onclick = ()=> {
-      if(ws && ws.readyState===1) ws.send('toggle:' + (i+1));
-      else fetch('/toggle?relay=' + (i+1)).then(()=>refresh());
-    };
-    container.appendChild(b);
-  }
-}
-
-// *** NEW: update IR info + mode controls
-function updateIr(j){
-  const d = document.getElementById('ir');
-  const val = typeof j.ir_value !== 'undefined' ? j.ir_value : '-';
-  const mode = j.relay4_mode || 'off';
-  d.innerHTML =
-    'IR value: <b>' + val + '</b><br>' +
-    'Relay 4 mode: <b>' + mode.toUpperCase() + '</b><br>' +
-    '<button class="btn" onclick="setR4Mode(\\'off\\')">Off</button>' +
-    '<button class="btn" onclick="setR4Mode(\\'on\\')">On</button>' +
-    '<button class="btn" onclick="setR4Mode(\\'auto\\')">Auto</button>';
+// ------------------ HTTP endpoints (AsyncTCP task) ------------------
+// server.on() with the handler timed as STAGE_HTTP
+void route(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction fn) {
+  server.on(uri, method, [fn](AsyncWebServerRequest* req){
+    StageTimer t(STAGE_HTTP);
+    fn(req);
+  });
 }
 
-function setR4Mode(m){
-  fetch('/relay4_mode?mode=' + m).then(()=>refresh());
+// form field, or query parameter
+const AsyncWebParameter* param(AsyncWebServerRequest* req, const char* name) {
+  const AsyncWebParameter* p = req->getParam(name, true);
+  return p ? p : req->getParam(name);
 }
 
-function refresh(){
-  fetch('/status').then(r=>r.json()).then(j=>{
-    buildRelays(j.relay_states);
-    updateIr(j);
-  });
+// relay_timers answer: the list, or 400/503 with the reason
+void sendTimers(AsyncWebServerRequest* req, RelayTimerError e) {
+  static char out[RELAY_TIMERS_JSON_MAX];   // AsyncTCP task only; send() copies it
+  if (e != RELAY_TIMER_OK) {
+    req->send(e == RELAY_TIMER_FULL ? 503 : e == RELAY_TIMER_NOT_FOUND ? 404 : 400, "text/plain", relayTimerErrorName(e));
+    return;
+  }
+  relayTimersJson(out, sizeof(out));
+  req->send(200, "application/json", out);
 }
 
-function scan(){
-  fetch('/scan').then(r=>r.json()).then(arr=>{
-    const ss = document.getElementById('ss');
-    ss.innerHTML='';
-    arr.forEach(a=>{
-      const d=document.createElement('div');
-      d.innerHTML = '<b>'+a.ssid+'</b> ('+a.rssi+' dBm) <button class="btn" onclick="useS(\\''+a.ssid+'\\')">Use</button>';
-      ss.appendChild(d);
-    });
-  });
+// scenes answer: the list, or 400/404/503 with the reason
+void sendScenes(AsyncWebServerRequest* req, SceneError e) {
+  static char out[SCENES_JSON_MAX];   // AsyncTCP task only; send() copies it
+  if (e != SCENE_OK) {
+    req->send(e == SCENE_BUSY || e == SCENE_FULL ? 503 : e == SCENE_NOT_FOUND ? 404 : 400, "text/plain",
+              sceneErrorName(e));
+    return;
+  }
+  scenesJson(out, sizeof(out));
+  req->send(200, "application/json", out);
 }
 
-function useS(ssid){
-  const pass = prompt('Password for '+ssid);
-  if(pass===null) return;
-  const data = new URLSearchParams();
-  data.append('ssid', ssid);
-  data.append('pass', pass);
-  fetch('/save', {method:'POST', body:data}).then(r=>r.text()).then(t=>alert(t));
+// rules answer: the list, or 400/404/503 with the reason
+void sendRules(AsyncWebServerRequest* req, RuleError e) {
+  static char out[RULES_JSON_MAX];   // AsyncTCP task only; send() copies it
+  if (e != RULE_OK) {
+    req->send(e == RULE_FULL ? 503 : e == RULE_NOT_FOUND ? 404 : 400, "text/plain", ruleErrorName(e));
+    return;
+  }
+  rulesJson(out, sizeof(out));
+  req->send(200, "application/json", out);
 }
 
-function tryWebsocket(){
-  const host = window.location.hostname;
-  try {
-    ws = new WebSocket('ws://' + host + ':81');
-    ws.onopen = ()=> { document.getElementById('info').innerText='WebSocket connected'; ws.send('status'); };
-    ws.onmessage = (evt)=> {
-      try {
-        const j = JSON.parse(evt.data);
-        buildRelays(j.relay_states);
-      } catch(e){ console.log('ws msg', evt.data); }
-    };
-    ws.onclose = ()=> { document.getElementById('info').innerText='WebSocket closed (falling back to HTTP)'; setTimeout(tryWebsocket,2000); };
-    ws.onerror = ()=> { document.getElementById('info').innerText='WebSocket error'; setTimeout(tryWebsocket,2000); };
-  } catch(e){
-    document.getElementById('info').innerText='WebSocket not available';
-  }
+// POST /update checks shared by its body and request handlers: an HTTP
+// status if the upload is refused outright, else 0 (and the expected digest)
+int otaRequestRefusal(AsyncWebServerRequest* req, uint8_t* digest) {
+  if (!OTA_PASSWORD[0]) return 403;
+  if (!req->authenticate(OTA_USER, OTA_PASSWORD)) return 401;
+  const AsyncWebHeader* sha = req->getHeader("X-Firmware-SHA256");
+  uint8_t scratch[32];
+  if (!req->contentLength() || !sha || !otaParseDigest(sha->value().c_str(), digest ? digest : scratch)) return 400;
+  return 0;
 }
 
-tryWebsocket();
-setInterval(refresh, 5000);
-</script>
-</body></html>
-)rawliteral";
-    server.send(200, "text/html", html);
+void setupRoutes() {
+  // UI page: gzipped at build time (web/index.html -> web_ui_gz.h) and streamed
+  // from flash; repeat loads revalidate with the ETag and get a 304.
+  route("/", HTTP_GET, [](AsyncWebServerRequest* req){
+    const AsyncWebHeader* inm = req->getHeader("If-None-Match");
+    bool fresh = inm && inm->value() == WEB_UI_ETAG;
+    AsyncWebServerResponse* res = fresh ? req->beginResponse(304)
+                                        : req->beginResponse(200, "text/html", WEB_UI_GZ, WEB_UI_GZ_LEN);
+    if (!fresh) res->addHeader("Content-Encoding", "gzip");
+    res->addHeader("ETag", WEB_UI_ETAG);
+    res->addHeader("Cache-Control", "no-cache");
+    req->send(res);
   });
 
-  server.on("/scan", HTTP_GET, [](){
-    int n = WiFi.scanNetworks();
-    String out = "[";
-    for (int i = 0; i < n; ++i) {
-      String ssid = WiFi.SSID(i);
-      int rssi = WiFi.RSSI(i);
-      bool sec = (WiFi.encryptionType(i) != WIFI_AUTH_OPEN);
-      out += "{\"ssid\":\"" + ssid + "\",\"rssi\":" + String(rssi) + ",\"secure\":" + (sec ? "true":"false") + "}";
-      if (i < n-1) out += ",";
-    }
-    out += "]";
-    if (n > 0) WiFi.scanDelete();
-    server.send(200, "application/json", out);
+  // Answers from the scan cache at once. A stale or empty cache queues a
+  // background scan; netTask pushes its results to WS clients as they land.
+  route("/scan", HTTP_GET, [](AsyncWebServerRequest* req){
+    bool running = wifiScanRequest();
+    static char out[SCAN_JSON_MAX];   // AsyncTCP task only; send() copies it
+    wifiScanJson(out, sizeof(out));
+    AsyncWebServerResponse* res = req->beginResponse(200, "application/json", out);
+    res->addHeader("X-Scan-Running", running ? "1" : "0");
+    req->send(res);
   });
 
-  server.on("/save", HTTP_POST, [](){
-    if (!server.hasArg("ssid")) { server.send(400, "text/plain", "Missing ssid"); return; }
-    String ssid = server.arg("ssid");
-    String pass = server.arg("pass");
+  route("/save", HTTP_POST, [](AsyncWebServerRequest* req){
+    if (!req->hasParam("ssid", true)) { req->send(400, "text/plain", "Missing ssid"); return; }
+    String ssid = req->getParam("ssid", true)->value();
+    String pass = req->hasParam("pass", true) ? req->getParam("pass", true)->value() : String();
     prefs.begin("wifi", false);
     prefs.putString("ssid", ssid);
     prefs.putString("pass", pass);
     prefs.end();
-    server.send(200, "text/plain", "Saved credentials — attempting to connect...");
-    delay(200);
-
-    // stop AP and servers
-    if (wsRunning) {
-      webSocket.disconnect(); // disconnect clients
-      wsRunning = false;
-    }
-    if (serverRunning) {
-      server.stop();
-      serverRunning = false;
-    }
-    WiFi.softAPdisconnect(true);
-    delay(200);
-
-    // try STA connect
-    bool ok = attemptWiFiConnectSTA(ssid.c_str(), pass.c_str(), 15000);
-    if (ok) {
-      startSinricIfConnected();
-      // Do NOT start HTTP or WS in STA mode (explicitly stopped)
-      Serial.println("Connected to STA after saving creds — SinricPro running, servers remain stopped.");
-    } else {
-      // fallback: restart AP+server so user can retry
-      WiFi.mode(WIFI_AP);
-      apSSID = generateAPSSID();
-      WiFi.softAP(apSSID.c_str());
-      delay(120);
-      setupRoutes();
-      server.begin();
-      serverRunning = true;
-      webSocket.begin();
-      webSocket.onEvent(handleWsEvent);
-      wsRunning = true;
-      Serial.println("Connect failed — returned to AP mode with servers.");
-    }
+    // the manager keeps the AP up while it tries them (picked up by netTask)
+    wifiManagerConnect(ssid.c_str(), pass.c_str());
+    req->send(200, "text/plain", "Saved credentials — connecting; this page stays up until it works.");
   });
 
-  server.on("/toggle", HTTP_GET, [](){
-    if (!server.hasArg("relay")) { server.send(400, "text/plain", "Missing relay"); return; }
-    int r = server.arg("relay").toInt();
-    if (r < 1 || r > 4) { server.send(400, "text/plain", "relay must be 1..4"); return; }
-    int pin = (r==1?RELAY_PIN_1: r==2?RELAY_PIN_2: r==3?RELAY_PIN_3:RELAY_PIN_4);
-    bool *ptr = (r==1?&relayState1: r==2?&relayState2: r==3?&relayState3:&relayState4);
-    *ptr = !(*ptr);
-    writeRelay(pin, *ptr);
-
-    // *** NEW: if relay 4 toggled via HTTP, force mode
-    if (r == 4) {
-      relay4Mode = (*ptr ? RELAY4_MODE_ON : RELAY4_MODE_OFF);
-    }
-
-    if (WiFi.status() == WL_CONNECTED && r >=1 && r<=3) {
-      SinricProSwitch &sw = SinricPro[(r==1?DEVICE_ID_1: r==2?DEVICE_ID_2: DEVICE_ID_3)];
-      sw.sendPowerStateEvent(*ptr);
-    }
-    // broadcast over ws (if running)
-    broadcastRelayStates();
-    server.send(200, "text/plain", "OK");
+  route("/toggle", HTTP_GET, [](AsyncWebServerRequest* req){
+    if (!req->hasParam("relay")) { req->send(400, "text/plain", "Missing relay"); return; }
+    int r = req->getParam("relay")->value().toInt();
+    if (r < 1 || r > NUM_RELAYS) { req->send(400, "text/plain", "relay out of range"); return; }
+    if (!submitRelayCommand(r, RELAY_OP_TOGGLE, SRC_HTTP)) { req->send(503, "text/plain", "busy"); return; }
+    req->send(200, "text/plain", "OK");
   });
 
   // *** NEW: endpoint to set relay 4 mode (off/on/auto)
-  server.on("/relay4_mode", HTTP_GET, [](){
-    if (!server.hasArg("mode")) { server.send(400, "text/plain", "Missing mode"); return; }
-    String m = server.arg("mode");
+  route("/relay4_mode", HTTP_GET, [](AsyncWebServerRequest* req){
+    if (!req->hasParam("mode")) { req->send(400, "text/plain", "Missing mode"); return; }
+    String m = req->getParam("mode")->value();
     Relay4Mode newMode;
     if (m == "off") newMode = RELAY4_MODE_OFF;
     else if (m == "on") newMode = RELAY4_MODE_ON;
     else if (m == "auto") newMode = RELAY4_MODE_AUTO;
-    else { server.send(400, "text/plain", "mode must be off|on|auto"); return; }
+    else { req->send(400, "text/plain", "mode must be off|on|auto"); return; }
+
+    // AUTO: relay will be updated by irTask based on IR sensor
+    commandRelay4Mode(newMode, SRC_HTTP);
+
+    req->send(200, "text/plain", "OK");
+  });
+
+  route("/status", HTTP_GET, [](AsyncWebServerRequest* req){
+    char out[STATE_JSON_MAX];
+    buildStateJson(out, sizeof(out), STATE_FULL);
+    req->send(200, "application/json", out);
+  });
+
+  // Timed actions (relay_timers.h). POST /timers: relay, op (on|off|toggle)
+  // and either in=<seconds> or at=HH:MM [days=<weekday mask>]. Sub-paths go
+  // first: a handler for /timers also matches /timers/...
+  route("/timers/cancel", HTTP_POST, [](AsyncWebServerRequest* req){
+    const AsyncWebParameter* id = param(req, "id");
+    uint32_t n;
+    sendTimers(req, id && relayTimerParseUint(id->value().c_str(), n) ? relayTimerCancel(n) : RELAY_TIMER_NOT_FOUND);
+  });
+
+  route("/timers", HTTP_GET, [](AsyncWebServerRequest* req){ sendTimers(req, RELAY_TIMER_OK); });
+
+  route("/timers", HTTP_POST, [](AsyncWebServerRequest* req){
+    const AsyncWebParameter* relay = param(req, "relay");
+    const AsyncWebParameter* opName = param(req, "op");
+    const AsyncWebParameter* in = param(req, "in");
+    const AsyncWebParameter* at = param(req, "at");
+    const AsyncWebParameter* days = param(req, "days");
+    if (!relay || !opName || !in == !at) { req->send(400, "text/plain", "Need relay, op and one of in, at"); return; }
+    RelayOp op;
+    if (!relayTimerParseOp(opName->value().c_str(), op)) { sendTimers(req, RELAY_TIMER_BAD_OP); return; }
+    uint32_t r;
+    uint8_t n = !relayTimerParseUint(relay->value().c_str(), r) || r < 1 || r > NUM_RELAYS ? 0 : (uint8_t)r;
+    uint32_t id;
+    if (in) {
+      uint32_t s;
+      sendTimers(req, relayTimerParseUint(in->value().c_str(), s) ? relayTimerAddOnce(n, op, s, &id)
+                                                                  : RELAY_TIMER_BAD_TIME);
+      return;
+    }
+    uint16_t minute;
+    uint32_t mask = RELAY_TIMER_EVERY_DAY;
+    if (!relayTimerParseTime(at->value().c_str(), minute) || (days && !relayTimerParseUint(days->value().c_str(), mask)) ||
+        mask < 1 || mask > RELAY_TIMER_EVERY_DAY) {
+      sendTimers(req, RELAY_TIMER_BAD_TIME);
+      return;
+    }
+    sendTimers(req, relayTimerAddDaily(n, op, minute, (uint8_t)mask, &id));
+  });
 
-    relay4Mode = newMode;
+  // auto-off after s seconds on (0 = never), whichever input turned the relay on
+  route("/auto_off", HTTP_POST, [](AsyncWebServerRequest* req){
+    const AsyncWebParameter* relay = param(req, "relay");
+    const AsyncWebParameter* s = param(req, "s");
+    if (!relay || !s) { req->send(400, "text/plain", "Need relay and s"); return; }
+    uint32_t r, seconds;
+    if (!relayTimerParseUint(s->value().c_str(), seconds)) { sendTimers(req, RELAY_TIMER_BAD_TIME); return; }
+    bool ok = relayTimerParseUint(relay->value().c_str(), r) && r >= 1 && r <= NUM_RELAYS;
+    sendTimers(req, relayTimerSetAutoOff(ok ? (uint8_t)r : 0, seconds));
+  });
+
+  // Scenes (scenes.h). POST /scenes: name, on=<relay list> (default: the
+  // relays on now), relays=<relay list> (default: all), e.g. on=1,3&relays=1,2,3.
+  // Sub-paths first, as for /timers.
+  route("/scenes/apply", HTTP_POST, [](AsyncWebServerRequest* req){
+    const AsyncWebParameter* name = param(req, "name");
+    SceneError e = name ? sceneApply(name->value().c_str(), SRC_HTTP) : SCENE_NOT_FOUND;
+    if (e == SCENE_OK) req->send(200, "text/plain", "OK");
+    else sendScenes(req, e);
+  });
+
+  route("/scenes/delete", HTTP_POST, [](AsyncWebServerRequest* req){
+    const AsyncWebParameter* name = param(req, "name");
+    sendScenes(req, name ? sceneDelete(name->value().c_str()) : SCENE_NOT_FOUND);
+  });
 
-    if (relay4Mode == RELAY4_MODE_OFF) {
-      relayState4 = false;
-      writeRelay(RELAY_PIN_4, relayState4);
-    } else if (relay4Mode == RELAY4_MODE_ON) {
-      relayState4 = true;
-      writeRelay(RELAY_PIN_4, relayState4);
+  route("/scenes", HTTP_GET, [](AsyncWebServerRequest* req){ sendScenes(req, SCENE_OK); });
+
+  route("/scenes", HTTP_POST, [](AsyncWebServerRequest* req){
+    const AsyncWebParameter* name = param(req, "name");
+    const AsyncWebParameter* on = param(req, "on");
+    const AsyncWebParameter* relays = param(req, "relays");
+    if (!name) { req->send(400, "text/plain", "Need name"); return; }
+    uint32_t onMask = relayStateMask(), relayMask = SCENE_DEFAULT_RELAYS;
+    if ((on && !sceneParseRelays(on->value().c_str(), onMask)) ||
+        (relays && !sceneParseRelays(relays->value().c_str(), relayMask))) {
+      sendScenes(req, SCENE_BAD_RELAYS);
+      return;
     }
-    // AUTO: relay will be updated in loop() based on IR sensor
+    sendScenes(req, sceneSave(name->value().c_str(), relayMask, on ? onMask : onMask & relayMask));
+  });
+
+  // Automation rules (rules.h). POST /rules: text=if <condition> then <action>,
+  // e.g. "if ir and not relay1 then relay3 on for 5m". Sub-path first, as
+  // for /timers.
+  route("/rules/delete", HTTP_POST, [](AsyncWebServerRequest* req){
+    const AsyncWebParameter* id = param(req, "id");
+    const char* text = id ? id->value().c_str() : "";
+    char* end;
+    long n = strtol(text, &end, 10);
+    sendRules(req, end == text || *end ? RULE_NOT_FOUND : ruleDelete((int)n));
+  });
+
+  route("/rules", HTTP_GET, [](AsyncWebServerRequest* req){ sendRules(req, RULE_OK); });
+
+  route("/rules", HTTP_POST, [](AsyncWebServerRequest* req){
+    const AsyncWebParameter* text = param(req, "text");
+    if (!text) { req->send(400, "text/plain", "Need text"); return; }
+    sendRules(req, ruleAdd(text->value().c_str(), nullptr));
+  });
+
+  // Other controllers on the ESP-NOW peer link (peer_link.h). POST
+  // /peers/relay: node, relay, op (on|off|toggle, default toggle); answered
+  // once the command is on its way. Sub-path first, as for /timers.
+  route("/peers/relay", HTTP_POST, [](AsyncWebServerRequest* req){
+    const AsyncWebParameter* node = param(req, "node");
+    const AsyncWebParameter* relay = param(req, "relay");
+    const AsyncWebParameter* opName = param(req, "op");
+    if (!node || !relay) { req->send(400, "text/plain", "Need node and relay"); return; }
+    RelayOp op = RELAY_OP_TOGGLE;
+    uint32_t n, r;
+    PeerError e = PEER_BAD_RELAY;
+    if (!relayTimerParseUint(node->value().c_str(), n) || n < 1 || n > 0xFFFF) e = PEER_UNKNOWN_NODE;
+    else if (relayTimerParseUint(relay->value().c_str(), r) && r >= 1 && r <= 32 &&
+             (!opName || relayTimerParseOp(opName->value().c_str(), op)))
+      e = peerCommand((uint16_t)n, (uint8_t)r, op, SRC_HTTP);
+    static const int CODES[] = {200, 404, 400, 503, 504};   // by PeerError
+    req->send(CODES[e], "text/plain", e == PEER_OK ? "OK" : peerErrorName(e));
+  });
+
+  route("/peers", HTTP_GET, [](AsyncWebServerRequest* req){
+    static char out[PEERS_JSON_MAX];   // AsyncTCP task only; send() copies it
+    peersJson(out, sizeof(out));
+    req->send(200, "application/json", out);
+  });
+
+  // Prometheus text; the same data goes to WS clients as "metrics:<ms>"
+  route("/metrics", HTTP_GET, [](AsyncWebServerRequest* req){
+    static char out[METRICS_TEXT_MAX];   // AsyncTCP task only; send() copies it
+    MetricsGauges g;
+    g.wsClients = ws.count();
+    g.irValue = irRaw;
+    metricsPrometheus(out, sizeof(out), g);
+    req->send(200, "text/plain; version=0.0.4", out);
+  });
 
-    broadcastRelayStates();
-    server.send(200, "text/plain", "OK");
+  // Recent event history (event_log.h): text, or ?format=bin for tools/decode_log.py
+  route("/log", HTTP_GET, [](AsyncWebServerRequest* req){
+    alignas(4) static uint8_t dump[EVENT_LOG_DUMP_MAX];   // AsyncTCP task only; the stream copies it
+    size_t len = eventLogDump(dump, sizeof(dump));
+    const AsyncWebParameter* format = req->getParam("format");
+    if (format && format->value() == "bin") {
+      AsyncResponseStream* res = req->beginResponseStream("application/octet-stream");
+      res->write(dump, len);
+      req->send(res);
+      return;
+    }
+    AsyncResponseStream* res = req->beginResponseStream("text/plain");
+    const LogRecord* records = (const LogRecord*)(dump + sizeof(LogDumpHeader));
+    char line[EVENT_LOG_LINE_MAX];
+    for (size_t i = 0; i < (len - sizeof(LogDumpHeader)) / sizeof(LogRecord); i++) {
+      eventLogFormat(line, sizeof(line), records[i]);
+      res->print(line);
+      res->print("\n");
+    }
+    req->send(res);
   });
 
-  server.on("/status", HTTP_GET, [](){
-    bool wifiConnected = (WiFi.status() == WL_CONNECTED);
-    String staIp = wifiConnected ? WiFi.localIP().toString() : String("");
-    String modeStr;
-    if (WiFi.getMode() == WIFI_AP) modeStr = "AP";
-    else if (wifiConnected) modeStr = "STA";
-    else modeStr = "UNKNOWN";
-
-    String relay4ModeStr = (relay4Mode == RELAY4_MODE_OFF) ? "off" :
-                           (relay4Mode == RELAY4_MODE_ON)  ? "on"  : "auto";
-
-    String out = "{";
-    out += "\"mode\":\"" + modeStr + "\",";
-    out += "\"wifi_connected\":" + String(wifiConnected ? "true":"false") + ",";
-    out += "\"sta_ip\":\"" + staIp + "\",";
-    out += "\"ap_ssid\":\"" + apSSID + "\",";
-    out += "\"ir_value\":" + String(irRaw) + ",";
-    out += "\"relay4_mode\":\"" + relay4ModeStr + "\",";
-    out += "\"relay_states\":[" +
-           String(relayState1?"true":"false") + "," +
-           String(relayState2?"true":"false") + "," +
-           String(relayState3?"true":"false") + "," +
-           String(relayState4?"true":"false") + "]";
-    out += "}";
-    server.send(200, "application/json", out);
+  // Firmware update (ota_update.h): the body is flashed as it arrives and
+  // checked against X-Firmware-SHA256; the answer comes once it is verified.
+  server.on("/update", HTTP_POST, [](AsyncWebServerRequest* req){
+    StageTimer t(STAGE_HTTP);
+    if (int code = otaRequestRefusal(req, nullptr)) {
+      if (code == 401) req->requestAuthentication("ota", false);
+      else req->send(code, "text/plain", code == 403 ? "OTA_PASSWORD is not set" : "Need a body and X-Firmware-SHA256");
+      return;
+    }
+    OtaError e = otaUploadFinish(req);
+    static const int CODES[] = {200, 409, 413, 422, 422, 500, 408, 400};   // by OtaError
+    req->send(CODES[e], "text/plain", e == OTA_OK ? "Verified; restarting into the new firmware" : otaErrorName(e));
+  }, nullptr, [](AsyncWebServerRequest* req, uint8_t* data, size_t len, size_t index, size_t total){
+    StageTimer t(STAGE_HTTP);
+    uint8_t digest[32];
+    if (index == 0 && !otaRequestRefusal(req, digest)) otaUploadStart(req, total, digest);
+    otaUploadData(req, data, len);   // refusals and failures are answered above
   });
 
-  server.onNotFound([](){ server.send(404, "text/plain", "Not found"); });
+  server.onNotFound([](AsyncWebServerRequest* req){ req->send(404, "text/plain", "Not found"); });
+
+  wsStreamBegin(&ws);
+  ws.onEvent(handleWsEvent);
+  server.addHandler(&ws);
 }
 
-// start SinricPro if STA connected
+// start SinricPro once STA is connected (it reconnects by itself after that)
 void startSinricIfConnected() {
-  if (WiFi.status() == WL_CONNECTED) {
-    SinricProSwitch &sw1 = SinricPro[DEVICE_ID_1];
-    SinricProSwitch &sw2 = SinricPro[DEVICE_ID_2];
-    SinricProSwitch &sw3 = SinricPro[DEVICE_ID_3];
-    sw1.onPowerState(onPowerState);
-    sw2.onPowerState(onPowerState);
-    sw3.onPowerState(onPowerState);
+  if (!cloudRunning && WiFi.status() == WL_CONNECTED) {
+    for (const RelayDef& def : RELAYS) {
+      if (!def.deviceId) continue;
+      SinricProSwitch &sw = SinricPro[def.deviceId];
+      sw.onPowerState(onPowerState);
+    }
+    for (const SceneDeviceDef& def : SCENE_DEVICES) {
+      if (!def.deviceId) continue;
+      SinricProSwitch &sw = SinricPro[def.deviceId];
+      sw.onPowerState(onScenePowerState);
+    }
     SinricPro.begin(APP_KEY, APP_SECRET);
-    Serial.println("SinricPro started");
+    cloudRunning = true;
+    logEvent(LOG_CLOUD_STARTED);
   }
 }
 
-// Start AP + HTTP server + WS (used for forced-AP or fallback)
-void startAPModeAndServer() {
-  WiFi.mode(WIFI_AP);
-  apSSID = generateAPSSID();
-  WiFi.softAP(apSSID.c_str());
-  delay(120);
-  setupRoutes();
-  server.begin();
-  serverRunning = true;
-  // start websocket for fast local control in AP
-  webSocket.begin();
-  webSocket.onEvent(handleWsEvent);
-  wsRunning = true;
-  Serial.printf("AP started (%s). HTTP & WS servers running.\n", apSSID.c_str());
+// ------------------ Tasks ------------------
+// Stream fresh scan results to WS clients a few per tick; returns the next
+// index to send, or -1 when done.
+int pushScanResults(int from) {
+  if (!ws.count()) return -1;
+  int n = wifiScanCount();
+  for (int i = 0; i < SCAN_PUSH_PER_TICK && from < n; i++, from++) {
+    char msg[SCAN_ENTRY_JSON_MAX];
+    size_t len = wifiScanEntryJson(msg, sizeof(msg), from);
+    if (len) ws.textAll(msg, len);
+  }
+  return from < n ? from : -1;
+}
+
+// Drives the connection manager, starts the cloud (and SNTP) once STA is up,
+// and runs the relay state journal, timers, rules and the peer link; streams relay state, IR telemetry and
+// scan results to WS clients. HTTP/WS requests themselves are served by AsyncTCP.
+void netTask(void*) {
+  int scanPushPos = -1;
+  uint32_t lastWsCleanupMs = 0;
+  for (;;) {
+    uint32_t tickStart = hal::cycleCount();
+    powerManagerTick();
+    wifiManagerTick();
+    startSinricIfConnected();
+    static bool clockStarted = false;
+    if (!clockStarted && wifiManagerState() == WIFI_STATE_CONNECTED) {
+      hal::clockSync(TIME_ZONE, NTP_SERVER);   // SNTP keeps it set from here on
+      clockStarted = true;
+    }
+
+    wsStreamTick(irRaw);
+    journalTick();
+    relayTimersTick();
+    rulesTick();
+    peerLinkTick();
+    if (otaUpdateTick(wifiManagerState() == WIFI_STATE_CONNECTED || wifiManagerApUp())) {
+      journalFlush();   // the relays come back as they are now
+      relayTimersFlush();
+      hal::restart();
+    }
+    if (wifiScanPoll()) scanPushPos = 0;
+    if (scanPushPos >= 0) scanPushPos = pushScanResults(scanPushPos);
+    uint32_t now = hal::millis();
+    if (now - lastWsCleanupMs >= WS_CLEANUP_MS) {
+      ws.cleanupClients();
+      lastWsCleanupMs = now;
+    }
+    metricsRecord(STAGE_NET_TICK, tickStart);
+    hal::delayMs(powerPollMs(NET_POLL_MS));
+  }
+}
+
+bool sendCloudPowerState(int relay, bool on) {
+  SinricProSwitch &sw = SinricPro[relayDeviceId(relay)];
+  return sw.sendPowerStateEvent(on);
+}
+
+// STA mode: SinricPro cloud handling + reporting local changes of cloud
+// relays. Changes made while offline stay pending and are replayed on
+// reconnect (cloud_sync.h).
+void cloudTask(void*) {
+  for (;;) {
+    if (cloudRunning && WiFi.status() == WL_CONNECTED) {
+      StageTimer t(STAGE_CLOUD);
+      SinricPro.handle();
+      bool up = SinricPro.isConnected();
+      if (up) metricsBootMark(BOOT_CLOUD_READY);
+      rulesSetInput(RULE_SIG_CLOUD, up);
+      cloudSyncTick(up, sendCloudPowerState);
+    } else {
+      cloudSyncTick(false, sendCloudPowerState);   // keeps collecting local changes
+      rulesSetInput(RULE_SIG_CLOUD, false);
+    }
+    hal::delayMs(powerPollMs(CLOUD_POLL_MS));
+  }
 }
 
-// stop AP & servers (called before attempting STA)
-void stopAPModeAndServer() {
-  if (wsRunning) {
-    webSocket.disconnect();
-    wsRunning = false;
+// *** NEW: IR presence pipeline. Continuous DMA sampling feeds IrFilter
+// (median + EMA + hysteresis + dwell); relay 4 follows it in AUTO mode.
+const IrFilterConfig IR_FILTER_CONFIG = {
+  IR_SAMPLE_RATE_HZ, IR_DECIMATE, IR_EMA_SHIFT,
+  (uint16_t)IR_ON_MIN, (uint16_t)IR_ON_MAX, IR_HYSTERESIS, IR_MIN_DWELL_MS,
+};
+const size_t IR_BLOCK_SAMPLES = 100;  // 5 ms at 20 kHz
+
+// On battery: a burst of IR_BURST_SAMPLES adcReads every
+// POWER_BACKUP_IR_PERIOD_MS, each fed to the filter (spikes still meet the
+// median; a lighter EMA and a two-sample dwell keep the response within two
+// periods). The CPU sleeps in between instead of servicing DMA every 5 ms.
+const size_t IR_BURST_SAMPLES = 5;
+const IrFilterConfig IR_BACKUP_FILTER_CONFIG = {
+  IR_BURST_SAMPLES * 1000 / POWER_BACKUP_IR_PERIOD_MS, 1, 1,
+  (uint16_t)IR_ON_MIN, (uint16_t)IR_ON_MAX, IR_HYSTERESIS,
+  (uint16_t)(2 * POWER_BACKUP_IR_PERIOD_MS / IR_BURST_SAMPLES),
+};
+
+void irTask(void*) {
+  static uint16_t block[IR_BLOCK_SAMPLES];
+  IrFilterConfig cfg = IR_FILTER_CONFIG;
+  bool dma = hal::adcStreamStart(IR_PIN, IR_SAMPLE_RATE_HZ);
+  if (!dma) {
+    // no DMA: poll at the filter's own rate instead
+    logEvent(LOG_IR_FALLBACK);
+    cfg.sampleRateHz = 1000;
+    cfg.decimate = 1;
   }
-  if (serverRunning) {
-    server.stop();
-    serverRunning = false;
+  IrFilter filter(cfg);
+  bool onBattery = false;
+
+  for (;;) {
+    if ((powerSource() == POWER_BACKUP) != onBattery) {
+      onBattery = !onBattery;
+      if (dma) {
+        if (onBattery) hal::adcStreamStop();
+        else hal::adcStreamStart(IR_PIN, IR_SAMPLE_RATE_HZ);
+      }
+      bool present = filter.present();
+      filter = IrFilter(onBattery ? IR_BACKUP_FILTER_CONFIG : cfg);
+      filter.assume(present);
+    }
+    size_t n;
+    if (onBattery) {
+      hal::delayMs(POWER_BACKUP_IR_PERIOD_MS);
+      for (n = 0; n < IR_BURST_SAMPLES; n++) block[n] = (uint16_t)hal::adcRead(IR_PIN);
+    } else if (dma) {
+      n = hal::adcStreamRead(block, IR_BLOCK_SAMPLES, 100);
+    } else {
+      block[0] = (uint16_t)hal::adcRead(IR_PIN);
+      n = 1;
+      hal::delayMs(1);
+    }
+    StageTimer t(STAGE_IR_BLOCK);
+    filter.push(block, n);
+    irRaw = filter.value();
+    rulesSetInput(RULE_SIG_IR, filter.present());
+
+    if (relay4Mode() == RELAY4_MODE_AUTO && filter.present() != relayIsOn(IR_RELAY)) {
+      submitRelayCommand(IR_RELAY, filter.present() ? RELAY_OP_ON : RELAY_OP_OFF, SRC_IR);
+    }
   }
-  WiFi.softAPdisconnect(true);
-  delay(120);
+}
+
+void startTasks() {
+  static bool started = false;
+  if (started) return;
+  started = true;
+  hal::taskSpawn("net", netTask, nullptr, 8192, 2, 0);
+  hal::taskSpawn("cloud", cloudTask, nullptr, 8192, 2, 0);
+  hal::taskSpawn("ir", irTask, nullptr, 2048, 3, 1);
+  irRemoteStart();
+  mqttLinkStart();
 }
 
 void setup() {
-  Serial.begin(115200);
-  delay(200);
-
-  pinMode(RELAY_PIN_1, OUTPUT);
-  pinMode(RELAY_PIN_2, OUTPUT);
-  pinMode(RELAY_PIN_3, OUTPUT);
-  pinMode(RELAY_PIN_4, OUTPUT);
-  pinMode(LED_PIN, OUTPUT);
-  pinMode(BOOT_BUTTON_PIN, INPUT_PULLUP);
-  pinMode(IR_PIN, INPUT); // *** NEW: IR sensor pin
-
-  // set relays off
-  writeRelay(RELAY_PIN_1, false);
-  writeRelay(RELAY_PIN_2, false);
-  writeRelay(RELAY_PIN_3, false);
-  writeRelay(RELAY_PIN_4, false);
+  Serial.begin(115200);   // no settle delay: the event log task owns the UART and nothing is lost
+  eventLogBegin();
+  metricsBegin();
+
+  hal::pinSetup(LED_PIN, hal::PIN_MODE_OUTPUT);
+  hal::pinSetup(BOOT_BUTTON_PIN, hal::PIN_MODE_INPUT_PULLUP);
+  hal::pinSetup(IR_PIN, hal::PIN_MODE_INPUT); // *** NEW: IR sensor pin
+  powerManagerBegin();   // mains or battery profile from the first task on
+  otaUpdateBegin();      // counts a trial boot of a new image (may roll it back)
+
+  // restore the last journaled relay state (all off on first boot) before
+  // WiFi comes up, then start the control task (owns the relay pins from here on)
+  JournalState saved;
+  if (journalRestore(saved)) logEvent(LOG_RESTORED, saved.relay4Mode, saved.relayMask);
+  relayControlStart(saved.relayMask, saved.relay4Mode);
+  metricsBootMark(BOOT_RELAYS_RESTORED);
+  relayTimersBegin();    // saved timers; auto-off for relays restored on
+  scenesBegin();
+  rulesBegin();          // after the relays and timers: rules read the one, set the other
 
   // load creds
   prefs.begin("wifi", true);
@@ -567,69 +718,28 @@ void setup() {
   String savedPass = prefs.getString("pass", "");
   prefs.end();
 
-  // check BOOT button
-  delay(50);
-  bool bootPressed = (digitalRead(BOOT_BUTTON_PIN) == LOW);
-  if (bootPressed) {
-    Serial.println("BOOT pressed -> forced AP mode for setup");
-    startAPModeAndServer();
-  } else {
-    // attempt STA
-    bool connected = false;
-    if (savedSsid.length()) connected = attemptWiFiConnectSTA(savedSsid.c_str(), savedPass.c_str(), WIFI_CONNECT_TIMEOUT_MS);
-    if (!connected) connected = attemptWiFiConnectSTA(FALLBACK_SSID, FALLBACK_PASS, WIFI_CONNECT_TIMEOUT_MS);
-
-    if (connected) {
-      // STA mode: run SinricPro only (NO HTTP or WS)
-      startSinricIfConnected();
-      Serial.print("STA connected; SinricPro running. Servers NOT started. IP: ");
-      Serial.println(WiFi.localIP());
-      serverRunning = false;
-      wsRunning = false;
-    } else {
-      // fallback to AP
-      Serial.println("STA failed -> starting AP + servers for setup");
-      startAPModeAndServer();
-    }
-  }
+  // check BOOT button (the pull-up has long settled by now)
+  bool bootPressed = !hal::gpioRead(BOOT_BUTTON_PIN);
+  if (bootPressed) logEvent(LOG_BOOT_BUTTON);
+
+  // STA (or the forced AP) starts here; the net task takes it from there, so
+  // setup() returns at once and relays/IR are live while WiFi comes up
+  setupRoutes();
+  wifiManagerBegin(savedSsid.c_str(), savedPass.c_str(), bootPressed);
+  peerLinkBegin();       // ESP-NOW needs the WiFi mode set
+  // after WiFi.mode(): listens on the AP and STA interfaces alike, for good
+  server.begin();
 
-  setLedMode(WiFi.status()==WL_CONNECTED ? LED_SOLID : LED_SLOW);
+  setLedMode(wifiLedMode());
+  startTasks();
+  metricsBootMark(BOOT_SETUP_DONE);
 }
 
 void loop() {
+  // everything time-critical runs in its own task; loop() only paces the LED
+  // (dark on battery)
+  LedMode want = powerSource() == POWER_BACKUP ? LED_OFF : wifiLedMode();
+  if (ledMode != LED_PATTERN && ledMode != want) setLedMode(want);
   updateLed();
-
-  // *** NEW: read IR sensor periodically and, if in AUTO, drive relay 4
-  static unsigned long lastIrSample = 0;
-  unsigned long now = millis();
-  if (now - lastIrSample >= 100) {    // sample every 100 ms
-    lastIrSample = now;
-    irRaw = analogRead(IR_PIN);
-
-    if (relay4Mode == RELAY4_MODE_AUTO) {
-      bool targetOn = (irRaw >= IR_ON_MIN && irRaw <= IR_ON_MAX);
-      if (targetOn != relayState4) {
-        relayState4 = targetOn;
-        writeRelay(RELAY_PIN_4, relayState4);
-        broadcastRelayStates();
-      }
-    }
-  }
-
-  // AP mode: handle HTTP + WS (fast responsive)
-  if (serverRunning) {
-    server.handleClient();
-  }
-  if (wsRunning) {
-    webSocket.loop();
-  }
-
-  // STA mode: only SinricPro cloud handling
-  if (WiFi.status() == WL_CONNECTED) {
-    SinricPro.handle();
-  }
-
-  // responsiveness: when AP clients connected keep tight loop, otherwise longer delay
-  if (wsRunning && wsClients > 0) delay(10);
-  else delay(150);
+  hal::delayMs(powerPollMs(LED_TICK_MS));
 }
@@ -0,0 +1,240 @@
+// src/metrics.cpp
+// Stage histograms, command counters and their exposition (see include/metrics.h).
+
+#include <stdio.h>
+
+#include <atomic>
+
+#include "metrics.h"
+#include "event_log.h"
+#include "power_manager.h"
+#include "state_json.h"
+#include "wifi_manager.h"
+
+namespace {
+
+const char* const STAGE_NAMES[STAGE_COUNT] = {
+  "net_tick", "http", "ws_event", "cloud", "mqtt", "ir_block", "relay_write",
+};
+// METRICS_BUCKET_US in seconds, as Prometheus wants them
+const char* const BUCKET_LE[] = {
+  "5e-06", "1e-05", "2e-05", "5e-05", "0.0001", "0.0002", "0.0005", "0.001", "0.002", "0.005", "0.01", "0.05",
+};
+static_assert(sizeof(BUCKET_LE) / sizeof(BUCKET_LE[0]) == METRICS_BUCKETS - 1, "one label per bucket bound");
+const char* const BOOT_NAMES[BOOT_MILESTONE_COUNT] = {
+  "relays_restored", "setup_done", "sta_connected", "first_command", "cloud_ready",
+};
+
+const int CALIBRATION_RECORDS = 1000;
+
+struct Histogram {
+  std::atomic<uint32_t> bucket[METRICS_BUCKETS];
+  // 64-bit cycle sum as two words behind a sequence counter (odd while the
+  // writer is in the middle); readers retry on a change
+  std::atomic<uint32_t> sumSeq, sumLo, sumHi;
+};
+
+// one extra, unexposed histogram absorbs the calibration records
+Histogram hist[STAGE_COUNT + 1];
+uint32_t edgeCycles[METRICS_BUCKETS - 1];
+std::atomic<uint32_t> commandCount[NUM_COMMAND_SOURCES];
+uint32_t recordNs = 0;
+std::atomic<uint32_t> bootMs[BOOT_MILESTONE_COUNT];   // ms + 1, 0 = not yet
+
+// only ever written by the stage's own task
+inline void bump(std::atomic<uint32_t>& a, uint32_t by = 1) {
+  a.store(a.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+// `units` of 10^-digits s as decimal seconds, without floating point
+void seconds(state_json::Writer& w, uint64_t units, int digits) {
+  uint64_t scale = 1;
+  for (int i = 0; i < digits; i++) scale *= 10;
+  char frac[24];
+  snprintf(frac, sizeof(frac), ".%0*llu", digits, (unsigned long long)(units % scale));
+  w.uinteger((uint32_t)(units / scale));
+  w.raw(frac);
+}
+
+void metricLine(state_json::Writer& w, const char* name, const char* labelKey, const char* labelValue, uint32_t v) {
+  w.raw(name);
+  if (labelKey) { w.raw("{"); w.raw(labelKey); w.raw("=\""); w.raw(labelValue); w.raw("\"}"); }
+  w.raw(" "); w.uinteger(v); w.raw("\n");
+}
+
+void header(state_json::Writer& w, const char* name, const char* type, const char* help) {
+  w.raw("# HELP "); w.raw(name); w.raw(" "); w.raw(help); w.raw("\n");
+  w.raw("# TYPE "); w.raw(name); w.raw(" "); w.raw(type); w.raw("\n");
+}
+
+} // namespace
+
+void metricsBegin() {
+  uint32_t perUs = hal::cyclesPerUs();
+  for (int i = 0; i < METRICS_BUCKETS - 1; i++) edgeCycles[i] = METRICS_BUCKET_US[i] * perUs;
+  uint32_t t0 = hal::cycleCount();
+  for (int i = 0; i < CALIBRATION_RECORDS; i++) metricsRecord((MetricStage)STAGE_COUNT, hal::cycleCount());
+  uint32_t cycles = hal::cycleCount() - t0;
+  recordNs = (uint32_t)((uint64_t)cycles * 1000 / perUs / CALIBRATION_RECORDS);
+}
+
+void metricsRecord(MetricStage stage, uint32_t startCycles) {
+  uint32_t d = hal::cycleCount() - startCycles;
+  Histogram& h = hist[stage];
+  int b = 0;
+  while (b < METRICS_BUCKETS - 1 && d > edgeCycles[b]) b++;
+  bump(h.bucket[b]);
+
+  uint32_t seq = h.sumSeq.load(std::memory_order_relaxed);
+  h.sumSeq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  uint32_t lo = h.sumLo.load(std::memory_order_relaxed) + d;
+  h.sumLo.store(lo, std::memory_order_relaxed);
+  if (lo < d) bump(h.sumHi);
+  h.sumSeq.store(seq + 2, std::memory_order_release);
+}
+
+void metricsCountCommand(CommandSource source, uint32_t n) {
+  // several tasks submit commands: this one needs a real RMW
+  if (source < NUM_COMMAND_SOURCES) commandCount[source].fetch_add(n, std::memory_order_relaxed);
+}
+
+void metricsBootMark(BootMilestone m) {
+  if (m >= BOOT_MILESTONE_COUNT || bootMs[m].load(std::memory_order_relaxed)) return;
+  uint32_t now = hal::millis(), none = 0;
+  if (bootMs[m].compare_exchange_strong(none, now + 1, std::memory_order_relaxed)) logEvent(LOG_BOOT_MILESTONE, m, now);
+}
+
+uint32_t metricsBootMs(BootMilestone m) {
+  uint32_t v = m < BOOT_MILESTONE_COUNT ? bootMs[m].load(std::memory_order_relaxed) : 0;
+  return v ? v - 1 : 0;
+}
+
+const char* metricsBootName(BootMilestone m) { return m < BOOT_MILESTONE_COUNT ? BOOT_NAMES[m] : "?"; }
+
+void metricsStage(MetricStage stage, StageStats& out) {
+  const Histogram& h = hist[stage];
+  out.count = 0;
+  for (int b = 0; b < METRICS_BUCKETS; b++) {
+    out.bucket[b] = h.bucket[b].load(std::memory_order_relaxed);
+    out.count += out.bucket[b];
+  }
+  for (;;) {
+    uint32_t s1 = h.sumSeq.load(std::memory_order_acquire);
+    uint32_t lo = h.sumLo.load(std::memory_order_relaxed);
+    uint32_t hi = h.sumHi.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!(s1 & 1) && h.sumSeq.load(std::memory_order_relaxed) == s1) {
+      out.sumCycles = (uint64_t)hi << 32 | lo;
+      return;
+    }
+  }
+}
+
+const char* metricsStageName(MetricStage stage) { return stage < STAGE_COUNT ? STAGE_NAMES[stage] : "?"; }
+
+uint32_t metricsRecordNs() { return recordNs; }
+
+size_t metricsPrometheus(char* out, size_t cap, const MetricsGauges& gauges) {
+  state_json::Writer w(out, cap);
+  uint32_t perUs = hal::cyclesPerUs();
+
+  header(w, "esp32_stage_seconds", "histogram", "Duration of one run of a firmware stage.");
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    StageStats st;
+    metricsStage((MetricStage)s, st);
+    uint32_t cumulative = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+      cumulative += st.bucket[b];
+      w.raw("esp32_stage_seconds_bucket{stage=\""); w.raw(STAGE_NAMES[s]);
+      w.raw("\",le=\""); w.raw(b < METRICS_BUCKETS - 1 ? BUCKET_LE[b] : "+Inf");
+      w.raw("\"} "); w.uinteger(cumulative); w.raw("\n");
+    }
+    w.raw("esp32_stage_seconds_sum{stage=\""); w.raw(STAGE_NAMES[s]); w.raw("\"} ");
+    seconds(w, st.sumCycles / perUs, 6); w.raw("\n");
+    metricLine(w, "esp32_stage_seconds_count", "stage", STAGE_NAMES[s], st.count);
+  }
+
+  header(w, "esp32_relay_commands_total", "counter", "Relay commands queued, by input path.");
+  for (int i = 0; i < NUM_COMMAND_SOURCES; i++) {
+    metricLine(w, "esp32_relay_commands_total", "source", commandSourceName((CommandSource)i), commandCount[i].load(std::memory_order_relaxed));
+  }
+
+  header(w, "esp32_heap_free_bytes", "gauge", "Free heap.");
+  metricLine(w, "esp32_heap_free_bytes", nullptr, nullptr, hal::heapFree());
+  header(w, "esp32_heap_largest_block_bytes", "gauge", "Largest allocatable heap block.");
+  metricLine(w, "esp32_heap_largest_block_bytes", nullptr, nullptr, hal::heapLargestBlock());
+  header(w, "esp32_ws_clients", "gauge", "Connected WebSocket clients.");
+  metricLine(w, "esp32_ws_clients", nullptr, nullptr, gauges.wsClients);
+  header(w, "esp32_ir_value", "gauge", "Filtered IR sensor reading.");
+  w.raw("esp32_ir_value "); w.integer(gauges.irValue); w.raw("\n");
+  header(w, "esp32_on_battery", "gauge", "1 while running on the Li-ion backup.");
+  metricLine(w, "esp32_on_battery", nullptr, nullptr, powerSource() == POWER_BACKUP);
+  header(w, "esp32_battery_volts", "gauge", "Last battery reading on backup (0 = none yet).");
+  w.raw("esp32_battery_volts "); seconds(w, batteryMillivolts(), 3); w.raw("\n");
+  header(w, "esp32_uptime_seconds", "counter", "Time since boot.");
+  metricLine(w, "esp32_uptime_seconds", nullptr, nullptr, hal::millis() / 1000);
+  header(w, "esp32_boot_milestone_seconds", "gauge", "Time from reset to each boot milestone (absent until reached).");
+  for (int m = 0; m < BOOT_MILESTONE_COUNT; m++) {
+    uint32_t v = bootMs[m].load(std::memory_order_relaxed);
+    if (!v) continue;
+    w.raw("esp32_boot_milestone_seconds{milestone=\""); w.raw(BOOT_NAMES[m]); w.raw("\"} ");
+    seconds(w, v - 1, 3); w.raw("\n");
+  }
+  WifiJoinStats join = wifiManagerJoinStats();
+  header(w, "esp32_wifi_join_seconds", "gauge", "Duration of the last STA join.");
+  w.raw("esp32_wifi_join_seconds "); seconds(w, join.lastJoinMs, 3); w.raw("\n");
+  header(w, "esp32_wifi_joins_total", "counter", "STA joins, straight to the cached BSSID/channel or after a scan.");
+  metricLine(w, "esp32_wifi_joins_total", "path", "cached", join.directed);
+  metricLine(w, "esp32_wifi_joins_total", "path", "scan", join.scanned);
+  header(w, "esp32_wifi_cache_misses_total", "counter", "Cached BSSID/channel joins that failed and fell back to a scan.");
+  metricLine(w, "esp32_wifi_cache_misses_total", nullptr, nullptr, join.directedMisses);
+  header(w, "esp32_metrics_record_seconds", "gauge", "Cost of timing one stage run (measured at boot).");
+  w.raw("esp32_metrics_record_seconds "); seconds(w, recordNs, 9); w.raw("\n");
+  return w.finish();
+}
+
+size_t metricsJson(char* out, size_t cap, const MetricsGauges& gauges) {
+  state_json::Writer w(out, cap);
+  uint32_t perUs = hal::cyclesPerUs();
+  w.raw("{\"metrics\":{\"uptime_s\":"); w.uinteger(hal::millis() / 1000);
+  w.raw(",\"heap_free\":"); w.uinteger(hal::heapFree());
+  w.raw(",\"heap_largest\":"); w.uinteger(hal::heapLargestBlock());
+  w.raw(",\"ws_clients\":"); w.uinteger(gauges.wsClients);
+  w.raw(",\"ir\":"); w.integer(gauges.irValue);
+  w.raw(",\"battery\":"); w.raw(powerSource() == POWER_BACKUP ? "true" : "false");
+  w.raw(",\"battery_mv\":"); w.uinteger(batteryMillivolts());
+  w.raw(",\"record_ns\":"); w.uinteger(recordNs);
+  w.raw(",\"boot\":{");
+  for (int m = 0; m < BOOT_MILESTONE_COUNT; m++) {
+    if (m) w.raw(",");
+    w.string(BOOT_NAMES[m]); w.raw(":"); w.uinteger(metricsBootMs((BootMilestone)m));
+  }
+  WifiJoinStats join = wifiManagerJoinStats();
+  w.raw("},\"wifi_join\":{\"ms\":"); w.uinteger(join.lastJoinMs);
+  w.raw(",\"cached\":"); w.uinteger(join.directed);
+  w.raw(",\"scan\":"); w.uinteger(join.scanned);
+  w.raw(",\"misses\":"); w.uinteger(join.directedMisses);
+  w.raw("},\"commands\":{");
+  for (int i = 0; i < NUM_COMMAND_SOURCES; i++) {
+    if (i) w.raw(",");
+    w.string(commandSourceName((CommandSource)i)); w.raw(":"); w.uinteger(commandCount[i].load(std::memory_order_relaxed));
+  }
+  w.raw("},\"stages\":{");
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    StageStats st;
+    metricsStage((MetricStage)s, st);
+    if (s) w.raw(",");
+    w.string(STAGE_NAMES[s]);
+    w.raw(":{\"n\":"); w.uinteger(st.count);
+    w.raw(",\"sum_us\":"); w.uinteger((uint32_t)(st.sumCycles / perUs));
+    w.raw(",\"b\":[");
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+      if (b) w.raw(",");
+      w.uinteger(st.bucket[b]);
+    }
+    w.raw("]}");
+  }
+  w.raw("}}}");
+  return w.finish();
+}
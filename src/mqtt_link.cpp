@@ -0,0 +1,158 @@
+// src/mqtt_link.cpp
+// MQTT task: broker connection, command topics, retained state (see include/mqtt_link.h).
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "event_log.h"
+#include "hal.h"
+#include "metrics.h"
+#include "mqtt_link.h"
+#include "power_manager.h"
+#include "relay_control.h"
+
+namespace {
+
+const uint32_t MQTT_POLL_MS = 5;
+const uint32_t MQTT_RETRY_MIN_MS = 1000;   // broker reconnect backoff, doubled per failure...
+const uint32_t MQTT_RETRY_MAX_MS = 30000;  // ...up to this
+
+// PubSubClient::connect blocks on the TCP connect, so MQTT gets its own task
+// rather than sharing cloudTask with SinricPro
+const uint32_t MQTT_TASK_STACK = 4096;
+const uint8_t MQTT_TASK_PRIO = 2;
+const int MQTT_TASK_CORE = 0;
+
+const uint32_t SUBMIT_WAIT_MS = 20;        // queue full: wait this long before dropping a command
+const size_t TOPIC_MAX = 96;
+
+WiFiClient net;
+PubSubClient mqtt(net);
+hal::TaskHandle task = nullptr;
+std::atomic<bool> linkUp{false};
+char clientId[32];
+
+// what the broker last got from us (MQTT task only)
+uint32_t publishedMask = 0;
+Relay4Mode publishedMode = RELAY4_MODE_OFF;
+bool publishAll = true;
+
+void topicFor(char* out, size_t cap, const char* suffix) {
+  snprintf(out, cap, "%s/%s", MQTT_BASE_TOPIC, suffix);
+}
+
+bool payloadIs(const uint8_t* payload, unsigned int len, const char* word) {
+  return strlen(word) == len && !strncasecmp((const char*)payload, word, len);
+}
+
+void onMessage(char* topic, uint8_t* payload, unsigned int len) {
+  size_t baseLen = strlen(MQTT_BASE_TOPIC);
+  if (strncmp(topic, MQTT_BASE_TOPIC, baseLen) || topic[baseLen] != '/') return;
+  const char* rest = topic + baseLen + 1;
+
+  if (!strcmp(rest, "relay4_mode/set")) {
+    for (int m = RELAY4_MODE_OFF; m <= RELAY4_MODE_AUTO; m++) {
+      if (payloadIs(payload, len, relay4ModeName((Relay4Mode)m))) commandRelay4Mode((Relay4Mode)m, SRC_MQTT);
+    }
+    return;
+  }
+
+  if (strncmp(rest, "relay/", 6)) return;
+  char* end;
+  long r = strtol(rest + 6, &end, 10);
+  if (end == rest + 6 || strcmp(end, "/set") || r < 1 || r > NUM_RELAYS) return;
+  RelayOp op;
+  if (payloadIs(payload, len, "ON") || payloadIs(payload, len, "1")) op = RELAY_OP_ON;
+  else if (payloadIs(payload, len, "OFF") || payloadIs(payload, len, "0")) op = RELAY_OP_OFF;
+  else if (payloadIs(payload, len, "TOGGLE")) op = RELAY_OP_TOGGLE;
+  else return;
+  // a burst from the broker can outrun the control task; this task can wait
+  for (uint32_t t = 0; !submitRelayCommand((uint8_t)r, op, SRC_MQTT) && t < SUBMIT_WAIT_MS; t++) hal::delayMs(1);
+}
+
+// Publishes every relay (and the relay 4 mode) that differs from what the
+// broker last got from us, back to back. QoS 0: nothing waits for the broker.
+void publishChanges() {
+  uint32_t mask = relayStateMask();
+  uint32_t diff = publishAll ? (uint32_t)((1ull << NUM_RELAYS) - 1) : (mask ^ publishedMask);
+  char topic[TOPIC_MAX];
+  char suffix[24];
+  for (int r = 1; r <= NUM_RELAYS; r++) {
+    uint32_t bit = 1u << (r - 1);
+    if (!(diff & bit)) continue;
+    snprintf(suffix, sizeof(suffix), "relay/%d/state", r);
+    topicFor(topic, sizeof(topic), suffix);
+    if (!mqtt.publish(topic, (mask & bit) ? "ON" : "OFF", true)) return;  // link lost: resent on reconnect
+    publishedMask = (publishedMask & ~bit) | (mask & bit);
+  }
+  Relay4Mode mode = relay4Mode();
+  if (publishAll || mode != publishedMode) {
+    topicFor(topic, sizeof(topic), "relay4_mode/state");
+    if (!mqtt.publish(topic, relay4ModeName(mode), true)) return;
+    publishedMode = mode;
+  }
+  publishAll = false;
+}
+
+bool connectBroker() {
+  char status[TOPIC_MAX];
+  topicFor(status, sizeof(status), "status");
+  const char* user = MQTT_USER[0] ? MQTT_USER : nullptr;
+  const char* pass = MQTT_USER[0] ? MQTT_PASS : nullptr;
+  if (!mqtt.connect(clientId, user, pass, status, 0, true, "offline")) return false;
+
+  mqtt.publish(status, "online", true);
+  char sub[TOPIC_MAX];
+  topicFor(sub, sizeof(sub), "relay/+/set");
+  mqtt.subscribe(sub);
+  topicFor(sub, sizeof(sub), "relay4_mode/set");
+  mqtt.subscribe(sub);
+  publishAll = true;
+  return true;
+}
+
+void mqttTaskFn(void*) {
+  uint32_t retryAtMs = 0;
+  uint32_t backoff = MQTT_RETRY_MIN_MS;
+  for (;;) {
+    if (mqtt.connected()) {
+      StageTimer t(STAGE_MQTT);
+      mqtt.loop();
+      publishChanges();
+    } else {
+      linkUp = false;
+      uint32_t now = hal::millis();
+      if (WiFi.status() == WL_CONNECTED && (int32_t)(now - retryAtMs) >= 0) {
+        if (connectBroker()) {
+          logEvent(LOG_MQTT_CONNECTED);
+          linkUp = true;
+          backoff = MQTT_RETRY_MIN_MS;
+          publishChanges();
+        } else {
+          logEvent(LOG_MQTT_FAILED, 0, (uint32_t)mqtt.state(), backoff);
+          retryAtMs = now + backoff;
+          backoff = min(backoff * 2, MQTT_RETRY_MAX_MS);
+        }
+      }
+    }
+    hal::delayMs(powerPollMs(MQTT_POLL_MS));
+  }
+}
+
+} // namespace
+
+void mqttLinkStart() {
+  if (!MQTT_HOST[0] || task) return;
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  snprintf(clientId, sizeof(clientId), "esp32-relays-%02X%02X%02X", mac[3], mac[4], mac[5]);
+  mqtt.setServer(MQTT_HOST, MQTT_PORT);
+  mqtt.setCallback(onMessage);
+  task = hal::taskSpawn("mqtt", mqttTaskFn, nullptr, MQTT_TASK_STACK, MQTT_TASK_PRIO, MQTT_TASK_CORE);
+}
+
+bool mqttLinkConnected() { return linkUp; }
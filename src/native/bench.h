@@ -0,0 +1,61 @@
+#pragma once
+
+// src/native/bench.h
+// Shared helpers for the host benchmark suite (src/native/bench_*.cpp).
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Collects samples and prints min/avg/p50/p99/max on one line.
+class BenchStats {
+public:
+  void add(double v) { samples_.push_back(v); }
+  void clear() { samples_.clear(); }
+  size_t count() const { return samples_.size(); }
+  void print(const char* label, const char* unit) const;
+  // 1-2-5 bucketed distribution, one line per non-empty bucket
+  void printHistogram(const char* unit) const;
+  const std::vector<double>& samples() const { return samples_; }
+
+private:
+  std::vector<double> samples_;
+};
+
+// Monotonic nanoseconds, for timing code under test.
+uint64_t benchNowNs();
+
+// A correctness check within a case: on failure prints "FAILED: <what>" and
+// makes the program exit 1 once the cases have run. Returns `ok`.
+bool benchCheck(bool ok, const char* what);
+
+struct BenchOptions {
+  int samples = 0;             // per-measurement sample count (0 = case default)
+  const char* file = nullptr;  // input file for cases that replay recordings
+  uint16_t port = 0;           // loopback port for cases that serve sockets (0 = case default)
+};
+
+// Bench cases
+void benchBoot(const BenchOptions& opt);
+void benchLoop(const BenchOptions& opt);
+void benchIr(const BenchOptions& opt);
+void benchJson(const BenchOptions& opt);
+void benchWifi(const BenchOptions& opt);
+void benchRelay(const BenchOptions& opt);
+void benchBank(const BenchOptions& opt);
+void benchJournal(const BenchOptions& opt);
+void benchMqtt(const BenchOptions& opt);
+void benchHttp(const BenchOptions& opt);
+void benchWs(const BenchOptions& opt);
+void benchWsProto(const BenchOptions& opt);
+void benchMetrics(const BenchOptions& opt);
+void benchLog(const BenchOptions& opt);
+void benchPower(const BenchOptions& opt);
+void benchRemote(const BenchOptions& opt);
+void benchCloud(const BenchOptions& opt);
+void benchOta(const BenchOptions& opt);
+void benchTimers(const BenchOptions& opt);
+void benchScenes(const BenchOptions& opt);
+void benchPeers(const BenchOptions& opt);
+void benchRules(const BenchOptions& opt);
+void benchServe(const BenchOptions& opt);
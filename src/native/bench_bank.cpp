@@ -0,0 +1,170 @@
+// src/native/bench_bank.cpp
+// Relay bank backends (relay_bank.h) against the simulated buses
+// (sim_bus.cpp, wire time included) for bank sizes up to 32:
+//   - one relay changing: time per update, bus transactions and bytes,
+//   - every relay changing at once: one batched update against one update
+//     per relay (what a per-relay digitalWrite-style driver would do),
+//   - the expander outputs checked against the requested state.
+// In a build with an expander backend (-DRELAY_BACKEND=...) it also boots
+// the firmware and times command -> bus write through the control task.
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "relay_bank.h"
+#include "relay_control.h"
+#include "sim.h"
+
+void setup();
+
+namespace {
+
+const int DEFAULT_SAMPLES = 500;
+const int E2E_SAMPLES = 100;
+const RelayDef GPIO_DEFS[] = {{16, nullptr}, {17, nullptr}, {18, nullptr}, {19, nullptr},
+                              {21, nullptr}, {22, nullptr}, {23, nullptr}, {25, nullptr}};
+
+sim::BusStats busStats() {
+  sim::BusStats s = sim::spiStats(), i = sim::i2cStats();
+  return {s.transactions + i.transactions, s.bytes + i.bytes, s.wireNs + i.wireNs};
+}
+
+uint32_t allOf(int outputs) { return (uint32_t)((1ull << outputs) - 1); }
+
+// what the expanders hold now, as a bank mask
+uint32_t hc595State(int outputs) { return (uint32_t)sim::hc595Outputs() & allOf(outputs); }
+uint32_t mcpState(int outputs) {
+  uint32_t m = sim::mcp23017Outputs(RELAY_I2C_ADDR) | (uint32_t)sim::mcp23017Outputs(RELAY_I2C_ADDR + 1) << 16;
+  return m & allOf(outputs);
+}
+uint32_t noState(int) { return 0; }
+
+template <typename Bank>
+void measureBank(const char* name, Bank& bank, int outputs, int samples, uint32_t (*state)(int)) {
+  std::mt19937 rng(outputs);
+  uint32_t all = allOf(outputs), want = 0;
+  bank.begin(0);
+  bool ok = true;
+
+  // one relay per update
+  BenchStats single;
+  sim::BusStats b0 = busStats();
+  for (int i = 0; i < samples; i++) {
+    uint32_t bit = 1u << (rng() % outputs);
+    uint64_t t0 = benchNowNs();
+    if (want & bit) bank.write(0, bit);
+    else bank.write(bit, 0);
+    single.add((benchNowNs() - t0) / 1e3);
+    want ^= bit;
+    ok &= state == noState || state(outputs) == want;
+  }
+  sim::BusStats b1 = busStats();
+
+  // every relay at once: batched, then one update per relay
+  BenchStats batched, perRelay;
+  for (int i = 0; i < samples / 10 + 1; i++) {
+    want = want ? 0 : all;
+    uint64_t t0 = benchNowNs();
+    bank.write(want, ~want & all);
+    batched.add((benchNowNs() - t0) / 1e3);
+    ok &= state == noState || state(outputs) == want;
+  }
+  sim::BusStats b2 = busStats();
+  for (int i = 0; i < samples / 10 + 1; i++) {
+    want = want ? 0 : all;
+    uint64_t t0 = benchNowNs();
+    for (int o = 0; o < outputs; o++) bank.write(want & (1u << o), ~want & (1u << o));
+    perRelay.add((benchNowNs() - t0) / 1e3);
+    ok &= state == noState || state(outputs) == want;
+  }
+  sim::BusStats b3 = busStats();
+
+  int n1 = single.count(), n2 = batched.count(), n3 = perRelay.count();
+  auto med = [](const BenchStats& s) {
+    std::vector<double> v(s.samples());
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+  };
+  auto p99 = [](const BenchStats& s) {
+    std::vector<double> v(s.samples());
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(0.99 * (v.size() - 1) + 0.5))];
+  };
+  printf("  %-9s %3d  %8.1f %8.1f %6.1f %5.1f  %9.1f %6.1f %5.1f  %9.1f %6.1f  %s\n", name, outputs, med(single),
+         p99(single), (double)(b1.transactions - b0.transactions) / n1, (double)(b1.bytes - b0.bytes) / n1,
+         med(batched), (double)(b2.transactions - b1.transactions) / n2, (double)(b2.bytes - b1.bytes) / n2,
+         med(perRelay), (double)(b3.transactions - b2.transactions) / n3,
+         state == noState ? "-" : ok ? "ok" : "MISMATCH");
+}
+
+} // namespace
+
+void benchBank(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+  printf("  SPI %u MHz, I2C %u kHz; times in us, wire time included\n", RELAY_SPI_HZ / 1000000, RELAY_I2C_HZ / 1000);
+  printf("  %-9s %3s  %17s %12s  %22s  %16s  %s\n", "backend", "n", "1 relay p50/p99", "txn/bytes",
+         "all relays p50 txn/B", "per-relay p50 txn", "outputs");
+  for (int n : {4, 8}) {
+    GpioBank bank(GPIO_DEFS, n);
+    measureBank("gpio", bank, n, samples, noState);
+  }
+  for (int n : {8, 16, 24, 32}) {
+    Hc595Bank bank(n);
+    measureBank("74hc595", bank, n, samples, hc595State);
+  }
+  for (int n : {8, 16, 24, 32}) {
+    Mcp23017Bank bank(n);
+    measureBank("mcp23017", bank, n, samples, mcpState);
+    if (bank.errors()) printf("  %u NACKed transactions\n", bank.errors());
+  }
+
+#if RELAY_BACKEND == RELAY_BACKEND_GPIO
+  printf("  firmware bank: GPIO (build with -DRELAY_BACKEND=RELAY_BACKEND_74HC595 or _MCP23017 to time the "
+         "control task on an expander)\n");
+#else
+  // ---- through the firmware: command -> control task -> bus ----
+  sim::setStaReachable(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  hal::delayMs(50);
+  BenchStats one, batch;
+  int timeouts = 0;
+  RelayCommand cmds[RELAY_BATCH_MAX];
+  int batchN = NUM_RELAYS < RELAY_BATCH_MAX ? NUM_RELAYS : RELAY_BATCH_MAX;
+  for (int i = 0; i < E2E_SAMPLES; i++) {
+    hal::delayMs(2);
+    uint32_t t0 = hal::micros(), at = 0;
+    submitRelayCommand(1 + i % NUM_RELAYS, RELAY_OP_TOGGLE, SRC_HTTP);
+    if (sim::waitBusWrite(t0, 1000, &at)) one.add(at - t0);
+    else timeouts++;
+
+    hal::delayMs(2);
+    for (int k = 0; k < batchN; k++) cmds[k] = {(uint8_t)(1 + k), i % 2 ? RELAY_OP_OFF : RELAY_OP_ON, SRC_HTTP};
+    t0 = hal::micros();
+    submitRelayBatch(cmds, batchN);
+    if (sim::waitBusWrite(t0, 1000, &at)) batch.add(at - t0);
+    else timeouts++;
+  }
+  char label[64];
+  snprintf(label, sizeof(label), "firmware, %d relays: 1 command", NUM_RELAYS);
+  one.print(label, "us");
+  snprintf(label, sizeof(label), "firmware, %d relays: batch of %d", NUM_RELAYS, batchN);
+  batch.print(label, "us");
+  // every relay on, then off, so every expander chip has been rewritten
+  // since the bank tables above used the same simulated bus
+  for (RelayOp op : {RELAY_OP_ON, RELAY_OP_OFF}) {
+    for (int r = 1; r <= NUM_RELAYS; r++) {
+      while (!submitRelayCommand(r, op, SRC_HTTP)) hal::delayMs(1);
+    }
+    hal::delayMs(20);
+  }
+  uint32_t want = relayStateMask() ^ (RELAY_ACTIVE_LOW ? allOf(NUM_RELAYS) : 0);
+  uint32_t have = RELAY_BACKEND == RELAY_BACKEND_74HC595 ? hc595State(NUM_RELAYS) : mcpState(NUM_RELAYS);
+  printf("  firmware outputs %s relay state%s\n", have == want ? "match" : "DO NOT MATCH",
+         timeouts ? " (some commands never reached the bus)" : "");
+#endif
+}
@@ -0,0 +1,190 @@
+// src/native/bench_boot.cpp
+// Boot to control: each boot runs in a forked child (setup() only runs once
+// per process), with the flash (NVS) handed from one boot to the next the way
+// it survives a reset on the board. A cold boot with nothing cached, boots
+// with the router's BSSID/channel cached, a boot after the router moved to
+// another channel, and a router outage while running. Reports the boot
+// milestones (metrics.h) from the child's start: STA up, first relay command
+// (a WS client that sends as soon as the board is on the network) and
+// SinricPro ready. Runs first: forking is only safe before any firmware task
+// exists in this process. Takes about a minute.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "metrics.h"
+#include "sim.h"
+#include "wifi_manager.h"
+
+void setup();
+
+namespace {
+
+const int DEFAULT_SAMPLES = 3;
+const uint32_t CLOUD_CONNECT_MS = 1200;   // WebSocket + TLS to the SinricPro server
+const uint32_t OUTAGE_MS = 5000;
+
+struct Scenario {
+  const char* name;
+  uint8_t apChannel;
+  uint8_t apBssidLast;
+  bool outage;         // drop the router once the boot is done, measure the way back
+};
+
+struct BootResult {
+  bool ok;
+  uint32_t ms[BOOT_MILESTONE_COUNT];   // from the child's start, 0 = not reached
+  WifiJoinStats join;
+  double reconnectMs;                  // router back -> STA connected (outage runs)
+};
+
+template <typename Pred>
+bool waitUntil(uint32_t timeoutMs, Pred done) {
+  uint32_t t0 = hal::millis();
+  while (!done()) {
+    if (hal::millis() - t0 >= timeoutMs) return false;
+    hal::delayMs(1);
+  }
+  return true;
+}
+
+bool writeAll(int fd, const void* p, size_t n) {
+  for (const uint8_t* b = (const uint8_t*)p; n;) {
+    ssize_t w = write(fd, b, n);
+    if (w <= 0) return false;
+    b += w;
+    n -= w;
+  }
+  return true;
+}
+
+bool readAll(int fd, void* p, size_t n) {
+  for (uint8_t* b = (uint8_t*)p; n;) {
+    ssize_t r = read(fd, b, n);
+    if (r <= 0) return false;
+    b += r;
+    n -= r;
+  }
+  return true;
+}
+
+// The child: the firmware from reset to SinricPro ready.
+void bootChild(int fd, const Scenario& sc, const std::vector<uint8_t>& flash) {
+  uint32_t t0 = hal::millis();
+  sim::nvsImport(flash);
+  sim::setStaAp(sc.apChannel, sc.apBssidLast);
+  sim::setStaReachable(true);
+  sim::setCloudUp(true);
+  sim::setCloudConnectMs(CLOUD_CONNECT_MS);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+
+  BootResult r{};
+  r.ok = waitUntil(20000, [] { return wifiManagerState() == WIFI_STATE_CONNECTED; });
+  if (r.ok) {
+    sim::wsConnect(0);
+    sim::wsText(0, "toggle:1");
+    r.ok = waitUntil(2000, [] { return metricsBootMs(BOOT_FIRST_COMMAND) != 0; }) &&
+           waitUntil(10000, [] { return metricsBootMs(BOOT_CLOUD_READY) != 0; });
+  }
+  if (r.ok && sc.outage) {
+    sim::setStaReachable(false);
+    hal::delayMs(OUTAGE_MS);
+    uint64_t back = benchNowNs();
+    sim::setStaReachable(true);
+    hal::delayMs(50);   // past the loss being noticed
+    r.ok = waitUntil(60000, [] { return wifiManagerState() == WIFI_STATE_CONNECTED; });
+    r.reconnectMs = (benchNowNs() - back) / 1e6;
+  }
+  for (int m = 0; m < BOOT_MILESTONE_COUNT; m++) {
+    uint32_t at = metricsBootMs((BootMilestone)m);
+    r.ms[m] = at ? at - t0 : 0;
+  }
+  r.join = wifiManagerJoinStats();
+  std::vector<uint8_t> out = sim::nvsExport();
+  uint32_t len = out.size();
+  bool sent = writeAll(fd, &r, sizeof(r)) && writeAll(fd, &len, sizeof(len)) && writeAll(fd, out.data(), len);
+  _exit(sent ? 0 : 1);
+}
+
+// One boot; `flash` is what NVS holds going in and after it.
+bool boot(const Scenario& sc, std::vector<uint8_t>& flash, BootResult& r) {
+  int fds[2];
+  if (pipe(fds)) return false;
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) return false;
+  if (pid == 0) {
+    close(fds[0]);
+    bootChild(fds[1], sc, flash);
+  }
+  close(fds[1]);
+  uint32_t len = 0;
+  bool ok = readAll(fds[0], &r, sizeof(r)) && readAll(fds[0], &len, sizeof(len));
+  if (ok) {
+    std::vector<uint8_t> next(len);
+    ok = readAll(fds[0], next.data(), len);
+    if (ok) flash.swap(next);
+  }
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return ok && r.ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+struct ScenarioStats {
+  BenchStats ms[BOOT_MILESTONE_COUNT];
+  BenchStats reconnect;
+  uint32_t cached = 0, scanned = 0, misses = 0;
+  int failed = 0;
+};
+
+void printScenario(const Scenario& sc, const ScenarioStats& st) {
+  printf("  -- %s: %u cached / %u scanned joins, %u cache misses%s --\n", sc.name, st.cached, st.scanned,
+         st.misses, st.failed ? " (some boots failed)" : "");
+  static const BootMilestone SHOWN[] = {BOOT_SETUP_DONE, BOOT_STA_CONNECTED, BOOT_FIRST_COMMAND, BOOT_CLOUD_READY};
+  for (BootMilestone m : SHOWN) {
+    char label[48];
+    snprintf(label, sizeof(label), "boot -> %s", metricsBootName(m));
+    st.ms[m].print(label, "ms");
+  }
+  if (sc.outage) st.reconnect.print("router back -> STA connected", "ms");
+}
+
+} // namespace
+
+void benchBoot(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+  const Scenario COLD = {"cold boot, nothing cached (scan)", 6, 0x01, false};
+  const Scenario CACHED = {"reboot, BSSID/channel cached", 6, 0x01, false};
+  const Scenario MOVED = {"reboot, router moved to channel 11 (stale cache)", 11, 0x02, false};
+  const Scenario OUTAGE = {"router outage while running", 11, 0x02, true};
+
+  ScenarioStats cold, cached, moved, outage;
+  auto add = [](ScenarioStats& st, bool ok, const BootResult& r) {
+    if (!ok) { st.failed++; return; }
+    for (int m = 0; m < BOOT_MILESTONE_COUNT; m++) {
+      if (r.ms[m]) st.ms[m].add(r.ms[m]);
+    }
+    st.cached += r.join.directed;
+    st.scanned += r.join.scanned;
+    st.misses += r.join.directedMisses;
+    st.reconnect.add(r.reconnectMs);
+  };
+
+  for (int i = 0; i < samples; i++) {
+    std::vector<uint8_t> flash;   // erased: no credentials, no cache
+    BootResult r;
+    add(cold, boot(COLD, flash, r), r);
+    add(cached, boot(CACHED, flash, r), r);
+    add(moved, boot(MOVED, flash, r), r);
+    add(outage, boot(OUTAGE, flash, r), r);
+  }
+  printScenario(COLD, cold);
+  printScenario(CACHED, cached);
+  printScenario(MOVED, moved);
+  printScenario(OUTAGE, outage);
+}
@@ -0,0 +1,217 @@
+// src/native/bench_cloud.cpp
+// SinricPro reconciliation (cloud_sync.h). First the policy on its own, in
+// simulated time: 32 cloud relays toggled thousands of times during an
+// outage, then replayed through a sender that refuses events like the SDK's
+// per-device limiter. Then the firmware against the simulated cloud: local
+// toggles while the server link is down, the time until the cloud shows the
+// relay's state again, and a stale cloud command arriving right after the
+// reconnect. The default config gives relays 1-3 the same placeholder device
+// ID, so the firmware part only switches relay 1.
+
+#include <random>
+
+#include "bench.h"
+#include "cloud_sync.h"
+#include "config.h"
+#include "hal.h"
+#include "relay_control.h"
+#include "sim.h"
+#include "wifi_manager.h"
+
+void setup();
+
+namespace {
+
+const int DEFAULT_SAMPLES = 5;
+const int SCALE_RELAYS = 32;
+const int SCALE_CHANGES = 10000;
+const uint32_t SCALE_OUTAGE_MS = 600000;
+const uint32_t TICK_MS = 20;          // the cloud task's period
+const uint32_t SDK_LIMIT_MS = 1000;   // per-device event limit, as in the sim client
+
+// -------- the policy in simulated time --------
+
+uint32_t simNowMs;
+uint32_t lastSendMs[SCALE_RELAYS];
+std::vector<std::pair<uint32_t, int>> sends;   // (time, relay)
+uint32_t cloudSeen;                            // bit n-1: relay n as the cloud shows it
+
+bool fakeSend(int relay, bool on) {
+  int i = relay - 1;
+  if (lastSendMs[i] && simNowMs - lastSendMs[i] < SDK_LIMIT_MS) return false;
+  lastSendMs[i] = simNowMs | 1;
+  sends.push_back({simNowMs, relay});
+  cloudSeen = on ? (cloudSeen | (1u << i)) : (cloudSeen & ~(1u << i));
+  return true;
+}
+
+uint32_t maxInWindow(uint32_t windowMs) {
+  uint32_t best = 0;
+  for (size_t a = 0, b = 0; b < sends.size(); b++) {
+    while (sends[b].first - sends[a].first >= windowMs) a++;
+    best = std::max<uint32_t>(best, b - a + 1);
+  }
+  return best;
+}
+
+void scaleRun() {
+  CloudSync sync(0xFFFFFFFFu);
+  std::mt19937 rng(7);
+  uint32_t state = 0;
+  simNowMs = 1000;
+  sync.tick(simNowMs, true, 0, state, fakeSend);   // boot: every relay reported
+  for (uint32_t t = 0; t < 10000 && sync.pendingMask(); t += TICK_MS) {
+    simNowMs += TICK_MS;
+    sync.tick(simNowMs, true, 0, state, fakeSend);
+  }
+  printf("  boot resync: %zu events for %d relays, cloud %s\n", sends.size(), SCALE_RELAYS,
+         cloudSeen == state ? "matches" : "STALE");
+  benchCheck(cloudSeen == state, "boot resync: the cloud matches every relay");
+
+  // outage: changes spread over SCALE_OUTAGE_MS, skewed towards a few relays
+  sends.clear();
+  simNowMs += TICK_MS;
+  sync.tick(simNowMs, false, 0, state, fakeSend);
+  uint32_t perTick = SCALE_CHANGES / (SCALE_OUTAGE_MS / TICK_MS) + 1, made = 0;
+  std::geometric_distribution<int> pick(0.15);
+  for (uint32_t t = 0; t < SCALE_OUTAGE_MS; t += TICK_MS) {
+    simNowMs += TICK_MS;
+    uint32_t changed = 0;
+    for (uint32_t k = 0; k < perTick && made < SCALE_CHANGES; k++, made++) {
+      uint32_t bit = 1u << (pick(rng) % SCALE_RELAYS);
+      state ^= bit;
+      changed |= bit;
+    }
+    sync.tick(simNowMs, false, changed, state, fakeSend);
+  }
+  uint32_t stale = __builtin_popcount(state ^ cloudSeen), pending = __builtin_popcount(sync.pendingMask());
+  printf("  outage %u s, %u local changes: %u relays pending, %u of them actually differ from the cloud\n",
+         SCALE_OUTAGE_MS / 1000, made, pending, stale);
+
+  uint32_t back = simNowMs;
+  for (uint32_t t = 0; t < 60000 && sync.pendingMask(); t += TICK_MS) {
+    simNowMs += TICK_MS;
+    sync.tick(simNowMs, true, 0, state, fakeSend);
+  }
+  CloudSync::Stats s = sync.stats();
+  printf("  reconnect -> cloud converged: %u ms, %zu events (%u coalesced, %u dropped as unchanged), cloud %s\n",
+         simNowMs - back, sends.size(), s.coalesced, s.dropped, cloudSeen == state ? "matches" : "STALE");
+  benchCheck(cloudSeen == state, "reconnect: the cloud converges on every relay");
+  printf("  peak rate: %u events in 100 ms, %u in any 1 s (burst %u, then 1 per %u ms)\n",
+         maxInWindow(100), maxInWindow(1000), CLOUD_REPORT_BURST, CLOUD_REPORT_INTERVAL_MS);
+  printf("  queue memory: %zu bytes for %d relays, independent of the outage (a per-event queue of\n"
+         "  {relay, state, ms} would hold %u entries)\n",
+         sizeof(CloudSync), CloudSync::MAX_RELAYS, made);
+}
+
+// -------- the firmware against the simulated cloud --------
+
+template <typename Pred>
+double waitFor(uint32_t timeoutMs, Pred done) {
+  uint64_t t0 = benchNowNs();
+  while (!done()) {
+    if ((benchNowNs() - t0) / 1000000 >= timeoutMs) return -1;
+    hal::delayMs(2);
+  }
+  return (benchNowNs() - t0) / 1e6;
+}
+
+bool cloudShowsRelay1() { return sim::cloudDeviceState(DEVICE_ID_1) == (int)relayIsOn(1); }
+
+size_t eventsSince(uint32_t ms) {
+  size_t n = 0;
+  for (const sim::CloudEvent& e : sim::cloudEvents()) n += (int32_t)(e.atMs - ms) >= 0;
+  return n;
+}
+
+void wsToggles(int n) {
+  for (int i = 0; i < n; i++) {
+    sim::wsText(0, "toggle:1");
+    hal::delayMs(15);
+  }
+  hal::delayMs(50);
+}
+
+} // namespace
+
+void benchCloud(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+
+  printf("  -- policy, simulated time --\n");
+  scaleRun();
+
+  printf("  -- firmware, simulated SinricPro --\n");
+  sim::setStaReachable(true);
+  sim::setCloudUp(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  if (waitFor(20000, [] { return wifiManagerState() == WIFI_STATE_CONNECTED; }) < 0 ||
+      waitFor(5000, [] { return sim::cloudDeviceState(DEVICE_ID_1) >= 0; }) < 0) {
+    benchCheck(false, "the cloud sees the boot state");
+    return;
+  }
+  sim::wsConnect(0);
+  hal::delayMs(1100);   // past the client's event limit for the boot report
+
+  BenchStats converge, events;
+  int stale = 0, matches = 0, odd = 0;
+  for (int i = 0; i < samples; i++) {
+    int n = 10 + 7 * i;   // alternately ends on the cloud's state and away from it
+    odd += n % 2;
+    sim::setCloudUp(false);
+    hal::delayMs(100);
+    wsToggles(n);
+    stale += !cloudShowsRelay1();
+    uint32_t backMs = hal::millis();
+    sim::setCloudUp(true);
+    double ms = waitFor(10000, [] { return cloudShowsRelay1() && !cloudSyncPending(); });
+    if (ms >= 0) converge.add(ms);
+    events.add(eventsSince(backMs));
+    matches += cloudShowsRelay1();
+    hal::delayMs(1100);
+  }
+  printf("  %d outages, %d..%d WS toggles of relay 1 each: cloud stale at reconnect %d times (%d odd counts)\n",
+         samples, 10, 10 + 7 * (samples - 1), stale, odd);
+  converge.print("reconnect -> cloud shows relay 1", "ms");
+  events.print("events sent per reconnect", "");
+  printf("  cloud matches the relay afterwards: %d/%d\n", matches, samples);
+  benchCheck(matches == samples && converge.count() == (size_t)samples, "the cloud shows relay 1 after each outage");
+
+  // stale command: the cloud still shows the old state and a user taps it
+  sim::setCloudUp(false);
+  hal::delayMs(100);
+  wsToggles(1);
+  bool local = relayIsOn(1);
+  CloudSync::Stats before = cloudSyncStats();
+  sim::setCloudUp(true);
+  sim::cloudPowerState(DEVICE_ID_1, !local);
+  double ms = waitFor(5000, [] { return cloudShowsRelay1() && !cloudSyncPending(); });
+  hal::delayMs(100);
+  bool refused = cloudSyncStats().refused > before.refused, kept = relayIsOn(1) == local;
+  printf("  stale cloud command after reconnect: %s, relay %s, cloud caught up in %.1f ms\n",
+         refused ? "refused" : "APPLIED", kept ? "kept its local state" : "SWITCHED", ms);
+  benchCheck(refused && kept && ms >= 0, "a stale cloud command is refused and the cloud catches up");
+  uint32_t t0 = hal::micros(), at = 0;
+  sim::cloudPowerState(DEVICE_ID_1, !local);
+  // the control task publishes the state mask just after the pin write
+  bool applied = sim::waitGpioWrite(RELAY_PIN_1, t0, 2000, &at) &&
+                 waitFor(500, [&] { return relayIsOn(1) != local; }) >= 0;
+  printf("  the same command once the cloud has the report: %s in %.1f ms\n",
+         applied ? "applied" : "NOT APPLIED", applied ? (at - t0) / 1000.0 : -1.0);
+  benchCheck(applied, "the same command is applied once the cloud has the report");
+
+  // the WiFi link itself drops (the old code lost these reports)
+  hal::delayMs(1100);
+  sim::setStaReachable(false);
+  waitFor(5000, [] { return wifiManagerState() != WIFI_STATE_CONNECTED; });
+  wsToggles(3);
+  sim::setStaReachable(true);
+  double up = waitFor(120000, [] { return wifiManagerState() == WIFI_STATE_CONNECTED; });
+  double synced = waitFor(10000, [] { return cloudShowsRelay1() && !cloudSyncPending(); });
+  printf("  WiFi outage, 3 toggles: STA back in %.0f ms, cloud shows relay 1 %.1f ms later\n", up, synced);
+  benchCheck(up >= 0 && synced >= 0, "the cloud shows relay 1 after a WiFi outage");
+
+  CloudSync::Stats s = cloudSyncStats();
+  printf("  totals: sent %u, coalesced %u, dropped %u, client refusals %u, commands refused %u, resyncs %u\n",
+         s.sent, s.coalesced, s.dropped, s.retries, s.refused, s.resyncs);
+}
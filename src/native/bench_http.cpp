@@ -0,0 +1,251 @@
+// src/native/bench_http.cpp
+// Load test of the async HTTP/WS server over real loopback sockets. The
+// firmware boots in STA mode and serves on 127.0.0.1 while 1, 8 and 32
+// client threads hammer it: GET /status (one connection per request, as the
+// server closes after each response) and WS "status" round trips on open
+// sockets. Reports requests/s and latency per level, plus SinricPro-to-relay
+// latency idle and under the heaviest HTTP load, to show relay control is
+// not held up by the server.
+//
+// `serve` boots the same way and just keeps serving, for tools/http_load.py
+// (which also runs against a board).
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "sim.h"
+#include "wifi_manager.h"
+
+void setup();
+
+namespace {
+
+const int LEVELS[] = {1, 8, 32};
+const int WS_LEVELS[] = {1, DEFAULT_MAX_WS_CLIENTS};   // the server closes clients beyond this
+const uint32_t LEVEL_MS = 2000;
+const int DEFAULT_SERVE_PORT = 8080;
+const int RELAY_SAMPLES = 40;
+
+uint16_t port = 0;
+
+int connectLocal() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  timeval tv{2, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in a{};
+  a.sin_family = AF_INET;
+  a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  a.sin_port = htons(port);
+  if (connect(fd, (sockaddr*)&a, sizeof(a))) { close(fd); return -1; }
+  return fd;
+}
+
+bool sendAll(int fd, const std::string& s) {
+  for (size_t off = 0; off < s.size();) {
+    ssize_t n = send(fd, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    off += n;
+  }
+  return true;
+}
+
+bool readExact(int fd, std::string& out, size_t n) {
+  out.clear();
+  char buf[4096];
+  while (out.size() < n) {
+    ssize_t r = recv(fd, buf, std::min(sizeof(buf), n - out.size()), 0);
+    if (r <= 0) return false;
+    out.append(buf, r);
+  }
+  return true;
+}
+
+// one GET on a fresh connection, read to EOF; true on a 200
+bool httpGet(const char* path) {
+  int fd = connectLocal();
+  if (fd < 0) return false;
+  std::string resp;
+  bool ok = sendAll(fd, std::string("GET ") + path + " HTTP/1.1\r\nHost: bench\r\n\r\n");
+  char buf[4096];
+  ssize_t n;
+  while (ok && (n = recv(fd, buf, sizeof(buf), 0)) > 0) resp.append(buf, n);
+  close(fd);
+  return ok && resp.compare(0, 12, "HTTP/1.1 200") == 0;
+}
+
+bool wsReadFrame(int fd, std::string& payload) {
+  std::string h;
+  if (!readExact(fd, h, 2)) return false;
+  size_t len = (uint8_t)h[1] & 0x7f;
+  if (len == 126) {
+    if (!readExact(fd, h, 2)) return false;
+    len = (uint8_t)h[0] << 8 | (uint8_t)h[1];
+  } else if (len == 127) {
+    return false;   // nothing here is that big
+  }
+  return readExact(fd, payload, len);
+}
+
+bool wsSendText(int fd, const std::string& text) {
+  static const uint8_t MASK[4] = {0x12, 0x34, 0x56, 0x78};
+  std::string f;
+  f += (char)0x81;
+  f += (char)(0x80 | text.size());   // short frames only
+  f.append((const char*)MASK, 4);
+  for (size_t i = 0; i < text.size(); i++) f += (char)(text[i] ^ MASK[i & 3]);
+  return sendAll(fd, f);
+}
+
+int wsOpen() {
+  int fd = connectLocal();
+  if (fd < 0) return -1;
+  std::string head;
+  bool ok = sendAll(fd, "GET /ws HTTP/1.1\r\nHost: bench\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+  char c;
+  while (ok && head.find("\r\n\r\n") == std::string::npos) {
+    ok = recv(fd, &c, 1, 0) == 1;
+    head += c;
+  }
+  std::string greeting;
+  if (!ok || head.compare(0, 12, "HTTP/1.1 101") || !wsReadFrame(fd, greeting)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+struct LevelResult {
+  BenchStats latency;   // ms
+  uint32_t done = 0, errors = 0;
+  double seconds = 0;
+};
+
+// runs `clients` threads of `op` for LEVEL_MS; each adds its latencies and error count
+template <typename Op>
+LevelResult runLevel(int clients, Op op) {
+  LevelResult res;
+  std::mutex mu;
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> threads;
+  uint64_t t0 = benchNowNs();
+  for (int i = 0; i < clients; i++) {
+    threads.emplace_back([&] {
+      BenchStats local;
+      uint32_t errors = 0;
+      op(stop, local, errors);
+      std::lock_guard<std::mutex> lk(mu);
+      for (double v : local.samples()) res.latency.add(v);
+      res.errors += errors;
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(LEVEL_MS));
+  stop = true;
+  for (std::thread& t : threads) t.join();
+  res.seconds = (benchNowNs() - t0) / 1e9;
+  res.done = (uint32_t)res.latency.count();
+  return res;
+}
+
+void printLevel(const char* what, int clients, const LevelResult& r) {
+  char label[48];
+  snprintf(label, sizeof(label), "%s, %d client%s", what, clients, clients == 1 ? "" : "s");
+  r.latency.print(label, "ms");
+  printf("  %-34s %.0f req/s, %u errors\n", "", r.done / r.seconds, r.errors);
+}
+
+void httpClient(std::atomic<bool>& stop, BenchStats& lat, uint32_t& errors) {
+  while (!stop) {
+    uint64_t t = benchNowNs();
+    if (httpGet("/status")) lat.add((benchNowNs() - t) / 1e6);
+    else errors++;
+  }
+}
+
+void wsClient(std::atomic<bool>& stop, BenchStats& lat, uint32_t& errors) {
+  int fd = wsOpen();
+  if (fd < 0) { errors++; return; }
+  std::string reply;
+  while (!stop) {
+    uint64_t t = benchNowNs();
+    if (wsSendText(fd, "status") && wsReadFrame(fd, reply)) {
+      lat.add((benchNowNs() - t) / 1e6);
+    } else {
+      errors++;
+      break;
+    }
+  }
+  close(fd);
+}
+
+// SinricPro command -> relay 1 pin write, ms
+void measureRelay(const char* label) {
+  BenchStats stats;
+  for (int i = 0; i < RELAY_SAMPLES; i++) {
+    hal::delayMs(20);
+    uint32_t t0 = hal::micros(), at = 0;
+    sim::cloudPowerState(DEVICE_ID_1, i % 2 == 0);
+    if (sim::waitGpioWrite(RELAY_PIN_1, t0, 2000, &at)) stats.add((at - t0) / 1000.0);
+  }
+  stats.print(label, "ms");
+}
+
+bool bootSta(uint16_t listenPort) {
+  sim::setStaReachable(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  while (wifiManagerState() != WIFI_STATE_CONNECTED) hal::delayMs(10);
+  port = sim::httpListen(listenPort);
+  if (!port) printf("  could not listen on 127.0.0.1:%u\n", listenPort);
+  return port != 0;
+}
+
+} // namespace
+
+void benchHttp(const BenchOptions& opt) {
+  if (!bootSta(opt.port)) return;
+  hal::delayMs(100);
+
+  for (int clients : LEVELS) printLevel("GET /status", clients, runLevel(clients, httpClient));
+  for (int clients : WS_LEVELS) printLevel("WS status round trip", clients, runLevel(clients, wsClient));
+
+  measureRelay("sinricpro -> relay, server idle");
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> load;
+  for (int i = 0; i < LEVELS[2]; i++) {
+    load.emplace_back([&] {
+      BenchStats ignored;
+      uint32_t errors = 0;
+      httpClient(stop, ignored, errors);
+    });
+  }
+  hal::delayMs(200);
+  char label[48];
+  snprintf(label, sizeof(label), "sinricpro -> relay, %d HTTP clients", LEVELS[2]);
+  measureRelay(label);
+  stop = true;
+  for (std::thread& t : load) t.join();
+}
+
+void benchServe(const BenchOptions& opt) {
+  if (!bootSta(opt.port ? opt.port : DEFAULT_SERVE_PORT)) return;
+  printf("  serving http://127.0.0.1:%u/ and ws://127.0.0.1:%u/ws -- Ctrl-C to stop\n", port, port);
+  fflush(stdout);
+  for (;;) hal::delayMs(1000);
+}
@@ -0,0 +1,151 @@
+// src/native/bench_ir.cpp
+// IR replay harness: runs an ADC trace through the legacy detector (one
+// analogRead every 100 ms checked against the band) and through IrFilter with
+// the firmware's config, and reports detection latency and false toggles.
+//
+// Trace file (-f): one sample per line, "raw" or "raw,present" where present
+// is the 0/1 ground truth; "# rate_hz=N" sets the sample rate (default
+// IR_SAMPLE_RATE_HZ). Without -f a synthetic trace is generated: noisy
+// presence/absence steps, impulse spikes, a hover just inside the band edge
+// and absences above the band (so the smoothed value sweeps through it).
+
+#include <math.h>
+
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "config.h"
+#include "ir_filter.h"
+
+namespace {
+
+struct Trace {
+  uint32_t rateHz = IR_SAMPLE_RATE_HZ;
+  std::vector<uint16_t> raw;
+  std::vector<int8_t> truth;   // -1 = unlabelled
+  bool labelled = false;
+};
+
+bool loadTrace(const char* path, Trace& t) {
+  FILE* f = fopen(path, "r");
+  if (!f) { printf("  cannot open %s\n", path); return false; }
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#') {
+      unsigned long r;
+      if (sscanf(line, "# rate_hz=%lu", &r) == 1 && r > 0) t.rateHz = (uint32_t)r;
+      continue;
+    }
+    int raw, present;
+    int n = sscanf(line, "%d,%d", &raw, &present);
+    if (n < 1) continue;
+    t.raw.push_back((uint16_t)std::max(0, std::min(4095, raw)));
+    t.truth.push_back(n == 2 ? (int8_t)(present != 0) : (int8_t)-1);
+    t.labelled |= (n == 2);
+  }
+  fclose(f);
+  return !t.raw.empty();
+}
+
+void synthTrace(Trace& t, double seconds) {
+  std::mt19937 rng(7);
+  std::normal_distribution<double> noise(0, 60);
+  std::uniform_real_distribution<double> uni(0, 1);
+  const int mid = (IR_ON_MIN + IR_ON_MAX) / 2;
+  size_t total = (size_t)(seconds * t.rateHz);
+  bool present = false;
+  int segment = 0;
+  while (t.raw.size() < total) {
+    size_t len = (size_t)((0.5 + 2.5 * uni(rng)) * t.rateHz);
+    int level;
+    if (present) level = (segment % 4 == 1) ? IR_ON_MIN + 40 : mid;   // every other presence hovers at the edge
+    else level = (segment % 4 == 2) ? 3700 : 600;                     // some absences sit above the band
+    for (size_t i = 0; i < len && t.raw.size() < total; i++) {
+      double v = level + noise(rng);
+      if (uni(rng) < 0.001) v = uni(rng) * 4095;                      // impulse spike
+      t.raw.push_back((uint16_t)std::max(0.0, std::min(4095.0, v)));
+      t.truth.push_back(present);
+    }
+    present = !present;
+    segment++;
+  }
+  t.labelled = true;
+}
+
+struct Result {
+  BenchStats latency;   // ms
+  int edges = 0;
+  int missed = 0;
+  int toggles = 0;
+  int falseToggles = 0;
+};
+
+// detect(i) must return the detector output after consuming sample i.
+template <typename Detect>
+Result replay(const Trace& t, Detect detect) {
+  Result r;
+  bool out = false;
+  int8_t truth = -1;
+  bool waiting = false;
+  size_t edgeAt = 0;
+  for (size_t i = 0; i < t.raw.size(); i++) {
+    if (t.truth[i] >= 0 && t.truth[i] != truth) {
+      if (truth >= 0) {
+        r.edges++;
+        if (waiting) r.missed++;
+        waiting = (t.truth[i] != out);
+        edgeAt = i;
+      }
+      truth = t.truth[i];
+    }
+    bool next = detect(i);
+    if (next == out) continue;
+    out = next;
+    r.toggles++;
+    if (waiting && out == truth) {
+      r.latency.add((i - edgeAt) * 1000.0 / t.rateHz);
+      waiting = false;
+    } else if (t.labelled) {
+      r.falseToggles++;
+    }
+  }
+  return r;
+}
+
+void report(const char* label, const Result& r, bool labelled) {
+  if (!labelled) { printf("  %-34s toggles=%d\n", label, r.toggles); return; }
+  r.latency.print(label, "ms");
+  printf("  %-34s edges=%d missed=%d toggles=%d false_toggles=%d\n", "", r.edges, r.missed, r.toggles, r.falseToggles);
+}
+
+} // namespace
+
+void benchIr(const BenchOptions& opt) {
+  Trace t;
+  if (opt.file) {
+    if (!loadTrace(opt.file, t)) return;
+  } else {
+    synthTrace(t, opt.samples > 0 ? opt.samples : 120);
+  }
+  printf("  trace: %s, %.1f s @ %u Hz%s\n", opt.file ? opt.file : "synthetic",
+         (double)t.raw.size() / t.rateHz, t.rateHz, t.labelled ? "" : " (unlabelled)");
+
+  // legacy: single analogRead every 100 ms, straight band compare
+  const size_t every = std::max<size_t>(1, t.rateHz / 10);
+  bool legacy = false;
+  Result old = replay(t, [&](size_t i) {
+    if (i % every == 0) legacy = t.raw[i] >= IR_ON_MIN && t.raw[i] <= IR_ON_MAX;
+    return legacy;
+  });
+  report("legacy 100 ms analogRead", old, t.labelled);
+
+  IrFilterConfig cfg = {t.rateHz, (uint16_t)std::max<uint32_t>(1, t.rateHz / 1000), IR_EMA_SHIFT,
+                        (uint16_t)IR_ON_MIN, (uint16_t)IR_ON_MAX, IR_HYSTERESIS, IR_MIN_DWELL_MS};
+  IrFilter filter(cfg);
+  Result neu = replay(t, [&](size_t i) {
+    filter.push(&t.raw[i], 1);
+    return filter.present();
+  });
+  report("IrFilter (1 kHz, median5+EMA)", neu, t.labelled);
+}
@@ -0,0 +1,95 @@
+// src/native/bench_journal.cpp
+// Relay state journal under load, in real time: a toggle storm, sporadic
+// toggles and on/off flapping. For each, reports state changes against
+// journal commits and raw NVS writes (one per change is what writing through
+// would cost), and the longest stretch during which flash held a different
+// state from the relays, i.e. when a power cut would restore the wrong one.
+// Takes about 40 s.
+
+#include <Preferences.h>
+
+#include <random>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "relay_control.h"
+#include "sim.h"
+#include "state_journal.h"
+
+void setup();
+
+namespace {
+
+struct Toggle {
+  uint32_t atMs;   // from scenario start
+  uint8_t relay;
+};
+
+uint32_t flashMask() {
+  Preferences p;
+  p.begin("relays", true);
+  uint64_t v = p.getULong64("state", 0);
+  p.end();
+  return (uint32_t)v;
+}
+
+void runScenario(const char* label, const std::vector<Toggle>& toggles, uint32_t tailMs) {
+  uint32_t commits0 = journalCommitCount(), writes0 = sim::nvsWrites();
+  uint32_t changes = 0, maxUnsavedMs = 0, behindSinceMs = 0;
+  bool behind = false;
+  size_t next = 0;
+  uint32_t t0 = hal::millis();
+  uint32_t endMs = (toggles.empty() ? 0 : toggles.back().atMs) + tailMs;
+
+  for (uint32_t now = 0; now < endMs || behind; now = hal::millis() - t0) {
+    while (next < toggles.size() && toggles[next].atMs <= now) {
+      submitRelayCommand(toggles[next++].relay, RELAY_OP_TOGGLE, SRC_HTTP);
+      changes++;
+    }
+    if (relayStateMask() != flashMask()) {
+      if (!behind) { behind = true; behindSinceMs = now; }
+    } else if (behind) {
+      behind = false;
+      maxUnsavedMs = max(maxUnsavedMs, now - behindSinceMs);
+    }
+    if (now > endMs + JOURNAL_MAX_DEFER_MS * 2) break;  // never caught up
+    hal::delayMs(2);
+  }
+
+  printf("  %-26s changes=%-4u commits=%-3u nvs writes=%-3u (%.3f/change) max unsaved span=%u ms%s\n",
+         label, changes, journalCommitCount() - commits0, sim::nvsWrites() - writes0,
+         changes ? (double)(sim::nvsWrites() - writes0) / changes : 0.0, maxUnsavedMs,
+         relayStateMask() == flashMask() ? "" : "  NOT PERSISTED");
+}
+
+} // namespace
+
+void benchJournal(const BenchOptions&) {
+  sim::setStaReachable(false);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  hal::delayMs(JOURNAL_MIN_INTERVAL_MS);
+
+  std::mt19937 rng(7);
+  std::vector<Toggle> toggles;
+
+  // storm: a random relay every 20..80 ms for 10 s
+  for (uint32_t t = 0; t < 10000; t += std::uniform_int_distribution<uint32_t>(20, 80)(rng)) {
+    toggles.push_back({t, (uint8_t)std::uniform_int_distribution<int>(1, NUM_RELAYS)(rng)});
+  }
+  runScenario("toggle storm (10 s)", toggles, 3000);
+
+  // sporadic: one toggle every 2 s
+  toggles.clear();
+  for (uint32_t i = 0; i < 8; i++) toggles.push_back({i * 2000, (uint8_t)(1 + i % NUM_RELAYS)});
+  runScenario("sporadic (every 2 s)", toggles, 3000);
+
+  // flapping: on and straight back off, ten times
+  toggles.clear();
+  for (uint32_t i = 0; i < 10; i++) {
+    toggles.push_back({i * 500, 2});
+    toggles.push_back({i * 500 + 50, 2});
+  }
+  runScenario("flapping (net no change)", toggles, 3000);
+}
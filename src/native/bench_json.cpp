@@ -0,0 +1,114 @@
+// src/native/bench_json.cpp
+// State serialization: the old String-concatenation builders (kept here
+// verbatim as the baseline) against serializeState(), per message type.
+// Reports ns/message and heap allocations + bytes/message. Host String is
+// std::string-backed, so absolute allocation counts differ a little from the
+// ESP32 core, but the relative picture holds.
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <new>
+
+#include "bench.h"
+#include "state_json.h"
+
+// Global allocation counters for the whole native binary; cheap enough that
+// the other cases are unaffected.
+static std::atomic<uint64_t> allocCount{0};
+static std::atomic<uint64_t> allocBytes{0};
+
+void* operator new(size_t n) {
+  allocCount.fetch_add(1, std::memory_order_relaxed);
+  allocBytes.fetch_add(n, std::memory_order_relaxed);
+  if (void* p = malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+namespace {
+
+const int DEFAULT_SAMPLES = 200000;
+
+// -------- baseline: the pre-serializer code --------
+
+bool relayState1 = true, relayState2 = false, relayState3 = true, relayState4 = false;
+String apSSID = "ESP32-Setup-BEEF";
+int irRaw = 2817;
+
+String legacyRelays() {
+  return String("{\"relay_states\":[") +
+         (relayState1 ? "true" : "false") + "," +
+         (relayState2 ? "true" : "false") + "," +
+         (relayState3 ? "true" : "false") + "," +
+         (relayState4 ? "true" : "false") + "]}";
+}
+
+String legacyStatus() {
+  bool wifiConnected = true;
+  String staIp = IPAddress(192, 168, 1, 50).toString();
+  String modeStr = "STA";
+  String relay4ModeStr = "auto";
+
+  String out = "{";
+  out += "\"mode\":\"" + modeStr + "\",";
+  out += "\"wifi_connected\":" + String(wifiConnected ? "true":"false") + ",";
+  out += "\"sta_ip\":\"" + staIp + "\",";
+  out += "\"ap_ssid\":\"" + apSSID + "\",";
+  out += "\"ir_value\":" + String(irRaw) + ",";
+  out += "\"relay4_mode\":\"" + relay4ModeStr + "\",";
+  out += "\"relay_states\":[" +
+         String(relayState1?"true":"false") + "," +
+         String(relayState2?"true":"false") + "," +
+         String(relayState3?"true":"false") + "," +
+         String(relayState4?"true":"false") + "]";
+  out += "}";
+  return out;
+}
+
+// -------- new path --------
+
+StateSnapshot snapshot() {
+  StateSnapshot s;
+  s.relayMask = 0x5;
+  s.mode = "STA";
+  s.wifiConnected = true;
+  s.staIp = "192.168.1.50";
+  s.apSsid = "ESP32-Setup-BEEF";
+  s.irValue = 2817;
+  s.relay4Mode = RELAY4_MODE_AUTO;
+  return s;
+}
+
+volatile size_t sink;
+
+template <typename Fn>
+void measure(const char* label, int samples, Fn fn) {
+  uint64_t c0 = allocCount, b0 = allocBytes;
+  uint64_t t0 = benchNowNs();
+  for (int i = 0; i < samples; i++) sink = fn();
+  uint64_t ns = benchNowNs() - t0;
+  printf("  %-34s %8.1f ns/msg %6.2f allocs/msg %8.1f bytes/msg\n", label, (double)ns / samples,
+         (double)(allocCount - c0) / samples, (double)(allocBytes - b0) / samples);
+}
+
+} // namespace
+
+void benchJson(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+  const StateSnapshot snap = snapshot();
+  char buf[STATE_JSON_MAX];
+
+  serializeState(buf, sizeof(buf), snap, STATE_RELAYS);
+  bool sameRelays = legacyRelays() == buf;
+  serializeState(buf, sizeof(buf), snap, STATE_FULL);
+  bool sameStatus = legacyStatus() == buf;
+  printf("  output matches baseline: relays=%s status=%s (buffer %zu bytes)\n",
+         sameRelays ? "yes" : "NO", sameStatus ? "yes" : "NO", sizeof(buf));
+
+  measure("String relay_states (old)", samples, [] { return (size_t)legacyRelays().length(); });
+  measure("serializeState relay_states", samples, [&] { return serializeState(buf, sizeof(buf), snap, STATE_RELAYS); });
+  measure("String /status (old)", samples, [] { return (size_t)legacyStatus().length(); });
+  measure("serializeState /status", samples, [&] { return serializeState(buf, sizeof(buf), snap, STATE_FULL); });
+}
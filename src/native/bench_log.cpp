@@ -0,0 +1,185 @@
+// src/native/bench_log.cpp
+// Deferred event log (event_log.h):
+//   - logEvent() cost, alone and with 4 writer threads while a reader takes
+//     snapshots (any torn record is counted),
+//   - a burst of WS-connect log lines: Serial.printf inline (UART model at
+//     115200 baud, see Arduino.h) vs logEvent(),
+//   - the booted firmware under a WS connect/toggle storm with the UART model
+//     on: WS event handler time, and how the log task keeps up or drops,
+//   - the /log dumps (text and binary), written to a file for tools/decode_log.py,
+//   - a flood of more events than the ring holds: what the log task drops.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "config.h"
+#include "event_log.h"
+#include "hal.h"
+#include "metrics.h"
+#include "sim.h"
+#include "wifi_manager.h"
+
+void setup();
+
+namespace {
+
+const int COST_SAMPLES = 1000000;
+const int WRITERS = 4;
+const int BURST_LINES = 20;
+const int STORM_CLIENTS = 16;
+const int STORM_ROUNDS = 10;
+const int FLOOD_EVENTS = 2000;
+const char* const DUMP_FILE = "/tmp/esp32_event_log.bin";
+const LogEventType TEST_TYPE = LOG_TYPE_COUNT;   // formatted as "event N ..."
+
+// spins (relaxed) so the measured writers are not slowed by the reader's sleeps
+int checkSnapshots(std::atomic<bool>& stop, uint32_t& snapshots) {
+  static LogRecord snap[EVENT_LOG_SIZE];
+  int torn = 0;
+  while (!stop.load(std::memory_order_relaxed)) {
+    size_t n = eventLogSnapshot(snap, EVENT_LOG_SIZE);
+    for (size_t i = 0; i < n; i++) {
+      if (snap[i].type == TEST_TYPE && snap[i].v2 != ~snap[i].v1) torn++;
+    }
+    snapshots++;
+  }
+  return torn;
+}
+
+void waitForLogTask(uint32_t timeoutMs) {
+  uint32_t start = hal::millis();
+  for (;;) {
+    EventLogStats s = eventLogStats();
+    if (s.printed + s.lost >= s.logged || hal::millis() - start >= timeoutMs) return;
+    hal::delayMs(10);
+  }
+}
+
+} // namespace
+
+void benchLog(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : COST_SAMPLES;
+
+  // ---- cost of one event ----
+  uint64_t t0 = benchNowNs();
+  for (int i = 0; i < samples; i++) logEvent(TEST_TYPE, 0, i, ~(uint32_t)i);
+  printf("  logEvent, 1 writer: %.1f ns\n", (double)(benchNowNs() - t0) / samples);
+
+  std::atomic<bool> stop{false};
+  uint32_t snapshots = 0;
+  int torn = 0;
+  std::thread reader([&] { torn = checkSnapshots(stop, snapshots); });
+  std::vector<std::thread> writers;
+  t0 = benchNowNs();
+  for (int w = 0; w < WRITERS; w++) {
+    writers.emplace_back([w, samples] {
+      for (int i = 0; i < samples / WRITERS; i++) logEvent(TEST_TYPE, w, i * WRITERS + w, ~(uint32_t)(i * WRITERS + w));
+    });
+  }
+  for (std::thread& t : writers) t.join();
+  double wallNs = (double)(benchNowNs() - t0);
+  stop = true;
+  reader.join();
+  printf("  logEvent, %d writers + reader: %.1f ns/event per writer, %u snapshots, %d torn records\n", WRITERS,
+         wallNs * WRITERS / samples, snapshots, torn);
+
+  // ---- inline Serial.printf vs logEvent, burst of WS connect lines ----
+  sim::setSerialTiming(true);
+  Serial.begin(115200);
+  BenchStats inlineUs, deferredUs;
+  for (int i = 0; i < BURST_LINES; i++) {
+    uint64_t s = benchNowNs();
+    Serial.printf("WS Client %u connected from %d.%d.%d.%d\n", 100u + i, 192, 168, 1, 10 + i);
+    inlineUs.add((benchNowNs() - s) / 1e3);
+  }
+  for (int i = 0; i < BURST_LINES; i++) {
+    uint64_t s = benchNowNs();
+    logEvent(LOG_WS_CONNECT, 0, 100u + i, 0x0A01A8C0u + ((uint32_t)i << 24));
+    deferredUs.add((benchNowNs() - s) / 1e3);
+  }
+  char label[48];
+  snprintf(label, sizeof(label), "%d lines, Serial.printf @115200", BURST_LINES);
+  inlineUs.print(label, "us");
+  snprintf(label, sizeof(label), "%d lines, logEvent", BURST_LINES);
+  deferredUs.print(label, "us");
+
+  // ---- the firmware under a WS storm, UART model on ----
+  sim::setStaReachable(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  while (wifiManagerState() != WIFI_STATE_CONNECTED) hal::delayMs(10);
+  waitForLogTask(5000);
+  EventLogStats before = eventLogStats();
+  StageStats wsBefore, wsAfter;
+  metricsStage(STAGE_WS_EVENT, wsBefore);
+  t0 = benchNowNs();
+  for (int round = 0; round < STORM_ROUNDS; round++) {
+    for (int c = 1; c <= STORM_CLIENTS; c++) sim::wsConnect(c);
+    for (int c = 1; c <= STORM_CLIENTS; c++) {
+      char cmd[16];
+      snprintf(cmd, sizeof(cmd), "toggle:%d", 1 + c % NUM_RELAYS);
+      sim::wsText(c, cmd);
+    }
+    hal::delayMs(20);
+    for (int c = 1; c <= STORM_CLIENTS; c++) sim::wsDisconnect(c);
+    hal::delayMs(20);
+  }
+  double stormMs = (benchNowNs() - t0) / 1e6;
+  metricsStage(STAGE_WS_EVENT, wsAfter);
+  uint32_t wsEvents = wsAfter.count - wsBefore.count;
+  uint32_t maxBucket = 0;
+  for (int b = 0; b < METRICS_BUCKETS; b++) {
+    if (wsAfter.bucket[b] != wsBefore.bucket[b]) maxBucket = b < METRICS_BUCKETS - 1 ? METRICS_BUCKET_US[b] : UINT32_MAX;
+  }
+  uint64_t wsNs = (wsAfter.sumCycles - wsBefore.sumCycles) * 1000 / hal::cyclesPerUs();
+  EventLogStats during = eventLogStats();
+  uint64_t d0 = benchNowNs();
+  waitForLogTask(20000);
+  EventLogStats after = eventLogStats();
+  printf("  WS storm (%d clients x %d rounds, %.0f ms): %u WS events, handler mean %.2f us, max bucket <=%u us\n",
+         STORM_CLIENTS, STORM_ROUNDS, stormMs, wsEvents, wsEvents ? wsNs / 1e3 / wsEvents : 0.0, maxBucket);
+  printf("    events logged %u, printed during the storm %u, drained %.0f ms later, lost %u\n",
+         after.logged - before.logged, during.printed - before.printed, (benchNowNs() - d0) / 1e6,
+         after.lost - before.lost);
+
+  // ---- dumps (the storm's events) ----
+  sim::serialInput("log\n");   // the serial dump, for coverage (output is silenced)
+  sim::httpRequest(HTTP_GET, "/log");
+  hal::delayMs(20);
+  sim::HttpResponse text = sim::lastHttpResponse();
+  int lines = 0;
+  for (unsigned i = 0; i < text.body.length(); i++) lines += text.body[i] == '\n';
+  sim::httpRequest(HTTP_GET, "/log", {{"format", "bin"}});
+  hal::delayMs(20);
+  sim::HttpResponse bin = sim::lastHttpResponse();
+  const std::string& raw = bin.body.str();
+  LogDumpHeader hdr = {};
+  if (raw.size() >= sizeof(hdr)) memcpy(&hdr, raw.data(), sizeof(hdr));
+  bool ok = !memcmp(hdr.magic, "EVL1", 4) && hdr.recordSize == sizeof(LogRecord) &&
+            raw.size() == sizeof(hdr) + hdr.count * sizeof(LogRecord);
+  int gaps = 0;
+  for (unsigned i = 1; ok && i < hdr.count; i++) {
+    LogRecord a, b;
+    memcpy(&a, raw.data() + sizeof(hdr) + (i - 1) * sizeof(LogRecord), sizeof(a));
+    memcpy(&b, raw.data() + sizeof(hdr) + i * sizeof(LogRecord), sizeof(b));
+    if ((uint16_t)(a.seq + 1) != b.seq) gaps++;
+  }
+  printf("  GET /log: HTTP %d, %d lines; ?format=bin: HTTP %d, %zu bytes, %s, %u records, %d seq gaps\n",
+         text.code, lines, bin.code, raw.size(), ok ? "header ok" : "BAD HEADER", hdr.count, gaps);
+  if (FILE* f = fopen(DUMP_FILE, "wb")) {
+    fwrite(raw.data(), 1, raw.size(), f);
+    fclose(f);
+    printf("  binary dump written to %s (python3 tools/decode_log.py %s)\n", DUMP_FILE, DUMP_FILE);
+  }
+
+  // ---- flood: more events than the ring holds, faster than the UART ----
+  before = eventLogStats();
+  for (int i = 0; i < FLOOD_EVENTS; i++) logEvent(TEST_TYPE, 0, i, ~(uint32_t)i);
+  waitForLogTask(20000);
+  after = eventLogStats();
+  printf("  flood of %d events: printed %u, lost %u (ring %d)\n", FLOOD_EVENTS, after.printed - before.printed,
+         after.lost - before.lost, EVENT_LOG_SIZE);
+  sim::setSerialTiming(false);
+}
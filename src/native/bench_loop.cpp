@@ -0,0 +1,124 @@
+// src/native/bench_loop.cpp
+// Boots the firmware with setup() (which starts its tasks) and runs loop() on
+// a worker thread, as the Arduino loopTask would, while commands are injected
+// from the bench thread at random phase. Reports loop() cost with
+// hal::delayMs time excluded, and the latency distribution from command
+// arrival to the resulting writeRelay for each input path.
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "sim.h"
+#include "wifi_manager.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const int DEFAULT_SAMPLES = 40;
+
+std::atomic<bool> running{false};
+std::mutex costMu;
+BenchStats loopCost;  // us
+
+void loopRunner() {
+  while (running) {
+    uint64_t slept0 = sim::sleptNs();
+    uint64_t t0 = benchNowNs();
+    loop();
+    uint64_t busy = benchNowNs() - t0 - (sim::sleptNs() - slept0);
+    std::lock_guard<std::mutex> lk(costMu);
+    loopCost.add(busy / 1000.0);
+  }
+}
+
+void startLoop() {
+  {
+    std::lock_guard<std::mutex> lk(costMu);
+    loopCost.clear();
+  }
+  running = true;
+  std::thread(loopRunner).detach();
+  hal::delayMs(300);  // let the loop settle before measuring
+}
+
+void stopLoop(const char* label) {
+  running = false;
+  hal::delayMs(200);
+  std::lock_guard<std::mutex> lk(costMu);
+  loopCost.print(label, "us");
+}
+
+std::mt19937 rng(1234);
+
+// Injects one command at a random point of the loop's cycle and returns the
+// time until `pin` is written, in ms (negative on timeout).
+template <typename Inject>
+double commandLatency(int pin, Inject inject) {
+  hal::delayMs(std::uniform_int_distribution<int>(20, 200)(rng));
+  uint32_t t0 = hal::micros();
+  inject();
+  uint32_t at = 0;
+  if (!sim::waitGpioWrite(pin, t0, 2000, &at)) return -1;
+  return (at - t0) / 1000.0;
+}
+
+template <typename Inject>
+void measurePath(const char* label, int pin, int samples, Inject inject) {
+  BenchStats stats;
+  int timeouts = 0;
+  for (int i = 0; i < samples; i++) {
+    double ms = commandLatency(pin, [&] { inject(i); });
+    if (ms < 0) timeouts++;
+    else stats.add(ms);
+  }
+  stats.print(label, "ms");
+  stats.printHistogram("ms");
+  if (timeouts) printf("  %-34s %d command(s) never reached the relay\n", "", timeouts);
+}
+
+} // namespace
+
+void benchLoop(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+
+  // --- AP mode (BOOT held), one WS client connected ---
+  sim::setStaReachable(false);
+  sim::setInput(BOOT_BUTTON_PIN, false);
+  setup();
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  startLoop();
+  sim::wsConnect(0);
+  hal::delayMs(100);
+
+  measurePath("latency ws toggle:1", RELAY_PIN_1, samples,
+              [](int) { sim::wsText(0, "toggle:1"); });
+  measurePath("latency http /toggle?relay=2", RELAY_PIN_2, samples,
+              [](int) { sim::httpRequest(HTTP_GET, "/toggle", {{"relay", "2"}}); });
+
+  sim::httpRequest(HTTP_GET, "/relay4_mode", {{"mode", "auto"}});
+  hal::delayMs(100);
+  measurePath("latency ir auto (relay 4)", RELAY_PIN_4, samples,
+              [](int i) { sim::setAdc(IR_PIN, (i % 2 == 0) ? (IR_ON_MIN + IR_ON_MAX) / 2 : 0); });
+  sim::setAdc(IR_PIN, 0);
+  stopLoop("loop() cost, AP + 1 WS client");
+
+  // --- STA mode: SinricPro, and the same HTTP/WS server on the LAN ---
+  sim::setStaReachable(true);
+  setup();
+  while (wifiManagerState() != WIFI_STATE_CONNECTED) hal::delayMs(10);  // STA joins in the background
+  startLoop();
+  measurePath("latency sinricpro onPowerState", RELAY_PIN_1, samples,
+              [](int i) { sim::cloudPowerState(DEVICE_ID_1, i % 2 == 0); });
+  measurePath("latency ws toggle:3 (STA)", RELAY_PIN_3, samples,
+              [](int) { sim::wsText(0, "toggle:3"); });
+  measurePath("latency http /toggle?relay=2 (STA)", RELAY_PIN_2, samples,
+              [](int) { sim::httpRequest(HTTP_GET, "/toggle", {{"relay", "2"}}); });
+  stopLoop("loop() cost, STA + SinricPro + 1 WS client");
+}
@@ -0,0 +1,141 @@
+// src/native/bench_metrics.cpp
+// Runtime metrics (metrics.h): boots in STA mode with MQTT and a WS client,
+// drives commands through every input path for a few seconds, then scrapes
+// /metrics. Reports per-stage counts and mean times from the histograms, the
+// cost of one StageTimer (tight loop, and as measured at boot) and what that
+// costs each stage and the firmware as a whole, and checks the exposition
+// (cumulative buckets, +Inf == _count) and the WS "metrics:<ms>" topic.
+
+#include <map>
+#include <string>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "metrics.h"
+#include "mqtt_link.h"
+#include "sim.h"
+#include "wifi_manager.h"
+
+void setup();
+
+namespace {
+
+const uint32_t LOAD_MS = 3000;
+const int TIMER_SAMPLES = 1000000;
+const uint32_t WS_METRICS_MS = 500;
+
+// sanity checks on the Prometheus text; returns the number of problems
+int checkExposition(const std::string& text, std::map<std::string, uint32_t>& counts) {
+  int problems = 0;
+  std::map<std::string, uint32_t> lastBucket;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t eol = text.find('\n', pos);
+    if (eol == std::string::npos) { problems++; break; }   // every line ends in \n
+    std::string line = text.substr(pos, eol - pos);
+    pos = eol + 1;
+    if (line.empty() || line[0] == '#') continue;
+    size_t sp = line.rfind(' ');
+    if (sp == std::string::npos) { problems++; continue; }
+    std::string name = line.substr(0, sp);
+    double v = strtod(line.c_str() + sp + 1, nullptr);
+    size_t st = name.find("stage=\"");
+    std::string stage = st == std::string::npos ? "" : name.substr(st + 7, name.find('"', st + 7) - st - 7);
+    if (name.compare(0, 27, "esp32_stage_seconds_bucket{") == 0) {
+      if (v < lastBucket[stage]) problems++;   // buckets are cumulative
+      lastBucket[stage] = (uint32_t)v;
+    } else if (name.compare(0, 26, "esp32_stage_seconds_count{") == 0) {
+      if ((uint32_t)v != lastBucket[stage]) problems++;   // +Inf bucket == count
+      counts[stage] = (uint32_t)v;
+    }
+  }
+  return problems;
+}
+
+} // namespace
+
+void benchMetrics(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : TIMER_SAMPLES;
+
+  sim::setStaReachable(true);
+  sim::setMqttBrokerUp(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  while (wifiManagerState() != WIFI_STATE_CONNECTED) hal::delayMs(10);
+  for (int i = 0; i < 200 && !mqttLinkConnected(); i++) hal::delayMs(10);
+  // an empty timed scope, on its own (after setup(): metricsBegin() has run)
+  uint64_t t0 = benchNowNs();
+  for (int i = 0; i < samples; i++) StageTimer t(STAGE_COUNT);
+  double timerNs = (double)(benchNowNs() - t0) / samples;
+
+  sim::wsConnect(1);
+  char sub[24];
+  snprintf(sub, sizeof(sub), "metrics:%u", WS_METRICS_MS);
+  sim::wsText(1, sub);
+
+  // every input path, for LOAD_MS
+  StageStats before[STAGE_COUNT];
+  for (int s = 0; s < STAGE_COUNT; s++) metricsStage((MetricStage)s, before[s]);
+  uint32_t start = hal::millis();
+  for (int i = 0; hal::millis() - start < LOAD_MS; i++) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "toggle:%d", 1 + i % NUM_RELAYS);
+    sim::wsText(1, buf);
+    snprintf(buf, sizeof(buf), "%d", 1 + (i + 1) % NUM_RELAYS);
+    sim::httpRequest(HTTP_GET, "/toggle", {{"relay", buf}});
+    if (i % 4 == 0) sim::cloudPowerState(DEVICE_ID_2, i % 8 == 0);
+    if (i % 4 == 2) sim::mqttInject((String(MQTT_BASE_TOPIC) + "/relay/3/set").c_str(), "TOGGLE");
+    hal::delayMs(5);
+  }
+  hal::delayMs(50);
+
+  printf("  %-12s %8s %10s %10s %9s\n", "stage", "runs", "mean us", "max bucket", "timer %");
+  uint64_t totalNs = 0, totalRuns = 0;
+  uint32_t perUs = hal::cyclesPerUs();
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    StageStats st;
+    metricsStage((MetricStage)s, st);
+    uint32_t runs = st.count - before[s].count;
+    uint64_t ns = (st.sumCycles - before[s].sumCycles) * 1000 / perUs;
+    int top = -1;
+    for (int b = 0; b < METRICS_BUCKETS; b++) if (st.bucket[b] != before[s].bucket[b]) top = b;
+    char topLabel[16] = "-";
+    if (top >= 0 && top < METRICS_BUCKETS - 1) snprintf(topLabel, sizeof(topLabel), "<=%u", METRICS_BUCKET_US[top]);
+    else if (top >= 0) snprintf(topLabel, sizeof(topLabel), "+Inf");
+    double mean = runs ? ns / 1000.0 / runs : 0;
+    printf("  %-12s %8u %10.2f %10s %8.2f%%\n", metricsStageName((MetricStage)s), runs, mean, topLabel,
+           runs ? 100.0 * timerNs / (ns / (double)runs) : 0.0);
+    totalNs += ns;
+    totalRuns += runs;
+  }
+  printf("  StageTimer cost: %.1f ns (loop), %u ns (measured at boot)\n", timerNs, metricsRecordNs());
+  printf("  instrumentation overhead: %.3f%% of the %.1f ms spent in timed stages over %u ms\n",
+         totalNs ? 100.0 * timerNs * totalRuns / totalNs : 0.0, totalNs / 1e6, LOAD_MS);
+
+  // scrape
+  uint64_t s0 = benchNowNs();
+  sim::httpRequest(HTTP_GET, "/metrics");
+  sim::HttpResponse resp;
+  for (int i = 0; i < 100; i++) {
+    hal::delayMs(2);
+    resp = sim::lastHttpResponse();
+    if (resp.body.startsWith("# HELP")) break;
+  }
+  double scrapeMs = (benchNowNs() - s0) / 1e6;
+  std::map<std::string, uint32_t> counts;
+  int problems = checkExposition(resp.body.c_str(), counts);
+  printf("  /metrics: HTTP %d, %u bytes (buffer %u), %zu stages, %d format problems, %.2f ms to answer\n",
+         resp.code, resp.body.length(), (unsigned)METRICS_TEXT_MAX, counts.size(), problems, scrapeMs);
+
+  // WS topic
+  int frames = 0;
+  size_t frameLen = 0;
+  for (const String& f : sim::wsTake(1)) {
+    if (!f.startsWith("{\"metrics\":")) continue;
+    frames++;
+    frameLen = f.length();
+  }
+  printf("  WS metrics:%u over %u ms -> %d frames of %zu bytes (buffer %u)\n", WS_METRICS_MS, LOAD_MS + 50,
+         frames, frameLen, (unsigned)METRICS_JSON_MAX);
+}
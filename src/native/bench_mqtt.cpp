@@ -0,0 +1,93 @@
+// src/native/bench_mqtt.cpp
+// MQTT transport against the simulated broker: command-to-actuation latency
+// (publish on <base>/relay/1/set until the relay pin is written) and the
+// full round trip to the retained state publish; how far a burst of
+// commands is coalesced; and reconnection after a broker restart.
+// tools/mqtt_latency.py measures the same round trip on a real board
+// through mosquitto.
+
+#include <random>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "mqtt_link.h"
+#include "relay_control.h"
+#include "sim.h"
+#include "wifi_manager.h"
+
+void setup();
+
+namespace {
+
+const int DEFAULT_SAMPLES = 40;
+const int BURST = 100;
+
+String topic(const char* suffix) { return String(MQTT_BASE_TOPIC) + "/" + suffix; }
+
+bool waitUntil(uint32_t timeoutMs, bool (*done)()) {
+  for (uint32_t t = 0; t < timeoutMs; t += 5) {
+    if (done()) return true;
+    hal::delayMs(5);
+  }
+  return done();
+}
+
+} // namespace
+
+void benchMqtt(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+
+  sim::setStaReachable(true);
+  sim::setMqttBrokerUp(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  if (!waitUntil(10000, mqttLinkConnected)) {
+    printf("  MQTT never connected (MQTT_HOST empty?)\n");
+    return;
+  }
+  hal::delayMs(50);
+
+  const String set1 = topic("relay/1/set"), state1 = topic("relay/1/state");
+  std::mt19937 rng(99);
+  BenchStats actuation, roundTrip;
+  for (int i = 0; i < samples; i++) {
+    hal::delayMs(std::uniform_int_distribution<int>(10, 60)(rng));
+    bool on = !relayIsOn(1);
+    uint32_t t0 = hal::micros(), pinAt = 0, pubAt = 0;
+    sim::mqttInject(set1.c_str(), on ? "ON" : "OFF");
+    if (sim::waitGpioWrite(RELAY_PIN_1, t0, 2000, &pinAt)) actuation.add((pinAt - t0) / 1000.0);
+    if (sim::mqttWaitPublish(state1.c_str(), t0, 2000, &pubAt, nullptr)) roundTrip.add((pubAt - t0) / 1000.0);
+  }
+  actuation.print("set -> relay pin", "ms");
+  actuation.printHistogram("ms");
+  roundTrip.print("set -> retained state publish", "ms");
+
+  // burst: toggles spread over every relay, injected back to back
+  hal::delayMs(100);
+  uint32_t pubs0 = sim::mqttPublishCount();
+  for (int i = 0; i < BURST; i++) {
+    String t = topic(("relay/" + String(1 + i % NUM_RELAYS) + "/set").c_str());
+    sim::mqttInject(t.c_str(), "TOGGLE");
+  }
+  hal::delayMs(200);
+  bool retainedOk = true;
+  for (int r = 1; r <= NUM_RELAYS; r++) {
+    String t = topic(("relay/" + String(r) + "/state").c_str());
+    retainedOk &= sim::mqttRetained(t.c_str()) == (relayIsOn(r) ? "ON" : "OFF");
+  }
+  printf("  burst of %d commands -> %u state publishes, retained state %s\n", BURST,
+         sim::mqttPublishCount() - pubs0, retainedOk ? "matches relays" : "STALE");
+
+  // broker restart: will goes out, client reconnects and republishes
+  String status = topic("status");
+  sim::setMqttBrokerUp(false);
+  hal::delayMs(20);
+  printf("  broker down: retained status \"%s\"\n", sim::mqttRetained(status.c_str()).c_str());
+  hal::delayMs(500);
+  uint32_t t0 = hal::millis();
+  sim::setMqttBrokerUp(true);
+  bool back = waitUntil(60000, mqttLinkConnected);
+  printf("  broker up: %s after %u ms, status \"%s\"\n", back ? "reconnected" : "NOT reconnected",
+         hal::millis() - t0, sim::mqttRetained(status.c_str()).c_str());
+}
@@ -0,0 +1,368 @@
+// src/native/bench_ota.cpp
+// Firmware upload (ota_update.h) over a real loopback socket. The firmware
+// boots in STA mode and serves on 127.0.0.1; a client POSTs an image to
+// /update the way tools/ota_upload.py does. Reports upload throughput with
+// flash timing off (network + hash + buffer hand-off: the ceiling) and on
+// (simulated sector erase and page program), how long the HTTP handler waited
+// for a free buffer, and WS toggle-to-relay latency during an upload against
+// idle. Then the failure paths: wrong digest, not an app image, a missing
+// or wrong password, a second upload while one runs, bad requests, a client
+// that disappears mid-body, and a new image that never gets confirmed
+// being rolled back on its (OTA_TRIAL_BOOTS + 1)-th boot.
+//
+// The image is 1 MB of noise behind an app image header, or -f firmware.bin.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "ota_update.h"
+#include "relay_control.h"
+#include "sim.h"
+#include "wifi_manager.h"
+
+void setup();
+
+namespace {
+
+const int DEFAULT_SAMPLES = 3;
+const size_t DEFAULT_IMAGE_BYTES = 1 << 20;
+const size_t CLIENT_WRITE = 16384;
+const uint32_t PROBE_MS = 50;        // mean gap between WS toggle probes (jittered, so
+                                     // they do not lock onto the sector write period)
+const uint32_t RESTART_WAIT_MS = 2000;
+
+uint16_t port = 0;
+
+struct Upload {
+  int status = 0;          // 0 = no response
+  double ms = 0;           // first byte sent to response read
+  std::string text;
+};
+
+int connectLocal() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  timeval tv{30, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  sockaddr_in a{};
+  a.sin_family = AF_INET;
+  a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  a.sin_port = htons(port);
+  if (connect(fd, (sockaddr*)&a, sizeof(a))) { close(fd); return -1; }
+  return fd;
+}
+
+bool sendAll(int fd, const void* data, size_t len) {
+  for (size_t off = 0; off < len;) {
+    ssize_t n = send(fd, (const char*)data + off, len - off, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    off += n;
+  }
+  return true;
+}
+
+std::string hexDigest(const std::vector<uint8_t>& data) {
+  uint8_t d[32];
+  hal::sha256Begin();
+  hal::sha256Update(data.data(), data.size());
+  hal::sha256Finish(d);
+  std::string hex;
+  char b[3];
+  for (uint8_t v : d) {
+    snprintf(b, sizeof(b), "%02x", v);
+    hex += b;
+  }
+  return hex;
+}
+
+// "Authorization: Basic ..." for user:password
+std::string basicAuth(const std::string& userPassword) {
+  static const char* T = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out = "Authorization: Basic ";
+  for (size_t i = 0; i < userPassword.size(); i += 3) {
+    uint32_t v = (uint8_t)userPassword[i] << 16;
+    if (i + 1 < userPassword.size()) v |= (uint8_t)userPassword[i + 1] << 8;
+    if (i + 2 < userPassword.size()) v |= (uint8_t)userPassword[i + 2];
+    out += T[(v >> 18) & 63];
+    out += T[(v >> 12) & 63];
+    out += i + 1 < userPassword.size() ? T[(v >> 6) & 63] : '=';
+    out += i + 2 < userPassword.size() ? T[v & 63] : '=';
+  }
+  return out + "\r\n";
+}
+
+// POST /update; sends only the first `sendBytes` of the body (the client
+// then vanishes) when that is less than the image
+Upload post(const std::vector<uint8_t>& image, const std::string& sha, size_t sendBytes = SIZE_MAX,
+            bool withLength = true, const std::string& password = OTA_PASSWORD) {
+  Upload u;
+  int fd = connectLocal();
+  if (fd < 0) return u;
+  std::string head = "POST /update HTTP/1.1\r\nHost: bench\r\nContent-Type: application/octet-stream\r\n";
+  if (withLength) head += "Content-Length: " + std::to_string(image.size()) + "\r\n";
+  if (!sha.empty()) head += "X-Firmware-SHA256: " + sha + "\r\n";
+  if (!password.empty()) head += basicAuth(std::string(OTA_USER) + ":" + password);
+  head += "\r\n";
+  uint64_t t0 = benchNowNs();
+  bool ok = sendAll(fd, head.data(), head.size());
+  size_t body = withLength ? std::min(sendBytes, image.size()) : 0;
+  for (size_t off = 0; ok && off < body; off += CLIENT_WRITE) {
+    ok = sendAll(fd, image.data() + off, std::min(CLIENT_WRITE, body - off));
+  }
+  if (ok && body == (withLength ? image.size() : 0)) {
+    char buf[1024];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) u.text.append(buf, n);
+    if (u.text.compare(0, 9, "HTTP/1.1 ") == 0) u.status = atoi(u.text.c_str() + 9);
+    size_t at = u.text.find("\r\n\r\n");
+    u.text = at == std::string::npos ? std::string() : u.text.substr(at + 4);
+  }
+  u.ms = (benchNowNs() - t0) / 1e6;
+  close(fd);
+  return u;
+}
+
+template <typename Pred>
+bool waitFor(uint32_t timeoutMs, Pred done) {
+  for (uint64_t t0 = benchNowNs(); !done();) {
+    if ((benchNowNs() - t0) / 1000000 >= timeoutMs) return false;
+    hal::delayMs(5);
+  }
+  return true;
+}
+
+// what the bootloader would do after the restart the net task asks for
+bool rebootAfter(uint32_t restartsBefore) {
+  if (!waitFor(RESTART_WAIT_MS, [&] { return sim::restarts() > restartsBefore; })) return false;
+  sim::otaBoot();
+  otaUpdateBegin();
+  return true;
+}
+
+// a WS client on its own socket, as the UI is; -1 if the upgrade fails
+int wsOpen() {
+  int fd = connectLocal();
+  if (fd < 0) return -1;
+  const char* req = "GET /ws HTTP/1.1\r\nHost: bench\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+  std::string head;
+  char c;
+  bool ok = sendAll(fd, req, strlen(req));
+  while (ok && head.find("\r\n\r\n") == std::string::npos) {
+    ok = recv(fd, &c, 1, 0) == 1;
+    head += c;
+  }
+  if (!ok || head.compare(0, 12, "HTTP/1.1 101")) { close(fd); return -1; }
+  return fd;
+}
+
+bool wsSendText(int fd, const char* text) {
+  static const uint8_t MASK[4] = {0x12, 0x34, 0x56, 0x78};
+  size_t len = strlen(text);   // short frames only
+  std::string f;
+  f += (char)0x81;
+  f += (char)(0x80 | len);
+  f.append((const char*)MASK, 4);
+  for (size_t i = 0; i < len; i++) f += (char)(text[i] ^ MASK[i & 3]);
+  return sendAll(fd, f.data(), f.size());
+}
+
+// WS toggle frame -> relay 2 pin write, ms; a probe every ~PROBE_MS until
+// `stop`. The state pushes that come back are just drained.
+void probeRelay(std::atomic<bool>& stop, BenchStats& lat) {
+  std::mt19937 rng(lat.count());
+  std::uniform_int_distribution<uint32_t> gap(PROBE_MS / 2, PROBE_MS * 3 / 2);
+  int fd = wsOpen();
+  if (fd < 0) { printf("  WS upgrade failed\n"); return; }
+  char drain[4096];
+  while (!stop) {
+    while (recv(fd, drain, sizeof(drain), MSG_DONTWAIT) > 0) {}
+    uint32_t t0 = hal::micros(), at = 0;
+    if (!wsSendText(fd, "toggle:2")) break;
+    if (sim::waitGpioWrite(RELAY_PIN_2, t0, 2000, &at)) lat.add((at - t0) / 1000.0);
+    hal::delayMs(gap(rng));
+  }
+  close(fd);
+}
+
+const char* verdict(bool ok) { return ok ? "ok" : "WRONG"; }
+
+} // namespace
+
+void benchOta(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+
+  // the hash everything below relies on (FIPS 180-2 examples)
+  std::vector<uint8_t> abc = {'a', 'b', 'c'};
+  bool shaOk = hexDigest(abc) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" &&
+               hexDigest({}) == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+  printf("  sha256 test vectors: %s\n", verdict(shaOk));
+  // RFC 4231 test case 2, for the peer link's frame tags
+  const char* jefe = "Jefe";
+  const char* want = "what do ya want for nothing?";
+  uint8_t mac[32];
+  hal::hmacSha256((const uint8_t*)jefe, 4, (const uint8_t*)want, strlen(want), mac);
+  std::string hex;
+  char b[3];
+  for (uint8_t v : mac) {
+    snprintf(b, sizeof(b), "%02x", v);
+    hex += b;
+  }
+  printf("  hmac-sha256 test vector: %s\n",
+         verdict(hex == "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843"));
+
+  std::vector<uint8_t> image;
+  if (opt.file) {
+    FILE* f = fopen(opt.file, "rb");
+    if (!f) { printf("  cannot open %s\n", opt.file); return; }
+    uint8_t buf[65536];
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) image.insert(image.end(), buf, buf + n);
+    fclose(f);
+  } else {
+    std::mt19937 rng(20);
+    image.resize(DEFAULT_IMAGE_BYTES);
+    for (uint8_t& b : image) b = (uint8_t)rng();
+    image[0] = 0xE9;   // ESP_IMAGE_HEADER_MAGIC
+  }
+  std::string sha = hexDigest(image);
+  printf("  image: %zu bytes, sha256 %.16s...\n", image.size(), sha.c_str());
+
+  sim::setStaReachable(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  if (!waitFor(20000, [] { return wifiManagerState() == WIFI_STATE_CONNECTED; })) {
+    printf("  STA never connected\n");
+    return;
+  }
+  port = sim::httpListen(opt.port);
+  if (!port) { printf("  could not listen on 127.0.0.1:%u\n", opt.port); return; }
+  hal::delayMs(200);
+
+  std::atomic<bool> stop{false};
+  BenchStats idle;
+  std::thread idleProbe(probeRelay, std::ref(stop), std::ref(idle));
+  hal::delayMs(2000);
+  stop = true;
+  idleProbe.join();
+  idle.print("WS toggle -> relay, idle", "ms");
+
+  // -------- good uploads --------
+  for (int timing = 0; timing < 2; timing++) {
+    sim::setFlashTiming(timing);
+    BenchStats rate, stall, during;
+    int good = 0;
+    for (int i = 0; i < samples; i++) {
+      uint32_t restartsBefore = sim::restarts();
+      int target = 1 - sim::otaBootSlot();
+      stop = false;
+      std::thread probe;
+      if (timing) probe = std::thread(probeRelay, std::ref(stop), std::ref(during));
+      Upload u = post(image, sha);
+      stop = true;
+      if (probe.joinable()) probe.join();
+      bool landed = u.status == 200 && sim::otaBootSlot() == target && sim::otaSlot(target) == image;
+      good += landed && rebootAfter(restartsBefore);
+      if (u.status == 200) {
+        rate.add(image.size() / 1024.0 / (u.ms / 1000.0));
+        stall.add(otaStats().stallMs);
+      } else {
+        printf("  upload %d: HTTP %d %s\n", i + 1, u.status, u.text.c_str());
+      }
+    }
+    printf("  -- flash timing %s --\n", timing ? "on (45 ms/sector erase, 0.4 ms/page)" : "off");
+    rate.print("upload throughput", "KB/s");
+    stall.print("handler waited for a free buffer", "ms");
+    if (timing) during.print("WS toggle -> relay, uploading", "ms");
+    printf("  verified, written to the spare slot, selected, restarted: %d/%d\n", good, samples);
+  }
+  printf("  last upload: %u ms first byte to verified; trial after the reboot: %s\n", otaStats().lastMs,
+         otaStats().trial ? "yes" : "NO");
+
+  // -------- refusals and failures --------
+  sim::setFlashTiming(false);
+  int slot = sim::otaBootSlot();
+  uint32_t failuresBefore = otaStats().failures;
+
+  std::string wrong = sha;
+  wrong[0] = wrong[0] == '0' ? '1' : '0';
+  Upload u = post(image, wrong);
+  printf("  wrong X-Firmware-SHA256: HTTP %d (%s), boot slot kept: %s\n", u.status, u.text.c_str(),
+         verdict(u.status == 422 && sim::otaBootSlot() == slot));
+
+  std::vector<uint8_t> notImage = image;
+  notImage[0] = 0;
+  u = post(notImage, hexDigest(notImage));
+  printf("  not an app image: HTTP %d (%s), boot slot kept: %s\n", u.status, u.text.c_str(),
+         verdict(u.status == 422 && sim::otaBootSlot() == slot));
+
+  u = post(image, sha, SIZE_MAX, true, "");
+  printf("  no password: HTTP %d, %s\n", u.status, verdict(u.status == 401 && sim::otaBootSlot() == slot));
+  u = post(image, sha, SIZE_MAX, true, std::string(OTA_PASSWORD) + "x");
+  printf("  wrong password: HTTP %d, %s\n", u.status, verdict(u.status == 401 && sim::otaBootSlot() == slot));
+  u = post(image, "");
+  printf("  no X-Firmware-SHA256: HTTP %d, %s\n", u.status, verdict(u.status == 400));
+  u = post(image, sha, SIZE_MAX, false);
+  printf("  no body: HTTP %d, %s\n", u.status, verdict(u.status == 400));
+
+  // one upload at a time: a second one while the first is still sending
+  sim::setFlashTiming(true);
+  uint32_t restartsBefore = sim::restarts();
+  Upload first, second;
+  std::thread a([&] { first = post(image, sha); });
+  hal::delayMs(300);
+  second = post(image, sha);
+  a.join();
+  printf("  second upload meanwhile: HTTP %d (%s), first still HTTP %d: %s\n", second.status,
+         second.text.c_str(), first.status, verdict(second.status == 409 && first.status == 200));
+  rebootAfter(restartsBefore);
+  sim::setFlashTiming(false);
+
+  // the client goes away half way: nothing answers, the ota task gives up
+  slot = sim::otaBootSlot();
+  uint64_t t0 = benchNowNs();
+  post(image, sha, image.size() / 2);
+  u = post(image, sha);
+  bool busy = u.status == 409;
+  bool freed = waitFor(OTA_STALL_MS + 2000, [&] { return otaStats().failures > failuresBefore + 2; });
+  double freedMs = (benchNowNs() - t0) / 1e6;
+  printf("  client gone half way: retry at once HTTP %d, abandoned after %.0f ms (stall limit %u ms), "
+         "boot slot kept: %s\n", u.status, freed ? freedMs : -1.0, OTA_STALL_MS,
+         verdict(busy && freed && sim::otaBootSlot() == slot));
+  restartsBefore = sim::restarts();
+  u = post(image, sha);
+  printf("  upload after that: HTTP %d, %s\n", u.status, verdict(u.status == 200 && rebootAfter(restartsBefore)));
+  printf("  failures counted: %u (3 expected)\n", otaStats().failures - failuresBefore);
+
+  // -------- trial boots --------
+  // the image just installed never reaches OTA_CONFIRM_MS: power-cycle it
+  int trialSlot = sim::otaBootSlot();
+  restartsBefore = sim::restarts();
+  int boots = 1;   // rebootAfter() above was the first
+  while (sim::otaBootSlot() == trialSlot && boots <= OTA_TRIAL_BOOTS + 1) {
+    sim::otaBoot();
+    otaUpdateBegin();
+    boots++;
+  }
+  bool restarted = waitFor(RESTART_WAIT_MS, [&] { return sim::restarts() > restartsBefore; });
+  printf("  unconfirmed image: rolled back at boot %d (OTA_TRIAL_BOOTS %u), to slot %d, restart %s: %s\n", boots,
+         OTA_TRIAL_BOOTS, sim::otaBootSlot(), restarted ? "asked" : "NOT ASKED",
+         verdict(boots == OTA_TRIAL_BOOTS + 1 && sim::otaBootSlot() != trialSlot && restarted));
+  sim::otaBoot();
+  otaUpdateBegin();
+  printf("  previous image after the rollback: on trial %s\n", otaStats().trial ? "YES" : "no");
+}
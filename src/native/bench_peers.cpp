@@ -0,0 +1,380 @@
+// src/native/bench_peers.cpp
+// ESP-NOW peer link on the simulated air (sim_peer.cpp), with no router:
+// the firmware (node F, in setup-AP mode) plus PeerLink nodes run here
+// next to it, each with 4 relays that switch as soon as a command is
+// applied. A, B and C hear F and each other; D hears only C, E only D, so
+// F reaches D through one node and E through two. For commands both ways:
+// time to the owner's relay, to the sender's acknowledgement, and until
+// the sender sees the owner's new state. Then a recorded command played back
+// long after, 20% and 50% frame loss, a node with another PEER_KEY, a node
+// out of reach, and the idle air time heartbeats take. Takes about 25 s.
+
+#include <Preferences.h>
+#include <string.h>
+
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "ir_remote.h"
+#include "peer_link.h"
+#include "relay_control.h"
+#include "sim.h"
+
+void setup();
+
+namespace {
+
+const int DEFAULT_SAMPLES = 20;
+const int LOSS_COMMANDS = 200;
+const double LOSS_RATES[] = {0.2, 0.5};
+const uint32_t TICK_MS = 2;           // as the firmware's net task
+
+template <typename Pred>
+bool waitUntil(uint32_t timeoutMs, Pred done) {
+  uint32_t t0 = hal::millis();
+  while (!done()) {
+    if (hal::millis() - t0 >= timeoutMs) return false;
+    hal::delayMs(1);
+  }
+  return true;
+}
+
+// A controller of its own: PeerLink on a station of the air, 4 relays.
+struct Node {
+  std::mutex mu;
+  int station = -1;
+  PeerLink link;
+  uint32_t state = 0;
+  uint32_t applied = 0;
+  uint32_t appliedAtUs = 0;
+  bool answered = false;
+  PeerError result = PEER_OK;
+  std::vector<uint8_t> lastCommand;   // as a receiver in range would record it
+
+  explicit Node(uint16_t id, const char* key = PEER_KEY) : link(id, {this, send, apply, done, nullptr, nullptr}, key) {
+    uint8_t mac[6] = {0x02, 0x00, 0x00, 0x00, (uint8_t)(id >> 8), (uint8_t)id};
+    station = sim::peerStationAdd(mac, receive, this);
+  }
+
+  // called from link calls, lock held
+  static bool send(void* ctx, const uint8_t mac[6], const uint8_t* frame, size_t len) {
+    Node* n = (Node*)ctx;
+    if (len > 2 && frame[2] == 2) n->lastCommand.assign(frame, frame + len);   // FRAME_COMMAND
+    return sim::peerStationSend(n->station, mac, frame, len);
+  }
+  // called from receive(), lock held
+  static PeerError apply(void* ctx, uint16_t, uint8_t relay, RelayOp op) {
+    Node* n = (Node*)ctx;
+    if (relay < 1 || relay > 4) return PEER_BAD_RELAY;
+    uint32_t bit = 1u << (relay - 1);
+    n->state = op == RELAY_OP_TOGGLE ? n->state ^ bit : op == RELAY_OP_ON ? n->state | bit : n->state & ~bit;
+    n->applied++;
+    n->appliedAtUs = hal::micros();
+    return PEER_OK;
+  }
+  static void done(void* ctx, uint16_t, uint8_t, PeerError result, uint32_t) {
+    Node* n = (Node*)ctx;
+    n->answered = true;
+    n->result = result;
+  }
+  static void receive(void* ctx, const uint8_t mac[6], const uint8_t* data, size_t len) {
+    Node* n = (Node*)ctx;
+    std::lock_guard<std::mutex> lk(n->mu);
+    n->link.receive(mac, data, len, hal::millis());
+  }
+
+  PeerError command(uint16_t node, uint8_t relay, RelayOp op) {
+    std::lock_guard<std::mutex> lk(mu);
+    answered = false;
+    return link.command(node, relay, op, hal::millis());
+  }
+  // what this node last heard of `node`'s relays, -1 if nothing
+  int64_t stateOf(uint16_t node) {
+    std::lock_guard<std::mutex> lk(mu);
+    const PeerLink::Peer* p = link.peer(node);
+    return p ? (int64_t)p->state : -1;
+  }
+  int hopsTo(uint16_t node) {
+    std::lock_guard<std::mutex> lk(mu);
+    const PeerLink::Peer* p = link.peer(node);
+    return p ? p->hops : -1;
+  }
+  PeerLink::Stats stats() {
+    std::lock_guard<std::mutex> lk(mu);
+    return link.stats();
+  }
+  bool answer(PeerError& r) {
+    std::lock_guard<std::mutex> lk(mu);
+    r = result;
+    return answered;
+  }
+  uint32_t appliedAt(uint32_t& count) {
+    std::lock_guard<std::mutex> lk(mu);
+    count = applied;
+    return appliedAtUs;
+  }
+};
+
+std::vector<Node*> nodes;
+
+void tickNodes() {
+  for (;;) {
+    for (Node* n : nodes) {
+      std::lock_guard<std::mutex> lk(n->mu);
+      n->link.tick(hal::millis(), n->state, 4);
+    }
+    hal::delayMs(TICK_MS);
+  }
+}
+
+// The firmware's view of `node` from GET /peers: relay states, -1 if unknown.
+int64_t firmwareSees(uint16_t node) {
+  char json[PEERS_JSON_MAX];
+  peersJson(json, sizeof(json));
+  char key[24];
+  snprintf(key, sizeof(key), "{\"node\":%u,", node);
+  const char* p = strstr(json, key);
+  if (!p || !(p = strstr(p, "\"on\":["))) return -1;
+  uint32_t mask = 0;
+  for (p += 6; *p && *p != ']';) {
+    char* end;
+    long r = strtol(p, &end, 10);
+    if (end == p) break;
+    mask |= 1u << (r - 1);
+    p = *end == ',' ? end + 1 : end;
+  }
+  return mask;
+}
+
+struct Latency {
+  BenchStats relay, ack, seen;
+  int failed = 0;
+  void print(const char* label) const {
+    printf("  -- %s%s --\n", label, failed ? " (some commands got nowhere)" : "");
+    relay.print("command -> owner's relay", "ms");
+    if (ack.count()) ack.print("command -> acknowledged", "ms");
+    seen.print("command -> sender sees new state", "ms");
+    benchCheck(!failed && seen.count() == relay.count(), label);
+  }
+};
+
+// Node `from` toggles relay 1 on the firmware, which hears it first hand or
+// through nodes in between.
+void toFirmware(Latency& lat, Node* from, uint16_t fw) {
+  // the last sample's state broadcast may still be on its way here
+  waitUntil(1000, [&] { return from->stateOf(fw) == relayStateMask(); });
+  int64_t before = from->stateOf(fw);
+  uint32_t t0 = hal::micros();
+  if (from->command(fw, 1, RELAY_OP_TOGGLE) != PEER_OK) { lat.failed++; return; }
+  uint32_t at = 0;
+  if (!sim::waitGpioWrite(RELAYS[0].pin, t0, 1000, &at)) { lat.failed++; return; }
+  lat.relay.add((int32_t)(at - t0) / 1000.0);
+  PeerError r;
+  if (waitUntil(1000, [&] { return from->answer(r); }))
+    lat.ack.add((hal::micros() - t0) / 1000.0);
+  if (waitUntil(1000, [&] { return from->stateOf(fw) != before; })) lat.seen.add((hal::micros() - t0) / 1000.0);
+}
+
+// The firmware toggles relay 2 on `to`, from the input `send` stands for.
+template <typename Send>
+void fromFirmware(Latency& lat, Node* to, uint16_t id, Send send) {
+  waitUntil(1000, [&] {
+    std::lock_guard<std::mutex> lk(to->mu);
+    return firmwareSees(id) == to->state;
+  });
+  int64_t before = firmwareSees(id);
+  uint32_t count0;
+  to->appliedAt(count0);
+  uint32_t t0 = hal::micros();
+  send();
+  uint32_t count = count0, at = 0;
+  if (!waitUntil(1000, [&] { at = to->appliedAt(count); return count != count0; })) { lat.failed++; return; }
+  lat.relay.add((int32_t)(at - t0) / 1000.0);
+  if (waitUntil(1000, [&] { return firmwareSees(id) != before; })) lat.seen.add((hal::micros() - t0) / 1000.0);
+}
+
+// A toggles B's relays with `loss` of frame copies lost: resends, and no
+// command applied twice.
+void lossRun(Node* a, Node* b, double loss) {
+  sim::setPeerAir(200, loss);
+  PeerLink::Stats sa0 = a->stats(), sb0 = b->stats();
+  uint32_t applied0, applied;
+  b->appliedAt(applied0);
+  int ok = 0, noAnswer = 0, refused = 0;
+  BenchStats answerMs;
+  for (int i = 0; i < LOSS_COMMANDS; i++) {
+    uint32_t t0 = hal::micros();
+    if (a->command(0x0A02, 1 + i % 4, RELAY_OP_TOGGLE) != PEER_OK) { refused++; continue; }
+    PeerError r = PEER_NO_ANSWER;
+    waitUntil(1000, [&] { return a->answer(r); });
+    if (r == PEER_OK) {
+      ok++;
+      answerMs.add((hal::micros() - t0) / 1000.0);
+    } else {
+      noAnswer++;
+    }
+  }
+  hal::delayMs(PEER_RETRY_MS * (PEER_RETRIES + 1));   // resends of the last one
+  b->appliedAt(applied);
+  PeerLink::Stats sa = a->stats(), sb = b->stats();
+  sim::setPeerAir(200, 0);
+  applied -= applied0;
+  bool once = applied <= (uint32_t)(LOSS_COMMANDS - refused) && applied >= (uint32_t)ok;
+  printf("  -- %d%% of frames lost, A -> B x %d --\n", (int)(loss * 100), LOSS_COMMANDS);
+  answerMs.print("command -> acknowledged", "ms");
+  printf("  acknowledged %d, no answer %d, refused %d; A resent %lu time(s); B applied %lu (each at most once: %s)\n"
+         "  and only acknowledged %lu resend(s) of commands it had applied already\n",
+         ok, noAnswer, refused, (unsigned long)(sa.resends - sa0.resends), (unsigned long)applied, once ? "yes" : "NO",
+         (unsigned long)(sb.repeats - sb0.repeats));
+  benchCheck(once, "lossy air: no command applied twice");
+}
+
+// A command of A's to F recorded off the air and played back (by a station
+// without the key) after F's duplicate check has forgotten it: F drops it
+// as stale, and relay 1 stays as it is.
+void replay(Node* a) {
+  static const uint8_t EVE[6] = {0x02, 0x00, 0x00, 0x00, 0xEE, 0xEE};
+  static const uint8_t BROADCAST[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  static int eve = sim::peerStationAdd(EVE, [](void*, const uint8_t*, const uint8_t*, size_t) {}, nullptr);
+  std::vector<uint8_t> frame;
+  {
+    std::lock_guard<std::mutex> lk(a->mu);
+    frame = a->lastCommand;
+  }
+  hal::delayMs(2500);   // past SEEN_KEEP_MS
+  uint32_t stale0 = peerLinkStats().stale;
+  bool on = relayIsOn(1);
+  uint32_t t0 = hal::micros(), at = 0;
+  sim::peerStationSend(eve, BROADCAST, frame.data(), frame.size());
+  bool switched = sim::waitGpioWrite(RELAYS[0].pin, t0, 300, &at) || relayIsOn(1) != on;
+  uint32_t stale = peerLinkStats().stale - stale0;
+  Preferences store;
+  store.begin("peer", true);
+  uint32_t reserved = store.getUInt("seq", 0);
+  store.end();
+  printf("  A's command replayed 2.5 s later: F dropped %lu as stale, relay 1 %s; F's seq kept in NVS up to %lu\n",
+         (unsigned long)stale, switched ? "SWITCHED" : "untouched", (unsigned long)reserved);
+  benchCheck(!frame.empty() && stale == 1 && !switched, "a replayed command is dropped");
+  benchCheck(reserved > 0, "F keeps its frame numbers in NVS");
+}
+
+void wsPeer(uint16_t id) {
+  char msg[32];
+  snprintf(msg, sizeof(msg), "peer:%u:2", id);
+  sim::wsText(0, msg);
+}
+
+} // namespace
+
+void benchPeers(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+  sim::setStaReachable(false);     // no router: the controllers are on their own
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  uint16_t fw = peerLinkNode();
+
+  Node* a = new Node(0x0A01);
+  Node* b = new Node(0x0A02);
+  Node* c = new Node(0x0A03);
+  Node* d = new Node(0x0A04);
+  Node* e = new Node(0x0A05);
+  Node* x = new Node(0x0BAD, "not-our-key");   // on the air only for its own test
+  nodes = {a, b, c, d, e, x};
+  for (int s : {0, a->station, b->station, c->station, d->station, e->station}) sim::setPeerInRange(s, x->station, false);
+  for (Node* n : {a, b, c}) sim::setPeerInRange(n->station, e->station, false);
+  for (Node* n : {a, b}) sim::setPeerInRange(n->station, d->station, false);
+  for (int s : {0, a->station, b->station, c->station}) {
+    sim::setPeerInRange(s, d->station, s == c->station);
+    sim::setPeerInRange(s, e->station, false);
+  }
+  uint32_t t0 = hal::millis();
+  std::thread(tickNodes).detach();
+  bool all = waitUntil(2 * PEER_HEARTBEAT_MS + 500, [&] {
+    for (uint16_t id : {0x0A01, 0x0A02, 0x0A03, 0x0A04, 0x0A05}) {
+      if (firmwareSees(id) < 0) return false;
+    }
+    return e->stateOf(fw) >= 0;
+  });
+  printf("  firmware is node %u; every node known to F %s after %lu ms (D %d hop(s) away, E %d, F from E %d)\n", fw,
+         all ? "and F to E" : "NOT", (unsigned long)(hal::millis() - t0), a->hopsTo(0x0A04), c->hopsTo(0x0A05),
+         e->hopsTo(fw));
+  benchCheck(all, "every node known to F, and F to E");
+  sim::wsConnect(0);
+  hal::delayMs(100);
+
+  Latency direct, oneHop, twoHops;
+  for (int i = 0; i < samples; i++) {
+    toFirmware(direct, a, fw);
+    toFirmware(oneHop, d, fw);
+    toFirmware(twoHops, e, fw);
+  }
+  direct.print("A -> F, direct");
+  oneHop.print("D -> F, through C");
+  twoHops.print("E -> F, through D and C");
+  replay(a);
+
+  Latency ws, http, ir, wsFar;
+  const IrKey key = {0, IR_KEY_PEER_TOGGLE, (uint32_t)0x0A01 << 8 | 2};
+  for (int i = 0; i < samples; i++) {
+    fromFirmware(ws, a, 0x0A01, [] { wsPeer(0x0A01); });
+    fromFirmware(http, a, 0x0A01, [] {
+      sim::httpRequest(HTTP_POST, "/peers/relay", {{"node", "2561"}, {"relay", "2"}});
+    });
+    fromFirmware(ir, a, 0x0A01, [&] { irRemoteApply(key); });
+    fromFirmware(wsFar, e, 0x0A05, [] { wsPeer(0x0A05); });
+  }
+  ws.print("F (WS peer:) -> A");
+  http.print("F (HTTP /peers/relay) -> A");
+  ir.print("F (IR key) -> A");
+  wsFar.print("F (WS peer:) -> E, two hops");
+  sim::httpRequest(HTTP_POST, "/peers/relay", {{"node", "2561x"}, {"relay", "2"}});
+  hal::delayMs(20);
+  int badNode = sim::lastHttpResponse().code;
+  sim::httpRequest(HTTP_POST, "/peers/relay", {{"node", "2561"}, {"relay", ""}});
+  hal::delayMs(20);
+  int badRelay = sim::lastHttpResponse().code;
+  printf("  /peers/relay node=2561x: HTTP %d, relay= : HTTP %d\n", badNode, badRelay);
+  benchCheck(badNode == 404 && badRelay == 400, "/peers/relay refuses a malformed node or relay");
+  sim::wsTake(0);
+
+  for (double loss : LOSS_RATES) lossRun(a, b, loss);
+
+  // X has another key: it hears and is heard by everyone, and nobody listens
+  uint32_t forged0 = peerLinkStats().forged, forgedA0 = a->stats().forged;
+  for (int s : {0, a->station, b->station, c->station}) sim::setPeerInRange(s, x->station, true);
+  hal::delayMs(2 * PEER_HEARTBEAT_MS + 500);
+  bool xKnown = firmwareSees(0x0BAD) >= 0 || a->stateOf(0x0BAD) >= 0;
+  PeerError xr = x->command(0x0A01, 1, RELAY_OP_TOGGLE);
+  uint32_t forgedF = peerLinkStats().forged - forged0, forgedA = a->stats().forged - forgedA0;
+  bool apart = !xKnown && x->stateOf(fw) < 0 && xr == PEER_UNKNOWN_NODE;
+  printf("  X with another key: known to F or A %s, X knows F %s, X -> A %s; F dropped %lu frame(s), A %lu: %s\n",
+         xKnown ? "YES" : "no", x->stateOf(fw) >= 0 ? "YES" : "no", peerErrorName(xr), (unsigned long)forgedF,
+         (unsigned long)forgedA, apart ? "ok" : "WRONG");
+  benchCheck(apart && forgedF > 0 && forgedA > 0, "frames signed with another key are dropped as forged");
+  for (int s : {0, a->station, b->station, c->station}) sim::setPeerInRange(s, x->station, false);
+
+  // D drops off the air: commands to it are given up on
+  sim::setPeerInRange(c->station, d->station, false);
+  sim::setPeerInRange(d->station, e->station, false);
+  uint32_t s0 = hal::millis();
+  PeerError r = a->command(0x0A04, 1, RELAY_OP_TOGGLE);
+  PeerError answer = PEER_OK;
+  bool answered = waitUntil(2000, [&] { return a->answer(answer); });
+  printf("  D out of reach: command %s, answer \"%s\" after %lu ms\n", peerErrorName(r),
+         answered ? peerErrorName(answer) : "(none)", (unsigned long)(hal::millis() - s0));
+  benchCheck(r == PEER_OK && answered && answer == PEER_NO_ANSWER, "a command to a node out of reach is given up on");
+
+  // idle: heartbeats and their forwards
+  hal::delayMs(PEER_HEARTBEAT_MS);
+  sim::PeerAirStats air0 = sim::peerAirStats();
+  uint32_t idle0 = hal::millis();
+  hal::delayMs(2 * PEER_HEARTBEAT_MS);
+  sim::PeerAirStats air = sim::peerAirStats();
+  double secs = (hal::millis() - idle0) / 1000.0;
+  printf("  idle, 6 nodes: %.1f frames/s on the air (%.2f%% air time at ~0.7 ms each)\n",
+         (air.frames - air0.frames) / secs, (air.frames - air0.frames) / secs * 0.07);
+}
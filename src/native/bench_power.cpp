@@ -0,0 +1,407 @@
+// src/native/bench_power.cpp
+// Li-ion backup profile (power_manager.h). Boots the firmware and measures,
+// live on the host:
+//   - CPU wakeups per second of every task on mains and on battery (each
+//     blocking delay / wait / DMA read is one wake on the board),
+//   - the profile applied when the 5 V sense pin drops and comes back,
+//   - wake-to-actuation latency on battery per input path (command or IR
+//     step until the relay pin is written).
+// Then replays an event trace (-f trace.csv, default: a synthetic 24 h day
+// written to /tmp/esp32_power_trace.csv) through an energy model built on
+// those wake rates and datasheet-level currents, and reports the average
+// draw and runtime on the battery with and without the power manager, plus
+// per-event latency on battery including the wait for the next DTIM beacon.
+//
+// Trace lines: `t_s,event[,arg]`, event = mains (arg 1 up / 0 down),
+// presence (arg 1/0), ws|http|mqtt|cloud (arg = relay toggled). Optional
+// header lines `# battery_mah=2000`, `# dtim=1`, `# relay_ma=90`,
+// `# ir_sensor_ma=30` override the model.
+
+#include <WiFi.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "mqtt_link.h"
+#include "power_manager.h"
+#include "relay_control.h"
+#include "sim.h"
+#include "wifi_manager.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const int DEFAULT_SAMPLES = 30;
+const uint32_t RATE_WINDOW_MS = 3000;
+const char* const TRACE_FILE = "/tmp/esp32_power_trace.csv";
+const double TRACE_HOURS = 24;
+
+// Energy model, mA / ms (ESP32 datasheet and WiFi power-save application
+// note figures; a board measurement replaces them).
+struct Model {
+  double batteryMah = 2000;
+  double usable = 0.9;           // cut-off before the cell is empty
+  int dtim = 1;                  // AP DTIM period in 102.4 ms beacons
+  double relayMa = 90;           // per energised relay coil
+  double irSensorMa = 30;        // the sensor is powered in both profiles
+  double boardMa = 3;            // regulator quiescent, dividers
+  double ledMa = 5;
+  double activeNoSleepMa = 100;  // 240 MHz, radio always listening (WIFI_PS_NONE)
+  double lightSleepMa = 0.8;
+  double beaconMa = 100, beaconMs = 2.5;   // radio on for one DTIM beacon
+  double wakeMa = 25, wakeMs = 0.5;        // one task wake at 80 MHz
+  double commandMa = 120, commandMs = 5;   // receive, actuate, answer
+};
+
+enum TraceEvent { EV_MAINS, EV_PRESENCE, EV_WS, EV_HTTP, EV_MQTT, EV_CLOUD, EV_COUNT };
+const char* const EVENT_NAMES[EV_COUNT] = {"mains", "presence", "ws", "http", "mqtt", "cloud"};
+
+struct TracePoint {
+  double t;
+  TraceEvent ev;
+  int arg;
+};
+
+std::atomic<bool> loopRunning{false};
+
+void loopTask(void*) {
+  while (loopRunning) loop();
+}
+
+std::map<std::string, uint32_t> wakeCounts() {
+  std::map<std::string, uint32_t> m;
+  for (auto& t : sim::taskWakes()) m[t.first] += t.second;
+  return m;
+}
+
+// wakes/s per task over RATE_WINDOW_MS
+std::map<std::string, double> wakeRates() {
+  std::map<std::string, uint32_t> a = wakeCounts();
+  hal::delayMs(RATE_WINDOW_MS);
+  std::map<std::string, uint32_t> b = wakeCounts();
+  std::map<std::string, double> r;
+  for (auto& kv : b) r[kv.first] = (kv.second - a[kv.first]) * 1000.0 / RATE_WINDOW_MS;
+  return r;
+}
+
+double total(const std::map<std::string, double>& rates) {
+  double s = 0;
+  for (auto& kv : rates) s += kv.second;
+  return s;
+}
+
+bool waitFor(uint32_t timeoutMs, bool (*done)()) {
+  for (uint32_t t = 0; t < timeoutMs; t += 10) {
+    if (done()) return true;
+    hal::delayMs(10);
+  }
+  return done();
+}
+
+std::mt19937 rng(2024);
+
+// One command at a random phase; ms until `pin` is written, -1 on timeout.
+template <typename Inject>
+double latency(int pin, Inject inject) {
+  hal::delayMs(std::uniform_int_distribution<int>(20, 120)(rng));
+  uint32_t t0 = hal::micros(), at = 0;
+  inject();
+  if (!sim::waitGpioWrite(pin, t0, 2000, &at)) return -1;
+  return (at - t0) / 1000.0;
+}
+
+struct PathLatency {
+  BenchStats stats[EV_COUNT];   // indexed by TraceEvent (EV_PRESENCE = IR)
+  int timeouts = 0;
+};
+
+void measurePaths(PathLatency& out, int samples) {
+  const String mqttSet = String(MQTT_BASE_TOPIC) + "/relay/3/set";
+  auto add = [&](TraceEvent ev, double ms) {
+    if (ms < 0) out.timeouts++;
+    else out.stats[ev].add(ms);
+  };
+  for (int i = 0; i < samples; i++) {
+    add(EV_WS, latency(RELAY_PIN_1, [] { sim::wsText(0, "toggle:1"); }));
+    add(EV_HTTP, latency(RELAY_PIN_2, [] { sim::httpRequest(HTTP_GET, "/toggle", {{"relay", "2"}}); }));
+    add(EV_MQTT, latency(RELAY_PIN_3, [&] { sim::mqttInject(mqttSet.c_str(), "TOGGLE"); }));
+    add(EV_CLOUD, latency(RELAY_PIN_1, [i] { sim::cloudPowerState(DEVICE_ID_1, i % 2 == 0); }));
+    add(EV_PRESENCE, latency(RELAY_PIN_4, [i] { sim::setAdc(IR_PIN, i % 2 == 0 ? (IR_ON_MIN + IR_ON_MAX) / 2 : 0); }));
+  }
+  sim::setAdc(IR_PIN, 0);
+}
+
+void printProfile(const char* label) {
+  sim::PowerConfig pc = sim::powerConfig();
+  printf("  %-8s source=%s cpu=%u..%u MHz light_sleep=%d wifi_sleep=%d adc_dma=%d led=%d\n", label,
+         powerSource() == POWER_BACKUP ? "battery" : "mains", pc.minMhz, pc.maxMhz, pc.lightSleep,
+         WiFi.getSleep(), sim::adcStreaming(), sim::outputLevel(LED_PIN));
+}
+
+// ---- trace ----
+
+bool parseTrace(FILE* f, std::vector<TracePoint>& out, Model& m) {
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    double v;
+    if (line[0] == '#') {
+      if (sscanf(line, "# battery_mah=%lf", &v) == 1) m.batteryMah = v;
+      else if (sscanf(line, "# dtim=%lf", &v) == 1) m.dtim = std::max(1, (int)v);
+      else if (sscanf(line, "# relay_ma=%lf", &v) == 1) m.relayMa = v;
+      else if (sscanf(line, "# ir_sensor_ma=%lf", &v) == 1) m.irSensorMa = v;
+      continue;
+    }
+    char name[16];
+    int arg = 0;
+    int n = sscanf(line, "%lf,%15[a-z],%d", &v, name, &arg);
+    if (n < 2) continue;
+    int ev = 0;
+    while (ev < EV_COUNT && strcmp(name, EVENT_NAMES[ev])) ev++;
+    if (ev == EV_COUNT) {
+      printf("  trace: unknown event '%s'\n", name);
+      return false;
+    }
+    out.push_back({v, (TraceEvent)ev, arg});
+  }
+  std::sort(out.begin(), out.end(), [](const TracePoint& a, const TracePoint& b) { return a.t < b.t; });
+  return !out.empty();
+}
+
+// A day: two outages (4 h overnight, 30 min in the evening), presence in
+// the morning and evening, a handful of commands per hour on every path.
+std::vector<TracePoint> syntheticTrace() {
+  std::vector<TracePoint> tr;
+  std::mt19937 r(7);
+  const double end = TRACE_HOURS * 3600;
+  tr.push_back({0, EV_MAINS, 1});
+  tr.push_back({1 * 3600, EV_MAINS, 0});
+  tr.push_back({5 * 3600, EV_MAINS, 1});
+  tr.push_back({19 * 3600, EV_MAINS, 0});
+  tr.push_back({19.5 * 3600, EV_MAINS, 1});
+  const double perHour[EV_COUNT] = {0, 0, 6, 2, 4, 3};
+  for (int ev = EV_WS; ev < EV_COUNT; ev++) {
+    std::exponential_distribution<double> gap(perHour[ev] / 3600);
+    for (double t = gap(r); t < end; t += gap(r)) tr.push_back({t, (TraceEvent)ev, 1 + (int)(r() % 3)});
+  }
+  // someone walks past: present for 10..120 s, a few times an hour in
+  // 06:00-09:00 and 17:00-23:00, once an hour otherwise
+  std::exponential_distribution<double> stay(1 / 40.0);
+  for (double t = 0; t < end;) {
+    double hour = fmod(t / 3600, 24);
+    double rate = (hour >= 6 && hour < 9) || (hour >= 17 && hour < 23) ? 6 : 1;
+    t += std::exponential_distribution<double>(rate / 3600)(r);
+    if (t >= end) break;
+    double d = 10 + std::min(110.0, stay(r));
+    tr.push_back({t, EV_PRESENCE, 1});
+    tr.push_back({t + d, EV_PRESENCE, 0});
+    t += d;
+  }
+  std::sort(tr.begin(), tr.end(), [](const TracePoint& a, const TracePoint& b) { return a.t < b.t; });
+  return tr;
+}
+
+void writeTrace(const std::vector<TracePoint>& tr, const Model& m) {
+  FILE* f = fopen(TRACE_FILE, "w");
+  if (!f) return;
+  fprintf(f, "# battery_mah=%g\n# dtim=%d\n# relay_ma=%g\n# ir_sensor_ma=%g\n", m.batteryMah, m.dtim, m.relayMa,
+          m.irSensorMa);
+  for (const TracePoint& p : tr) fprintf(f, "%.1f,%s,%d\n", p.t, EVENT_NAMES[p.ev], p.arg);
+  fclose(f);
+}
+
+// Charge drawn on battery, mAh, split by component.
+enum Part { PART_CPU_RADIO, PART_COMMANDS, PART_RELAYS, PART_IR_SENSOR, PART_LED, PART_BOARD, PART_COUNT };
+const char* const PART_NAMES[PART_COUNT] = {"cpu + radio", "commands", "relay coils", "ir sensor", "led", "board"};
+
+struct Energy {
+  double mah[PART_COUNT] = {};
+  double total() const {
+    double s = 0;
+    for (double v : mah) s += v;
+    return s;
+  }
+};
+
+} // namespace
+
+void benchPower(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+
+  // ---- live: wake rates, profiles, latency ----
+  sim::setInput(POWER_SENSE_PIN, true);
+  sim::setStaReachable(true);
+  sim::setMqttBrokerUp(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  loopRunning = true;
+  hal::taskSpawn("loop", loopTask, nullptr, 8192, 1, 1);   // the Arduino loopTask
+  waitFor(10000, [] { return wifiManagerState() == WIFI_STATE_CONNECTED && mqttLinkConnected(); });
+  sim::wsConnect(0);
+  sim::httpRequest(HTTP_GET, "/relay4_mode", {{"mode", "auto"}});
+  hal::delayMs(300);
+
+  printProfile("mains:");
+  std::map<std::string, double> mainsRate = wakeRates();
+  PathLatency mainsLat;
+  measurePaths(mainsLat, samples);
+
+  uint32_t t0 = hal::millis();
+  sim::setInput(POWER_SENSE_PIN, false);
+  waitFor(5000, [] { return powerSource() == POWER_BACKUP; });
+  uint32_t switchMs = hal::millis() - t0;
+  hal::delayMs(200);
+  printProfile("battery:");
+  printf("  switched to battery %u ms after the rail dropped (debounce %u ms)\n", switchMs, POWER_BACKUP_DEBOUNCE_MS);
+  std::map<std::string, double> backupRate = wakeRates();
+  PathLatency backupLat;
+  measurePaths(backupLat, samples);
+
+  printf("  %-10s %12s %12s\n", "task", "wakes/s mains", "battery");
+  for (auto& kv : mainsRate) printf("  %-10s %12.1f %12.1f\n", kv.first.c_str(), kv.second, backupRate[kv.first]);
+  printf("  %-10s %12.1f %12.1f\n", "total", total(mainsRate), total(backupRate));
+
+  const char* const PATH_LABELS[EV_COUNT] = {"", "ir presence -> relay 4", "ws toggle", "http /toggle", "mqtt set",
+                                             "sinricpro"};
+  char label[64];
+  for (int ev = EV_PRESENCE; ev < EV_COUNT; ev++) {
+    snprintf(label, sizeof(label), "%s, mains", PATH_LABELS[ev]);
+    mainsLat.stats[ev].print(label, "ms");
+    snprintf(label, sizeof(label), "%s, battery", PATH_LABELS[ev]);
+    backupLat.stats[ev].print(label, "ms");
+  }
+  if (mainsLat.timeouts + backupLat.timeouts) {
+    printf("  %d command(s) never reached the relay\n", mainsLat.timeouts + backupLat.timeouts);
+  }
+
+  t0 = hal::millis();
+  sim::setInput(POWER_SENSE_PIN, true);
+  waitFor(5000, [] { return powerSource() == POWER_MAINS; });
+  uint32_t backMs = hal::millis() - t0;
+  hal::delayMs(100);
+  printProfile("mains:");
+  printf("  back on mains %u ms after the rail returned (debounce %u ms)\n", backMs, POWER_MAINS_DEBOUNCE_MS);
+  loopRunning = false;
+  sim::wsDisconnect(0);
+
+  // ---- model: replay the trace ----
+  Model m;
+  std::vector<TracePoint> trace;
+  if (opt.file) {
+    FILE* f = fopen(opt.file, "r");
+    bool ok = f && parseTrace(f, trace, m);
+    if (f) fclose(f);
+    if (!ok) {
+      printf("  cannot read trace %s\n", opt.file);
+      return;
+    }
+    printf("  trace: %s, %zu events\n", opt.file, trace.size());
+  } else {
+    trace = syntheticTrace();
+    writeTrace(trace, m);
+    printf("  trace: synthetic %.0f h, %zu events (written to %s)\n", TRACE_HOURS, trace.size(), TRACE_FILE);
+  }
+
+  // per-mode CPU + radio draw, mA
+  const double beaconsPerS = 1000.0 / (m.dtim * 102.4);
+  const double pmIdleMa = m.lightSleepMa + beaconsPerS * m.beaconMs / 1000 * (m.beaconMa - m.lightSleepMa) +
+                          total(backupRate) * m.wakeMs / 1000 * (m.wakeMa - m.lightSleepMa);
+  const double noPmIdleMa = m.activeNoSleepMa;
+
+  Energy withPm, withoutPm;
+  BenchStats eventLat[EV_COUNT];
+  std::uniform_real_distribution<double> dtimWait(0, m.dtim * 102.4);
+  bool mains = true, present = false;
+  uint32_t relays = 0;   // bit per relay, as the trace leaves them
+  double last = 0, onBattery = 0;
+  int outages = 0;
+  auto accrue = [&](double until) {
+    double h = (until - last) / 3600;
+    if (!mains && h > 0) {
+      onBattery += h * 3600;
+      int on = __builtin_popcount(relays);
+      for (Energy* e : {&withPm, &withoutPm}) {
+        e->mah[PART_RELAYS] += on * m.relayMa * h;
+        e->mah[PART_IR_SENSOR] += m.irSensorMa * h;
+        e->mah[PART_BOARD] += m.boardMa * h;
+      }
+      withPm.mah[PART_CPU_RADIO] += pmIdleMa * h;
+      withoutPm.mah[PART_CPU_RADIO] += noPmIdleMa * h;
+      withoutPm.mah[PART_LED] += m.ledMa * h;   // the mains profile keeps it lit
+    }
+    last = until;
+  };
+  auto pick = [&](const BenchStats& s) {
+    const std::vector<double>& v = s.samples();
+    return v.empty() ? 0.0 : v[rng() % v.size()];
+  };
+  for (const TracePoint& p : trace) {
+    accrue(p.t);
+    if (p.ev == EV_MAINS) {
+      if (mains && !p.arg) outages++;
+      mains = p.arg != 0;
+      continue;
+    }
+    if (p.ev == EV_PRESENCE) {
+      if ((p.arg != 0) == present) continue;
+      present = p.arg != 0;
+      relays = present ? relays | 8 : relays & ~8u;
+    } else {
+      relays ^= 1u << ((p.arg - 1) & 3);
+    }
+    if (mains) continue;
+    // command handling on top of the idle draw; network commands wait for
+    // the next DTIM beacon to be delivered in modem sleep
+    double cmdMah = m.commandMs / 3.6e6 * m.commandMa;
+    withPm.mah[PART_COMMANDS] += cmdMah;
+    withoutPm.mah[PART_COMMANDS] += m.commandMs / 3.6e6 * (m.commandMa - m.activeNoSleepMa);
+    double lat = pick(backupLat.stats[p.ev]);
+    if (p.ev != EV_PRESENCE) lat += dtimWait(rng);
+    eventLat[p.ev].add(lat);
+  }
+  accrue(trace.back().t);
+
+  if (onBattery <= 0) {
+    printf("  the trace never runs on battery\n");
+    return;
+  }
+  double hours = onBattery / 3600;
+  printf("  model: %.0f mAh cell (%.0f%% usable), DTIM %d (%.1f ms), %.1f h on battery in %d outage(s)\n",
+         m.batteryMah, m.usable * 100, m.dtim, m.dtim * 102.4, hours, outages);
+  printf("  %-14s %14s %14s\n", "avg mA", "no power mgr", "power manager");
+  for (int i = 0; i < PART_COUNT; i++) {
+    printf("  %-14s %14.2f %14.2f\n", PART_NAMES[i], withoutPm.mah[i] / hours, withPm.mah[i] / hours);
+  }
+  double noPmMa = withoutPm.total() / hours, pmMa = withPm.total() / hours;
+  double usableMah = m.batteryMah * m.usable;
+  printf("  %-14s %14.2f %14.2f\n", "total", noPmMa, pmMa);
+  printf("  runtime on battery: %.1f h without, %.1f h with the power manager (x%.1f); the trace's outages "
+         "use %.0f vs %.0f of %.0f mAh\n",
+         usableMah / noPmMa, usableMah / pmMa, noPmMa / pmMa, withoutPm.total(), withPm.total(), usableMah);
+
+  // bounds from power_manager.h: event-driven paths within one DTIM period,
+  // polled paths one POWER_BACKUP_POLL_MS later, IR within two burst periods
+  const double dtimMs = m.dtim * 102.4, slackMs = 10;
+  const double bound[EV_COUNT] = {0, 2.0 * POWER_BACKUP_IR_PERIOD_MS + slackMs, dtimMs + slackMs, dtimMs + slackMs,
+                                  dtimMs + POWER_BACKUP_POLL_MS + slackMs, dtimMs + POWER_BACKUP_POLL_MS + slackMs};
+  for (int ev = EV_PRESENCE; ev < EV_COUNT; ev++) {
+    if (!eventLat[ev].count()) continue;
+    const std::vector<double>& live = backupLat.stats[ev].samples();
+    double liveMax = live.empty() ? 0 : *std::max_element(live.begin(), live.end());
+    snprintf(label, sizeof(label), "battery %s", PATH_LABELS[ev]);
+    eventLat[ev].print(label, "ms");
+    printf("  %-34s bound %.0f ms: %s (live max %.1f ms + DTIM wait)\n", "", bound[ev],
+           liveMax + (ev == EV_PRESENCE ? 0 : dtimMs) <= bound[ev] ? "met" : "EXCEEDED", liveMax);
+  }
+}
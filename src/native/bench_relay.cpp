@@ -0,0 +1,81 @@
+// src/native/bench_relay.cpp
+// Relay registry: SinricPro device-ID routing, the old String compare chain
+// (kept here as the baseline) against relayForDeviceId(), and how far apart
+// the pins of a multi-relay update land when the control task applies a
+// burst of commands as one batch.
+
+#include <Arduino.h>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "relay_control.h"
+#include "sim.h"
+
+namespace {
+
+const int DEFAULT_SAMPLES = 1000000;
+const int BURSTS = 200;
+
+// -------- baseline: the pre-registry lookup --------
+
+const String LEGACY_ID_1 = DEVICE_ID_1;
+const String LEGACY_ID_2 = DEVICE_ID_2;
+const String LEGACY_ID_3 = DEVICE_ID_3;
+
+int legacyDeviceIdToRelay(const String& deviceId) {
+  if (deviceId == LEGACY_ID_1) return 1;
+  if (deviceId == LEGACY_ID_2) return 2;
+  if (deviceId == LEGACY_ID_3) return 3;
+  return -1;
+}
+
+volatile int sink;
+
+template <typename Fn>
+void measure(const char* label, int samples, Fn fn) {
+  uint64_t t0 = benchNowNs();
+  for (int i = 0; i < samples; i++) sink = fn();
+  printf("  %-40s %8.1f ns/lookup\n", label, (double)(benchNowNs() - t0) / samples);
+}
+
+} // namespace
+
+void benchRelay(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+
+  // The SinricPro callback hands over a String; both paths start from one.
+  const String known = DEVICE_ID_1;
+  const String unknown = "0123456789abcdef01234567";
+  measure("String chain, known id (old)", samples, [&] { return legacyDeviceIdToRelay(known); });
+  measure("relayForDeviceId, known id", samples, [&] { return relayForDeviceId(known.c_str()); });
+  measure("String chain, unknown id (old)", samples, [&] { return legacyDeviceIdToRelay(unknown); });
+  measure("relayForDeviceId, unknown id", samples, [&] { return relayForDeviceId(unknown.c_str()); });
+
+#if RELAY_BACKEND == RELAY_BACKEND_GPIO
+  // Every relay on, then every relay off: spread between the first and last
+  // pin write of each burst.
+  relayControlStart();
+  hal::delayMs(20);
+  BenchStats skew;
+  for (int b = 0; b < BURSTS; b++) {
+    RelayOp op = (b % 2 == 0) ? RELAY_OP_ON : RELAY_OP_OFF;
+    uint32_t t0 = hal::micros();
+    for (int r = 1; r <= NUM_RELAYS; r++) submitRelayCommand(r, op, SRC_HTTP);
+    uint32_t first = UINT32_MAX, last = 0;
+    for (const RelayDef& def : RELAYS) {
+      uint32_t at = 0;
+      if (!sim::waitGpioWrite(def.pin, t0, 1000, &at)) continue;
+      first = min(first, at);
+      last = max(last, at);
+    }
+    if (last >= first) skew.add(last - first);
+    hal::delayMs(5);
+  }
+  char label[48];
+  snprintf(label, sizeof(label), "pin skew, %d-relay burst", NUM_RELAYS);
+  skew.print(label, "us");
+#else
+  printf("  pin skew: none, the expander latches every output at once (see the `bank` case)\n");
+#endif
+}
@@ -0,0 +1,320 @@
+// src/native/bench_remote.cpp
+// IR remote input (ir_remote.h):
+//   - replays recorded pulse trains through the NEC decoder and checks every
+//     labelled frame (codes, repeats, and frames that must not decode),
+//   - decode time per frame and the decode rate as receiver jitter grows,
+//   - boots the firmware, plays frames into the simulated RMT receiver and
+//     times the last edge of each key press until the relay pin is written
+//     (toggle, scene and mode keys), checking the 50 ms budget,
+//   - a held key (repeat frames, or the full code resent) switches once.
+//
+// Recording (-f): IRremoteESP8266 IRrecvDumpV2 output, one frame per line:
+//   uint16_t rawData[67] = {9024, 4450, 612, 530, ...};  // NEC FF30CF
+// "// NEC (Repeat)" marks a repeat frame; another protocol name (or
+// UNKNOWN) marks a frame that must not decode as NEC; no comment = not
+// checked. A bare comma-separated line of durations also works. Without -f
+// a synthetic recording (every mapped key and random codes with receiver
+// skew and jitter, repeats, cut-off and corrupted frames) is written to
+// /tmp/esp32_ir_remote.txt and replayed.
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "ir_remote.h"
+#include "relay_control.h"
+#include "sim.h"
+
+void setup();
+
+namespace {
+
+const char* const RECORDING_FILE = "/tmp/esp32_ir_remote.txt";
+const int DEFAULT_SAMPLES = 100;
+const double LATENCY_BUDGET_MS = 50;
+const size_t KEY_COUNT = sizeof(IR_REMOTE_KEYS) / sizeof(IR_REMOTE_KEYS[0]);
+
+volatile uint32_t sink;
+
+struct Recorded {
+  std::vector<uint16_t> d;
+  bool labelled = false;
+  IrFrameType want = IR_FRAME_NONE;
+  uint32_t code = 0;
+};
+
+// A NEC frame as a TSOP1838 hands it over: marks stretched and spaces
+// shortened by `skewUs`, every duration jittered by N(0, sigmaUs).
+struct Receiver {
+  std::mt19937 rng{99};
+  int skewUs = 60;
+  double sigmaUs = 40;
+
+  uint16_t mark(int us) { return shape(us + skewUs); }
+  uint16_t space(int us) { return shape(us - skewUs); }
+  uint16_t shape(double us) {
+    us += std::normal_distribution<double>(0, sigmaUs)(rng);
+    return (uint16_t)std::max(1.0, std::min(65535.0, us));
+  }
+
+  std::vector<uint16_t> code(uint32_t code, int headerMarkUs = 9000) {
+    std::vector<uint16_t> d = {mark(headerMarkUs), space(4500)};
+    for (int i = 31; i >= 0; i--) {
+      d.push_back(mark(560));
+      d.push_back(space((code >> i) & 1 ? 1690 : 560));
+    }
+    d.push_back(mark(560));
+    return d;
+  }
+  std::vector<uint16_t> repeat() { return {mark(9000), space(2250), mark(560)}; }
+};
+
+// address byte, its inverse, command byte, its inverse, each sent LSB first
+// (IRremoteESP8266's MSB-first value puts the reversed bytes in that order)
+uint32_t necCode(std::mt19937& rng) {
+  uint8_t addr = rng(), cmd = rng();
+  auto rev = [](uint8_t b) {
+    uint8_t r = 0;
+    for (int i = 0; i < 8; i++) r |= ((b >> i) & 1) << (7 - i);
+    return r;
+  };
+  return (uint32_t)rev(addr) << 24 | (uint32_t)rev((uint8_t)~addr) << 16 | (uint32_t)rev(cmd) << 8 | rev((uint8_t)~cmd);
+}
+
+void writeRecorded(FILE* f, const std::vector<uint16_t>& d, const char* label) {
+  fprintf(f, "uint16_t rawData[%zu] = {", d.size());
+  for (size_t i = 0; i < d.size(); i++) fprintf(f, "%s%u", i ? ", " : "", d[i]);
+  fprintf(f, "};  // %s\n", label);
+}
+
+bool writeSynthetic(const char* path) {
+  FILE* f = fopen(path, "w");
+  if (!f) return false;
+  Receiver rx;
+  std::mt19937 rng(5);
+  char label[32];
+  std::vector<uint32_t> codes;
+  for (const IrKey& k : IR_REMOTE_KEYS) codes.push_back(k.code);
+  for (int i = 0; i < 64; i++) codes.push_back(necCode(rng));
+  for (size_t i = 0; i < codes.size(); i++) {
+    // one in ten presses starts while the board is still waking from light sleep
+    int header = i % 10 == 3 ? 5000 + (int)(rng() % 3000) : 9000;
+    snprintf(label, sizeof(label), "NEC %X", (unsigned)codes[i]);
+    writeRecorded(f, rx.code(codes[i], header), label);
+    for (uint32_t r = 0; r < i % 4; r++) writeRecorded(f, rx.repeat(), "NEC (Repeat)");
+  }
+  for (int i = 0; i < 16; i++) {
+    std::vector<uint16_t> d = rx.code(codes[i]);
+    d.resize(3 + rng() % (d.size() - 4));                    // cut off mid-frame
+    if (d.size() % 2 == 0) d.pop_back();
+    writeRecorded(f, d, "UNKNOWN");
+    d = rx.code(codes[i]);
+    size_t bit = 3 + 2 * (16 + rng() % 16);                  // flip one command bit
+    d[bit] = d[bit] > 1000 ? 560 : 1690;
+    writeRecorded(f, d, "UNKNOWN");
+    std::vector<uint16_t> noise(1 + 2 * (rng() % 40));       // random pulse train
+    for (uint16_t& v : noise) v = (uint16_t)(100 + rng() % 10000);
+    writeRecorded(f, noise, "UNKNOWN");
+  }
+  // a Sony SIRC 12-bit frame: 2.4 ms header, 600 µs spaces, 600/1200 µs marks
+  std::vector<uint16_t> sony = {2400};
+  for (int i = 0; i < 12; i++) { sony.push_back(600); sony.push_back(i % 3 ? 600 : 1200); }
+  writeRecorded(f, sony, "SONY 12");
+  fclose(f);
+  return true;
+}
+
+bool loadRecording(const char* path, std::vector<Recorded>& out) {
+  FILE* f = fopen(path, "r");
+  if (!f) { printf("  cannot open %s\n", path); return false; }
+  char line[4096];
+  while (fgets(line, sizeof(line), f)) {
+    const char* p = strchr(line, '{');
+    p = p ? p + 1 : line;
+    if (!strchr("0123456789 \t", *p) || *p == '\0') continue;
+    Recorded r;
+    char* end;
+    for (unsigned long v = strtoul(p, &end, 10); end != p; v = strtoul(p, &end, 10)) {
+      r.d.push_back((uint16_t)std::min(v, 65535ul));
+      p = end;
+      while (*p == ',' || *p == ' ' || *p == '\t') p++;
+    }
+    if (r.d.empty()) continue;
+    const char* comment = strstr(line, "//");
+    if (comment) {
+      r.labelled = true;
+      const char* nec = strstr(comment, "NEC");
+      if (!nec) {
+        r.want = IR_FRAME_NONE;
+      } else if (strstr(nec, "Repeat")) {
+        r.want = IR_FRAME_REPEAT;
+      } else {
+        r.want = IR_FRAME_CODE;
+        r.code = (uint32_t)strtoul(nec + 3, nullptr, 16);
+      }
+    }
+    out.push_back(std::move(r));
+  }
+  fclose(f);
+  return !out.empty();
+}
+
+void replay(const std::vector<Recorded>& rec) {
+  int codes = 0, repeats = 0, rejects = 0, wrong = 0, missed = 0, falseDecodes = 0, unlabelled = 0;
+  for (const Recorded& r : rec) {
+    IrFrame got = irDecodeNec(r.d.data(), r.d.size());
+    if (!r.labelled) { unlabelled++; continue; }
+    if (r.want == IR_FRAME_NONE) {
+      if (got.type == IR_FRAME_NONE) rejects++;
+      else falseDecodes++;
+    } else if (got.type == IR_FRAME_NONE) {
+      missed++;
+    } else if (got.type != r.want || got.code != r.code) {
+      wrong++;
+    } else if (got.type == IR_FRAME_CODE) {
+      codes++;
+    } else {
+      repeats++;
+    }
+  }
+  printf("  %zu frames: %d codes + %d repeats decoded, %d junk frames rejected\n", rec.size(), codes, repeats, rejects);
+  printf("  missed %d, wrong code %d, junk decoded as NEC %d%s  [%s]\n", missed, wrong, falseDecodes,
+         unlabelled ? " (some frames unlabelled)" : "", missed + wrong + falseDecodes ? "FAIL" : "ok");
+
+  // decode cost, everything in the recording
+  const int rounds = 200;
+  uint64_t t0 = benchNowNs();
+  for (int i = 0; i < rounds; i++) {
+    for (const Recorded& r : rec) sink = irDecodeNec(r.d.data(), r.d.size()).code;
+  }
+  double ns = (double)(benchNowNs() - t0) / (rounds * rec.size());
+  printf("  decode: %.0f ns/frame (host)\n", ns);
+}
+
+void jitterSweep() {
+  printf("  receiver jitter (sigma) vs frames decoded / decoded to a wrong code, 1000 codes each:\n");
+  for (double sigma : {0.0, 50.0, 100.0, 150.0, 200.0, 250.0}) {
+    Receiver rx;
+    rx.sigmaUs = sigma;
+    std::mt19937 rng(11);
+    int ok = 0, wrong = 0;
+    for (int i = 0; i < 1000; i++) {
+      uint32_t code = necCode(rng);
+      std::vector<uint16_t> d = rx.code(code);
+      IrFrame f = irDecodeNec(d.data(), d.size());
+      ok += f.type == IR_FRAME_CODE && f.code == code;
+      wrong += f.type == IR_FRAME_CODE && f.code != code;
+    }
+    printf("    %3.0f us  %5.1f%%  %d\n", sigma, ok / 10.0, wrong);
+  }
+}
+
+#if RELAY_BACKEND == RELAY_BACKEND_GPIO
+int keyIndex(IrKeyAction action, uint32_t arg) {
+  for (size_t i = 0; i < KEY_COUNT; i++) {
+    if (IR_REMOTE_KEYS[i].action == action && IR_REMOTE_KEYS[i].arg == arg) return (int)i;
+  }
+  return -1;
+}
+
+std::mt19937 phase(77);
+
+// Plays a key press and returns ms from its last edge on air until `pin` is
+// written, -1 on timeout.
+double pressLatency(Receiver& rx, uint32_t code, int pin) {
+  hal::delayMs(std::uniform_int_distribution<int>(160, 260)(phase));   // past the hold window
+  std::vector<uint16_t> d = rx.code(code);
+  uint32_t lastEdge = sim::irRxSend(d.data(), d.size()), at = 0;
+  if (!sim::waitGpioWrite(pin, lastEdge, 2000, &at)) return -1;
+  return (int32_t)(at - lastEdge) / 1000.0;
+}
+
+bool measureKey(const char* label, Receiver& rx, int samples, int pin, int keyA, int keyB) {
+  if (keyA < 0) { printf("  %-34s (no such key in IR_REMOTE_KEYS)\n", label); return true; }
+  BenchStats stats;
+  int timeouts = 0;
+  for (int i = 0; i < samples; i++) {
+    int k = (i % 2 && keyB >= 0) ? keyB : keyA;
+    double ms = pressLatency(rx, IR_REMOTE_KEYS[k].code, pin);
+    if (ms < 0) timeouts++;
+    else stats.add(ms);
+  }
+  stats.print(label, "ms");
+  std::vector<double> s(stats.samples());
+  std::sort(s.begin(), s.end());
+  bool ok = !timeouts && !s.empty() && s.back() < LATENCY_BUDGET_MS;
+  if (timeouts) printf("  %-34s %d press(es) never reached the relay\n", "", timeouts);
+  return ok;
+}
+
+// the relay's state after `frames` (all played back to back, as one held key)
+bool heldKeySwitchesOnce(const char* label, int relay, const std::vector<std::vector<uint16_t>>& frames) {
+  hal::delayMs(300);
+  bool before = relayIsOn(relay);
+  for (const auto& d : frames) sim::irRxSend(d.data(), d.size());
+  hal::delayMs(400);
+  bool after = relayIsOn(relay);
+  // and a fresh press after the hold window switches it back
+  std::vector<uint16_t> again = frames.front();
+  sim::irRxSend(again.data(), again.size());
+  hal::delayMs(200);
+  bool ok = after != before && relayIsOn(relay) == before;
+  printf("  %-34s %s\n", label, ok ? "switched once, next press switched back [ok]" : "[FAIL]");
+  return ok;
+}
+#endif
+
+} // namespace
+
+void benchRemote(const BenchOptions& opt) {
+  const char* path = opt.file;
+  if (!path) {
+    if (!writeSynthetic(RECORDING_FILE)) { printf("  cannot write %s\n", RECORDING_FILE); return; }
+    path = RECORDING_FILE;
+  }
+  std::vector<Recorded> rec;
+  if (!loadRecording(path, rec)) { printf("  no frames in %s\n", path); return; }
+  printf("  recording: %s\n", path);
+  replay(rec);
+  jitterSweep();
+
+#if RELAY_BACKEND != RELAY_BACKEND_GPIO
+  printf("  firmware latency: measured on relay pins, GPIO backend only\n");
+#else
+  if (IR_REMOTE_PIN < 0) { printf("  IR_REMOTE_PIN < 0: no receiver in this build\n"); return; }
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+  sim::setStaReachable(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  hal::delayMs(100);
+
+  Receiver rx;
+  printf("  key press (last edge on air) -> relay pin, %d presses each, budget %.0f ms:\n", samples,
+         LATENCY_BUDGET_MS);
+  bool ok = true;
+  ok &= measureKey("toggle relay 2", rx, samples, RELAYS[1].pin, keyIndex(IR_KEY_TOGGLE, 2), -1);
+  ok &= measureKey("scene 1-3 on / all off (relay 1)", rx, samples, RELAYS[0].pin, keyIndex(IR_KEY_SCENE, 0x7),
+                   keyIndex(IR_KEY_SCENE, 0));
+  ok &= measureKey("relay 4 mode on / off", rx, samples, RELAYS[IR_RELAY - 1].pin,
+                   keyIndex(IR_KEY_MODE, RELAY4_MODE_ON), keyIndex(IR_KEY_MODE, RELAY4_MODE_OFF));
+  printf("  latency budget: %s\n", ok ? "met" : "MISSED");
+
+  int k3 = keyIndex(IR_KEY_TOGGLE, 3);
+  if (k3 >= 0) {
+    uint32_t code = IR_REMOTE_KEYS[k3].code;
+    heldKeySwitchesOnce("held key, code + 5 repeat frames", 3,
+                        {rx.code(code), rx.repeat(), rx.repeat(), rx.repeat(), rx.repeat(), rx.repeat()});
+    heldKeySwitchesOnce("held key, full code resent 4x", 3,
+                        {rx.code(code), rx.code(code), rx.code(code), rx.code(code)});
+  }
+  IrRemoteStats st = irRemoteStats();
+  printf("  remote task: %u frames, %u not NEC, %u presses\n", st.frames, st.undecoded, st.presses);
+#endif
+}
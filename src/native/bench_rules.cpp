@@ -0,0 +1,350 @@
+// src/native/bench_rules.cpp
+// Automation rules. First the rule engine on its own with 10, 100 and 1000
+// random rules, on this board's inputs (4 relays) and on a 32-relay build's:
+// program size, the cost of a tick with no input changed, of a tick with one
+// input changed (and the rules it re-ran) against re-running every rule,
+// checked against that full re-run for the rules that fire, and the
+// compile -> decompile -> compile round trip. Then the firmware: rules added
+// over WS and HTTP, IR presence and a lost SinricPro link to the relay, a
+// "for" timer switching back, refusals, two rules undoing each other
+// switched off, the rules kept over a reboot, and rulesTick() with every
+// rule in use. Takes about 15 s.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "relay_control.h"
+#include "rules.h"
+#include "sim.h"
+#include "wifi_manager.h"
+
+void setup();
+
+namespace {
+
+const int ENGINE_RULES[] = {10, 100, 1000};
+const int ENGINE_CHANGES = 20000;
+const int IDLE_TICKS = 1000000;
+const size_t ENGINE_CODE = 32768;
+const int DEFAULT_SAMPLES = 10;
+const int IR_MID = (IR_ON_MIN + IR_ON_MAX) / 2;
+
+typedef RuleEngine<1000, ENGINE_CODE> BigEngine;
+
+volatile uint64_t sink;
+
+// "if <1-3 inputs, some negated, joined by and/or> then relay<n> <op> [for ..]"
+std::string randomRule(std::mt19937& rng, int relays) {
+  static const char* const NAMED[] = {"ir", "wifi", "cloud", "mqtt", "battery"};
+  static const char* const OPS[] = {"off", "on", "toggle"};
+  auto input = [&] {
+    std::string s = rng() % 2 ? "not " : "";
+    int k = (int)(rng() % (relays + 5));
+    return s + (k < relays ? "relay" + std::to_string(k + 1) : NAMED[k - relays]);
+  };
+  std::string text = "if " + input();
+  int terms = 1 + (int)(rng() % 3);
+  for (int t = 1; t < terms; t++) text += (rng() % 3 ? " and " : " or ") + input();
+  text += " then relay" + std::to_string(1 + rng() % relays) + " " + OPS[rng() % 3];
+  if (rng() % 4 == 0) text += " for " + std::to_string(1 + rng() % 30) + "m";
+  return text;
+}
+
+void benchEngine(int relays) {
+  int inputs = relays + (RULE_SIGNALS - RULE_SIG_IR);
+  printf("  -- engine, %d relays: %d inputs --\n", relays, inputs);
+  for (int rules : ENGINE_RULES) {
+    std::mt19937 rng(11 + rules);
+    std::vector<uint8_t> program = {RULES_CODE_VERSION};
+    int roundTrip = 0;
+    for (int i = 0; i < rules; i++) {
+      uint8_t code[RULE_CODE_MAX], again[RULE_CODE_MAX];
+      size_t len, len2;
+      std::string text = randomRule(rng, relays);
+      RuleError e = ruleCompile(text.c_str(), code, sizeof(code), &len, relays);
+      if (!benchCheck(e == RULE_OK, "random rules compile")) {
+        printf("  \"%s\": %s\n", text.c_str(), ruleErrorName(e));
+        return;
+      }
+      char listed[RULE_TEXT_MAX + 1];
+      ruleFormat(code, listed, sizeof(listed));
+      if (ruleCompile(listed, again, sizeof(again), &len2, relays) == RULE_OK && len2 == len &&
+          !memcmp(code, again, len)) {
+        roundTrip++;
+      }
+      program.insert(program.end(), code, code + len);
+    }
+
+    std::unique_ptr<BigEngine> engine(new BigEngine(relays));
+    RuleError e = engine->load(program.data(), program.size(), 0);
+    if (!benchCheck(e == RULE_OK, "the rule program loads")) {
+      printf("  loading %d rules: %s\n", rules, ruleErrorName(e));
+      return;
+    }
+
+    // the trace: one input flipped per tick
+    std::vector<uint64_t> trace(ENGINE_CHANGES + 1);
+    uint64_t in = 0;
+    trace[0] = in;
+    for (int i = 1; i <= ENGINE_CHANGES; i++) {
+      int k = (int)(rng() % inputs);
+      in ^= 1ull << (k < relays ? RULE_SIG_RELAY1 + k : RULE_SIG_IR + k - relays);
+      trace[i] = in;
+    }
+
+    // correctness: what fires against re-running every rule
+    std::vector<uint8_t> was(rules);
+    for (int r = 0; r < rules; r++) was[r] = ruleEvaluate(engine->rule(r), trace[0]);
+    int mismatches = 0;
+    uint64_t fired = 0;
+    for (int i = 1; i <= ENGINE_CHANGES; i++) {
+      std::vector<uint8_t> got(rules);
+      engine->update(trace[i], [&](int id, const RuleAction&) { got[id] = 1; fired++; });
+      for (int r = 0; r < rules; r++) {
+        uint8_t now = ruleEvaluate(engine->rule(r), trace[i]);
+        if ((now && !was[r]) != (got[r] != 0)) mismatches++;
+        was[r] = now;
+      }
+    }
+
+    // timing: the same trace again, incremental and re-running everything
+    engine->load(program.data(), program.size(), trace[0]);
+    uint64_t evaluated = 0, picked = 0;
+    uint64_t t0 = benchNowNs();
+    for (int i = 1; i <= ENGINE_CHANGES; i++) {
+      evaluated += engine->update(trace[i], [&](int id, const RuleAction&) { picked += id; });
+    }
+    double changeNs = (double)(benchNowNs() - t0) / ENGINE_CHANGES;
+    t0 = benchNowNs();
+    for (int i = 0; i < IDLE_TICKS; i++) picked += engine->update(trace[ENGINE_CHANGES], [&](int, const RuleAction&) {});
+    double idleNs = (double)(benchNowNs() - t0) / IDLE_TICKS;
+    std::fill(was.begin(), was.end(), 0);
+    t0 = benchNowNs();
+    for (int i = 1; i <= ENGINE_CHANGES; i++) {
+      for (int r = 0; r < rules; r++) {
+        uint8_t now = ruleEvaluate(engine->rule(r), trace[i]);
+        if (now && !was[r]) picked += r;
+        was[r] = now;
+      }
+    }
+    double fullNs = (double)(benchNowNs() - t0) / ENGINE_CHANGES;
+    sink = picked;
+
+    printf("  %4d rules: %5zu B of program (%.1f B/rule), round trip %d/%d\n", rules, program.size(),
+           (double)(program.size() - 1) / rules, roundTrip, rules);
+    printf("    tick, nothing changed %8.1f ns\n", idleNs);
+    printf("    tick, one input       %8.1f ns  (%.1f rules re-run, %.2f fire)\n", changeNs,
+           (double)evaluated / ENGINE_CHANGES, (double)fired / ENGINE_CHANGES);
+    printf("    re-running every rule %8.1f ns  fired as the full re-run: %s\n", fullNs,
+           mismatches ? "NO" : "yes");
+    benchCheck(!mismatches && roundTrip == rules, "the engine fires as a full re-run; rules list as they compile");
+  }
+}
+
+template <typename Pred>
+bool waitUntil(uint32_t timeoutMs, Pred done) {
+  uint32_t t0 = hal::millis();
+  while (!done()) {
+    if (hal::millis() - t0 >= timeoutMs) return false;
+    hal::delayMs(1);
+  }
+  return true;
+}
+
+void setRelay(uint8_t relay, bool on) {
+  hal::delayMs(20);
+  if (relayIsOn(relay) != on) submitRelayCommand(relay, on ? RELAY_OP_ON : RELAY_OP_OFF, SRC_HTTP);
+  waitUntil(500, [&] { return relayIsOn(relay) == on; });
+  hal::delayMs(20);   // and the rules have seen it
+}
+
+// ms from t0Us until `relay` is `on`, -1 on timeout
+double relayAfter(uint8_t relay, bool on, uint32_t t0Us, uint32_t timeoutMs) {
+  if (!waitUntil(timeoutMs, [&] { return relayIsOn(relay) == on; })) return -1;
+  uint32_t at = 0;
+  if (!sim::waitGpioWrite(RELAYS[relay - 1].pin, t0Us, 0, &at)) return -1;
+  return (at - t0Us) / 1000.0;
+}
+
+int wsCount(const char* key) {
+  int n = 0;
+  for (const String& f : sim::wsTake(0)) n += strstr(f.c_str(), key) != nullptr;
+  return n;
+}
+
+// the "rule" fields of a rulesJson() list
+std::vector<std::string> ruleTexts() {
+  static char list[RULES_JSON_MAX];
+  rulesJson(list, sizeof(list));
+  std::vector<std::string> out;
+  for (const char* p = list; (p = strstr(p, "\"rule\":\"")) != nullptr;) {
+    p += 8;
+    const char* end = strchr(p, '"');
+    out.emplace_back(p, end - p);
+    p = end;
+  }
+  return out;
+}
+
+void deleteAll() {
+  while (ruleDelete(0) == RULE_OK) {}
+}
+
+void benchFirmware(int samples) {
+  sim::setStaReachable(true);
+  sim::setCloudUp(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  sim::setAdc(IR_PIN, 0);
+  setup();
+  if (!waitUntil(20000, [] { return wifiManagerState() == WIFI_STATE_CONNECTED; })) {
+    benchCheck(false, "STA connected");
+    return;
+  }
+  sim::wsConnect(0);
+  hal::delayMs(1500);   // SinricPro connected
+  deleteAll();
+  sim::wsTake(0);
+
+  sim::wsText(0, "rule:if ir and not relay1 then relay3 on for 2s");
+  hal::delayMs(50);
+  int listed = wsCount("\"rules\"");
+  sim::httpRequest(HTTP_POST, "/rules", {{"text", "IF NOT cloud THEN relay2 off"}});
+  hal::delayMs(50);
+  int http = sim::lastHttpResponse().code;
+  std::vector<std::string> texts = ruleTexts();
+  printf("  -- firmware --\n");
+  printf("  added over WS (%s) and HTTP (%d): %zu rules\n", listed ? "listed" : "NO REPLY", http, texts.size());
+  for (const std::string& t : texts) printf("    %s\n", t.c_str());
+  benchCheck(listed && http == 200 && texts.size() == 2, "rules added over WS and HTTP");
+
+  BenchStats ir, back, cloud;
+  int blocked = 0, blockedFired = 0;
+  for (int i = 0; i < samples; i++) {
+    setRelay(3, false);
+    setRelay(1, i % 4 == 3);   // every fourth: relay 1 on, the rule must not fire
+    uint32_t t0 = hal::micros();
+    sim::setAdc(IR_PIN, IR_MID);
+    if (relayIsOn(1)) {
+      hal::delayMs(300);
+      blocked++;
+      blockedFired += relayIsOn(3);
+    } else {
+      double ms = relayAfter(3, true, t0, 1000);
+      ir.add(ms);
+      uint32_t t1 = hal::micros();
+      if (ms >= 0) back.add(relayAfter(3, false, t1, 3000) / 1000.0);
+    }
+    sim::setAdc(IR_PIN, 0);
+    hal::delayMs(200);   // presence gone through the filter
+  }
+  ir.print("IR presence -> relay 3 on (rule)", "ms");   // the IR filter's median, EMA and dwell included
+  back.print("then \"for 2s\" -> relay 3 off", "s");
+  printf("  %-34s %d of %d times\n", "relay 1 on: relay 3 switched", blockedFired, blocked);
+  int irMissed = 0;
+  for (const BenchStats* b : {&ir, &back}) {
+    for (double v : b->samples()) irMissed += v < 0;
+  }
+  benchCheck(!irMissed && !blockedFired && back.count() == ir.count(), "the IR rule fires unless relay 1 is on, then ends");
+
+  for (int i = 0; i < samples; i++) {
+    setRelay(2, true);
+    uint32_t t0 = hal::micros();
+    sim::setCloudUp(false);
+    cloud.add(relayAfter(2, false, t0, 1000));
+    sim::setCloudUp(true);
+    hal::delayMs(300);   // reconnected
+  }
+  cloud.print("SinricPro link lost -> relay 2 off", "ms");
+  int cloudMissed = 0;
+  for (double ms : cloud.samples()) cloudMissed += ms < 0;
+  benchCheck(!cloudMissed, "the cloud-loss rule switches relay 2 off");
+
+  // refusals
+  sim::wsTake(0);
+  sim::wsText(0, "rule:if doorbell then relay1 on");
+  sim::wsText(0, "rule:if ir then relay9 on");
+  sim::wsText(0, "rule:ir then relay1 on");
+  sim::wsText(0, "rule_delete:7");
+  hal::delayMs(50);
+  int refused = wsCount("rule_error");
+  size_t kept = ruleTexts().size();
+  int deleteCodes[2];
+  const char* badIds[] = {"", "abc"};
+  for (int i = 0; i < 2; i++) {
+    sim::httpRequest(HTTP_POST, "/rules/delete", {{"id", badIds[i]}});
+    hal::delayMs(50);
+    deleteCodes[i] = sim::lastHttpResponse().code;
+  }
+  bool rulesKept = ruleTexts().size() == kept;
+  printf("  refusals answered: %d/4; /rules/delete id= and id=abc: HTTP %d, %d, rules kept: %s\n", refused,
+         deleteCodes[0], deleteCodes[1], rulesKept ? "yes" : "NO");
+  benchCheck(refused == 4 && deleteCodes[0] == 404 && deleteCodes[1] == 404 && rulesKept,
+             "bad rules and deletes refused, rules kept");
+
+  // two rules undoing each other
+  setRelay(3, false);
+  int loopFrom = (int)ruleTexts().size();
+  ruleAdd("if relay3 then relay3 off", nullptr);
+  ruleAdd("if not relay3 then relay3 on", nullptr);
+  submitRelayCommand(3, RELAY_OP_ON, SRC_HTTP);   // sets them off
+  hal::delayMs(RULE_BURST_WINDOW_MS + 500);
+  static char list[RULES_JSON_MAX];
+  rulesJson(list, sizeof(list));
+  int off = 0;
+  unsigned long firedOff = 0;   // by the rule switched off
+  for (const char* p = list; (p = strstr(p, "\"fired\":")) != nullptr;) {
+    char* end;
+    unsigned long fired = strtoul(p + 8, &end, 10);
+    p = end;
+    if (strncmp(end, ",\"off\":true", 11)) continue;
+    off++;
+    firedOff = fired;
+  }
+  bool r3 = relayIsOn(3);
+  hal::delayMs(200);
+  printf("  looping pair: %d rule(s) switched off after firing %lu times (RULE_BURST_MAX %u), relay 3 %s\n", off,
+         firedOff, RULE_BURST_MAX, relayIsOn(3) == r3 ? "settled" : "STILL SWITCHING");
+  benchCheck(off == 1 && firedOff == RULE_BURST_MAX && relayIsOn(3) == r3,
+             "the loop breaker switches one rule off after RULE_BURST_MAX firings");
+  ruleDelete(loopFrom + 1);
+  ruleDelete(loopFrom);
+
+  // a reboot, as far as rules go
+  std::vector<std::string> before = ruleTexts();
+  rulesBegin();
+  printf("  after a reboot: %s\n", before == ruleTexts() ? "same rules" : "RULES DIFFER");
+  benchCheck(before == ruleTexts(), "rules kept over a reboot");
+
+  // every rule in use: rulesTick() with nothing changed
+  deleteAll();
+  std::mt19937 rng(3);
+  int added = 0;
+  while (added < RULES_MAX && ruleAdd(randomRule(rng, NUM_RELAYS).c_str(), nullptr) == RULE_OK) added++;
+  rulesJson(list, sizeof(list));
+  const char* code = strstr(list, "\"code_bytes\":");
+  const int TICKS = 100000;
+  uint64_t t0 = benchNowNs();
+  for (int i = 0; i < TICKS; i++) rulesTick();
+  printf("  %d rules, %lu B of program: rulesTick() %.0f ns with nothing changed\n", added,
+         code ? strtoul(code + 13, nullptr, 10) : 0ul, (double)(benchNowNs() - t0) / TICKS);
+  deleteAll();
+  RuleStats st = rulesStats();
+  printf("  whole run: %lu input changes, %.1f rules re-run each, %lu fired\n", (unsigned long)st.changes,
+         st.changes ? (double)st.evaluated / st.changes : 0.0, (unsigned long)st.fired);
+}
+
+} // namespace
+
+void benchRules(const BenchOptions& opt) {
+  benchEngine(NUM_RELAYS);
+  benchEngine(32);
+  benchFirmware(opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES);
+}
@@ -0,0 +1,216 @@
+// src/native/bench_scenes.cpp
+// Scenes against switching the same relays one request at a time. Relays
+// 1-4 go all on / all off, alternately, either as four WS "toggle:<n>"
+// messages (each sent once the previous one has reached its relay, like a
+// client waiting for its answer) or as one saved scene. For each: time from
+// the first relay switching to the last, distinct GPIO writes, state deltas
+// streamed to a WS client. Then the scene from each
+// trigger (HTTP, WS, the SinricPro scene switch, the IR remote's saved-scene
+// key) to the last relay, the scenes kept over a reboot, and a save with no
+// relay list. Takes about 15 s.
+
+#include <string.h>
+
+#include <set>
+#include <string>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "relay_control.h"
+#include "scenes.h"
+#include "sim.h"
+#include "wifi_manager.h"
+
+void setup();
+
+namespace {
+
+const int DEFAULT_SAMPLES = 5;
+const uint32_t SETTLE_MS = 300;    // past the WS stream tick and the IR remote's hold window
+
+template <typename Pred>
+bool waitUntil(uint32_t timeoutMs, Pred done) {
+  uint32_t t0 = hal::millis();
+  while (!done()) {
+    if (hal::millis() - t0 >= timeoutMs) return false;
+    hal::delayMs(1);
+  }
+  return true;
+}
+
+const uint32_t ALL = (uint32_t)((1ull << NUM_RELAYS) - 1);
+
+struct Switching {
+  BenchStats spanMs, writes, deltas;
+  int failed = 0;
+};
+
+// What reached the pins and the WS client since t0Us.
+void record(Switching& st, uint32_t t0Us, uint32_t want) {
+  bool ok = waitUntil(1000, [&] { return relayStateMask() == want; });
+  hal::delayMs(SETTLE_MS);
+  if (!ok) { st.failed++; return; }
+  uint32_t first = 0, last = 0;
+  std::set<uint32_t> at;
+  for (int r = 1; r <= NUM_RELAYS; r++) {
+    uint32_t us = 0;
+    if (!sim::waitGpioWrite(RELAYS[r - 1].pin, t0Us, 0, &us)) continue;
+    if (at.empty() || (int32_t)(us - first) < 0) first = us;
+    if (at.empty() || (int32_t)(us - last) > 0) last = us;
+    at.insert(us);
+  }
+  int deltas = 0;
+  for (const String& f : sim::wsTake(0)) deltas += strstr(f.c_str(), "\"d\":") != nullptr;
+  st.spanMs.add((last - first) / 1000.0);
+  st.writes.add(at.size());
+  st.deltas.add(deltas);
+}
+
+void print(const char* label, const Switching& st) {
+  printf("  -- %s%s --\n", label, st.failed ? " (some runs never got there)" : "");
+  st.spanMs.print("first -> last relay switched", "ms");
+  st.writes.print("GPIO writes", "");
+  st.deltas.print("WS state deltas", "");
+}
+
+// Clean NEC frame for `code`, as the receiver hands it over.
+std::vector<uint16_t> necFrame(uint32_t code) {
+  std::vector<uint16_t> d = {9000, 4500};
+  for (int i = 31; i >= 0; i--) {
+    d.push_back(560);
+    d.push_back((code >> i) & 1 ? 1690 : 560);
+  }
+  d.push_back(560);
+  return d;
+}
+
+int savedSceneKey(int slot) {
+  for (size_t i = 0; i < sizeof(IR_REMOTE_KEYS) / sizeof(IR_REMOTE_KEYS[0]); i++) {
+    if (IR_REMOTE_KEYS[i].action == IR_KEY_SAVED_SCENE && IR_REMOTE_KEYS[i].arg == (uint32_t)slot) return (int)i;
+  }
+  return -1;
+}
+
+// ms from the trigger until the last relay of the scene has switched
+template <typename Trigger>
+double triggerLatency(uint32_t want, Trigger trigger) {
+  hal::delayMs(SETTLE_MS);
+  uint32_t t0 = hal::micros();
+  uint32_t from = trigger(t0);
+  if (!waitUntil(2000, [&] { return relayStateMask() == want; })) return -1;
+  uint32_t last = 0;
+  for (int r = 1; r <= NUM_RELAYS; r++) {
+    uint32_t us = 0;
+    if (sim::waitGpioWrite(RELAYS[r - 1].pin, from, 0, &us) && (int32_t)(us - last) > 0) last = us;
+  }
+  return (int32_t)(last - from) / 1000.0;
+}
+
+} // namespace
+
+void benchScenes(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+  sim::setStaReachable(true);
+  sim::setCloudUp(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  if (!waitUntil(20000, [] { return wifiManagerState() == WIFI_STATE_CONNECTED; })) {
+    printf("  STA never connected\n");
+    return;
+  }
+  sim::wsConnect(0);
+  hal::delayMs(1500);   // SinricPro connected, boot reports out of the way
+
+  char list[SCENES_JSON_MAX];
+  // slot 0 (the IR key's) all on, slot 1 all off, the SinricPro scene switch's all on
+  SceneError e = sceneSave("all_on", ALL, ALL);
+  if (e == SCENE_OK) e = sceneSave("all_off", ALL, 0);
+  if (e == SCENE_OK) e = sceneSave(SCENE_DEVICES[0].scene, ALL, ALL);
+  if (e != SCENE_OK) {
+    printf("  saving scenes failed: %s\n", sceneErrorName(e));
+    return;
+  }
+  sceneApply("all_off", SRC_HTTP);
+  hal::delayMs(SETTLE_MS);
+  sim::wsTake(0);
+
+  Switching oneByOne, scene;
+  for (int i = 0; i < samples * 2; i++) {
+    bool on = i % 2 == 0;
+    uint32_t t0Us = hal::micros();
+    for (int r = 1; r <= NUM_RELAYS; r++) {
+      char msg[16];
+      snprintf(msg, sizeof(msg), "toggle:%d", r);
+      sim::wsText(0, msg);
+      waitUntil(500, [&] { return relayIsOn(r) == on; });
+    }
+    record(oneByOne, t0Us, on ? ALL : 0);
+  }
+  for (int i = 0; i < samples * 2; i++) {
+    bool on = i % 2 == 0;
+    uint32_t t0Us = hal::micros();
+    sim::wsText(0, on ? "scene:all_on" : "scene:all_off");
+    record(scene, t0Us, on ? ALL : 0);
+  }
+  print("4 x toggle:<n>, one after the other", oneByOne);
+  print("scene:<name>", scene);
+
+  // each trigger, alternating all on / all off
+  sim::wsTake(0);
+  BenchStats http, ws, cloud, ir;
+  int key = savedSceneKey(0);
+  for (int i = 0; i < samples; i++) {
+    http.add(triggerLatency(ALL, [](uint32_t t0) {
+      sim::httpRequest(HTTP_POST, "/scenes/apply", {{"name", "all_on"}});
+      return t0;
+    }));
+    ws.add(triggerLatency(0, [](uint32_t t0) { sim::wsText(0, "scene:all_off"); return t0; }));
+    if (SCENE_DEVICES[0].deviceId) {
+      cloud.add(triggerLatency(ALL, [](uint32_t t0) {
+        sim::cloudPowerState(SCENE_DEVICES[0].deviceId, true);
+        return t0;
+      }));
+    }
+    sceneApply("all_off", SRC_HTTP);
+    if (key >= 0) {
+      ir.add(triggerLatency(ALL, [&](uint32_t) {
+        std::vector<uint16_t> d = necFrame(IR_REMOTE_KEYS[key].code);
+        return sim::irRxSend(d.data(), d.size());   // from the end of the key press
+      }));
+      sceneApply("all_off", SRC_HTTP);
+    }
+  }
+  http.print("HTTP /scenes/apply -> last relay", "ms");
+  ws.print("WS scene: -> last relay", "ms");
+  if (SCENE_DEVICES[0].deviceId) cloud.print("SinricPro scene switch -> last relay", "ms");
+  else printf("  %-34s (no device ID in SCENE_DEVICES)\n", "SinricPro");
+  if (key >= 0) ir.print("IR saved-scene key -> last relay", "ms");
+  else printf("  %-34s (no IR_KEY_SAVED_SCENE key for slot 0)\n", "IR");
+
+  // refusals, and the scenes after a reboot
+  sim::wsText(0, "scene:nope");
+  sim::wsText(0, "scene_save:bad name:1");
+  sim::wsText(0, "scene_save:x:9");
+  hal::delayMs(50);
+  int refused = 0;
+  for (const String& f : sim::wsTake(0)) refused += strstr(f.c_str(), "scene_error") != nullptr;
+  scenesJson(list, sizeof(list));
+  std::string before = list;
+  scenesBegin();
+  scenesJson(list, sizeof(list));
+  printf("  refusals answered: %d/3; after a reboot: %s\n", refused,
+         before == list ? "same scenes" : "SCENES DIFFER");
+  printf("  %s\n", list);
+
+  // no relay list: SCENE_DEFAULT_RELAYS, which always fits one batch
+  sim::wsText(0, "scene_save:plain");
+  hal::delayMs(50);
+  bool plainSaved = false;
+  for (const String& f : sim::wsTake(0)) plainSaved |= strstr(f.c_str(), "\"plain\"") != nullptr;
+  printf("  scene_save:<name> with no relay list (%d relays): %s\n", NUM_RELAYS, plainSaved ? "saved" : "REFUSED");
+  sceneDelete("plain");
+  sceneDelete("all_on");
+  sceneDelete("all_off");
+  sceneDelete(SCENE_DEVICES[0].scene);
+}
@@ -0,0 +1,318 @@
+// src/native/bench_timers.cpp
+// Relay timers. First the timer wheel on its own, at a scale the firmware
+// never reaches: 10000 timers from one tick to beyond the wheel's span, half
+// of them cancelled; add/cancel cost, per-tick cost (empty ticks, ticks that
+// fire, cascades) against scanning an array every tick, and a check that
+// every timer fires exactly at its due tick and no cancelled one fires.
+// Then the firmware: a one-shot over HTTP and WS, auto-off after a WS toggle,
+// a daily schedule at a local time (simulated SNTP clock), timers kept over a
+// "reboot" with time spent powered off, and the cost of relayTimersTick()
+// with every timer in use. Every timer early, late (by more than LATE_MS) or
+// not fired, and every timer lost over the reboot, fails the run. Takes
+// about 20 s.
+
+#include <time.h>
+
+#include <memory>
+#include <random>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "relay_control.h"
+#include "relay_timers.h"
+#include "sim.h"
+#include "timer_wheel.h"
+#include "wifi_manager.h"
+
+void setup();
+
+namespace {
+
+const int WHEEL_TIMERS = 10000;
+const int FAR_TIMERS = 100;                 // beyond the wheel's 2^26 tick span
+const uint32_t NEAR_SPAN = 1u << 20;        // the rest: 1 tick .. ~29 h at 100 ms
+const int NAIVE_TICKS = 2000;
+const double LATE_MS = 500;                 // firmware timers: 100 ms ticks plus scheduling
+
+typedef TimerWheel<16384> BigWheel;
+
+void benchWheel() {
+  std::unique_ptr<BigWheel> wheel(new BigWheel(0));
+  std::mt19937 rng(7);
+  std::vector<uint32_t> due(WHEEL_TIMERS);
+  std::vector<BigWheel::Handle> handle(WHEEL_TIMERS);
+  std::vector<uint8_t> cancelled(WHEEL_TIMERS), firedAt(WHEEL_TIMERS);
+  for (int i = 0; i < WHEEL_TIMERS; i++) {
+    due[i] = i < FAR_TIMERS ? std::uniform_int_distribution<uint32_t>(1u << 26, 1u << 27)(rng)
+                            : std::uniform_int_distribution<uint32_t>(1, NEAR_SPAN)(rng);
+  }
+
+  uint64_t t0 = benchNowNs();
+  for (int i = 0; i < WHEEL_TIMERS; i++) handle[i] = wheel->add(due[i], i);
+  double addNs = (double)(benchNowNs() - t0) / WHEEL_TIMERS;
+  std::vector<int> order(WHEEL_TIMERS);
+  for (int i = 0; i < WHEEL_TIMERS; i++) order[i] = i;
+  std::shuffle(order.begin(), order.end(), rng);
+  t0 = benchNowNs();
+  for (int k = 0; k < WHEEL_TIMERS / 2; k++) cancelled[order[k]] = wheel->cancel(handle[order[k]]);
+  double cancelNs = (double)(benchNowNs() - t0) / (WHEEL_TIMERS / 2);
+  printf("  wheel: %d timers, add %.1f ns, cancel %.1f ns (%d cancelled)\n", WHEEL_TIMERS, addNs, cancelNs,
+         WHEEL_TIMERS / 2);
+
+  int early = 0, late = 0, ghosts = 0, twice = 0;
+  uint32_t ticking = 0;
+  auto fire = [&](uint32_t i) {
+    if (cancelled[i]) ghosts++;
+    if (firedAt[i]++) twice++;
+    if (ticking < due[i]) early++;
+    if (ticking > due[i]) late++;
+  };
+
+  // tick by tick over the near span; cascades happen every 256 ticks
+  double emptyNs = 0, firingNs = 0, cascadeNs = 0, maxNs = 0;
+  uint32_t emptyTicks = 0, firingTicks = 0, cascadeTicks = 0;
+  for (ticking = 1; ticking <= NEAR_SPAN; ticking++) {
+    uint64_t s = benchNowNs();
+    int n = wheel->advance(ticking, fire);
+    double ns = (double)(benchNowNs() - s);
+    maxNs = std::max(maxNs, ns);
+    if (!(ticking & 0xFF)) { cascadeNs += ns; cascadeTicks++; }
+    else if (n) { firingNs += ns; firingTicks++; }
+    else { emptyNs += ns; emptyTicks++; }
+  }
+  printf("  per tick: empty %.1f ns (%u), firing %.1f ns (%u), cascading %.1f ns (%u), max %.0f ns\n",
+         emptyNs / emptyTicks, emptyTicks, firingNs / std::max(firingTicks, 1u), firingTicks,
+         cascadeNs / std::max(cascadeTicks, 1u), cascadeTicks, maxNs);
+
+  // the far ones: one advance() over the rest of the span
+  int farPending = wheel->size();
+  t0 = benchNowNs();
+  for (; ticking <= (1u << 27) + 1; ticking++) wheel->advance(ticking, fire);
+  double farMs = (benchNowNs() - t0) / 1e6;
+  printf("  far timers: %d pending after the near span, %.0f ms for the %u ticks to the last\n", farPending,
+         farMs, (1u << 27) + 1 - NEAR_SPAN);
+
+  int missing = 0;
+  for (int i = 0; i < WHEEL_TIMERS; i++) missing += !cancelled[i] && !firedAt[i];
+  printf("  check: early %d, late %d, cancelled but fired %d, fired twice %d, never fired %d, left %d\n", early,
+         late, ghosts, twice, missing, wheel->size());
+  benchCheck(!early && !late && !ghosts && !twice && !missing && !wheel->size(),
+             "wheel: every timer fires once at its due tick, no cancelled one fires");
+
+  // the alternative: every tick looks at every timer
+  std::vector<uint32_t> naive(due.begin(), due.end());
+  for (int i = 0; i < WHEEL_TIMERS; i++) if (cancelled[i]) naive[i] = 0;
+  uint32_t hits = 0;
+  t0 = benchNowNs();
+  for (uint32_t t = 1; t <= NAIVE_TICKS; t++) {
+    for (uint32_t& d : naive) if (d == t) { d = 0; hits++; }
+  }
+  printf("  array scan of %d timers: %.1f ns per tick (%u fired)\n", WHEEL_TIMERS,
+         (double)(benchNowNs() - t0) / NAIVE_TICKS, hits);
+}
+
+template <typename Pred>
+bool waitUntil(uint32_t timeoutMs, Pred done) {
+  uint32_t t0 = hal::millis();
+  while (!done()) {
+    if (hal::millis() - t0 >= timeoutMs) return false;
+    hal::delayMs(1);
+  }
+  return true;
+}
+
+// Puts the relay in a known state first (after the pin write that ended the
+// last wait has reached the state mask too).
+void setRelay(uint8_t relay, bool on) {
+  hal::delayMs(20);
+  if (relayIsOn(relay) != on) submitRelayCommand(relay, on ? RELAY_OP_ON : RELAY_OP_OFF, SRC_HTTP);
+  waitUntil(500, [&] { return relayIsOn(relay) == on; });
+}
+
+// ms from t0Us until `pin` is written, -1 on timeout
+double pinAfter(int pin, uint32_t t0Us, uint32_t timeoutMs) {
+  uint32_t at = 0;
+  if (!sim::waitGpioWrite(pin, t0Us, timeoutMs, &at)) return -1;
+  return (at - t0Us) / 1000.0;
+}
+
+// fired at `dueMs`, give or take the firmware's tick
+bool onTime(double ms, double dueMs) { return ms >= dueMs && ms <= dueMs + LATE_MS; }
+
+bool wsReplied(const char* key) {
+  for (const String& f : sim::wsTake(0)) {
+    if (strstr(f.c_str(), key)) return true;
+  }
+  return false;
+}
+
+void benchFirmware() {
+  sim::setStaReachable(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  if (!waitUntil(20000, [] { return wifiManagerState() == WIFI_STATE_CONNECTED; })) {
+    benchCheck(false, "STA connected");
+    return;
+  }
+  sim::wsConnect(0);
+  hal::delayMs(100);
+  sim::wsTake(0);
+
+  // one-shot over HTTP: relay 2 on in 1 s
+  BenchStats oneShot;
+  int offTime = 0;
+  for (int i = 0; i < 5; i++) {
+    setRelay(2, false);
+    uint32_t t0 = hal::micros();
+    sim::httpRequest(HTTP_POST, "/timers", {{"relay", "2"}, {"op", "on"}, {"in", "1"}});
+    double ms = pinAfter(RELAY_PIN_2, t0, 3000);
+    if (ms >= 0) oneShot.add(ms);
+    offTime += !onTime(ms, 1000);
+  }
+  oneShot.print("HTTP in=1 -> relay 2 on", "ms");
+  benchCheck(!offTime, "HTTP one-shot fires 1 s after it was set");
+  hal::delayMs(20);
+  sim::HttpResponse list = sim::lastHttpResponse();
+  printf("  POST /timers: HTTP %d, %s\n", list.code, list.body.c_str());
+  benchCheck(list.code == 200, "POST /timers answers 200");
+  for (const char* in : {"", "abc", "5s", "-1", " 5"}) {
+    setRelay(2, false);
+    uint32_t t1 = hal::micros();
+    sim::httpRequest(HTTP_POST, "/timers", {{"relay", "2"}, {"op", "on"}, {"in", in}});
+    hal::delayMs(20);
+    int code = sim::lastHttpResponse().code;
+    bool switched = pinAfter(RELAY_PIN_2, t1, 200) >= 0;
+    printf("  POST /timers in=\"%s\": HTTP %d%s\n", in, code, switched ? ", relay 2 SWITCHED" : "");
+    benchCheck(code == 400 && !switched, "POST /timers refuses a malformed delay");
+  }
+  sim::httpRequest(HTTP_POST, "/timers", {{"relay", "2"}, {"op", "on"}, {"at", "07:00"}, {"days", "abc"}});
+  hal::delayMs(20);
+  int daysCode = sim::lastHttpResponse().code;
+  sim::httpRequest(HTTP_POST, "/auto_off", {{"relay", "2"}, {"s", "abc"}});
+  hal::delayMs(20);
+  int autoOffCode = sim::lastHttpResponse().code;
+  sim::httpRequest(HTTP_POST, "/timers/cancel", {{"id", "abc"}});
+  hal::delayMs(20);
+  int cancelCode = sim::lastHttpResponse().code;
+  printf("  days=abc: HTTP %d, /auto_off s=abc: HTTP %d, /timers/cancel id=abc: HTTP %d\n", daysCode, autoOffCode,
+         cancelCode);
+  benchCheck(daysCode == 400 && autoOffCode == 400 && cancelCode == 404, "malformed days, s and id refused");
+
+  // one-shot over WS
+  setRelay(3, false);
+  uint32_t t0 = hal::micros();
+  sim::wsText(0, "timer:3:toggle:2");
+  double ms = pinAfter(RELAY_PIN_3, t0, 4000);
+  bool listed = wsReplied("\"timers\"");
+  printf("  WS timer:3:toggle:2 -> relay 3 toggled after %.1f ms, list in reply: %s\n", ms, listed ? "yes" : "no");
+  benchCheck(onTime(ms, 2000) && listed, "WS one-shot fires 2 s after it was set, list in the reply");
+  sim::wsText(0, "timer:9:on:5");
+  hal::delayMs(20);
+  bool refused = wsReplied("bad relay");
+  printf("  WS timer:9:on:5 -> %s\n", refused ? "refused (bad relay)" : "NOT refused");
+  benchCheck(refused, "WS timer for relay 9 refused");
+
+  // auto-off: relay 2 goes off 1 s after a WS toggle turned it on
+  sim::wsText(0, "autooff:2:1");
+  BenchStats autoOff;
+  offTime = 0;
+  for (int i = 0; i < 5; i++) {
+    setRelay(2, false);
+    hal::delayMs(150);   // past the next tick, so the off is seen
+    sim::wsText(0, "toggle:2");
+    uint32_t onAt = 0;
+    if (!sim::waitGpioWrite(RELAY_PIN_2, hal::micros() - 50000, 500, &onAt)) { offTime++; continue; }
+    ms = pinAfter(RELAY_PIN_2, onAt + 1, 3000);
+    if (ms >= 0) autoOff.add(ms);
+    offTime += !onTime(ms, 1000);
+  }
+  autoOff.print("auto-off 1 s: relay 2 on -> off", "ms");
+  benchCheck(!offTime, "auto-off switches relay 2 off 1 s after it went on");
+  sim::wsText(0, "autooff:2:0");
+
+  // daily at 07:00 local (TIME_ZONE: CET in January, 06:00 UTC), clock at 06:59:57
+  struct tm utc = {};
+  utc.tm_year = 2026 - 1900;
+  utc.tm_mon = 0;
+  utc.tm_mday = 15;
+  utc.tm_hour = 5;
+  utc.tm_min = 59;
+  utc.tm_sec = 57;
+  uint32_t before7 = (uint32_t)timegm(&utc);
+  setRelay(1, false);
+  uint32_t id = 0;
+  relayTimerAddDaily(1, RELAY_OP_ON, 7 * 60, RELAY_TIMER_EVERY_DAY, &id);
+  sim::setWallClock(before7);
+  t0 = hal::micros();
+  ms = pinAfter(RELAY_PIN_1, t0, 6000);
+  uint32_t at = hal::wallClock();
+  printf("  daily 07:00 CET: relay 1 on %.0f ms after the clock read 06:59:57 (%s at %u s past 06:00 UTC; 1 s clock, checked every 1 s)\n", ms,
+         ms >= 0 ? "fired" : "did not fire", at - (before7 + 3));
+  benchCheck(ms >= 0 && at >= before7 + 3, "daily timer fires at 07:00, not before");
+  hal::delayMs(300);
+  char out[RELAY_TIMERS_JSON_MAX];
+  relayTimersJson(out, sizeof(out));
+  const char* next = strstr(out, "\"daily\"");
+  const char* inS = next ? strstr(next, "\"in_s\":") : nullptr;
+  long rearm = inS ? strtol(inS + 7, nullptr, 10) : -1L;
+  printf("  re-armed for tomorrow: in_s=%ld (expect ~86400)\n", rearm);
+  benchCheck(rearm > 86390 && rearm <= 86400, "daily timer re-armed for tomorrow");
+  relayTimerCancel(id);
+
+  // persistence: a long one-shot and a short one, saved; 30 s powered off
+  setRelay(4, false);
+  uint32_t longId = 0, shortId = 0;
+  relayTimerAddOnce(3, RELAY_OP_TOGGLE, 600, &longId);
+  relayTimerAddOnce(4, RELAY_OP_ON, 10, &shortId);
+  uint32_t saves0 = relayTimerStats().saves;
+  relayTimersFlush();
+  uint32_t saves1 = relayTimerStats().saves;
+  sim::setWallClock(hal::wallClock() + 30);
+  t0 = hal::micros();
+  relayTimersBegin();   // boot: reload from NVS
+  ms = pinAfter(RELAY_PIN_4, t0, 1000);
+  hal::delayMs(300);
+  relayTimersJson(out, sizeof(out));
+  char key[24];
+  snprintf(key, sizeof(key), "{\"id\":%u,", longId);
+  const char* restored = strstr(out, key);
+  inS = restored ? strstr(restored, "\"in_s\":") : nullptr;
+  long back = inS ? strtol(inS + 7, nullptr, 10) : -1L;
+  printf("  reboot after 30 s off: overdue timer fired in %.1f ms, 600 s timer back with in_s=%ld (expect ~569),"
+         " %u NVS save(s) for the flush\n", ms, back, saves1 - saves0);
+  benchCheck(ms >= 0 && back >= 565 && back <= 570, "timers kept over a reboot: the overdue one fires, the other is back");
+  relayTimerCancel(longId);
+
+  // relayTimersTick() with every timer in use (far off, none due)
+  uint32_t ids[RELAY_TIMER_MAX];
+  int used = 0;
+  while (used < RELAY_TIMER_MAX && relayTimerAddOnce(1 + used % NUM_RELAYS, RELAY_OP_TOGGLE, 3600 + used, &ids[used]) ==
+                                       RELAY_TIMER_OK)
+    used++;
+  uint32_t extra;
+  RelayTimerError full = relayTimerAddOnce(1, RELAY_OP_ON, 5, &extra);
+  BenchStats tickCost;
+  for (int i = 0; i < 2000; i++) {
+    uint64_t s = benchNowNs();
+    relayTimersTick();
+    tickCost.add((benchNowNs() - s) / 1e3);
+    hal::delayMs(i % 2 ? 1 : 0);
+  }
+  char label[48];
+  snprintf(label, sizeof(label), "relayTimersTick, %d timers", used);
+  tickCost.print(label, "us");
+  printf("  timer %d: %s\n", used + 1, relayTimerErrorName(full));
+  benchCheck(used == RELAY_TIMER_MAX && full == RELAY_TIMER_FULL, "RELAY_TIMER_MAX timers, then full");
+  for (int i = 0; i < used; i++) relayTimerCancel(ids[i]);
+  relayTimersFlush();
+  RelayTimerStats st = relayTimerStats();
+  printf("  totals: fired %u, NVS saves %u, pending %u\n", st.fired, st.saves, st.pending);
+}
+
+} // namespace
+
+void benchTimers(const BenchOptions&) {
+  benchWheel();
+  benchFirmware();
+}
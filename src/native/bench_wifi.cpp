@@ -0,0 +1,99 @@
+// src/native/bench_wifi.cpp
+// Connection-manager scenarios in real time: boot with the router down,
+// credentials saved from the setup page, the router coming back, and outages
+// of increasing length while connected. Reports how long each transition
+// took and the relay command latency (WS) while STA retries run alongside
+// the AP. Takes about two minutes.
+
+#include <WiFi.h>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "sim.h"
+#include "wifi_manager.h"
+
+void setup();
+
+namespace {
+
+const int DEFAULT_SAMPLES = 20;
+const uint32_t OUTAGES_MS[] = {3000, 14000, 30000};
+
+// Polls `done` every few ms; elapsed ms, or -1 after timeoutMs.
+template <typename Pred>
+double waitFor(uint32_t timeoutMs, Pred done) {
+  uint64_t t0 = benchNowNs();
+  while (!done()) {
+    if ((benchNowNs() - t0) / 1000000 >= timeoutMs) return -1;
+    hal::delayMs(2);
+  }
+  return (benchNowNs() - t0) / 1e6;
+}
+
+void report(const char* label, double ms) {
+  if (ms < 0) printf("  %-44s TIMEOUT\n", label);
+  else printf("  %-44s %9.1f ms\n", label, ms);
+}
+
+bool connected() { return wifiManagerState() == WIFI_STATE_CONNECTED; }
+
+double wsToggleMs() {
+  uint32_t t0 = hal::micros();
+  sim::wsText(0, "toggle:1");
+  uint32_t at = 0;
+  if (!sim::waitGpioWrite(RELAY_PIN_1, t0, 2000, &at)) return -1;
+  return (at - t0) / 1000.0;
+}
+
+} // namespace
+
+void benchWifi(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+
+  // --- boot with the router down ---
+  sim::setStaReachable(false);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  uint64_t t0 = benchNowNs();
+  setup();
+  report("boot: setup() returned", (benchNowNs() - t0) / 1e6);
+  double ap = waitFor(30000, wifiManagerApUp);
+  report("boot: setup AP up (router down)", ap < 0 ? -1 : (benchNowNs() - t0) / 1e6);
+  hal::delayMs(50);
+  sim::wsConnect(0);
+  hal::delayMs(50);
+
+  BenchStats ws;
+  for (int i = 0; i < samples; i++) {
+    double ms = wsToggleMs();
+    if (ms >= 0) ws.add(ms);
+    hal::delayMs(100);
+  }
+  ws.print("ws toggle:1 during STA retries", "ms");
+
+  // --- credentials saved from the page; the old handler blocked ~15 s here ---
+  sim::httpRequest(HTTP_POST, "/save", {{"ssid", FALLBACK_SSID}, {"pass", FALLBACK_PASS}});
+  report("ws toggle:1 right after POST /save", wsToggleMs());
+
+  // --- the router comes back ---
+  hal::delayMs(4000);  // a few failed rounds, so backoff is in play
+  sim::setStaReachable(true);
+  report("router back -> STA connected", waitFor(120000, connected));
+  report("STA connected -> AP down", waitFor(30000, [] { return !wifiManagerApUp(); }));
+
+  // --- outages while connected ---
+  for (uint32_t outage : OUTAGES_MS) {
+    printf("  outage %lu ms:\n", (unsigned long)outage);
+    uint64_t down = benchNowNs();
+    sim::setStaReachable(false);
+    report("  link drop detected", waitFor(5000, [] { return !connected(); }));
+    ap = waitFor(outage - (benchNowNs() - down) / 1000000, wifiManagerApUp);
+    if (ap < 0) printf("  %-44s (outage too short)\n", "  setup AP not needed");
+    else report("  setup AP up", (benchNowNs() - down) / 1e6);
+    uint64_t elapsedMs = (benchNowNs() - down) / 1000000;
+    if (elapsedMs < outage) hal::delayMs(outage - elapsedMs);
+    sim::setStaReachable(true);
+    report("  router back -> STA connected", waitFor(120000, connected));
+    waitFor(30000, [] { return !wifiManagerApUp(); });
+  }
+}
@@ -0,0 +1,180 @@
+// src/native/bench_ws.cpp
+// WebSocket state stream (ws_stream.cpp) with simulated clients. Each client
+// rebuilds relay state from the frames it receives, the way the web UI does
+// (snapshot, then deltas in seq order; "status" after a gap), and the
+// bench checks it against the relays after:
+//   - a toggle storm: frames per client vs. applied changes (coalescing),
+//   - an IR subscription: frames per second at "ir:100",
+//   - a client that stops reading: it is resynced when it resumes, the
+//     others never see a gap, and one that stays stuck is closed.
+
+#include <random>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "relay_control.h"
+#include "sim.h"
+#include "wifi_manager.h"
+#include "ws_stream.h"
+
+void setup();
+extern AsyncWebSocket ws;
+
+namespace {
+
+const int CLIENTS = 4;
+const uint32_t STORM_MS = 2000;
+const uint32_t TAKE_MS = 20;        // how often the clients read their frames
+const uint32_t IR_PERIOD_MS = 100;
+const uint32_t IR_WINDOW_MS = 2000;
+
+// what a client knows, rebuilt from its frames
+struct ClientView {
+  uint8_t num = 0;
+  long seq = -1;
+  uint32_t mask = 0;
+  uint32_t stateFrames = 0, snapshots = 0, irFrames = 0, gaps = 0;
+};
+
+void apply(ClientView& v, const String& f) {
+  const char* s = f.c_str();
+  if (!strncmp(s, "{\"ir\":", 6)) { v.irFrames++; return; }
+  if (strncmp(s, "{\"seq\":", 7)) return;
+  v.stateFrames++;
+  char* p;
+  long seq = strtol(s + 7, &p, 10);
+  if (const char* a = strstr(p, "\"relay_states\":[")) {
+    a += 16;
+    v.mask = 0;
+    for (int i = 0; i < NUM_RELAYS && *a != ']'; i++) {
+      if (!strncmp(a, "true", 4)) v.mask |= 1u << i;
+      a = strchr(a, i + 1 < NUM_RELAYS ? ',' : ']');
+      if (!a) return;
+      if (*a == ',') a++;
+    }
+    v.seq = seq;
+    v.snapshots++;
+    return;
+  }
+  if (v.seq < 0) return;   // waiting for a snapshot
+  if (seq != v.seq + 1) {
+    v.gaps++;
+    v.seq = -1;
+    sim::wsText(v.num, "status");
+    return;
+  }
+  const char* d = strstr(p, "\"d\":{");
+  for (d = d ? d + 5 : "}"; *d == '"';) {
+    int r = (int)strtol(d + 1, &p, 10);
+    bool on = !strncmp(p + 2, "true", 4);
+    if (r >= 1 && r <= NUM_RELAYS) v.mask = (v.mask & ~(1u << (r - 1))) | ((uint32_t)on << (r - 1));
+    d = strpbrk(p + 2, ",}");
+    if (!d || *d == '}') break;
+    d++;
+  }
+  v.seq = seq;
+}
+
+void drain(ClientView& v) {
+  for (const String& f : sim::wsTake(v.num)) apply(v, f);
+}
+
+void drainAll(ClientView* views) {
+  for (int i = 0; i < CLIENTS; i++) drain(views[i]);
+}
+
+// random toggles from client 1 every ms for `ms`, clients reading every TAKE_MS;
+// returns the number of toggles sent
+uint32_t storm(ClientView* views, uint32_t ms, std::mt19937& rng) {
+  uint32_t sent = 0;
+  uint32_t t0 = hal::millis();
+  while (hal::millis() - t0 < ms) {
+    char cmd[16];
+    snprintf(cmd, sizeof(cmd), "toggle:%d", std::uniform_int_distribution<int>(1, NUM_RELAYS)(rng));
+    sim::wsText(1, cmd);
+    sent++;
+    hal::delayMs(1);
+    if (sent % TAKE_MS == 0) drainAll(views);
+  }
+  return sent;
+}
+
+bool converged(const ClientView& v) { return v.seq >= 0 && v.mask == relayStateMask(); }
+
+void settle(ClientView* views) {
+  for (int i = 0; i < 10; i++) {
+    hal::delayMs(TAKE_MS);
+    drainAll(views);
+  }
+}
+
+} // namespace
+
+void benchWs(const BenchOptions&) {
+  sim::setStaReachable(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  while (wifiManagerState() != WIFI_STATE_CONNECTED) hal::delayMs(10);
+
+  ClientView views[CLIENTS];
+  for (int i = 0; i < CLIENTS; i++) {
+    views[i].num = (uint8_t)(i + 1);
+    sim::wsConnect(views[i].num);
+  }
+  settle(views);
+
+  // toggle storm
+  std::mt19937 rng(7);
+  uint32_t seq0 = wsStreamSeq();
+  uint32_t frames0 = views[0].stateFrames;
+  uint32_t sent = storm(views, STORM_MS, rng);
+  settle(views);
+  uint32_t deltas = wsStreamSeq() - seq0;
+  printf("  storm: %u toggles in %u ms -> %u deltas (%.1f per toggle), client 1 got %u frames\n",
+         sent, STORM_MS, deltas, (double)deltas / sent, views[0].stateFrames - frames0);
+  for (const ClientView& v : views) {
+    printf("  client %u: %u state frames, %u snapshots, %u gaps, state %s\n", v.num, v.stateFrames,
+           v.snapshots, v.gaps, converged(v) ? "matches relays" : "DIVERGED");
+  }
+
+  // IR telemetry subscription
+  char sub[16];
+  snprintf(sub, sizeof(sub), "ir:%u", IR_PERIOD_MS);
+  sim::wsText(2, sub);
+  hal::delayMs(TAKE_MS);
+  drain(views[1]);
+  uint32_t ir0 = views[1].irFrames;
+  hal::delayMs(IR_WINDOW_MS);
+  drain(views[1]);
+  sim::wsText(2, "ir:0");
+  printf("  ir:%u for %u ms -> %u IR frames (expect ~%u); unsubscribed clients got %u\n", IR_PERIOD_MS,
+         IR_WINDOW_MS, views[1].irFrames - ir0, IR_WINDOW_MS / IR_PERIOD_MS,
+         views[0].irFrames + views[2].irFrames + views[3].irFrames);
+
+  // client 3 stops reading during a storm, then resumes
+  settle(views);
+  for (ClientView& v : views) v.gaps = 0;
+  uint32_t snaps3 = views[2].snapshots;
+  sim::wsSetPaused(3, true);
+  storm(views, 1000, rng);
+  sim::wsSetPaused(3, false);
+  settle(views);
+  printf("  client 3 paused 1000 ms: resumed with %u snapshot(s), %u gap(s), state %s\n",
+         views[2].snapshots - snaps3, views[2].gaps, converged(views[2]) ? "matches relays" : "DIVERGED");
+  uint32_t otherGaps = views[0].gaps + views[1].gaps + views[3].gaps;
+  bool othersOk = converged(views[0]) && converged(views[1]) && converged(views[3]);
+  printf("  other clients meanwhile: %u gaps, state %s\n", otherGaps, othersOk ? "matches relays" : "DIVERGED");
+
+  // client 4 never resumes
+  size_t before = ws.count();
+  sim::wsSetPaused(4, true);
+  uint32_t t0 = hal::millis();
+  storm(views, 200, rng);   // fill its queue
+  while (ws.count() == before && hal::millis() - t0 < WS_STALL_DROP_MS + 2000) hal::delayMs(10);
+  if (ws.count() < before) {
+    printf("  client 4 stuck: closed after %u ms (WS_STALL_DROP_MS %u)\n", hal::millis() - t0, WS_STALL_DROP_MS);
+  } else {
+    printf("  client 4 stuck: STILL CONNECTED after %u ms\n", hal::millis() - t0);
+  }
+}
@@ -0,0 +1,293 @@
+// src/native/bench_wsproto.cpp
+// Binary WS command protocol (ws_protocol.h):
+//   - parser throughput: the old String path for "toggle:<n>" (kept here as
+//     the baseline) against parseText() and binary frames of 1/4/16 commands,
+//   - fuzzing: random, mutated and resized frames through the parser and
+//     execute(), each in an exactly-sized heap buffer (so a sanitizer build
+//     catches over-reads), checking the decode and ack invariants,
+//   - end to end over a simulated WS client: frame -> ack latency, pin skew
+//     of a 4-relay frame and stream deltas per frame, against the same
+//     change sent as text toggles.
+
+#include <Arduino.h>
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "config.h"
+#include "hal.h"
+#include "relay_control.h"
+#include "sim.h"
+#include "wifi_manager.h"
+#include "ws_protocol.h"
+#include "ws_stream.h"
+
+void setup();
+
+namespace {
+
+const int DEFAULT_SAMPLES = 1000000;
+const int FRAMES = 200;
+
+volatile int sink;
+
+// -------- baseline: the pre-protocol text handler --------
+
+int legacyToggle(const uint8_t* data, size_t len) {
+  String s((char*)data, len);
+  if (s.startsWith("toggle:")) return s.substring(7).toInt();
+  return -1;
+}
+
+std::vector<uint8_t> encode(const std::vector<WsCommand>& cmds) {
+  std::vector<uint8_t> f = {WS_CMD_MAGIC, (uint8_t)cmds.size()};
+  for (const WsCommand& c : cmds) {
+    f.push_back((uint8_t)c.seq);
+    f.push_back((uint8_t)(c.seq >> 8));
+    f.push_back(c.op);
+    f.push_back(c.arg);
+  }
+  return f;
+}
+
+std::vector<uint8_t> randomFrame(std::mt19937& rng, int n) {
+  std::vector<WsCommand> cmds;
+  for (int i = 0; i < n; i++) {
+    cmds.push_back({(uint16_t)rng(), (uint8_t)(WS_OP_OFF + rng() % 4), (uint8_t)(1 + rng() % NUM_RELAYS)});
+  }
+  return encode(cmds);
+}
+
+int decodeAll(const uint8_t* data, size_t len) {
+  int n = ws_protocol::frameCount(data, len);
+  int ok = 0;
+  RelayCommand rc;
+  for (int i = 0; i < n; i++) {
+    ok += ws_protocol::toRelayCommand(ws_protocol::frameCommand(data, i), rc) == WS_ACK_OK;
+  }
+  return ok;
+}
+
+template <typename Fn>
+void measure(const char* label, int samples, int perCall, Fn fn) {
+  uint64_t t0 = benchNowNs();
+  for (int i = 0; i < samples; i++) sink = fn();
+  double ns = (double)(benchNowNs() - t0) / samples;
+  printf("  %-40s %8.1f ns/frame %8.1f ns/command\n", label, ns, ns / perCall);
+}
+
+void throughput(int samples) {
+  const uint8_t text[] = "toggle:3";
+  measure("text toggle:3, String path (old)", samples, 1, [&] { return legacyToggle(text, 8); });
+  measure("text toggle:3, parseText", samples, 1, [&] {
+    WsCommand c;
+    return ws_protocol::parseText((const char*)text, 8, c) ? c.arg : -1;
+  });
+  std::mt19937 rng(1);
+  for (int n : {1, 4, WS_CMD_BATCH_MAX}) {
+    std::vector<uint8_t> f = randomFrame(rng, n);
+    char label[48];
+    snprintf(label, sizeof(label), "binary frame, %d command%s", n, n == 1 ? "" : "s");
+    measure(label, samples, n, [&] { return decodeAll(f.data(), f.size()); });
+  }
+}
+
+// -------- fuzz --------
+
+struct FuzzResult {
+  uint32_t inputs = 0, accepted = 0, violations = 0;
+};
+
+void check(FuzzResult& r, bool ok, const char* what) {
+  if (ok) return;
+  if (r.violations++ < 5) printf("  VIOLATION: %s\n", what);
+}
+
+void fuzzOne(FuzzResult& r, const std::vector<uint8_t>& input) {
+  // exact-size heap copy: no slack for an over-read to hide in
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[input.size() ? input.size() : 1]);
+  if (!input.empty()) memcpy(buf.get(), input.data(), input.size());
+  const uint8_t* data = buf.get();
+  size_t len = input.size();
+  r.inputs++;
+
+  int n = ws_protocol::frameCount(data, len);
+  check(r, n == -1 || (n >= 1 && n <= WS_CMD_BATCH_MAX && len == 2 + n * WS_CMD_SIZE && data[0] == WS_CMD_MAGIC),
+        "frameCount accepted a bad frame");
+  if (n > 0) {
+    r.accepted++;
+    std::vector<WsCommand> cmds;
+    for (int i = 0; i < n; i++) {
+      WsCommand c = ws_protocol::frameCommand(data, i);
+      cmds.push_back(c);
+      RelayCommand rc{};
+      if (ws_protocol::toRelayCommand(c, rc) == WS_ACK_OK) {
+        check(r, rc.relay >= 1 && rc.relay <= NUM_RELAYS && rc.source == SRC_WS, "relay command out of range");
+        check(r, c.op >= WS_OP_OFF && c.op <= WS_OP_MODE, "unknown op accepted");
+      }
+    }
+    check(r, encode(cmds) == input, "decode does not round-trip");
+  }
+
+  // ack: guard bytes past the end must survive
+  uint8_t ack[WS_ACK_MAX + 8];
+  memset(ack, 0xEE, sizeof(ack));
+  size_t alen = ws_protocol::execute(data, len, ack, WS_ACK_MAX);
+  bool guards = true;
+  for (size_t i = WS_ACK_MAX; i < sizeof(ack); i++) guards &= ack[i] == 0xEE;
+  check(r, guards, "ack overran its buffer");
+  check(r, alen >= 3 && ack[0] == WS_ACK_MAGIC, "bad ack header");
+  if (n < 0) {
+    check(r, alen == 3 && ack[1] == WS_FRAME_MALFORMED && ack[2] == 0, "malformed frame not reported");
+  } else {
+    check(r, alen == 3 + 3 * (size_t)n && ack[1] == WS_FRAME_OK && ack[2] == n, "ack size");
+    for (int i = 0; i < n && alen == 3 + 3 * (size_t)n; i++) {
+      WsCommand c = ws_protocol::frameCommand(data, i);
+      const uint8_t* e = ack + 3 + 3 * i;
+      check(r, (uint16_t)(e[0] | e[1] << 8) == c.seq && e[2] <= WS_ACK_BUSY, "ack entry");
+    }
+  }
+}
+
+void fuzzText(FuzzResult& r, std::mt19937& rng) {
+  static const char ALPHABET[] = "toggle:0123456789 -+x";
+  std::string s = rng() % 2 ? "toggle:" : "";
+  for (int i = rng() % 6; i > 0; i--) s += ALPHABET[rng() % (sizeof(ALPHABET) - 1)];
+  std::unique_ptr<char[]> buf(new char[s.size() ? s.size() : 1]);
+  memcpy(buf.get(), s.data(), s.size());
+  r.inputs++;
+  WsCommand c;
+  bool ok = ws_protocol::parseText(buf.get(), s.size(), c);
+  // reference: the whole tail is decimal digits naming a relay
+  bool digits = s.size() > 7 && s.compare(0, 7, "toggle:") == 0 &&
+                s.find_first_not_of("0123456789", 7) == std::string::npos;
+  long v = digits && s.size() <= 17 ? strtol(s.c_str() + 7, nullptr, 10) : 0;
+  check(r, ok == (digits && v >= 1 && v <= NUM_RELAYS), "parseText disagrees with the reference");
+  if (ok) check(r, c.op == WS_OP_TOGGLE && c.arg == v, "parseText value");
+}
+
+void fuzz(int samples) {
+  std::mt19937 rng(2);
+  FuzzResult r;
+  uint64_t t0 = benchNowNs();
+  for (int i = 0; i < samples; i++) {
+    std::vector<uint8_t> in;
+    switch (i % 4) {
+      case 0:   // random bytes, sometimes with the right magic
+        in.resize(rng() % 72);
+        for (uint8_t& b : in) b = (uint8_t)rng();
+        if (!in.empty() && rng() % 2) in[0] = WS_CMD_MAGIC;
+        break;
+      case 1:   // valid frame with a few bytes flipped
+        in = randomFrame(rng, 1 + rng() % WS_CMD_BATCH_MAX);
+        for (int k = 1 + rng() % 3; k > 0; k--) in[rng() % in.size()] ^= (uint8_t)(1 + rng() % 255);
+        break;
+      case 2:   // valid frame, cut short or padded
+        in = randomFrame(rng, 1 + rng() % WS_CMD_BATCH_MAX);
+        if (rng() % 2) in.resize(rng() % in.size());
+        else in.resize(in.size() + 1 + rng() % 4, (uint8_t)rng());
+        break;
+      default:
+        fuzzText(r, rng);
+        continue;
+    }
+    fuzzOne(r, in);
+  }
+  double s = (benchNowNs() - t0) / 1e9;
+  printf("  fuzz: %u inputs (%u well-formed frames) in %.2f s, %.2f M/s, %u invariant violations\n",
+         r.inputs, r.accepted, s, r.inputs / s / 1e6, r.violations);
+}
+
+// -------- end to end --------
+
+// waits for client 1's next binary frame; true if it is an ack
+bool waitAck(uint32_t timeoutMs) {
+  uint64_t until = benchNowNs() + timeoutMs * 1000000ull;
+  while (benchNowNs() < until) {
+    for (const String& f : sim::wsTake(1)) {
+      if (f.length() >= 3 && (uint8_t)f[0] == WS_ACK_MAGIC) return true;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  return false;
+}
+
+// spread between the first and last relay pin write at or after t0, us
+bool pinSpread(uint32_t t0, double& spread) {
+  uint32_t first = UINT32_MAX, last = 0;
+  for (const RelayDef& def : RELAYS) {
+    uint32_t at = 0;
+    if (!sim::waitGpioWrite(def.pin, t0, 1000, &at)) return false;
+    first = min(first, at);
+    last = max(last, at);
+  }
+  spread = last - first;
+  return true;
+}
+
+void endToEnd() {
+  sim::setStaReachable(true);
+  sim::setInput(BOOT_BUTTON_PIN, true);
+  setup();
+  while (wifiManagerState() != WIFI_STATE_CONNECTED) hal::delayMs(10);
+  sim::wsConnect(1);
+  for (int r = 1; r <= NUM_RELAYS; r++) submitRelayCommand(r, RELAY_OP_OFF, SRC_WS);   // undo the fuzzer
+  hal::delayMs(20);
+
+  // every relay to the opposite state, FRAMES times: one binary frame ...
+  BenchStats ackLat, binSkew, txtSkew;
+  uint32_t binDeltas = 0, txtDeltas = 0;
+  uint16_t seq = 0;
+  for (int i = 0; i < FRAMES; i++) {
+    bool on = i % 2 == 0;
+    std::vector<WsCommand> cmds;
+    for (int r = 1; r <= NUM_RELAYS; r++) cmds.push_back({seq++, on ? WS_OP_ON : WS_OP_OFF, (uint8_t)r});
+    std::vector<uint8_t> f = encode(cmds);
+    uint32_t s0 = wsStreamSeq();
+    sim::wsTake(1);
+    uint32_t t0 = hal::micros();
+    uint64_t n0 = benchNowNs();
+    sim::wsBinary(1, f.data(), f.size());
+    if (waitAck(1000)) ackLat.add((benchNowNs() - n0) / 1e6);
+    double spread;
+    if (pinSpread(t0, spread)) binSkew.add(spread);
+    hal::delayMs(6);
+    binDeltas += wsStreamSeq() - s0;
+  }
+  // ... or NUM_RELAYS text toggles sent back to back
+  for (int i = 0; i < FRAMES; i++) {
+    uint32_t s0 = wsStreamSeq();
+    uint32_t t0 = hal::micros();
+    for (int r = 1; r <= NUM_RELAYS; r++) {
+      char cmd[16];
+      snprintf(cmd, sizeof(cmd), "toggle:%d", r);
+      sim::wsText(1, cmd);
+    }
+    double spread;
+    if (pinSpread(t0, spread)) txtSkew.add(spread);
+    hal::delayMs(6);
+    txtDeltas += wsStreamSeq() - s0;
+  }
+  ackLat.print("binary frame -> ack", "ms");
+  char label[48];
+  snprintf(label, sizeof(label), "pin skew, %d-command frame", NUM_RELAYS);
+  binSkew.print(label, "us");
+  snprintf(label, sizeof(label), "pin skew, %d text toggles", NUM_RELAYS);
+  txtSkew.print(label, "us");
+  printf("  stream deltas per change: binary frame %.2f, text toggles %.2f\n",
+         (double)binDeltas / FRAMES, (double)txtDeltas / FRAMES);
+}
+
+} // namespace
+
+void benchWsProto(const BenchOptions& opt) {
+  int samples = opt.samples > 0 ? opt.samples : DEFAULT_SAMPLES;
+  throughput(samples);
+  relayControlStart();   // execute() queues what the fuzzer sends
+  fuzz(samples);
+  endToEnd();
+}
@@ -0,0 +1,364 @@
+// src/native/hal_native.cpp
+// Host implementation of include/hal.h. Pins and the ADC are plain arrays the
+// simulation can drive; the clock is the host's monotonic clock, so
+// hal::delayMs really sleeps and multi-threaded code behaves as on the board.
+
+#include "hal.h"
+#include "sim.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace {
+
+const int NUM_PINS = 40;
+
+std::mutex pinMu;
+std::condition_variable pinCv;
+bool outLevel[NUM_PINS] = {};
+uint32_t lastWriteUs[NUM_PINS] = {};
+bool hasWritten[NUM_PINS] = {};
+bool inLevel[NUM_PINS];
+int adcValue[NUM_PINS] = {};
+int adcNoise[NUM_PINS] = {};
+std::mt19937 noiseRng(42);
+
+// Continuous-sampling stream, paced in real time like the I2S DMA.
+int streamPin = -1;
+uint32_t streamRateHz = 0;
+std::chrono::steady_clock::time_point streamNext;
+
+thread_local uint64_t threadSleptNs = 0;
+
+// IR receiver: frames from sim::irRxSend go on air back to back and are
+// handed to hal::irRxRead once the line has been idle for irIdleUs after
+// their last edge, as the RMT's idle detection would.
+struct IrAirFrame {
+  std::chrono::steady_clock::time_point readyAt;
+  std::vector<uint16_t> durations;
+};
+std::mutex irMu;
+std::condition_variable irCv;
+std::deque<IrAirFrame> irFrames;
+std::chrono::steady_clock::time_point irAirFree;   // the previous frame's idle gap ends
+bool irRxOn = false;
+uint32_t irIdleUs = 0;
+
+// A spawned task: its thread blocks on `cv` in taskWait until notified.
+// `wakes` counts how often it blocked (delay, wait or DMA read), i.e. how
+// often it would wake the CPU on the board.
+struct NativeTask {
+  const char* name = "";
+  std::mutex mu;
+  std::condition_variable cv;
+  uint32_t notified = 0;
+  std::atomic<uint32_t> wakes{0};
+};
+thread_local NativeTask* currentTask = nullptr;
+std::mutex tasksMu;
+std::vector<NativeTask*> tasks;
+
+inline void countWake() {
+  if (currentTask) currentTask->wakes.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::mutex powerMu;
+sim::PowerConfig power = {240, 240, false};
+
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+// wall clock: the host's once clockSync() has run, unless the simulation set one
+std::mutex clockMu;
+bool clockSynced = false;
+bool wallFixed = false;
+uint32_t wallBase = 0, wallBaseMs = 0;
+
+struct InputsIdleHigh {
+  InputsIdleHigh() { for (bool& b : inLevel) b = true; }
+} inputsIdleHigh;
+
+inline bool validPin(int pin) { return pin >= 0 && pin < NUM_PINS; }
+
+} // namespace
+
+namespace hal {
+
+void pinSetup(int, PinMode) {}
+
+void gpioWrite(int pin, bool high) {
+  if (!validPin(pin)) return;
+  uint32_t now = micros();
+  {
+    std::lock_guard<std::mutex> lk(pinMu);
+    outLevel[pin] = high;
+    lastWriteUs[pin] = now;
+    hasWritten[pin] = true;
+  }
+  pinCv.notify_all();
+}
+
+// all pins in the masks get the same write timestamp, like one register store
+void gpioWriteMask(uint64_t highMask, uint64_t lowMask) {
+  uint32_t now = micros();
+  {
+    std::lock_guard<std::mutex> lk(pinMu);
+    for (int pin = 0; pin < NUM_PINS; pin++) {
+      uint64_t bit = 1ull << pin;
+      if (!((highMask | lowMask) & bit)) continue;
+      outLevel[pin] = (highMask & bit) != 0;
+      lastWriteUs[pin] = now;
+      hasWritten[pin] = true;
+    }
+  }
+  pinCv.notify_all();
+}
+
+bool gpioRead(int pin) {
+  std::lock_guard<std::mutex> lk(pinMu);
+  return validPin(pin) ? inLevel[pin] : false;
+}
+
+// caller holds pinMu
+int sampleLocked(int pin) {
+  int v = adcValue[pin];
+  if (adcNoise[pin]) v += std::uniform_int_distribution<int>(-adcNoise[pin], adcNoise[pin])(noiseRng);
+  return v < 0 ? 0 : v > 4095 ? 4095 : v;
+}
+
+int adcRead(int pin) {
+  std::lock_guard<std::mutex> lk(pinMu);
+  return validPin(pin) ? sampleLocked(pin) : 0;
+}
+
+bool adcStreamStart(int pin, uint32_t sampleRateHz) {
+  if (!validPin(pin) || sampleRateHz == 0) return false;
+  streamPin = pin;
+  streamRateHz = sampleRateHz;
+  streamNext = std::chrono::steady_clock::now();
+  return true;
+}
+
+size_t adcStreamRead(uint16_t* buf, size_t maxSamples, uint32_t timeoutMs) {
+  if (streamPin < 0) { delayMs(timeoutMs); return 0; }
+  countWake();
+  auto now = std::chrono::steady_clock::now();
+  if (now - streamNext > std::chrono::milliseconds(100)) streamNext = now;  // overrun: DMA drops old data
+  streamNext += std::chrono::nanoseconds((uint64_t)maxSamples * 1000000000ull / streamRateHz);
+  std::this_thread::sleep_until(streamNext);
+  std::lock_guard<std::mutex> lk(pinMu);
+  for (size_t i = 0; i < maxSamples; i++) buf[i] = (uint16_t)sampleLocked(streamPin);
+  return maxSamples;
+}
+
+void adcStreamStop() { streamPin = -1; }
+
+bool irRxBegin(int pin, uint32_t idleUs) {
+  if (!validPin(pin)) return false;
+  std::lock_guard<std::mutex> lk(irMu);
+  irRxOn = true;
+  irIdleUs = idleUs;
+  return true;
+}
+
+size_t irRxRead(uint16_t* durations, size_t maxDurations, uint32_t timeoutMs) {
+  countWake();
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  std::unique_lock<std::mutex> lk(irMu);
+  for (;;) {
+    auto now = std::chrono::steady_clock::now();
+    if (!irFrames.empty() && irFrames.front().readyAt <= now) break;
+    if (now >= deadline) return 0;
+    irCv.wait_until(lk, irFrames.empty() ? deadline : std::min(deadline, irFrames.front().readyAt));
+  }
+  std::vector<uint16_t> d = std::move(irFrames.front().durations);
+  irFrames.pop_front();
+  size_t n = std::min(d.size(), maxDurations);
+  std::copy(d.begin(), d.begin() + n, durations);
+  return n;
+}
+
+uint32_t micros() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - epoch).count();
+}
+
+uint32_t millis() { return micros() / 1000; }
+
+void clockSync(const char* tz, const char*) {
+  std::lock_guard<std::mutex> lk(clockMu);
+  setenv("TZ", tz, 1);
+  tzset();
+  clockSynced = true;
+}
+
+uint32_t wallClock() {
+  std::lock_guard<std::mutex> lk(clockMu);
+  if (!clockSynced) return 0;
+  if (!wallFixed) return (uint32_t)time(nullptr);
+  return wallBase ? wallBase + (millis() - wallBaseMs) / 1000 : 0;
+}
+
+// The TSC stands in for CCOUNT on x86 (one cheap read, like on the board);
+// elsewhere host "cycles" are nanoseconds.
+#if defined(__x86_64__) || defined(__i386__)
+uint32_t cycleCount() { return (uint32_t)__rdtsc(); }
+
+uint32_t cyclesPerUs() {
+  static const uint32_t perUs = [] {
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = __rdtsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t c1 = __rdtsc();
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+    return (uint32_t)std::max<uint64_t>(1, (c1 - c0) / (uint64_t)us);
+  }();
+  return perUs;
+}
+#else
+uint32_t cycleCount() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+uint32_t cyclesPerUs() { return 1000; }
+#endif
+
+bool powerConfigure(uint32_t maxMhz, uint32_t minMhz, bool lightSleep) {
+  std::lock_guard<std::mutex> lk(powerMu);
+  power = {maxMhz, minMhz, lightSleep};
+  return true;   // as if built with CONFIG_PM_ENABLE
+}
+
+// the host heap says nothing about the board's; report a typical idle ESP32
+uint32_t heapFree() { return 180 * 1024; }
+uint32_t heapLargestBlock() { return 110 * 1024; }
+
+void delayMs(uint32_t ms) {
+  countWake();
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  threadSleptNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+TaskHandle taskSpawn(const char* name, TaskFn fn, void* arg, uint32_t, uint8_t, int) {
+  // Tasks live for the life of the process, as they do on the board.
+  NativeTask* t = new NativeTask();
+  t->name = name;
+  {
+    std::lock_guard<std::mutex> lk(tasksMu);
+    tasks.push_back(t);
+  }
+  std::thread([t, fn, arg] {
+    currentTask = t;
+    fn(arg);
+  }).detach();
+  return t;
+}
+
+void taskNotify(TaskHandle task) {
+  NativeTask* t = (NativeTask*)task;
+  if (!t) return;
+  {
+    std::lock_guard<std::mutex> lk(t->mu);
+    t->notified++;
+  }
+  t->cv.notify_one();
+}
+
+bool taskWait(uint32_t timeoutMs) {
+  NativeTask* t = currentTask;
+  if (!t) { delayMs(timeoutMs); return false; }
+  countWake();
+  std::unique_lock<std::mutex> lk(t->mu);
+  bool ok = t->cv.wait_for(lk, std::chrono::milliseconds(timeoutMs), [t] { return t->notified > 0; });
+  t->notified = 0;
+  return ok;
+}
+
+} // namespace hal
+
+namespace sim {
+
+void setInput(int pin, bool high) {
+  std::lock_guard<std::mutex> lk(pinMu);
+  if (validPin(pin)) inLevel[pin] = high;
+}
+
+void setAdc(int pin, int value) {
+  std::lock_guard<std::mutex> lk(pinMu);
+  if (validPin(pin)) adcValue[pin] = value;
+}
+
+void setAdcNoise(int pin, int amplitude) {
+  std::lock_guard<std::mutex> lk(pinMu);
+  if (validPin(pin)) adcNoise[pin] = amplitude;
+}
+
+bool outputLevel(int pin) {
+  std::lock_guard<std::mutex> lk(pinMu);
+  return validPin(pin) ? outLevel[pin] : false;
+}
+
+bool waitGpioWrite(int pin, uint32_t sinceUs, uint32_t timeoutMs, uint32_t* atUs) {
+  if (!validPin(pin)) return false;
+  std::unique_lock<std::mutex> lk(pinMu);
+  bool ok = pinCv.wait_for(lk, std::chrono::milliseconds(timeoutMs), [&] {
+    return hasWritten[pin] && (int32_t)(lastWriteUs[pin] - sinceUs) >= 0;
+  });
+  if (ok && atUs) *atUs = lastWriteUs[pin];
+  return ok;
+}
+
+uint64_t sleptNs() { return threadSleptNs; }
+
+std::vector<std::pair<const char*, uint32_t>> taskWakes() {
+  std::lock_guard<std::mutex> lk(tasksMu);
+  std::vector<std::pair<const char*, uint32_t>> out;
+  for (NativeTask* t : tasks) out.push_back({t->name, t->wakes.load(std::memory_order_relaxed)});
+  return out;
+}
+
+PowerConfig powerConfig() {
+  std::lock_guard<std::mutex> lk(powerMu);
+  return power;
+}
+
+bool adcStreaming() { return streamPin >= 0; }
+
+uint32_t irRxSend(const uint16_t* durations, size_t n) {
+  uint64_t airUs = 0;
+  for (size_t i = 0; i < n; i++) airUs += durations[i];
+  std::chrono::steady_clock::time_point lastEdge;
+  {
+    std::lock_guard<std::mutex> lk(irMu);
+    auto start = std::max(std::chrono::steady_clock::now(), irAirFree);
+    lastEdge = start + std::chrono::microseconds(airUs);
+    irAirFree = lastEdge + std::chrono::microseconds(irIdleUs);
+    if (irRxOn) irFrames.push_back({irAirFree, std::vector<uint16_t>(durations, durations + n)});
+  }
+  irCv.notify_all();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(lastEdge - epoch).count();
+}
+
+void setWallClock(uint32_t utc) {
+  std::lock_guard<std::mutex> lk(clockMu);
+  wallFixed = true;
+  wallBase = utc;
+  wallBaseMs = hal::millis();
+}
+
+} // namespace sim
@@ -0,0 +1,131 @@
+#pragma once
+
+// src/native/include/Arduino.h
+// Host stand-in for the parts of the Arduino core the firmware uses directly:
+// String, Serial, IPAddress and a few constants. Pin/ADC/clock access is NOT
+// provided here on purpose -- application code must go through include/hal.h.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+using std::max;
+using std::min;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+static const uint8_t LED_BUILTIN = 2;
+
+class String {
+public:
+  String() = default;
+  String(const char* cstr) : s_(cstr ? cstr : "") {}
+  String(const char* cstr, unsigned int length) : s_(cstr, length) {}
+  String(const std::string& s) : s_(s) {}
+  explicit String(char c) : s_(1, c) {}
+  explicit String(int v) : s_(std::to_string(v)) {}
+  explicit String(unsigned int v) : s_(std::to_string(v)) {}
+  explicit String(long v) : s_(std::to_string(v)) {}
+  explicit String(unsigned long v) : s_(std::to_string(v)) {}
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned int length() const { return (unsigned int)s_.size(); }
+  bool reserve(unsigned int n) { s_.reserve(n); return true; }
+  char operator[](unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+
+  bool startsWith(const String& p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+  bool endsWith(const String& p) const {
+    return s_.size() >= p.s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+  }
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t i = s_.find(c, from);
+    return i == std::string::npos ? -1 : (int)i;
+  }
+  String substring(unsigned int from) const { return from >= s_.size() ? String() : String(s_.substr(from)); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    if (from >= s_.size()) return String();
+    return String(s_.substr(from, to - from));
+  }
+  long toInt() const { return strtol(s_.c_str(), nullptr, 10); }
+
+  String& operator+=(const String& o) { s_ += o.s_; return *this; }
+  String& operator+=(const char* o) { s_ += o ? o : ""; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+  bool concat(const String& o) { s_ += o.s_; return true; }
+  bool concat(const char* cstr, unsigned int length) { s_.append(cstr, length); return true; }
+
+  bool operator==(const String& o) const { return s_ == o.s_; }
+  bool operator==(const char* o) const { return s_ == (o ? o : ""); }
+  bool operator!=(const String& o) const { return !(*this == o); }
+  bool operator!=(const char* o) const { return !(*this == o); }
+  bool operator<(const String& o) const { return s_ < o.s_; }
+
+  const std::string& str() const { return s_; }
+
+private:
+  std::string s_;
+};
+
+inline String operator+(const String& a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+inline String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, char b) { String r(a); r += b; return r; }
+
+class IPAddress {
+public:
+  IPAddress() = default;
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : b_{a, b, c, d} {}
+  IPAddress(uint32_t raw) { memcpy(b_, &raw, 4); }   // first octet in the low byte, as on the ESP32
+  operator uint32_t() const { uint32_t raw; memcpy(&raw, b_, 4); return raw; }
+  uint8_t operator[](int i) const { return b_[i & 3]; }
+  uint8_t& operator[](int i) { return b_[i & 3]; }
+  bool operator==(const IPAddress& o) const { return memcmp(b_, o.b_, 4) == 0; }
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", b_[0], b_[1], b_[2], b_[3]);
+    return String(buf);
+  }
+
+private:
+  uint8_t b_[4] = {0, 0, 0, 0};
+};
+
+// Serial goes to stdout; the benchmark runner silences it with setEcho(false).
+// Input comes from sim::serialInput(). With sim::setSerialTiming(true), writes
+// take as long as they would at the begin() baud rate behind a 128-byte TX
+// FIFO (echoed or not), like the blocking UART driver on the board.
+class HardwareSerial {
+public:
+  void begin(unsigned long baud) { baud_ = baud; }
+  void setEcho(bool on) { echo_ = on; }
+  void setTiming(bool on) { timing_ = on; }
+  int available();
+  int read();
+
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+  size_t print(const char* s);
+  size_t print(const String& s) { return print(s.c_str()); }
+  size_t print(int v) { return printf("%d", v); }
+  size_t print(unsigned int v) { return printf("%u", v); }
+  size_t print(long v) { return printf("%ld", v); }
+  size_t print(unsigned long v) { return printf("%lu", v); }
+  size_t print(const IPAddress& ip) { return print(ip.toString()); }
+
+  size_t println() { return print("\n"); }
+  template <typename T> size_t println(const T& v) { size_t n = print(v); return n + print("\n"); }
+
+private:
+  void transmit(size_t bytes);   // blocks like the UART when timing_ is set
+
+  bool echo_ = true;
+  bool timing_ = false;
+  unsigned long baud_ = 115200;
+};
+
+extern HardwareSerial Serial;
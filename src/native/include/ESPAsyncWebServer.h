@@ -0,0 +1,226 @@
+#pragma once
+
+// src/native/include/ESPAsyncWebServer.h
+// Host stand-in for ESPAsyncWebServer + AsyncWebSocket (the subset the
+// firmware uses). Like AsyncTCP, one event thread owns every connection and
+// runs all request/WS handlers; other threads may call textAll()/text(),
+// which queue frames for it. Clients come from the simulation (sim::httpRequest,
+// sim::wsConnect) or, after sim::httpListen(), from real TCP sockets on the
+// host, so a load generator can drive the firmware (see bench_http.cpp).
+
+#include <Arduino.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+typedef enum {
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_PATCH = 0b00010000,
+  HTTP_HEAD = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+#define DEFAULT_MAX_WS_CLIENTS 8
+#define WS_MAX_QUEUED_MESSAGES 32   // per client; further text() calls are dropped
+
+class AsyncWebParameter {
+public:
+  AsyncWebParameter(const String& name, const String& value, bool post)
+      : name_(name), value_(value), post_(post) {}
+  const String& name() const { return name_; }
+  const String& value() const { return value_; }
+  bool isPost() const { return post_; }
+
+private:
+  String name_, value_;
+  bool post_;
+};
+
+class AsyncWebHeader {
+public:
+  AsyncWebHeader(const String& name, const String& value) : name_(name), value_(value) {}
+  const String& name() const { return name_; }
+  const String& value() const { return value_; }
+
+private:
+  String name_, value_;
+};
+
+class AsyncWebServerResponse {
+public:
+  AsyncWebServerResponse(int code, const String& contentType, const String& body)
+      : code_(code), contentType_(contentType), body_(body) {}
+  void addHeader(const String& name, const String& value) { headers_.push_back({name, value}); }
+
+  int code() const { return code_; }
+  const String& contentType() const { return contentType_; }
+  const std::vector<AsyncWebHeader>& headers() const { return headers_; }
+  const String& body() const { return body_; }
+
+protected:
+  void append(const char* data, size_t len) { body_.concat(data, (unsigned int)len); }
+
+private:
+  int code_;
+  String contentType_;
+  std::vector<AsyncWebHeader> headers_;
+  String body_;
+};
+
+// Response built with print()/write() before send() (copies what it is given).
+class AsyncResponseStream : public AsyncWebServerResponse {
+public:
+  explicit AsyncResponseStream(const String& contentType) : AsyncWebServerResponse(200, contentType, String()) {}
+  size_t write(const uint8_t* data, size_t len) { append((const char*)data, len); return len; }
+  size_t print(const char* s) { append(s, strlen(s)); return strlen(s); }
+};
+
+class AsyncWebServerRequest {
+public:
+  AsyncWebServerRequest(WebRequestMethodComposite method, const String& url)
+      : method_(method), url_(url) {}
+
+  WebRequestMethodComposite method() const { return method_; }
+  const String& url() const { return url_; }
+  size_t contentLength() const { return contentLength_; }
+
+  bool hasParam(const String& name, bool post = false) const { return getParam(name, post) != nullptr; }
+  const AsyncWebParameter* getParam(const String& name, bool post = false) const;
+  bool hasHeader(const String& name) const { return getHeader(name) != nullptr; }
+  const AsyncWebHeader* getHeader(const String& name) const;   // case-insensitive
+  // Basic auth only (the library also takes Digest)
+  bool authenticate(const char* username, const char* password) const;
+  void requestAuthentication(const char* realm = nullptr, bool isDigest = true);
+
+  AsyncWebServerResponse* beginResponse(int code, const String& contentType = String(),
+                                        const String& content = String());
+  AsyncWebServerResponse* beginResponse(int code, const String& contentType, const uint8_t* content, size_t len);
+  AsyncResponseStream* beginResponseStream(const String& contentType) { return new AsyncResponseStream(contentType); }
+  void send(AsyncWebServerResponse* response);
+  void send(int code, const String& contentType = String(), const String& content = String()) {
+    send(beginResponse(code, contentType, content));
+  }
+
+  // filled in by the server before the handler runs
+  void addParam(const String& name, const String& value, bool post) { params_.emplace_back(name, value, post); }
+  void addHeader(const String& name, const String& value) { headers_.emplace_back(name, value); }
+  void setContentLength(size_t len) { contentLength_ = len; }
+  AsyncWebServerResponse* response() const { return response_.get(); }
+
+private:
+  WebRequestMethodComposite method_;
+  String url_;
+  size_t contentLength_ = 0;
+  std::vector<AsyncWebParameter> params_;
+  std::vector<AsyncWebHeader> headers_;
+  std::unique_ptr<AsyncWebServerResponse> response_;
+};
+
+typedef std::function<void(AsyncWebServerRequest* request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest* request, const String& filename, size_t index,
+                           uint8_t* data, size_t len, bool final)> ArUploadHandlerFunction;   // multipart: not simulated
+// A body other than a form arrives in pieces as it is received (at most a
+// TCP segment each); the request handler runs once it is all in.
+typedef std::function<void(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index,
+                           size_t total)> ArBodyHandlerFunction;
+
+typedef enum { WS_EVT_CONNECT, WS_EVT_DISCONNECT, WS_EVT_PONG, WS_EVT_ERROR, WS_EVT_DATA } AwsEventType;
+typedef enum { WS_CONTINUATION, WS_TEXT, WS_BINARY, WS_DISCONNECT = 0x08, WS_PING, WS_PONG } AwsFrameType;
+
+typedef struct {
+  uint8_t message_opcode;
+  uint32_t num;
+  uint8_t final;
+  uint8_t masked;
+  uint8_t opcode;
+  uint64_t len;
+  uint8_t mask[4];
+  uint64_t index;
+} AwsFrameInfo;
+
+class AsyncWebSocket;
+
+class AsyncWebSocketClient {
+public:
+  AsyncWebSocketClient(AsyncWebSocket* server, uint32_t id, IPAddress ip) : server_(server), id_(id), ip_(ip) {}
+  uint32_t id() const { return id_; }
+  IPAddress remoteIP() const { return ip_; }
+  AsyncWebSocket* server() const { return server_; }
+  bool text(const char* message, size_t len);
+  bool text(const String& message) { return text(message.c_str(), message.length()); }
+  bool binary(const uint8_t* message, size_t len);
+  void close();
+
+private:
+  AsyncWebSocket* server_;
+  uint32_t id_;
+  IPAddress ip_;
+};
+
+typedef std::function<void(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type,
+                           void* arg, uint8_t* data, size_t len)> AwsEventHandler;
+
+class AsyncWebSocket {
+public:
+  explicit AsyncWebSocket(const String& url) : url_(url) {}
+  const String& url() const { return url_; }
+  void onEvent(AwsEventHandler handler) { handler_ = handler; }
+
+  bool text(uint32_t id, const char* message, size_t len);
+  bool textAll(const char* message, size_t len);
+  bool textAll(const String& message) { return textAll(message.c_str(), message.length()); }
+  bool binary(uint32_t id, const uint8_t* message, size_t len);
+  bool availableForWrite(uint32_t id);   // client exists and its send queue has room
+  size_t count() const;
+  void close(uint32_t id);
+  void closeAll();
+  // closes the oldest clients beyond maxClients
+  void cleanupClients(uint16_t maxClients = DEFAULT_MAX_WS_CLIENTS);
+
+  // used by the event thread
+  void simEvent(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len) {
+    if (handler_) handler_(this, client, type, arg, data, len);
+  }
+
+private:
+  String url_;
+  AwsEventHandler handler_;
+};
+
+class AsyncWebServer {
+public:
+  explicit AsyncWebServer(uint16_t port) : port_(port) {}
+  ~AsyncWebServer();
+
+  void begin();
+  void end();
+  void on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction fn);
+  void on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction fn,
+          ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody);
+  void onNotFound(ArRequestHandlerFunction fn) { notFound_ = fn; }
+  void addHandler(AsyncWebSocket* ws);
+
+  // used by the event thread: runs the matching route (or onNotFound)
+  void simDispatch(AsyncWebServerRequest* request);
+  // the body handler of the route that will take `request`, if it has one
+  ArBodyHandlerFunction simBodyHandler(const AsyncWebServerRequest* request) const;
+  AsyncWebSocket* simSocketFor(const String& url) const;
+
+private:
+  struct Route {
+    String uri;
+    WebRequestMethodComposite method;
+    ArRequestHandlerFunction fn;
+    ArBodyHandlerFunction body;
+  };
+  const Route* match(const AsyncWebServerRequest* request) const;
+  uint16_t port_;
+  std::vector<Route> routes_;
+  ArRequestHandlerFunction notFound_;
+  std::vector<AsyncWebSocket*> sockets_;
+};
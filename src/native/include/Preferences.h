@@ -0,0 +1,42 @@
+#pragma once
+
+// src/native/include/Preferences.h
+// Host stand-in for the ESP32 Preferences (NVS) library, backed by an
+// in-process map. Contents live for the life of the process; writes are
+// counted (sim::nvsWrites) so wear can be measured.
+
+#include <Arduino.h>
+
+class Preferences {
+public:
+  bool begin(const char* name, bool readOnly = false);
+  void end();
+
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+
+  size_t putString(const char* key, const String& value);
+  String getString(const char* key, const String& defaultValue = String());
+
+  size_t putBool(const char* key, bool value);
+  bool getBool(const char* key, bool defaultValue = false);
+
+  size_t putUChar(const char* key, uint8_t value);
+  uint8_t getUChar(const char* key, uint8_t defaultValue = 0);
+
+  size_t putUInt(const char* key, uint32_t value);
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+
+  size_t putULong64(const char* key, uint64_t value);
+  uint64_t getULong64(const char* key, uint64_t defaultValue = 0);
+
+  size_t putBytes(const char* key, const void* value, size_t len);
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+  size_t getBytesLength(const char* key);
+
+private:
+  String ns_;
+  bool open_ = false;
+  bool readOnly_ = false;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+// src/native/include/PubSubClient.h
+// Host stand-in for the PubSubClient MQTT library, talking to an in-process
+// broker (see sim.h: sim::mqttInject / sim::mqttWaitPublish). Connecting
+// needs WiFi STA up and the broker up (sim::setMqttBrokerUp).
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include <functional>
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+#define MQTT_CONNECTION_LOST     -3
+#define MQTT_CONNECT_FAILED      -2
+#define MQTT_DISCONNECTED        -1
+#define MQTT_CONNECTED            0
+
+class PubSubClient {
+public:
+  explicit PubSubClient(WiFiClient&) {}
+
+  PubSubClient& setServer(const char* host, uint16_t port);
+  PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+  bool setBufferSize(uint16_t) { return true; }
+
+  bool connect(const char* id, const char* user = nullptr, const char* pass = nullptr,
+               const char* willTopic = nullptr, uint8_t willQos = 0, bool willRetain = false,
+               const char* willMessage = nullptr);
+  void disconnect();
+  bool connected();
+  int state() const { return state_; }
+
+  bool publish(const char* topic, const char* payload, bool retained = false);
+  bool subscribe(const char* topic, uint8_t qos = 0);
+  bool loop();
+
+private:
+  std::function<void(char*, uint8_t*, unsigned int)> callback_;
+  int state_ = MQTT_DISCONNECTED;
+};
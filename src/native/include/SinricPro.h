@@ -0,0 +1,64 @@
+#pragma once
+
+// src/native/include/SinricPro.h
+// Host stand-in for the SinricPro client. Cloud commands are queued by the
+// simulation (sim::cloudPowerState) and dispatched from handle(); events the
+// firmware reports back are recorded as the state the cloud shows. The
+// server link can be dropped (sim::setCloudUp): events then fail and
+// commands are lost, as with the real client.
+
+#include <Arduino.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "SinricProSwitch.h"
+
+class SinricProClass {
+public:
+  class Proxy {
+  public:
+    Proxy(SinricProClass* owner, const String& id) : owner_(owner), id_(id) {}
+    operator SinricProSwitch&() { return owner_->device(id_); }
+  private:
+    SinricProClass* owner_;
+    String id_;
+  };
+
+  void begin(const String& appKey, const String& appSecret);
+  void handle();
+  void stop() { running_ = false; }
+  bool isConnected() const;
+
+  Proxy operator[](const String& deviceId) { return Proxy(this, deviceId); }
+
+  // simulation hooks (see sim.h)
+  void simEnqueuePowerState(const String& deviceId, bool state);
+  uint32_t simEventsSent() const;
+  void simSetLinkUp(bool up) { linkUp_ = up; }
+  void simSetConnectMs(uint32_t ms) { connectMs_ = ms; }
+  void simRecordState(const String& deviceId, bool state, bool event);
+  int simDeviceState(const String& deviceId) const;
+  struct SimEvent {
+    uint32_t atMs;
+    String deviceId;
+    bool state;
+  };
+  std::vector<SimEvent> simEvents() const;
+
+private:
+  SinricProSwitch& device(const String& id);
+
+  bool running_ = false;
+  std::atomic<bool> linkUp_{true};
+  std::atomic<uint32_t> connectMs_{0}, beganAtMs_{0};   // the WebSocket + TLS handshake after begin()
+  std::map<String, bool> cloudState_;
+  std::vector<SimEvent> events_;
+  std::map<String, SinricProSwitch> devices_;
+  std::deque<std::pair<String, bool>> pending_;
+  mutable std::mutex mu_;
+};
+
+extern SinricProClass SinricPro;
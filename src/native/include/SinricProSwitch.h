@@ -0,0 +1,34 @@
+#pragma once
+
+// src/native/include/SinricProSwitch.h
+// Host stand-in for SinricProSwitch (see SinricPro.h).
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+
+class SinricProSwitch {
+public:
+  typedef std::function<bool(const String&, bool&)> PowerStateCallback;
+
+  SinricProSwitch() = default;
+  explicit SinricProSwitch(const String& id) : deviceId_(id) {}
+  SinricProSwitch(const SinricProSwitch& o)
+      : deviceId_(o.deviceId_), cb_(o.cb_), eventsSent_(o.eventsSent_.load()), lastEventMs_(o.lastEventMs_.load()) {}
+
+  void onPowerState(PowerStateCallback cb) { cb_ = cb; }
+  // false if the server link is down or, like the SDK's event limiter, if
+  // this device sent an event less than SIM_EVENT_LIMIT_MS ago
+  bool sendPowerStateEvent(bool state, String cause = "PHYSICAL_INTERACTION");
+  static const uint32_t SIM_EVENT_LIMIT_MS = 1000;
+
+  const String& getDeviceId() const { return deviceId_; }
+  bool simDispatch(bool state);
+  uint32_t simEventsSent() const { return eventsSent_; }
+
+private:
+  String deviceId_;
+  PowerStateCallback cb_;
+  std::atomic<uint32_t> eventsSent_{0};
+  std::atomic<uint32_t> lastEventMs_{0};   // 0 = none yet
+};
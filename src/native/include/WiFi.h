@@ -0,0 +1,74 @@
+#pragma once
+
+// src/native/include/WiFi.h
+// Host stand-in for the ESP32 WiFi class. STA joins complete asynchronously,
+// like the real driver; whether they succeed, and whether an established link
+// drops, is controlled from the simulation (see sim.h: sim::setStaReachable).
+// A join takes as long as the driver's would: a channel scan up to the
+// router's channel unless begin() names the channel and BSSID, association,
+// then DHCP unless config() set a static address (sim::setStaTiming).
+
+#include <Arduino.h>
+#include <vector>
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED  (-2)
+
+typedef enum { WIFI_AUTH_OPEN = 0, WIFI_AUTH_WEP, WIFI_AUTH_WPA_PSK, WIFI_AUTH_WPA2_PSK } wifi_auth_mode_t;
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t m);
+  wifi_mode_t getMode() const { return mode_; }
+
+  wl_status_t begin(const char* ssid, const char* pass = nullptr, int32_t channel = 0, const uint8_t* bssid = nullptr);
+  // all zero: DHCP again
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress());
+  bool disconnect(bool wifioff = false);
+  bool setAutoReconnect(bool) { return true; }
+  bool setSleep(bool enabled) { sleep_ = enabled; return true; }   // modem sleep (WIFI_PS_MIN_MODEM)
+  bool getSleep() const { return sleep_; }
+  wl_status_t status() const;
+  IPAddress localIP() const;
+  IPAddress gatewayIP() const;
+  IPAddress subnetMask() const;
+  IPAddress dnsIP(uint8_t i = 0) const;
+  uint8_t* BSSID();       // of the joined router (zeros when not joined)
+  int32_t channel() const;
+
+  bool softAP(const char* ssid, const char* pass = nullptr, int channel = 1);
+  bool softAPdisconnect(bool wifioff = false);
+  IPAddress softAPIP() const { return IPAddress(192, 168, 4, 1); }
+
+  uint8_t* macAddress(uint8_t* mac) const;
+
+  // async scans finish after sim::setScanDurationMs (blocking ones sleep that long)
+  int16_t scanNetworks(bool async = false);
+  int16_t scanComplete() const;
+  String SSID(uint8_t i) const;
+  int32_t RSSI(uint8_t i) const;
+  wifi_auth_mode_t encryptionType(uint8_t i) const;
+  void scanDelete();
+
+private:
+  wifi_mode_t mode_ = WIFI_OFF;
+  bool sleep_ = true;   // the driver's default, as on the board
+  uint8_t bssid_[6] = {};
+};
+
+extern WiFiClass WiFi;
+
+// TCP client handed to PubSubClient; the simulated broker needs nothing from it.
+class WiFiClient {};
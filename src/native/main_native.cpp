@@ -0,0 +1,136 @@
+// src/native/main_native.cpp
+// Host entry point for the `native` env: runs the firmware's setup()/loop()
+// against the simulated HAL and prints the benchmark suite. Exits 1 if any
+// case's correctness checks (benchCheck) failed, so CI can run it.
+//
+//   pio run -e native && .pio/build/native/program [-n samples] [-f file] [-p port] [case ...]
+
+#include <Arduino.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include "bench.h"
+#include "sim.h"
+
+namespace {
+
+struct BenchCase {
+  const char* name;
+  const char* help;
+  void (*run)(const BenchOptions& opt);
+  bool byNameOnly = false;   // not part of the default run (e.g. runs until killed)
+};
+
+// "boot" forks a child per boot, so it has to come before any case that
+// starts the firmware's tasks in this process
+const BenchCase CASES[] = {
+  {"boot", "boot to control: STA, first command, cloud ready; cold vs cached BSSID/channel, stale cache, outage", benchBoot},
+  {"loop", "loop() cost and command-to-writeRelay latency per input path", benchLoop},
+  {"ir", "IR filter replay: detection latency + false toggles (-f trace.csv)", benchIr},
+  {"json", "state JSON: String concatenation vs serializeState (ns, allocations)", benchJson},
+  {"relay", "relay registry: device-ID routing ns, pin skew of multi-relay bursts", benchRelay},
+  {"bank", "relay bank backends (GPIO, 74HC595, MCP23017): update latency and bus traffic vs bank size", benchBank},
+  {"journal", "relay state journal: NVS commits and flash lag under toggle storms", benchJournal},
+  {"mqtt", "MQTT: set-to-actuation latency, burst coalescing, broker restart", benchMqtt},
+  {"wifi", "WiFi manager scenarios: outage detection, AP fallback, recovery timing", benchWifi},
+  {"http", "async HTTP/WS server over loopback: req/s + latency at 1/8/32 clients", benchHttp},
+  {"ws", "WS state stream: deltas per toggle storm, IR subscription rate, slow-client resync/drop", benchWs},
+  {"wsproto", "binary WS commands: parser ns + fuzzing, frame->ack latency, batch pin skew", benchWsProto},
+  {"metrics", "stage histograms under load: per-stage time, StageTimer overhead, /metrics + WS topic", benchMetrics},
+  {"log", "event log: logEvent ns + torn-record check, inline Serial vs deferred, WS storm, /log dumps", benchLog},
+  {"power", "battery profile: task wakes/s, backup latency, energy model runtime (-f trace.csv)", benchPower},
+  {"remote", "IR remote: NEC decoder replay (-f IRrecvDumpV2 capture), key press-to-relay latency, held keys", benchRemote},
+  {"cloud", "SinricPro offline queue: coalesced replay on reconnect, rate limit, stale-command conflicts", benchCloud},
+  {"ota", "firmware upload: throughput with/without flash timing, WS latency meanwhile, bad images, trial-boot rollback (-f firmware.bin)", benchOta},
+  {"timers", "relay timers: wheel add/cancel/tick cost at 10k timers, one-shot, auto-off, daily, kept over reboot", benchTimers},
+  {"scenes", "scenes vs one toggle per relay: switch span, GPIO writes, WS deltas; latency per trigger (HTTP, WS, SinricPro, IR)", benchScenes},
+  {"peers", "ESP-NOW peer link without a router: command/ack/state latency direct and over 1-2 hops, HTTP/WS/IR to a peer, 20% loss, lost node", benchPeers},
+  {"rules", "automation rules: engine tick cost at 10/100/1000 rules against re-running all, IR/cloud-loss rules to the relay, loop breaker", benchRules},
+  {"serve", "boot in STA mode and serve HTTP/WS on 127.0.0.1 (-p, default 8080) until killed", benchServe, true},
+};
+
+std::atomic<int> failedChecks{0};
+
+void usage(const char* argv0) {
+  printf("usage: %s [-n samples] [-f file] [-p port] [case ...]\n\ncases:\n", argv0);
+  for (const BenchCase& c : CASES) printf("  %-10s %s\n", c.name, c.help);
+}
+
+} // namespace
+
+void BenchStats::print(const char* label, const char* unit) const {
+  if (samples_.empty()) { printf("  %-34s n=0\n", label); return; }
+  std::vector<double> s(samples_);
+  std::sort(s.begin(), s.end());
+  double sum = 0;
+  for (double v : s) sum += v;
+  auto pct = [&](double p) { return s[std::min(s.size() - 1, (size_t)(p * (s.size() - 1) + 0.5))]; };
+  printf("  %-34s n=%-6zu min=%-9.3f avg=%-9.3f p50=%-9.3f p99=%-9.3f max=%-9.3f %s\n",
+         label, s.size(), s.front(), sum / s.size(), pct(0.50), pct(0.99), s.back(), unit);
+}
+
+void BenchStats::printHistogram(const char* unit) const {
+  static const double EDGES[] = {0.1, 0.2, 0.5, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000};
+  const int nEdges = sizeof(EDGES) / sizeof(EDGES[0]);
+  size_t counts[nEdges + 1] = {};
+  for (double v : samples_) {
+    int b = 0;
+    while (b < nEdges && v >= EDGES[b]) b++;
+    counts[b]++;
+  }
+  for (int b = 0; b <= nEdges; b++) {
+    if (!counts[b]) continue;
+    char range[32];
+    if (b == 0) snprintf(range, sizeof(range), "< %g %s", EDGES[0], unit);
+    else if (b == nEdges) snprintf(range, sizeof(range), ">= %g %s", EDGES[nEdges - 1], unit);
+    else snprintf(range, sizeof(range), "%g..%g %s", EDGES[b - 1], EDGES[b], unit);
+    int bar = (int)(40 * counts[b] / samples_.size());
+    printf("      %-16s %6zu %.*s\n", range, counts[b], bar > 0 ? bar : 1, "########################################");
+  }
+}
+
+uint64_t benchNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool benchCheck(bool ok, const char* what) {
+  if (!ok) {
+    printf("  FAILED: %s\n", what);
+    failedChecks++;
+  }
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  BenchOptions opt;
+  std::vector<const char*> names;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) opt.samples = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-f") && i + 1 < argc) opt.file = argv[++i];
+    else if (!strcmp(argv[i], "-p") && i + 1 < argc) opt.port = (uint16_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) { usage(argv[0]); return 0; }
+    else names.push_back(argv[i]);
+  }
+
+  sim::setSerialEcho(false);
+  int ran = 0;
+  for (const BenchCase& c : CASES) {
+    bool selected = names.empty() && !c.byNameOnly;
+    for (const char* n : names) selected |= !strcmp(n, c.name);
+    if (!selected) continue;
+    printf("== %s: %s\n", c.name, c.help);
+    c.run(opt);
+    ran++;
+  }
+  if (!ran) { usage(argv[0]); return 1; }
+  int failed = failedChecks.load();
+  if (failed) printf("%d check(s) FAILED\n", failed);
+  // the firmware's tasks never stop, as on the board: leave without running
+  // static destructors under them
+  fflush(stdout);
+  _exit(failed ? 1 : 0);
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+// src/native/sim.h
+// Controls for the host simulation: drive inputs (pins, ADC, HTTP/WS clients,
+// cloud commands) and observe outputs. Only used by code under src/native/.
+
+#include <stdint.h>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#include <ESPAsyncWebServer.h>
+
+namespace sim {
+
+// -------- GPIO / ADC --------
+void setInput(int pin, bool high);       // level seen by hal::gpioRead (inputs idle high)
+void setAdc(int pin, int value);         // value returned by hal::adcRead / the ADC stream
+void setAdcNoise(int pin, int amplitude);  // uniform +-amplitude added to every ADC sample
+bool outputLevel(int pin);               // last level written with hal::gpioWrite
+// Blocks until `pin` is written at or after `sinceUs` (hal::micros time base).
+// Returns false on timeout, otherwise stores the write time in *atUs.
+bool waitGpioWrite(int pin, uint32_t sinceUs, uint32_t timeoutMs, uint32_t* atUs);
+uint64_t sleptNs();                      // time the calling thread spent in hal::delayMs
+// hal::wallClock() from now on: `utc` ticking with hal::millis() once
+// hal::clockSync() has run (0 = SNTP never answers). By default the host's clock.
+void setWallClock(uint32_t utc);
+bool adcStreaming();                     // an ADC DMA stream is running
+// The IR receiver sees a frame (alternating mark/space µs, mark first),
+// starting now or when the previous one's idle gap ends. hal::irRxRead gets
+// it once the line has been idle for the irRxBegin threshold. Returns the
+// hal::micros() time of its last edge (the end of the key press on air).
+uint32_t irRxSend(const uint16_t* durations, size_t n);
+
+// -------- tasks / power --------
+// Per spawned task (by name): how often it has blocked so far, i.e. how often
+// it would have woken the CPU on the board.
+std::vector<std::pair<const char*, uint32_t>> taskWakes();
+struct PowerConfig {
+  uint32_t maxMhz, minMhz;
+  bool lightSleep;
+};
+PowerConfig powerConfig();               // last hal::powerConfigure()
+
+// -------- relay expander buses (sim_bus.cpp) --------
+// hal::spiWrite feeds a chain of up to 8 74HC595s, hal::i2cWrite reaches
+// MCP23017s at 0x20..0x27 (other addresses NACK). Each transaction takes its
+// wire time at the hal::spiBegin / i2cBegin clock.
+uint64_t hc595Outputs();                 // latched outputs: chip k (k = 0 nearest the MCU) in byte k
+uint16_t mcp23017Outputs(uint8_t addr);  // latch bits of pins set as outputs, GPB in the high byte
+struct BusStats {
+  uint32_t transactions;
+  uint32_t bytes;
+  uint64_t wireNs;                       // total modelled time on the wire
+};
+BusStats spiStats();
+BusStats i2cStats();
+// Blocks until an SPI or I2C transaction ends at or after `sinceUs`.
+bool waitBusWrite(uint32_t sinceUs, uint32_t timeoutMs, uint32_t* atUs);
+
+// -------- app partitions (sim_ota.cpp) --------
+// Two app slots of 1.25 MB (the default 4 MB layout); the image in slot 0
+// runs. hal::otaWrite takes the time the flash would to erase each new
+// sector and program its pages, unless flash timing is off.
+void setFlashTiming(bool on);            // default on
+std::vector<uint8_t> otaSlot(int slot);  // what has been written to a slot
+int otaBootSlot();                       // slot the next boot starts (hal::otaEnd / otaRollback)
+void otaBoot();                          // "reboot": the boot slot becomes the running one
+bool otaConfirmed();                     // hal::otaConfirm() since the last otaBoot()
+uint32_t restarts();                     // hal::restart() calls (the process carries on)
+
+// -------- ESP-NOW air (sim_peer.cpp) --------
+// One WiFi channel shared by stations: station 0 is the firmware's radio
+// (hal::peerRadio*, with the WiFi MAC), the others are added here. Frames go
+// out one at a time, each taking its 1 Mbit/s air time, and reach every
+// station in range (unicast: only the addressed one) `latencyUs` later.
+// Each receiver misses a frame with probability `loss`; a unicast frame is
+// retried by the MAC up to 3 times first. Receive callbacks run on one
+// "air" thread, like the WiFi task on the board.
+typedef void (*PeerStationRecv)(void* ctx, const uint8_t mac[6], const uint8_t* data, size_t len);
+int peerStationAdd(const uint8_t mac[6], PeerStationRecv onRecv, void* ctx);   // returns its index
+bool peerStationSend(int station, const uint8_t mac[6], const uint8_t* data, size_t len);
+void setPeerAir(uint32_t latencyUs, double loss);   // defaults 200 µs, 0
+void setPeerInRange(int a, int b, bool inRange);    // all stations hear each other by default
+struct PeerAirStats {
+  uint32_t frames;      // sent, MAC retries not counted
+  uint32_t delivered;   // frame copies received
+  uint32_t lost;        // copies a station in range missed
+};
+PeerAirStats peerAirStats();
+
+// -------- Serial / NVS / WiFi --------
+void setSerialEcho(bool on);
+void setSerialTiming(bool on);           // Serial writes block like a 115200 baud UART (see Arduino.h)
+void serialInput(const char* text);      // bytes for Serial.read()
+uint32_t nvsWrites();                    // Preferences put* calls so far
+// The whole NVS contents as bytes and back (e.g. to hand flash to a forked "reboot").
+std::vector<uint8_t> nvsExport();
+void nvsImport(const std::vector<uint8_t>& blob);
+void setStaReachable(bool reachable);    // the router: STA joins succeed / the link stays up
+// The router: channel and last BSSID byte (defaults 6, 0x01); a join naming
+// another channel or BSSID finds nothing.
+void setStaAp(uint8_t channel, uint8_t bssidLast);
+// STA join timing: scan per channel (swept from 1 up to the router's),
+// association, DHCP. Defaults 120/150/600 ms.
+void setStaTiming(uint32_t scanPerChannelMs, uint32_t assocMs, uint32_t dhcpMs);
+void setScanDurationMs(uint32_t ms);     // how long a WiFi scan takes (default 1500)
+
+// -------- clients --------
+// Simulated HTTP/WS clients are served by the web server's event thread, like
+// socket clients; WS client `num` gets id() == num (socket clients start at 100).
+struct HttpResponse {
+  int code = 0;
+  String contentType;
+  std::vector<std::pair<String, String>> headers;
+  String body;
+};
+void httpRequest(WebRequestMethodComposite method, const char* uri,
+                 std::initializer_list<std::pair<const char*, const char*>> args = {},
+                 std::initializer_list<std::pair<const char*, const char*>> headers = {});
+HttpResponse lastHttpResponse();
+void wsConnect(uint8_t num);
+void wsDisconnect(uint8_t num);
+void wsText(uint8_t num, const char* text);
+void wsBinary(uint8_t num, const uint8_t* data, size_t len);
+std::vector<String> wsTake(uint8_t num);  // frames (text or binary) sent to client `num` since the last call
+// A paused client stops reading: frames pile up in its send queue (and count
+// against WS_MAX_QUEUED_MESSAGES) until it is resumed.
+void wsSetPaused(uint8_t num, bool paused);
+// Also accept real TCP clients on 127.0.0.1:port (0 = any free port).
+// Returns the bound port, 0 on failure.
+uint16_t httpListen(uint16_t port);
+void cloudPowerState(const char* deviceId, bool state);   // dropped while the cloud link is down
+
+// -------- SinricPro server (sim_cloud.cpp) --------
+void setCloudUp(bool up);                // the client's server link, WiFi aside
+void setCloudConnectMs(uint32_t ms);     // SinricPro.begin() to connected (default 0)
+int cloudDeviceState(const char* deviceId);  // what the cloud shows: -1 unknown, 0 off, 1 on
+struct CloudEvent {
+  uint32_t atMs;                         // hal::millis()
+  String deviceId;
+  bool state;
+};
+std::vector<CloudEvent> cloudEvents();   // power-state events that got through, oldest first
+
+// -------- MQTT broker (the firmware's PubSubClient connects to it) --------
+void setMqttBrokerUp(bool up);           // down: drops the client (will is published)
+bool mqttClientConnected();
+void mqttInject(const char* topic, const char* payload);  // another client publishes
+String mqttRetained(const char* topic);  // retained payload, empty if none
+uint32_t mqttPublishCount();             // publishes sent by the firmware so far
+// Blocks until the firmware publishes to `topic` at or after `sinceUs`.
+bool mqttWaitPublish(const char* topic, uint32_t sinceUs, uint32_t timeoutMs, uint32_t* atUs, String* payload);
+
+} // namespace sim
@@ -0,0 +1,226 @@
+// src/native/sim_arduino.cpp
+// Serial and Preferences for the host simulation.
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <stdarg.h>
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "sim.h"
+
+HardwareSerial Serial;
+
+namespace {
+const size_t UART_TX_FIFO = 128;
+std::mutex uartMu;
+std::chrono::steady_clock::time_point uartBusyUntil;  // last queued byte leaves the wire
+std::mutex serialInMu;
+std::deque<char> serialIn;
+} // namespace
+
+void HardwareSerial::transmit(size_t bytes) {
+  if (!timing_ || !bytes) return;
+  // the driver's lock is held while it waits for FIFO room, so do the same
+  std::lock_guard<std::mutex> lk(uartMu);
+  auto byteTime = std::chrono::nanoseconds(10ull * 1000000000ull / baud_);   // 8N1
+  auto now = std::chrono::steady_clock::now();
+  uartBusyUntil = std::max(now, uartBusyUntil) + byteTime * bytes;
+  // returns once the rest fits in the FIFO
+  std::this_thread::sleep_until(uartBusyUntil - byteTime * UART_TX_FIFO);
+}
+
+size_t HardwareSerial::printf(const char* fmt, ...) {
+  if (!echo_ && !timing_) return 0;
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n < 0) return 0;
+  if (echo_) {
+    if ((size_t)n < sizeof(buf)) {
+      fputs(buf, stdout);
+    } else {
+      va_start(ap, fmt);
+      vprintf(fmt, ap);
+      va_end(ap);
+    }
+  }
+  transmit((size_t)n);
+  return (size_t)n;
+}
+
+size_t HardwareSerial::print(const char* s) {
+  if (!echo_ && !timing_) return 0;
+  size_t n = strlen(s);
+  if (echo_) fputs(s, stdout);
+  transmit(n);
+  return n;
+}
+
+int HardwareSerial::available() {
+  std::lock_guard<std::mutex> lk(serialInMu);
+  return (int)serialIn.size();
+}
+
+int HardwareSerial::read() {
+  std::lock_guard<std::mutex> lk(serialInMu);
+  if (serialIn.empty()) return -1;
+  char c = serialIn.front();
+  serialIn.pop_front();
+  return (uint8_t)c;
+}
+
+namespace sim {
+void setSerialEcho(bool on) { Serial.setEcho(on); }
+void setSerialTiming(bool on) { Serial.setTiming(on); }
+void serialInput(const char* text) {
+  std::lock_guard<std::mutex> lk(serialInMu);
+  serialIn.insert(serialIn.end(), text, text + strlen(text));
+}
+} // namespace sim
+
+// -------- Preferences --------
+
+namespace {
+std::mutex nvsMu;
+std::map<std::string, std::vector<uint8_t>> nvs;  // "<namespace>/<key>" -> value
+uint32_t nvsWriteCount = 0;
+
+std::string nvsKey(const String& ns, const char* key) { return ns.str() + "/" + key; }
+} // namespace
+
+bool Preferences::begin(const char* name, bool readOnly) {
+  ns_ = name;
+  readOnly_ = readOnly;
+  open_ = true;
+  return true;
+}
+
+void Preferences::end() { open_ = false; }
+
+bool Preferences::clear() {
+  if (!open_ || readOnly_) return false;
+  std::lock_guard<std::mutex> lk(nvsMu);
+  std::string prefix = ns_.str() + "/";
+  for (auto it = nvs.begin(); it != nvs.end();) {
+    if (it->first.compare(0, prefix.size(), prefix) == 0) it = nvs.erase(it);
+    else ++it;
+  }
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  if (!open_ || readOnly_) return false;
+  std::lock_guard<std::mutex> lk(nvsMu);
+  return nvs.erase(nvsKey(ns_, key)) > 0;
+}
+
+bool Preferences::isKey(const char* key) {
+  std::lock_guard<std::mutex> lk(nvsMu);
+  return open_ && nvs.count(nvsKey(ns_, key));
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  if (!open_ || readOnly_) return 0;
+  std::lock_guard<std::mutex> lk(nvsMu);
+  const uint8_t* p = (const uint8_t*)value;
+  nvs[nvsKey(ns_, key)] = std::vector<uint8_t>(p, p + len);
+  nvsWriteCount++;
+  return len;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  std::lock_guard<std::mutex> lk(nvsMu);
+  auto it = nvs.find(nvsKey(ns_, key));
+  return (open_ && it != nvs.end()) ? it->second.size() : 0;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  std::lock_guard<std::mutex> lk(nvsMu);
+  auto it = nvs.find(nvsKey(ns_, key));
+  if (!open_ || it == nvs.end() || it->second.size() > maxLen) return 0;
+  memcpy(buf, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+size_t Preferences::putString(const char* key, const String& value) {
+  return putBytes(key, value.c_str(), value.length()) == value.length() ? value.length() : 0;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+  std::lock_guard<std::mutex> lk(nvsMu);
+  auto it = nvs.find(nvsKey(ns_, key));
+  if (!open_ || it == nvs.end()) return defaultValue;
+  return String((const char*)it->second.data(), (unsigned int)it->second.size());
+}
+
+size_t Preferences::putBool(const char* key, bool value) { return putUChar(key, value ? 1 : 0); }
+bool Preferences::getBool(const char* key, bool defaultValue) { return getUChar(key, defaultValue ? 1 : 0) != 0; }
+
+size_t Preferences::putUChar(const char* key, uint8_t value) { return putBytes(key, &value, 1); }
+uint8_t Preferences::getUChar(const char* key, uint8_t defaultValue) {
+  uint8_t v;
+  return getBytes(key, &v, sizeof(v)) == sizeof(v) ? v : defaultValue;
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) {
+  uint32_t v;
+  return getBytes(key, &v, sizeof(v)) == sizeof(v) ? v : defaultValue;
+}
+
+size_t Preferences::putULong64(const char* key, uint64_t value) { return putBytes(key, &value, sizeof(value)); }
+uint64_t Preferences::getULong64(const char* key, uint64_t defaultValue) {
+  uint64_t v;
+  return getBytes(key, &v, sizeof(v)) == sizeof(v) ? v : defaultValue;
+}
+
+namespace sim {
+uint32_t nvsWrites() {
+  std::lock_guard<std::mutex> lk(nvsMu);
+  return nvsWriteCount;
+}
+
+// per entry: u16 key length, key, u32 value length, value
+std::vector<uint8_t> nvsExport() {
+  std::lock_guard<std::mutex> lk(nvsMu);
+  std::vector<uint8_t> blob;
+  auto put = [&](const void* p, size_t n) { blob.insert(blob.end(), (const uint8_t*)p, (const uint8_t*)p + n); };
+  for (const auto& e : nvs) {
+    uint16_t kl = (uint16_t)e.first.size();
+    uint32_t vl = (uint32_t)e.second.size();
+    put(&kl, sizeof(kl)); put(e.first.data(), kl);
+    put(&vl, sizeof(vl)); put(e.second.data(), vl);
+  }
+  return blob;
+}
+
+void nvsImport(const std::vector<uint8_t>& blob) {
+  std::lock_guard<std::mutex> lk(nvsMu);
+  nvs.clear();
+  size_t i = 0;
+  auto take = [&](void* p, size_t n) {
+    if (blob.size() - i < n) return false;
+    memcpy(p, blob.data() + i, n);
+    i += n;
+    return true;
+  };
+  uint16_t kl;
+  uint32_t vl;
+  while (take(&kl, sizeof(kl))) {
+    std::string key(kl, '\0');
+    std::vector<uint8_t> value;
+    if (!take(&key[0], kl) || !take(&vl, sizeof(vl))) return;
+    value.resize(vl);
+    if (vl && !take(value.data(), vl)) return;
+    nvs[key] = std::move(value);
+  }
+}
+} // namespace sim
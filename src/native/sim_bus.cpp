@@ -0,0 +1,143 @@
+// src/native/sim_bus.cpp
+// hal::spi* / hal::i2c* against simulated relay expanders: a chain of
+// 74HC595s on SPI (latched on the chip-select rising edge) and MCP23017s at
+// 0x20..0x27 on I2C. Every transaction busy-waits for its wire time at the
+// configured clock, so bus cost shows up in the control task's timings.
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "hal.h"
+#include "sim.h"
+
+namespace {
+
+const uint8_t MCP_FIRST_ADDR = 0x20;
+const int MCP_CHIPS = 8;
+const int MCP_REGS = 0x16;                 // IOCON.BANK = 0 register map
+const uint8_t MCP_IODIRA = 0x00, MCP_IODIRB = 0x01;
+const uint8_t MCP_GPIOA = 0x12, MCP_GPIOB = 0x13, MCP_OLATA = 0x14, MCP_OLATB = 0x15;
+const uint32_t I2C_START_STOP_BITS = 2;
+
+std::mutex busMu;
+std::condition_variable busCv;
+uint32_t spiHz = 0, i2cHz = 0;
+uint64_t shiftReg = 0, latched = 0;        // 8 chips: chip k = byte k, chip 0 nearest the MCU
+uint8_t mcpRegs[MCP_CHIPS][MCP_REGS];
+sim::BusStats spi = {}, i2c = {};
+uint32_t lastWriteUs = 0;
+bool written = false;
+
+struct McpPowerOn {
+  McpPowerOn() {
+    for (auto& regs : mcpRegs) {
+      for (uint8_t& r : regs) r = 0;
+      regs[MCP_IODIRA] = regs[MCP_IODIRB] = 0xFF;   // all inputs after reset
+    }
+  }
+} mcpPowerOn;
+
+// busy-waits for `bits` clocks at `hz` (the transaction holds the bus, and
+// the calling task, that long)
+uint64_t wireTime(uint64_t bits, uint32_t hz) {
+  if (!hz) return 0;
+  uint64_t ns = bits * 1000000000ull / hz;
+  auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+  while (std::chrono::steady_clock::now() < until) {}
+  return ns;
+}
+
+// caller holds busMu
+void transactionDone(sim::BusStats& s, size_t bytes, uint64_t ns) {
+  s.transactions++;
+  s.bytes += bytes;
+  s.wireNs += ns;
+  lastWriteUs = hal::micros();
+  written = true;
+}
+
+} // namespace
+
+namespace hal {
+
+void spiBegin(int, int, int, uint32_t hz) {
+  std::lock_guard<std::mutex> lk(busMu);
+  spiHz = hz;
+}
+
+void spiWrite(const uint8_t* data, size_t len) {
+  uint64_t ns = wireTime(len * 8, spiHz);
+  {
+    std::lock_guard<std::mutex> lk(busMu);
+    for (size_t i = 0; i < len; i++) shiftReg = shiftReg << 8 | data[i];
+    latched = shiftReg;   // CS rising edge
+    transactionDone(spi, len, ns);
+  }
+  busCv.notify_all();
+}
+
+void i2cBegin(int, int, uint32_t hz) {
+  std::lock_guard<std::mutex> lk(busMu);
+  i2cHz = hz;
+}
+
+bool i2cWrite(uint8_t addr, const uint8_t* data, size_t len) {
+  // address byte + data bytes, 9 clocks each with the ACK
+  uint64_t ns = wireTime(I2C_START_STOP_BITS + 9 * (1 + len), i2cHz);
+  int chip = addr - MCP_FIRST_ADDR;
+  {
+    std::lock_guard<std::mutex> lk(busMu);
+    transactionDone(i2c, len, ns);
+    if (chip < 0 || chip >= MCP_CHIPS) return false;   // nobody ACKs the address
+    if (len && data[0] >= MCP_REGS) return false;
+    // data[0] is the register pointer; it advances after every byte
+    for (size_t i = 1; i < len; i++) {
+      uint8_t reg = (data[0] + i - 1) % MCP_REGS;
+      if (reg == MCP_GPIOA) reg = MCP_OLATA;        // writing the port writes the latch
+      else if (reg == MCP_GPIOB) reg = MCP_OLATB;
+      mcpRegs[chip][reg] = data[i];
+    }
+  }
+  busCv.notify_all();
+  return true;
+}
+
+} // namespace hal
+
+namespace sim {
+
+uint64_t hc595Outputs() {
+  std::lock_guard<std::mutex> lk(busMu);
+  return latched;
+}
+
+uint16_t mcp23017Outputs(uint8_t addr) {
+  int chip = addr - MCP_FIRST_ADDR;
+  if (chip < 0 || chip >= MCP_CHIPS) return 0;
+  std::lock_guard<std::mutex> lk(busMu);
+  const uint8_t* r = mcpRegs[chip];
+  uint8_t a = r[MCP_OLATA] & ~r[MCP_IODIRA], b = r[MCP_OLATB] & ~r[MCP_IODIRB];
+  return (uint16_t)(b << 8 | a);
+}
+
+BusStats spiStats() {
+  std::lock_guard<std::mutex> lk(busMu);
+  return spi;
+}
+
+BusStats i2cStats() {
+  std::lock_guard<std::mutex> lk(busMu);
+  return i2c;
+}
+
+bool waitBusWrite(uint32_t sinceUs, uint32_t timeoutMs, uint32_t* atUs) {
+  std::unique_lock<std::mutex> lk(busMu);
+  bool ok = busCv.wait_for(lk, std::chrono::milliseconds(timeoutMs), [&] {
+    return written && (int32_t)(lastWriteUs - sinceUs) >= 0;
+  });
+  if (ok && atUs) *atUs = lastWriteUs;
+  return ok;
+}
+
+} // namespace sim
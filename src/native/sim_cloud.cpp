@@ -0,0 +1,97 @@
+// src/native/sim_cloud.cpp
+// SinricPro client for the host simulation.
+
+#include <SinricPro.h>
+
+#include "hal.h"
+#include "sim.h"
+
+SinricProClass SinricPro;
+
+bool SinricProSwitch::sendPowerStateEvent(bool state, String) {
+  if (!SinricPro.isConnected()) return false;
+  uint32_t now = hal::millis() | 1, last = lastEventMs_.load();
+  if (last && now - last < SIM_EVENT_LIMIT_MS) return false;
+  lastEventMs_.store(now);
+  eventsSent_++;
+  SinricPro.simRecordState(deviceId_, state, true);
+  return true;
+}
+
+bool SinricProSwitch::simDispatch(bool state) {
+  if (!cb_) return false;
+  return cb_(deviceId_, state);
+}
+
+void SinricProClass::begin(const String&, const String&) {
+  beganAtMs_ = hal::millis();
+  running_ = true;
+}
+
+bool SinricProClass::isConnected() const {
+  return running_ && linkUp_ && hal::millis() - beganAtMs_ >= connectMs_;
+}
+
+void SinricProClass::handle() {
+  if (!running_) return;
+  std::deque<std::pair<String, bool>> batch;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    batch.swap(pending_);
+  }
+  for (auto& cmd : batch) {
+    if (device(cmd.first).simDispatch(cmd.second)) simRecordState(cmd.first, cmd.second, false);
+  }
+}
+
+SinricProSwitch& SinricProClass::device(const String& id) {
+  std::lock_guard<std::mutex> lk(mu_);
+  auto it = devices_.find(id);
+  if (it == devices_.end()) it = devices_.emplace(id, SinricProSwitch(id)).first;
+  return it->second;
+}
+
+void SinricProClass::simEnqueuePowerState(const String& deviceId, bool state) {
+  if (!isConnected()) return;   // the device is offline: the command goes nowhere
+  std::lock_guard<std::mutex> lk(mu_);
+  pending_.push_back({deviceId, state});
+}
+
+void SinricProClass::simRecordState(const String& deviceId, bool state, bool event) {
+  std::lock_guard<std::mutex> lk(mu_);
+  cloudState_[deviceId] = state;
+  if (event) events_.push_back({hal::millis(), deviceId, state});
+}
+
+int SinricProClass::simDeviceState(const String& deviceId) const {
+  std::lock_guard<std::mutex> lk(mu_);
+  auto it = cloudState_.find(deviceId);
+  return it == cloudState_.end() ? -1 : it->second;
+}
+
+std::vector<SinricProClass::SimEvent> SinricProClass::simEvents() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return events_;
+}
+
+uint32_t SinricProClass::simEventsSent() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  uint32_t n = 0;
+  for (const auto& d : devices_) n += d.second.simEventsSent();
+  return n;
+}
+
+namespace sim {
+
+void cloudPowerState(const char* deviceId, bool state) { SinricPro.simEnqueuePowerState(deviceId, state); }
+void setCloudUp(bool up) { SinricPro.simSetLinkUp(up); }
+void setCloudConnectMs(uint32_t ms) { SinricPro.simSetConnectMs(ms); }
+int cloudDeviceState(const char* deviceId) { return SinricPro.simDeviceState(deviceId); }
+
+std::vector<CloudEvent> cloudEvents() {
+  std::vector<CloudEvent> out;
+  for (const auto& e : SinricPro.simEvents()) out.push_back({e.atMs, e.deviceId, e.state});
+  return out;
+}
+
+} // namespace sim
@@ -0,0 +1,863 @@
+// src/native/sim_http.cpp
+// ESPAsyncWebServer + AsyncWebSocket for the host simulation. One event
+// thread (standing in for the AsyncTCP task) owns every connection: simulated
+// clients queued through sim.h and, after sim::httpListen(), real TCP
+// clients on the loopback interface. As with the real server, each HTTP
+// connection carries one request and is closed after the response.
+
+#include <ESPAsyncWebServer.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "sim.h"
+
+namespace {
+
+const size_t MAX_REQUEST_BYTES = 16384;       // bodies streamed to a body handler are not limited
+const size_t RECV_WINDOW = 5744;              // lwIP TCP_WND in the Arduino core: unprocessed bytes held
+const size_t BODY_SEGMENT = 1436;             // TCP_MSS: a body handler gets one of these per pass
+const size_t MAX_WS_FRAME = 16384;
+const size_t SIM_WS_INBOX = 256;              // text frames kept per simulated WS client
+const uint32_t FIRST_SOCKET_CLIENT_ID = 100;  // simulated WS clients use their sim number
+const int POLL_MS = 50;
+
+// -------- SHA-1 + base64, for Sec-WebSocket-Accept --------
+
+uint32_t rol(uint32_t v, int n) { return (v << n) | (v >> (32 - n)); }
+
+std::string sha1(const std::string& msg) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  std::string m = msg;
+  uint64_t bits = (uint64_t)msg.size() * 8;
+  m += (char)0x80;
+  while (m.size() % 64 != 56) m += (char)0;
+  for (int i = 7; i >= 0; i--) m += (char)(bits >> (i * 8));
+  for (size_t off = 0; off < m.size(); off += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+      const uint8_t* p = (const uint8_t*)m.data() + off + i * 4;
+      w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    }
+    for (int i = 16; i < 80; i++) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+      uint32_t f, k;
+      if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+      else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+      else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+      else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+      uint32_t t = rol(a, 5) + f + e + k + w[i];
+      e = d; d = c; c = rol(b, 30); b = a; a = t;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+  }
+  std::string out;
+  for (uint32_t v : h) for (int i = 3; i >= 0; i--) out += (char)(v >> (i * 8));
+  return out;
+}
+
+std::string base64(const std::string& in) {
+  static const char* T = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < in.size(); i += 3) {
+    uint32_t v = (uint8_t)in[i] << 16;
+    if (i + 1 < in.size()) v |= (uint8_t)in[i + 1] << 8;
+    if (i + 2 < in.size()) v |= (uint8_t)in[i + 2];
+    out += T[(v >> 18) & 63];
+    out += T[(v >> 12) & 63];
+    out += i + 1 < in.size() ? T[(v >> 6) & 63] : '=';
+    out += i + 2 < in.size() ? T[v & 63] : '=';
+  }
+  return out;
+}
+
+// -------- HTTP helpers --------
+
+bool equalsNoCase(const std::string& a, const std::string& b) {
+  return a.size() == b.size() && !strncasecmp(a.data(), b.data(), a.size());
+}
+
+std::string trim(const std::string& s) {
+  size_t b = s.find_first_not_of(" \t"), e = s.find_last_not_of(" \t");
+  return b == std::string::npos ? std::string() : s.substr(b, e - b + 1);
+}
+
+std::string urlDecode(const std::string& s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '+') out += ' ';
+    else if (s[i] == '%' && i + 2 < s.size()) {
+      out += (char)strtol(s.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    } else out += s[i];
+  }
+  return out;
+}
+
+void addFormParams(AsyncWebServerRequest& req, const std::string& form, bool post) {
+  size_t pos = 0;
+  while (pos < form.size()) {
+    size_t amp = form.find('&', pos);
+    if (amp == std::string::npos) amp = form.size();
+    std::string kv = form.substr(pos, amp - pos);
+    size_t eq = kv.find('=');
+    if (!kv.empty()) {
+      req.addParam(urlDecode(kv.substr(0, eq)).c_str(),
+                   eq == std::string::npos ? "" : urlDecode(kv.substr(eq + 1)).c_str(), post);
+    }
+    pos = amp + 1;
+  }
+}
+
+WebRequestMethodComposite methodFromName(const std::string& m) {
+  if (m == "GET") return HTTP_GET;
+  if (m == "POST") return HTTP_POST;
+  if (m == "DELETE") return HTTP_DELETE;
+  if (m == "PUT") return HTTP_PUT;
+  if (m == "PATCH") return HTTP_PATCH;
+  if (m == "HEAD") return HTTP_HEAD;
+  if (m == "OPTIONS") return HTTP_OPTIONS;
+  return 0;
+}
+
+const char* reason(int code) {
+  switch (code) {
+    case 101: return "Switching Protocols";
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default: return "";
+  }
+}
+
+std::string serialize(const AsyncWebServerResponse& r, bool head) {
+  bool body = r.code() != 304 && r.code() != 204;
+  std::string s = "HTTP/1.1 " + std::to_string(r.code()) + " " + reason(r.code()) + "\r\n";
+  if (r.contentType().length()) s += "Content-Type: " + r.contentType().str() + "\r\n";
+  if (body) s += "Content-Length: " + std::to_string(r.body().length()) + "\r\n";
+  for (const AsyncWebHeader& h : r.headers()) s += h.name().str() + ": " + h.value().str() + "\r\n";
+  s += "Connection: close\r\n\r\n";
+  if (body && !head) s += r.body().str();
+  return s;
+}
+
+std::string wsFrame(uint8_t opcode, const char* data, size_t len) {
+  std::string f;
+  f += (char)(0x80 | opcode);
+  if (len < 126) {
+    f += (char)len;
+  } else if (len < 65536) {
+    f += (char)126;
+    f += (char)(len >> 8);
+    f += (char)len;
+  } else {
+    f += (char)127;
+    for (int i = 7; i >= 0; i--) f += (char)((uint64_t)len >> (i * 8));
+  }
+  f.append(data, len);
+  return f;
+}
+
+// -------- event thread --------
+
+struct Conn {
+  int fd = -1;                  // -1: simulated WS client
+  std::string in, out;
+  bool closeWhenFlushed = false;
+  bool dead = false;
+  AsyncWebSocket* ws = nullptr; // set once upgraded
+  std::unique_ptr<AsyncWebSocketClient> client;
+  uint32_t seq = 0;             // connect order, for cleanupClients
+  std::deque<size_t> outChunks; // sizes of the messages in `out`, oldest first
+  size_t frontSent = 0;         // bytes of outChunks.front() already written
+  std::deque<String> inbox;     // simulated client: frames received
+  bool paused = false;          // simulated client stopped reading (sim::wsSetPaused)
+  std::deque<String> unread;    // ...and what queued up meanwhile
+  std::unique_ptr<AsyncWebServerRequest> bodyReq;   // request whose body is being streamed
+  ArBodyHandlerFunction bodyFn;
+  size_t bodyIndex = 0, bodyTotal = 0;
+};
+
+// messages waiting to go out on a WS connection (the library's per-client queue)
+size_t queueLen(const Conn& c) { return c.fd < 0 ? c.unread.size() : c.outChunks.size(); }
+
+void queueOut(Conn& c, const std::string& bytes) {
+  c.out += bytes;
+  c.outChunks.push_back(bytes.size());
+}
+
+struct SimRequest {
+  WebRequestMethodComposite method;
+  String uri;
+  std::vector<std::pair<String, String>> args, headers;
+};
+
+struct SimWsEvent {
+  uint8_t num;
+  AwsEventType type;
+  String data;
+  uint8_t opcode;
+};
+
+class Engine {
+public:
+  // Held by the event thread while it works (handlers included) and by other
+  // threads queueing frames; recursive so handlers can reply.
+  std::recursive_mutex mu;
+  AsyncWebServer* server = nullptr;
+  std::list<std::unique_ptr<Conn>> conns;
+  std::deque<SimRequest> simRequests;
+  std::deque<SimWsEvent> simWs;
+  sim::HttpResponse lastResponse;
+
+  void start() {
+    std::lock_guard<std::recursive_mutex> lk(mu);
+    if (started_) return;
+    started_ = true;
+    int p[2];
+    if (pipe(p) == 0) {
+      wakeR_ = p[0];
+      wakeW_ = p[1];
+      fcntl(wakeR_, F_SETFL, O_NONBLOCK);
+      fcntl(wakeW_, F_SETFL, O_NONBLOCK);
+    }
+    std::thread([this] { run(); }).detach();
+  }
+
+  void wake() {
+    if (wakeW_ >= 0 && write(wakeW_, "x", 1) < 0) {}  // full pipe: a wake is already pending
+  }
+
+  uint16_t listenOn(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return 0;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    a.sin_port = htons(port);
+    socklen_t alen = sizeof(a);
+    if (bind(fd, (sockaddr*)&a, sizeof(a)) || ::listen(fd, 256) || getsockname(fd, (sockaddr*)&a, &alen)) {
+      close(fd);
+      return 0;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    start();
+    std::lock_guard<std::recursive_mutex> lk(mu);
+    if (listenFd_ >= 0) close(listenFd_);
+    listenFd_ = fd;
+    wake();
+    return ntohs(a.sin_port);
+  }
+
+  Conn* findClient(AsyncWebSocket* ws, uint32_t id) {
+    for (auto& c : conns) {
+      if (!c->dead && c->ws == ws && c->client && c->client->id() == id) return c.get();
+    }
+    return nullptr;
+  }
+
+  // caller holds mu
+  bool sendFrame(Conn& c, uint8_t opcode, const char* msg, size_t len) {
+    if (c.dead || c.closeWhenFlushed || queueLen(c) >= WS_MAX_QUEUED_MESSAGES) return false;
+    if (c.fd < 0) {
+      if (c.paused) {
+        c.unread.push_back(String(msg, (unsigned int)len));
+      } else {
+        if (c.inbox.size() >= SIM_WS_INBOX) c.inbox.pop_front();
+        c.inbox.push_back(String(msg, (unsigned int)len));
+      }
+      return true;
+    }
+    queueOut(c, wsFrame(opcode, msg, len));
+    wake();
+    return true;
+  }
+
+  void setPaused(Conn& c, bool paused) {
+    c.paused = paused;
+    if (paused) return;
+    for (String& m : c.unread) {
+      if (c.inbox.size() >= SIM_WS_INBOX) c.inbox.pop_front();
+      c.inbox.push_back(m);
+    }
+    c.unread.clear();
+  }
+
+  void closeConn(Conn& c) {
+    c.dead = true;
+    wake();
+  }
+
+  void detach(AsyncWebServer* s) {
+    std::lock_guard<std::recursive_mutex> lk(mu);
+    if (server != s) return;
+    for (auto& c : conns) c->dead = true;
+    reap();
+    server = nullptr;
+  }
+
+private:
+  bool started_ = false;
+  int wakeR_ = -1, wakeW_ = -1, listenFd_ = -1;
+  uint32_t nextId_ = FIRST_SOCKET_CLIENT_ID;
+  uint32_t nextSeq_ = 0;
+
+  void run() {
+    std::vector<pollfd> fds;
+    std::vector<Conn*> who;
+    for (;;) {
+      fds.clear();
+      who.clear();
+      bool bodyQueued = false;
+      {
+        std::lock_guard<std::recursive_mutex> lk(mu);
+        fds.push_back({wakeR_, POLLIN, 0});
+        who.push_back(nullptr);
+        if (listenFd_ >= 0) { fds.push_back({listenFd_, POLLIN, 0}); who.push_back(nullptr); }
+        for (auto& c : conns) {
+          if (c->fd < 0) continue;
+          // a body not yet handed over is unacked data: the sender waits
+          bool windowFull = c->bodyReq && c->in.size() >= RECV_WINDOW;
+          fds.push_back({c->fd, (short)((windowFull ? 0 : POLLIN) | (c->out.empty() ? 0 : POLLOUT)), 0});
+          who.push_back(c.get());
+          bodyQueued |= c->bodyReq && !c->in.empty();
+        }
+      }
+      poll(fds.data(), fds.size(), bodyQueued ? 0 : POLL_MS);
+
+      std::lock_guard<std::recursive_mutex> lk(mu);
+      char drain[64];
+      while (read(wakeR_, drain, sizeof(drain)) > 0) {}
+      for (size_t i = 1; i < fds.size(); i++) {
+        if (!fds[i].revents) continue;
+        if (!who[i]) { acceptAll(); continue; }
+        if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) readFrom(*who[i]);
+      }
+      runSimQueues();
+      // AsyncTCP queues an event per segment, so other connections' events
+      // are handled between the segments of a long body
+      for (auto& c : conns) {
+        if (c->bodyReq && !c->dead) feedBody(*c);
+      }
+      for (auto& c : conns) flush(*c);
+      reap();
+    }
+  }
+
+  void acceptAll() {
+    for (;;) {
+      int fd = accept(listenFd_, nullptr, nullptr);
+      if (fd < 0) return;
+      fcntl(fd, F_SETFL, O_NONBLOCK);
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      std::unique_ptr<Conn> c(new Conn);
+      c->fd = fd;
+      c->seq = nextSeq_++;
+      conns.push_back(std::move(c));
+    }
+  }
+
+  void readFrom(Conn& c) {
+    char buf[4096];
+    // an HTTP request takes at most a window per pass, and a body no more
+    // than the window minus what is still waiting for its handler
+    size_t window = c.bodyReq ? RECV_WINDOW - std::min(c.in.size(), RECV_WINDOW) : RECV_WINDOW;
+    for (size_t got = 0; c.ws || got < window;) {
+      ssize_t n = recv(c.fd, buf, c.ws ? sizeof(buf) : std::min(sizeof(buf), window - got), 0);
+      if (n > 0) { c.in.append(buf, n); got += n; continue; }
+      if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) c.dead = true;
+      break;
+    }
+    if (c.dead || c.closeWhenFlushed) return;
+    if (c.ws) processWs(c);
+    else processHttp(c);
+  }
+
+  void flush(Conn& c) {
+    if (c.fd < 0 || c.dead) return;
+    while (!c.out.empty()) {
+      ssize_t n = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+      if (n > 0) {
+        c.out.erase(0, n);
+        for (size_t left = n; left && !c.outChunks.empty();) {
+          size_t rest = c.outChunks.front() - c.frontSent;
+          if (left < rest) { c.frontSent += left; break; }
+          left -= rest;
+          c.outChunks.pop_front();
+          c.frontSent = 0;
+        }
+        continue;
+      }
+      if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) c.dead = true;
+      return;
+    }
+    if (c.closeWhenFlushed) c.dead = true;
+  }
+
+  void reap() {
+    for (auto it = conns.begin(); it != conns.end();) {
+      Conn& c = **it;
+      if (!c.dead) { ++it; continue; }
+      if (c.ws && c.client) c.ws->simEvent(c.client.get(), WS_EVT_DISCONNECT, nullptr, nullptr, 0);
+      if (c.fd >= 0) close(c.fd);
+      it = conns.erase(it);
+    }
+  }
+
+  void respond(Conn& c, AsyncWebServerRequest& req) {
+    if (server) server->simDispatch(&req);
+    else req.send(503, "text/plain", "server not started");
+    if (!req.response()) req.send(500, "text/plain", "no response");
+    queueOut(c, serialize(*req.response(), req.method() == HTTP_HEAD));
+    c.closeWhenFlushed = true;
+  }
+
+  // one segment of a streamed body; the response once it is all in
+  void feedBody(Conn& c) {
+    if (!c.in.empty() && c.bodyIndex < c.bodyTotal) {
+      size_t n = std::min(std::min(c.in.size(), BODY_SEGMENT), c.bodyTotal - c.bodyIndex);
+      c.bodyFn(c.bodyReq.get(), (uint8_t*)&c.in[0], n, c.bodyIndex, c.bodyTotal);
+      c.bodyIndex += n;
+      c.in.erase(0, n);
+    }
+    if (c.bodyIndex < c.bodyTotal) return;
+    std::unique_ptr<AsyncWebServerRequest> req = std::move(c.bodyReq);
+    respond(c, *req);
+  }
+
+  void processHttp(Conn& c) {
+    if (c.bodyReq) return;   // run() feeds it
+    size_t end = c.in.find("\r\n\r\n");
+    if (end == std::string::npos) {
+      if (c.in.size() > MAX_REQUEST_BYTES) c.dead = true;
+      return;
+    }
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string requestLine;
+    size_t contentLength = 0;
+    for (size_t pos = 0; pos < end;) {
+      size_t eol = c.in.find("\r\n", pos);
+      if (eol == std::string::npos || eol > end) eol = end;
+      std::string line = c.in.substr(pos, eol - pos);
+      pos = eol + 2;
+      if (requestLine.empty()) { requestLine = line; continue; }
+      size_t colon = line.find(':');
+      if (colon == std::string::npos) continue;
+      headers.push_back({trim(line.substr(0, colon)), trim(line.substr(colon + 1))});
+      if (equalsNoCase(headers.back().first, "Content-Length")) contentLength = strtoul(headers.back().second.c_str(), nullptr, 10);
+    }
+    size_t sp1 = requestLine.find(' '), sp2 = requestLine.rfind(' ');
+    std::string target = sp1 < sp2 ? requestLine.substr(sp1 + 1, sp2 - sp1 - 1) : std::string();
+    WebRequestMethodComposite method = methodFromName(requestLine.substr(0, sp1));
+    size_t q = target.find('?');
+    std::unique_ptr<AsyncWebServerRequest> reqPtr(new AsyncWebServerRequest(method, target.substr(0, q).c_str()));
+    AsyncWebServerRequest& req = *reqPtr;
+    req.setContentLength(contentLength);
+    ArBodyHandlerFunction bodyFn = server && contentLength && method ? server->simBodyHandler(&req) : nullptr;
+
+    std::string body;
+    if (bodyFn) {
+      c.in.erase(0, end + 4);
+    } else {
+      if (contentLength > MAX_REQUEST_BYTES) { c.dead = true; return; }
+      if (c.in.size() < end + 4 + contentLength) return;
+      body = c.in.substr(end + 4, contentLength);
+      c.in.erase(0, end + 4 + contentLength);
+    }
+    if (q != std::string::npos) addFormParams(req, target.substr(q + 1), false);
+    std::string upgrade, wsKey, contentType;
+    for (const auto& h : headers) {
+      req.addHeader(h.first.c_str(), h.second.c_str());
+      if (equalsNoCase(h.first, "Upgrade")) upgrade = h.second;
+      if (equalsNoCase(h.first, "Sec-WebSocket-Key")) wsKey = h.second;
+      if (equalsNoCase(h.first, "Content-Type")) contentType = h.second;
+    }
+    if (!method || target.empty()) {
+      req.send(400, "text/plain", "Bad Request");
+      queueOut(c, serialize(*req.response(), false));
+      c.closeWhenFlushed = true;
+      return;
+    }
+    if (method == HTTP_POST && contentType.compare(0, 33, "application/x-www-form-urlencoded") == 0) {
+      addFormParams(req, body, true);
+    }
+
+    AsyncWebSocket* ws = server ? server->simSocketFor(req.url()) : nullptr;
+    if (ws && method == HTTP_GET && equalsNoCase(upgrade, "websocket") && !wsKey.empty()) {
+      queueOut(c, "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                  "Sec-WebSocket-Accept: " + base64(sha1(wsKey + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11")) + "\r\n\r\n");
+      c.ws = ws;
+      c.client.reset(new AsyncWebSocketClient(ws, nextId_++, IPAddress(127, 0, 0, 1)));
+      ws->simEvent(c.client.get(), WS_EVT_CONNECT, nullptr, nullptr, 0);
+      processWs(c);
+      return;
+    }
+    if (bodyFn) {
+      c.bodyReq = std::move(reqPtr);
+      c.bodyFn = bodyFn;
+      c.bodyIndex = 0;
+      c.bodyTotal = contentLength;
+      return;
+    }
+    respond(c, req);
+  }
+
+  void dataEvent(Conn& c, uint8_t opcode, bool final, std::string& payload) {
+    AwsFrameInfo info{};
+    info.message_opcode = opcode;
+    info.final = final;
+    info.opcode = opcode;
+    info.len = payload.size();
+    c.ws->simEvent(c.client.get(), WS_EVT_DATA, &info, (uint8_t*)&payload[0], payload.size());
+  }
+
+  void processWs(Conn& c) {
+    while (c.in.size() >= 2 && !c.dead && !c.closeWhenFlushed) {
+      const uint8_t* p = (const uint8_t*)c.in.data();
+      uint64_t len = p[1] & 0x7f;
+      size_t pos = 2;
+      if (len == 126) {
+        if (c.in.size() < 4) return;
+        len = (uint64_t)p[2] << 8 | p[3];
+        pos = 4;
+      } else if (len == 127) {
+        if (c.in.size() < 10) return;
+        len = 0;
+        for (int i = 0; i < 8; i++) len = len << 8 | p[2 + i];
+        pos = 10;
+      }
+      if (len > MAX_WS_FRAME) { c.dead = true; return; }
+      bool masked = p[1] & 0x80;
+      if (c.in.size() < pos + (masked ? 4 : 0) + len) return;
+      uint8_t mask[4] = {};
+      if (masked) { memcpy(mask, p + pos, 4); pos += 4; }
+      std::string payload = c.in.substr(pos, len);
+      for (size_t i = 0; i < payload.size(); i++) payload[i] ^= mask[i & 3];
+      uint8_t opcode = p[0] & 0x0f;
+      bool final = p[0] & 0x80;
+      c.in.erase(0, pos + len);
+
+      if (opcode == WS_DISCONNECT) {
+        queueOut(c, wsFrame(WS_DISCONNECT, "", 0));
+        c.closeWhenFlushed = true;
+      } else if (opcode == WS_PING) {
+        queueOut(c, wsFrame(WS_PONG, payload.data(), payload.size()));
+      } else if (opcode == WS_PONG) {
+        c.ws->simEvent(c.client.get(), WS_EVT_PONG, nullptr, (uint8_t*)&payload[0], payload.size());
+      } else {
+        dataEvent(c, opcode, final, payload);
+      }
+    }
+  }
+
+  void runSimQueues() {
+    while (!simRequests.empty()) {
+      SimRequest r = simRequests.front();
+      simRequests.pop_front();
+      AsyncWebServerRequest req(r.method, r.uri);
+      for (const auto& a : r.args) req.addParam(a.first, a.second, r.method == HTTP_POST);
+      for (const auto& h : r.headers) req.addHeader(h.first, h.second);
+      Conn scratch;
+      respond(scratch, req);
+      const AsyncWebServerResponse& resp = *req.response();
+      lastResponse.code = resp.code();
+      lastResponse.contentType = resp.contentType();
+      lastResponse.headers.clear();
+      for (const AsyncWebHeader& h : resp.headers()) lastResponse.headers.push_back({h.name(), h.value()});
+      lastResponse.body = resp.body();
+    }
+    while (!simWs.empty()) {
+      SimWsEvent ev = simWs.front();
+      simWs.pop_front();
+      AsyncWebSocket* ws = server ? server->simSocketFor(String()) : nullptr;
+      if (!ws) continue;
+      Conn* c = findClient(ws, ev.num);
+      if (ev.type == WS_EVT_CONNECT) {
+        if (c) continue;
+        std::unique_ptr<Conn> nc(new Conn);
+        nc->ws = ws;
+        nc->seq = nextSeq_++;
+        nc->client.reset(new AsyncWebSocketClient(ws, ev.num, IPAddress(192, 168, 4, (uint8_t)(2 + ev.num))));
+        AsyncWebSocketClient* client = nc->client.get();
+        conns.push_back(std::move(nc));
+        ws->simEvent(client, WS_EVT_CONNECT, nullptr, nullptr, 0);
+      } else if (c && ev.type == WS_EVT_DISCONNECT) {
+        c->dead = true;
+      } else if (c) {
+        std::string payload = ev.data.str();
+        dataEvent(*c, ev.opcode, true, payload);
+      }
+    }
+  }
+};
+
+// leaked on purpose: the event thread and the firmware's global server may
+// outlive any static destructor order
+Engine& engine() {
+  static Engine* e = new Engine;
+  return *e;
+}
+
+} // namespace
+
+// -------- ESPAsyncWebServer API --------
+
+const AsyncWebParameter* AsyncWebServerRequest::getParam(const String& name, bool post) const {
+  for (const AsyncWebParameter& p : params_) {
+    if (p.name() == name && p.isPost() == post) return &p;
+  }
+  return nullptr;
+}
+
+const AsyncWebHeader* AsyncWebServerRequest::getHeader(const String& name) const {
+  for (const AsyncWebHeader& h : headers_) {
+    if (equalsNoCase(h.name().str(), name.str())) return &h;
+  }
+  return nullptr;
+}
+
+bool AsyncWebServerRequest::authenticate(const char* username, const char* password) const {
+  const AsyncWebHeader* h = getHeader("Authorization");
+  return h && h->value().str() == "Basic " + base64(std::string(username) + ":" + password);
+}
+
+void AsyncWebServerRequest::requestAuthentication(const char* realm, bool) {
+  AsyncWebServerResponse* res = beginResponse(401);
+  res->addHeader("WWW-Authenticate", String("Basic realm=\"" + std::string(realm ? realm : "Login") + "\""));
+  send(res);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(int code, const String& contentType,
+                                                             const String& content) {
+  return new AsyncWebServerResponse(code, contentType, content);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(int code, const String& contentType,
+                                                             const uint8_t* content, size_t len) {
+  return new AsyncWebServerResponse(code, contentType, String((const char*)content, (unsigned int)len));
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse* response) {
+  if (!response_) response_.reset(response);
+  else delete response;   // only the first response goes out
+}
+
+bool AsyncWebSocketClient::text(const char* message, size_t len) { return server_->text(id_, message, len); }
+
+bool AsyncWebSocketClient::binary(const uint8_t* message, size_t len) { return server_->binary(id_, message, len); }
+
+void AsyncWebSocketClient::close() { server_->close(id_); }
+
+bool AsyncWebSocket::text(uint32_t id, const char* message, size_t len) {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  Conn* c = e.findClient(this, id);
+  return c && e.sendFrame(*c, WS_TEXT, message, len);
+}
+
+bool AsyncWebSocket::binary(uint32_t id, const uint8_t* message, size_t len) {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  Conn* c = e.findClient(this, id);
+  return c && e.sendFrame(*c, WS_BINARY, (const char*)message, len);
+}
+
+bool AsyncWebSocket::textAll(const char* message, size_t len) {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  bool any = false;
+  for (auto& c : e.conns) {
+    if (c->ws == this && c->client) any |= e.sendFrame(*c, WS_TEXT, message, len);
+  }
+  return any;
+}
+
+bool AsyncWebSocket::availableForWrite(uint32_t id) {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  Conn* c = e.findClient(this, id);
+  return c && !c->closeWhenFlushed && queueLen(*c) < WS_MAX_QUEUED_MESSAGES;
+}
+
+size_t AsyncWebSocket::count() const {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  size_t n = 0;
+  for (auto& c : e.conns) n += (c->ws == this && c->client && !c->dead);
+  return n;
+}
+
+void AsyncWebSocket::close(uint32_t id) {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  if (Conn* c = e.findClient(this, id)) e.closeConn(*c);
+}
+
+void AsyncWebSocket::closeAll() {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  for (auto& c : e.conns) {
+    if (c->ws == this && c->client) e.closeConn(*c);
+  }
+}
+
+void AsyncWebSocket::cleanupClients(uint16_t maxClients) {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  size_t live = count();
+  // conns is in connect order
+  for (auto& c : e.conns) {
+    if (live <= maxClients) break;
+    if (c->ws != this || !c->client || c->dead) continue;
+    e.closeConn(*c);
+    live--;
+  }
+}
+
+AsyncWebServer::~AsyncWebServer() { engine().detach(this); }
+
+void AsyncWebServer::begin() {
+  Engine& e = engine();
+  e.start();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  e.server = this;
+}
+
+void AsyncWebServer::end() { engine().detach(this); }
+
+void AsyncWebServer::on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction fn) {
+  on(uri, method, fn, nullptr, nullptr);
+}
+
+void AsyncWebServer::on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction fn,
+                        ArUploadHandlerFunction, ArBodyHandlerFunction onBody) {
+  for (Route& r : routes_) {
+    if (r.uri == uri && r.method == method) { r.fn = fn; r.body = onBody; return; }
+  }
+  routes_.push_back({uri, method, fn, onBody});
+}
+
+void AsyncWebServer::addHandler(AsyncWebSocket* ws) {
+  for (AsyncWebSocket* s : sockets_) if (s == ws) return;
+  sockets_.push_back(ws);
+}
+
+// same URI rule as AsyncCallbackWebHandler: exact, or a sub-path of it
+const AsyncWebServer::Route* AsyncWebServer::match(const AsyncWebServerRequest* request) const {
+  for (const Route& r : routes_) {
+    if (!(r.method & request->method())) continue;
+    if (request->url() == r.uri || request->url().startsWith(r.uri + "/")) return &r;
+  }
+  return nullptr;
+}
+
+void AsyncWebServer::simDispatch(AsyncWebServerRequest* request) {
+  if (const Route* r = match(request)) r->fn(request);
+  else if (notFound_) notFound_(request);
+}
+
+ArBodyHandlerFunction AsyncWebServer::simBodyHandler(const AsyncWebServerRequest* request) const {
+  const Route* r = match(request);
+  return r ? r->body : nullptr;
+}
+
+AsyncWebSocket* AsyncWebServer::simSocketFor(const String& url) const {
+  for (AsyncWebSocket* s : sockets_) {
+    if (!url.length() || s->url() == url) return s;
+  }
+  return nullptr;
+}
+
+// -------- sim controls --------
+
+namespace sim {
+
+uint16_t httpListen(uint16_t port) { return engine().listenOn(port); }
+
+void httpRequest(WebRequestMethodComposite method, const char* uri,
+                 std::initializer_list<std::pair<const char*, const char*>> args,
+                 std::initializer_list<std::pair<const char*, const char*>> headers) {
+  Engine& e = engine();
+  SimRequest req{method, uri, {}, {}};
+  for (const auto& a : args) req.args.push_back({a.first, a.second});
+  for (const auto& h : headers) req.headers.push_back({h.first, h.second});
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  e.simRequests.push_back(req);
+  e.wake();
+}
+
+HttpResponse lastHttpResponse() {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  return e.lastResponse;
+}
+
+void wsConnect(uint8_t num) {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  e.simWs.push_back({num, WS_EVT_CONNECT, String(), WS_TEXT});
+  e.wake();
+}
+
+void wsDisconnect(uint8_t num) {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  e.simWs.push_back({num, WS_EVT_DISCONNECT, String(), WS_TEXT});
+  e.wake();
+}
+
+void wsText(uint8_t num, const char* text) {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  e.simWs.push_back({num, WS_EVT_DATA, String(text), WS_TEXT});
+  e.wake();
+}
+
+void wsBinary(uint8_t num, const uint8_t* data, size_t len) {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  e.simWs.push_back({num, WS_EVT_DATA, String((const char*)data, (unsigned int)len), WS_BINARY});
+  e.wake();
+}
+
+void wsSetPaused(uint8_t num, bool paused) {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  AsyncWebSocket* ws = e.server ? e.server->simSocketFor(String()) : nullptr;
+  if (Conn* c = e.findClient(ws, num)) e.setPaused(*c, paused);
+}
+
+std::vector<String> wsTake(uint8_t num) {
+  Engine& e = engine();
+  std::lock_guard<std::recursive_mutex> lk(e.mu);
+  std::vector<String> out;
+  AsyncWebSocket* ws = e.server ? e.server->simSocketFor(String()) : nullptr;
+  if (Conn* c = e.findClient(ws, num)) {
+    out.assign(c->inbox.begin(), c->inbox.end());
+    c->inbox.clear();
+  }
+  return out;
+}
+
+} // namespace sim
@@ -0,0 +1,207 @@
+// src/native/sim_mqtt.cpp
+// PubSubClient against an in-process MQTT broker, for the host simulation.
+// One firmware client; the simulation plays every other client.
+
+#include <PubSubClient.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "hal.h"
+#include "sim.h"
+
+namespace {
+
+struct Published {
+  std::string topic;
+  std::string payload;
+  uint32_t atUs;
+};
+
+struct Broker {
+  std::mutex mu;
+  std::condition_variable cv;
+  bool up = true;
+  bool clientConnected = false;
+  std::string willTopic, willMessage;
+  bool willRetain = false;
+  std::vector<std::string> subscriptions;
+  std::deque<std::pair<std::string, std::string>> toClient;
+  std::map<std::string, std::string> retained;
+  std::vector<Published> published;   // everything the firmware sent
+};
+
+Broker& broker() {
+  static Broker b;
+  return b;
+}
+
+// MQTT topic filter match with '+' (one level) and '#' (rest)
+bool topicMatches(const std::string& filter, const std::string& topic) {
+  size_t f = 0, t = 0;
+  while (f < filter.size()) {
+    if (filter[f] == '#') return true;
+    if (filter[f] == '+') {
+      while (t < topic.size() && topic[t] != '/') t++;
+      f++;
+      continue;
+    }
+    if (t >= topic.size() || filter[f] != topic[t]) return false;
+    f++;
+    t++;
+  }
+  return t == topic.size();
+}
+
+// caller holds mu
+void dropClientLocked(Broker& b) {
+  if (!b.clientConnected) return;
+  b.clientConnected = false;
+  b.subscriptions.clear();
+  b.toClient.clear();
+  if (!b.willTopic.empty() && b.willRetain) b.retained[b.willTopic] = b.willMessage;
+}
+
+} // namespace
+
+PubSubClient& PubSubClient::setServer(const char*, uint16_t) { return *this; }
+
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+  callback_ = callback;
+  return *this;
+}
+
+bool PubSubClient::connect(const char*, const char*, const char*, const char* willTopic, uint8_t,
+                           bool willRetain, const char* willMessage) {
+  Broker& b = broker();
+  std::lock_guard<std::mutex> lk(b.mu);
+  if (!b.up || WiFi.status() != WL_CONNECTED) {
+    state_ = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  dropClientLocked(b);
+  b.clientConnected = true;
+  b.willTopic = willTopic ? willTopic : "";
+  b.willMessage = willMessage ? willMessage : "";
+  b.willRetain = willRetain;
+  state_ = MQTT_CONNECTED;
+  return true;
+}
+
+void PubSubClient::disconnect() {
+  Broker& b = broker();
+  std::lock_guard<std::mutex> lk(b.mu);
+  b.clientConnected = false;   // clean disconnect: no will
+  b.subscriptions.clear();
+  b.toClient.clear();
+  state_ = MQTT_DISCONNECTED;
+}
+
+bool PubSubClient::connected() {
+  Broker& b = broker();
+  std::lock_guard<std::mutex> lk(b.mu);
+  if (state_ == MQTT_CONNECTED && (!b.clientConnected || !b.up || WiFi.status() != WL_CONNECTED)) {
+    dropClientLocked(b);
+    state_ = MQTT_CONNECTION_LOST;
+  }
+  return state_ == MQTT_CONNECTED;
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, bool retained) {
+  if (!connected()) return false;
+  Broker& b = broker();
+  {
+    std::lock_guard<std::mutex> lk(b.mu);
+    b.published.push_back({topic, payload, hal::micros()});
+    if (retained) b.retained[topic] = payload;
+  }
+  b.cv.notify_all();
+  return true;
+}
+
+bool PubSubClient::subscribe(const char* topic, uint8_t) {
+  if (!connected()) return false;
+  Broker& b = broker();
+  std::lock_guard<std::mutex> lk(b.mu);
+  b.subscriptions.push_back(topic);
+  return true;
+}
+
+bool PubSubClient::loop() {
+  if (!connected()) return false;
+  Broker& b = broker();
+  std::deque<std::pair<std::string, std::string>> batch;
+  {
+    std::lock_guard<std::mutex> lk(b.mu);
+    batch.swap(b.toClient);
+  }
+  for (auto& m : batch) {
+    if (!callback_) continue;
+    std::vector<char> topic(m.first.begin(), m.first.end());
+    topic.push_back(0);
+    callback_(topic.data(), (uint8_t*)m.second.data(), (unsigned int)m.second.size());
+  }
+  return true;
+}
+
+namespace sim {
+
+void setMqttBrokerUp(bool up) {
+  Broker& b = broker();
+  std::lock_guard<std::mutex> lk(b.mu);
+  b.up = up;
+  if (!up) dropClientLocked(b);
+}
+
+bool mqttClientConnected() {
+  Broker& b = broker();
+  std::lock_guard<std::mutex> lk(b.mu);
+  return b.clientConnected;
+}
+
+void mqttInject(const char* topic, const char* payload) {
+  Broker& b = broker();
+  std::lock_guard<std::mutex> lk(b.mu);
+  if (!b.clientConnected) return;
+  for (const std::string& f : b.subscriptions) {
+    if (!topicMatches(f, topic)) continue;
+    b.toClient.push_back({topic, payload});
+    return;
+  }
+}
+
+String mqttRetained(const char* topic) {
+  Broker& b = broker();
+  std::lock_guard<std::mutex> lk(b.mu);
+  auto it = b.retained.find(topic);
+  return it == b.retained.end() ? String() : String(it->second);
+}
+
+uint32_t mqttPublishCount() {
+  Broker& b = broker();
+  std::lock_guard<std::mutex> lk(b.mu);
+  return (uint32_t)b.published.size();
+}
+
+bool mqttWaitPublish(const char* topic, uint32_t sinceUs, uint32_t timeoutMs, uint32_t* atUs, String* payload) {
+  Broker& b = broker();
+  std::unique_lock<std::mutex> lk(b.mu);
+  size_t scanned = 0;
+  auto found = [&] {
+    for (; scanned < b.published.size(); scanned++) {
+      const Published& p = b.published[scanned];
+      if (p.topic != topic || (int32_t)(p.atUs - sinceUs) < 0) continue;
+      if (atUs) *atUs = p.atUs;
+      if (payload) *payload = String(p.payload);
+      return true;
+    }
+    return false;
+  };
+  return b.cv.wait_for(lk, std::chrono::milliseconds(timeoutMs), found);
+}
+
+} // namespace sim
@@ -0,0 +1,192 @@
+// src/native/sim_net.cpp
+// WiFi for the host simulation.
+
+#include <WiFi.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "hal.h"
+#include "sim.h"
+
+// -------- WiFi --------
+
+WiFiClass WiFi;
+
+namespace {
+enum StaLink { STA_IDLE, STA_JOINING, STA_JOINED, STA_FAILED };
+const uint32_t STA_FAIL_MS = 3000;
+const uint8_t AP_BSSID[5] = {0x3C, 0x84, 0x6A, 0x5E, 0x10};   // + the last byte (setStaAp)
+std::atomic<bool> staReachable{false};
+std::atomic<StaLink> staLink{STA_IDLE};
+std::atomic<uint32_t> staJoinStartMs{0};
+std::atomic<uint32_t> staJoinMs{0};   // this join, from begin()
+std::atomic<uint32_t> staFailMs{STA_FAIL_MS};
+std::atomic<bool> staFound{false};    // begin() aimed where the router is
+std::atomic<uint32_t> reachableSinceMs{0};
+std::atomic<uint8_t> apChannel{6}, apBssidLast{0x01};
+std::atomic<uint32_t> scanPerChannelMs{120}, assocMs{150}, dhcpMs{600};
+std::atomic<uint32_t> staticIp{0};
+
+struct ScanEntry {
+  const char* ssid;
+  int32_t rssi;
+  wifi_auth_mode_t auth;
+};
+const ScanEntry SCAN_RESULTS[] = {
+  {"HomeNet", -48, WIFI_AUTH_WPA2_PSK},
+  {"HomeNet-IoT", -55, WIFI_AUTH_WPA2_PSK},
+  {"Neighbour", -81, WIFI_AUTH_WPA_PSK},
+  {"CafeGuest", -86, WIFI_AUTH_OPEN},
+};
+const int SCAN_COUNT = sizeof(SCAN_RESULTS) / sizeof(SCAN_RESULTS[0]);
+
+std::atomic<uint32_t> scanDurationMs{1500};
+std::atomic<bool> scanStarted{false};
+std::atomic<uint32_t> scanDoneAtMs{0};
+} // namespace
+
+bool WiFiClass::mode(wifi_mode_t m) {
+  mode_ = m;
+  if (!(m & WIFI_STA)) staLink = STA_IDLE;
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char*, const char*, int32_t channel, const uint8_t* bssid) {
+  if (!(mode_ & WIFI_STA)) mode_ = (wifi_mode_t)(mode_ | WIFI_STA);
+  uint32_t link = assocMs + (staticIp ? 0 : dhcpMs.load());
+  if (channel > 0) {
+    // directed: one channel, one BSSID; a miss is known after a few probes
+    staFound = channel == apChannel && (!bssid || (!memcmp(bssid, AP_BSSID, 5) && bssid[5] == apBssidLast));
+    staJoinMs = link;
+    staFailMs = 4 * scanPerChannelMs;
+  } else {
+    staFound = true;
+    staJoinMs = apChannel * scanPerChannelMs + link;
+    staFailMs = STA_FAIL_MS;
+  }
+  staLink = STA_JOINING;
+  staJoinStartMs = hal::millis();
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::config(IPAddress local, IPAddress, IPAddress, IPAddress, IPAddress) {
+  staticIp = (uint32_t)local;
+  return true;
+}
+
+bool WiFiClass::disconnect(bool wifioff) {
+  staLink = STA_IDLE;
+  if (wifioff) mode_ = (wifi_mode_t)(mode_ & ~WIFI_STA);
+  return true;
+}
+
+// A join succeeds staJoinMs after begin() or after the router came back,
+// whichever is later, or reports WL_NO_SSID_AVAIL after staFailMs (sooner for
+// a directed join that missed); a joined link drops when the router goes away
+// and stays down until the next begin().
+wl_status_t WiFiClass::status() const {
+  uint32_t now = hal::millis();
+  uint32_t elapsed = now - staJoinStartMs;
+  switch (staLink.load()) {
+    case STA_JOINING:
+      if (staReachable && staFound && elapsed >= staJoinMs && now - reachableSinceMs >= staJoinMs) {
+        staLink = STA_JOINED;
+        return WL_CONNECTED;
+      }
+      if ((!staReachable || !staFound) && elapsed >= staFailMs) { staLink = STA_FAILED; return WL_NO_SSID_AVAIL; }
+      return WL_DISCONNECTED;
+    case STA_JOINED:
+      if (staReachable) return WL_CONNECTED;
+      staLink = STA_IDLE;
+      return WL_CONNECTION_LOST;
+    case STA_FAILED:
+      return WL_NO_SSID_AVAIL;
+    default:
+      return WL_DISCONNECTED;
+  }
+}
+
+IPAddress WiFiClass::localIP() const {
+  if (status() != WL_CONNECTED) return IPAddress();
+  return staticIp ? IPAddress((uint32_t)staticIp) : IPAddress(192, 168, 1, 50);
+}
+
+IPAddress WiFiClass::gatewayIP() const { return status() == WL_CONNECTED ? IPAddress(192, 168, 1, 1) : IPAddress(); }
+IPAddress WiFiClass::subnetMask() const { return status() == WL_CONNECTED ? IPAddress(255, 255, 255, 0) : IPAddress(); }
+IPAddress WiFiClass::dnsIP(uint8_t) const { return status() == WL_CONNECTED ? IPAddress(192, 168, 1, 1) : IPAddress(); }
+
+uint8_t* WiFiClass::BSSID() {
+  memset(bssid_, 0, sizeof(bssid_));
+  if (status() == WL_CONNECTED) {
+    memcpy(bssid_, AP_BSSID, 5);
+    bssid_[5] = apBssidLast;
+  }
+  return bssid_;
+}
+
+int32_t WiFiClass::channel() const { return status() == WL_CONNECTED ? apChannel.load() : 0; }
+
+bool WiFiClass::softAP(const char*, const char*, int) {
+  mode_ = (wifi_mode_t)(mode_ | WIFI_AP);
+  return true;
+}
+
+bool WiFiClass::softAPdisconnect(bool wifioff) {
+  if (wifioff) mode_ = (wifi_mode_t)(mode_ & ~WIFI_AP);
+  return true;
+}
+
+uint8_t* WiFiClass::macAddress(uint8_t* mac) const {
+  static const uint8_t SIM_MAC[6] = {0x24, 0x6F, 0x28, 0x00, 0xBE, 0xEF};
+  memcpy(mac, SIM_MAC, 6);
+  return mac;
+}
+
+int16_t WiFiClass::scanNetworks(bool async) {
+  if (!async) {
+    hal::delayMs(scanDurationMs);
+    scanStarted = true;
+    scanDoneAtMs = hal::millis();
+    return SCAN_COUNT;
+  }
+  if (scanStarted && (int32_t)(hal::millis() - scanDoneAtMs) < 0) return WIFI_SCAN_RUNNING;
+  scanStarted = true;
+  scanDoneAtMs = hal::millis() + scanDurationMs;
+  return WIFI_SCAN_RUNNING;
+}
+
+int16_t WiFiClass::scanComplete() const {
+  if (!scanStarted) return WIFI_SCAN_FAILED;
+  return (int32_t)(hal::millis() - scanDoneAtMs) < 0 ? WIFI_SCAN_RUNNING : SCAN_COUNT;
+}
+
+String WiFiClass::SSID(uint8_t i) const { return i < SCAN_COUNT ? String(SCAN_RESULTS[i].ssid) : String(); }
+int32_t WiFiClass::RSSI(uint8_t i) const { return i < SCAN_COUNT ? SCAN_RESULTS[i].rssi : 0; }
+wifi_auth_mode_t WiFiClass::encryptionType(uint8_t i) const {
+  return i < SCAN_COUNT ? SCAN_RESULTS[i].auth : WIFI_AUTH_OPEN;
+}
+void WiFiClass::scanDelete() { scanStarted = false; }
+
+// -------- sim controls --------
+
+namespace sim {
+
+void setStaReachable(bool reachable) {
+  if (reachable && !staReachable) reachableSinceMs = hal::millis();
+  staReachable = reachable;
+}
+void setStaAp(uint8_t channel, uint8_t bssidLast) {
+  apChannel = channel;
+  apBssidLast = bssidLast;
+}
+void setStaTiming(uint32_t scanPerChannel, uint32_t assoc, uint32_t dhcp) {
+  scanPerChannelMs = scanPerChannel;
+  assocMs = assoc;
+  dhcpMs = dhcp;
+}
+void setScanDurationMs(uint32_t ms) { scanDurationMs = ms; }
+
+} // namespace sim
@@ -0,0 +1,242 @@
+// src/native/sim_ota.cpp
+// hal::ota* against two simulated app slots, hal::sha256* and
+// hal::hmacSha256 in plain C++ and hal::restart as a counter. Flash writes
+// sleep for what a typical 4 MB SPI NOR (W25Q32-class) takes: a 4 KB sector
+// erase when the writes reach a new sector, then 256-byte page programs. On
+// the board both cores stall meanwhile; here only the writing thread does.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string.h>
+#include <thread>
+
+#include "hal.h"
+#include "sim.h"
+
+namespace {
+
+const uint32_t SLOT_BYTES = 0x140000;
+const uint32_t SECTOR_BYTES = 4096;
+const uint32_t PAGE_BYTES = 256;
+const uint32_t SECTOR_ERASE_US = 45000;
+const uint32_t PAGE_PROGRAM_US = 400;
+const uint8_t IMAGE_MAGIC = 0xE9;         // ESP_IMAGE_HEADER_MAGIC
+
+std::mutex otaMu;
+std::vector<uint8_t> slots[2];
+bool slotValid[2] = {true, false};        // the running image came from somewhere
+int running = 0, bootSlot = 0;
+bool writing = false;
+uint32_t imageBytes = 0;
+bool flashTiming = true;
+bool confirmed = false;
+std::atomic<uint32_t> restartCalls{0};
+
+int spare() { return 1 - running; }
+
+// -------- SHA-256 (FIPS 180-4) --------
+
+const uint32_t K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+struct Sha256 {
+  uint32_t h[8];
+  uint8_t block[64];
+  size_t fill;
+  uint64_t bytes;
+};
+Sha256 sha;   // hal::sha256*: one hash at a time, as on the board
+
+inline uint32_t ror(uint32_t v, int n) { return (v >> n) | (v << (32 - n)); }
+
+void shaCompress(Sha256& ctx, const uint8_t* p) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  uint32_t* H = ctx.h;
+  uint32_t a = H[0], b = H[1], c = H[2], d = H[3], e = H[4], f = H[5], g = H[6], h = H[7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+    uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+  }
+  H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+  H[4] += e; H[5] += f; H[6] += g; H[7] += h;
+}
+
+void shaBegin(Sha256& ctx) {
+  static const uint32_t H0[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  memcpy(ctx.h, H0, sizeof(ctx.h));
+  ctx.fill = 0;
+  ctx.bytes = 0;
+}
+
+void shaUpdate(Sha256& ctx, const uint8_t* data, size_t len) {
+  ctx.bytes += len;
+  while (len) {
+    if (!ctx.fill && len >= 64) {
+      shaCompress(ctx, data);
+      data += 64;
+      len -= 64;
+      continue;
+    }
+    size_t n = std::min(len, 64 - ctx.fill);
+    memcpy(ctx.block + ctx.fill, data, n);
+    ctx.fill += n;
+    data += n;
+    len -= n;
+    if (ctx.fill == 64) {
+      shaCompress(ctx, ctx.block);
+      ctx.fill = 0;
+    }
+  }
+}
+
+void shaFinish(Sha256& ctx, uint8_t digest[32]) {
+  uint64_t bits = ctx.bytes * 8;
+  uint8_t pad[72] = {0x80};
+  size_t padLen = (ctx.fill < 56 ? 56 : 120) - ctx.fill;
+  for (int i = 0; i < 8; i++) pad[padLen + i] = (uint8_t)(bits >> (56 - 8 * i));
+  shaUpdate(ctx, pad, padLen + 8);
+  for (int i = 0; i < 8; i++) {
+    for (int j = 0; j < 4; j++) digest[4 * i + j] = (uint8_t)(ctx.h[i] >> (24 - 8 * j));
+  }
+}
+
+} // namespace
+
+namespace hal {
+
+bool otaBegin(uint32_t imageSize) {
+  std::lock_guard<std::mutex> lk(otaMu);
+  if (imageSize > SLOT_BYTES) return false;
+  slots[spare()].clear();
+  slotValid[spare()] = false;
+  writing = true;
+  imageBytes = imageSize;
+  return true;
+}
+
+bool otaWrite(const uint8_t* data, size_t len) {
+  uint32_t sleepUs = 0;
+  {
+    std::lock_guard<std::mutex> lk(otaMu);
+    std::vector<uint8_t>& s = slots[spare()];
+    if (!writing || s.size() + len > SLOT_BYTES) return false;
+    if (s.empty() && len && data[0] != IMAGE_MAGIC) return false;
+    if (flashTiming) {
+      uint32_t from = s.size(), to = from + len;
+      uint32_t newSectors = (to + SECTOR_BYTES - 1) / SECTOR_BYTES - (from + SECTOR_BYTES - 1) / SECTOR_BYTES;
+      sleepUs = newSectors * SECTOR_ERASE_US + (len + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_PROGRAM_US;
+    }
+    s.insert(s.end(), data, data + len);
+  }
+  std::this_thread::sleep_for(std::chrono::microseconds(sleepUs));
+  return true;
+}
+
+bool otaEnd() {
+  std::lock_guard<std::mutex> lk(otaMu);
+  if (!writing) return false;
+  writing = false;
+  if (slots[spare()].size() != imageBytes) return false;
+  slotValid[spare()] = true;
+  bootSlot = spare();
+  return true;
+}
+
+void otaAbort() {
+  std::lock_guard<std::mutex> lk(otaMu);
+  writing = false;
+}
+
+void otaConfirm() {
+  std::lock_guard<std::mutex> lk(otaMu);
+  confirmed = true;
+}
+
+bool otaRollback() {
+  std::lock_guard<std::mutex> lk(otaMu);
+  if (!slotValid[spare()]) return false;
+  bootSlot = spare();
+  return true;
+}
+
+void restart() { restartCalls.fetch_add(1); }
+
+void sha256Begin() { shaBegin(sha); }
+void sha256Update(const uint8_t* data, size_t len) { shaUpdate(sha, data, len); }
+void sha256Finish(uint8_t digest[32]) { shaFinish(sha, digest); }
+
+void hmacSha256(const uint8_t* key, size_t keyLen, const uint8_t* data, size_t len, uint8_t mac[32]) {
+  uint8_t k[64] = {};
+  if (keyLen > sizeof(k)) {
+    Sha256 kh;
+    shaBegin(kh);
+    shaUpdate(kh, key, keyLen);
+    shaFinish(kh, k);
+  } else {
+    memcpy(k, key, keyLen);
+  }
+  uint8_t pad[64], inner[32];
+  Sha256 ctx;
+  for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x36;
+  shaBegin(ctx);
+  shaUpdate(ctx, pad, sizeof(pad));
+  shaUpdate(ctx, data, len);
+  shaFinish(ctx, inner);
+  for (int i = 0; i < 64; i++) pad[i] = k[i] ^ 0x5c;
+  shaBegin(ctx);
+  shaUpdate(ctx, pad, sizeof(pad));
+  shaUpdate(ctx, inner, sizeof(inner));
+  shaFinish(ctx, mac);
+}
+
+} // namespace hal
+
+namespace sim {
+
+void setFlashTiming(bool on) {
+  std::lock_guard<std::mutex> lk(otaMu);
+  flashTiming = on;
+}
+
+std::vector<uint8_t> otaSlot(int slot) {
+  std::lock_guard<std::mutex> lk(otaMu);
+  return slots[slot & 1];
+}
+
+int otaBootSlot() {
+  std::lock_guard<std::mutex> lk(otaMu);
+  return bootSlot;
+}
+
+void otaBoot() {
+  std::lock_guard<std::mutex> lk(otaMu);
+  running = bootSlot;
+  confirmed = false;
+}
+
+bool otaConfirmed() {
+  std::lock_guard<std::mutex> lk(otaMu);
+  return confirmed;
+}
+
+uint32_t restarts() { return restartCalls.load(); }
+
+} // namespace sim
@@ -0,0 +1,187 @@
+// src/native/sim_peer.cpp
+// hal::peerRadio* as station 0 on a simulated ESP-NOW channel, and the
+// stations benchmarks add next to it (sim.h). The channel carries one frame
+// at a time: a frame starts once the previous one is off the air, takes
+// its air time at 1 Mbit/s (ESP-NOW's default rate) plus the gap before it,
+// and a unicast frame also waits for its ACK, or for the MAC's retries when
+// that is missed.
+
+#include <WiFi.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "hal.h"
+#include "sim.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const uint32_t PREAMBLE_US = 192;     // long PLCP preamble + header
+const size_t FRAME_OVERHEAD = 43;     // 802.11 header, vendor action header, FCS
+const uint32_t GAP_US = 50;           // DIFS + mean backoff
+const uint32_t ACK_US = 10 + 304;     // SIFS + the ACK frame
+const int MAC_RETRIES = 3;
+const int MAX_STATIONS = 32;
+
+struct Station {
+  bool used;
+  uint8_t mac[6];
+  sim::PeerStationRecv onRecv;   // nullptr for station 0 (halRecv)
+  void* ctx;
+};
+
+struct Delivery {
+  int to;
+  uint8_t from[6];
+  std::vector<uint8_t> data;
+};
+
+std::mutex mu;
+std::condition_variable wake;
+Station stations[MAX_STATIONS];
+int stationCount = 1;                 // 0 is the firmware's, used once peerRadioBegin runs
+hal::PeerRecvFn halRecv = nullptr;
+bool outOfRange[MAX_STATIONS][MAX_STATIONS];
+std::multimap<Clock::time_point, Delivery> inFlight;
+Clock::time_point airFreeAt;
+uint32_t latencyUs = 200;
+double lossRate = 0;
+std::mt19937 rng(1);
+std::uniform_real_distribution<double> unit(0, 1);
+sim::PeerAirStats stats;
+bool airRunning = false;
+
+// Delivers frames as they land, one at a time (the board's WiFi task).
+void airLoop() {
+  std::unique_lock<std::mutex> lk(mu);
+  for (;;) {
+    if (inFlight.empty()) {
+      wake.wait(lk);
+      continue;
+    }
+    auto next = inFlight.begin();
+    if (Clock::now() < next->first) {
+      wake.wait_until(lk, next->first);
+      continue;
+    }
+    Delivery d = std::move(next->second);
+    inFlight.erase(next);
+    Station to = stations[d.to];
+    hal::PeerRecvFn fw = halRecv;
+    lk.unlock();
+    if (to.onRecv) to.onRecv(to.ctx, d.from, d.data.data(), d.data.size());
+    else if (fw) fw(d.from, d.data.data(), d.data.size());
+    lk.lock();
+  }
+}
+
+bool missed() { return lossRate > 0 && unit(rng) < lossRate; }
+
+bool transmit(int from, const uint8_t mac[6], const uint8_t* data, size_t len) {
+  if (!len || len > hal::PEER_RADIO_FRAME_MAX) return false;
+  std::lock_guard<std::mutex> lk(mu);
+  if (from < 0 || from >= stationCount || !stations[from].used) return false;
+  if (!airRunning) {
+    std::thread(airLoop).detach();
+    airRunning = true;
+  }
+  static const uint8_t BROADCAST[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  bool broadcast = !memcmp(mac, BROADCAST, 6);
+  Clock::time_point t = std::max(Clock::now(), airFreeAt);
+  uint32_t frameUs = GAP_US + PREAMBLE_US + (uint32_t)(FRAME_OVERHEAD + len) * 8;
+  auto queue = [&](int to, Clock::time_point offAir) {
+    Delivery d{to, {}, std::vector<uint8_t>(data, data + len)};
+    memcpy(d.from, stations[from].mac, 6);
+    inFlight.emplace(offAir + std::chrono::microseconds(latencyUs), std::move(d));
+    stats.delivered++;
+  };
+  stats.frames++;
+  if (broadcast) {
+    t += std::chrono::microseconds(frameUs);
+    for (int i = 0; i < stationCount; i++) {
+      if (i == from || !stations[i].used || outOfRange[from][i]) continue;
+      if (missed()) stats.lost++;
+      else queue(i, t);
+    }
+  } else {
+    int to = -1;
+    for (int i = 0; i < stationCount; i++) {
+      if (i != from && stations[i].used && !memcmp(stations[i].mac, mac, 6)) to = i;
+    }
+    bool reachable = to >= 0 && !outOfRange[from][to];
+    for (int attempt = 0; attempt <= MAC_RETRIES; attempt++) {
+      t += std::chrono::microseconds(frameUs + ACK_US);
+      if (!reachable) continue;
+      if (missed()) {
+        stats.lost++;
+        continue;
+      }
+      queue(to, t);
+      break;
+    }
+  }
+  airFreeAt = t;
+  wake.notify_all();
+  return true;
+}
+
+} // namespace
+
+namespace hal {
+
+bool peerRadioBegin(PeerRecvFn onRecv) {
+  std::lock_guard<std::mutex> lk(mu);
+  WiFi.macAddress(stations[0].mac);
+  stations[0].used = true;
+  halRecv = onRecv;
+  return true;
+}
+
+bool peerRadioSend(const uint8_t mac[6], const uint8_t* data, size_t len) { return transmit(0, mac, data, len); }
+
+} // namespace hal
+
+namespace sim {
+
+int peerStationAdd(const uint8_t mac[6], PeerStationRecv onRecv, void* ctx) {
+  std::lock_guard<std::mutex> lk(mu);
+  if (stationCount == MAX_STATIONS) return -1;
+  Station& s = stations[stationCount];
+  memcpy(s.mac, mac, 6);
+  s.onRecv = onRecv;
+  s.ctx = ctx;
+  s.used = true;
+  return stationCount++;
+}
+
+bool peerStationSend(int station, const uint8_t mac[6], const uint8_t* data, size_t len) {
+  return station > 0 && transmit(station, mac, data, len);
+}
+
+void setPeerAir(uint32_t latency, double loss) {
+  std::lock_guard<std::mutex> lk(mu);
+  latencyUs = latency;
+  lossRate = loss;
+}
+
+void setPeerInRange(int a, int b, bool inRange) {
+  std::lock_guard<std::mutex> lk(mu);
+  if (a < 0 || b < 0 || a >= MAX_STATIONS || b >= MAX_STATIONS) return;
+  outOfRange[a][b] = outOfRange[b][a] = !inRange;
+}
+
+PeerAirStats peerAirStats() {
+  std::lock_guard<std::mutex> lk(mu);
+  return stats;
+}
+
+} // namespace sim
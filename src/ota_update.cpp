@@ -0,0 +1,361 @@
+// src/ota_update.cpp
+// Streaming firmware updates and trial boots (see include/ota_update.h).
+
+#include <Preferences.h>
+
+#include <atomic>
+#include <string.h>
+
+#include "config.h"
+#include "event_log.h"
+#include "hal.h"
+#include "ota_update.h"
+
+namespace {
+
+const char* const OTA_NS = "ota";
+const char* const TRIAL_KEY = "trial";   // boots of the image on trial so far
+const uint32_t OTA_POLL_MS = 100;
+// The HTTP handler runs on the AsyncTCP task, which feeds the task
+// watchdog: never block it anywhere near the 5 s timeout.
+const uint32_t OTA_HANDLER_WAIT_MS = 2000;
+
+enum OtaState : uint8_t {
+  OTA_IDLE,
+  OTA_RECEIVING,        // the handler fills buffers, the ota task writes them
+  OTA_FINISHING,        // last buffer queued: write, hash, check
+  OTA_RESTART_PENDING,  // verified and selected for the next boot
+};
+// abortWith while the ota task selects a verified image: too late to abort
+const uint8_t OTA_COMMITTING = 0xFF;
+
+// Sector buffers: filled in turn by the handler, written in turn by the ota
+// task; full[i] hands buffer i over and back.
+uint8_t buffers[OTA_BUFFERS][OTA_CHUNK];
+size_t bufferLen[OTA_BUFFERS];
+std::atomic<bool> full[OTA_BUFFERS];
+
+std::atomic<uint8_t> state{OTA_IDLE};
+std::atomic<uint8_t> result{OTA_OK};       // of the last upload, once it left RECEIVING/FINISHING
+std::atomic<uint8_t> abortWith{OTA_OK};    // the handler gives up: the ota task abandons the partition
+std::atomic<uint32_t> lastDataMs{0};
+
+// set by otaUploadStart before the state goes RECEIVING
+uint32_t imageSize = 0;
+uint8_t expected[32];
+uint32_t startMs = 0;
+
+// HTTP handler side (AsyncTCP task only)
+const void* owner = nullptr;
+const void* refusedOwner = nullptr;        // the last upload refused at start, and why
+OtaError refusedWhy = OTA_OK;
+int fillIndex = 0;
+size_t fillLen = 0;
+uint32_t received = 0;
+
+// net task
+Preferences store;
+bool trialArmed = false;                   // this update's trial key is in NVS
+std::atomic<bool> restartWanted{false};    // after a rollback
+uint32_t pendingSinceMs = 0;
+uint32_t healthySinceMs = 0;
+
+hal::TaskHandle otaTask = nullptr;
+std::atomic<uint32_t> uploads{0}, failures{0}, bytesWritten{0}, stallMs{0}, lastUploadMs{0};
+std::atomic<bool> onTrial{false};
+
+void fail(OtaError e, uint32_t written) {
+  hal::otaAbort();
+  failures.fetch_add(1, std::memory_order_relaxed);
+  logEvent(LOG_OTA_FAILED, e, written);
+  for (std::atomic<bool>& f : full) f.store(false, std::memory_order_relaxed);
+  result.store(e, std::memory_order_relaxed);
+  state.store(OTA_IDLE, std::memory_order_release);
+}
+
+// Owns the partition and the hash: writes full buffers in order and checks
+// the result once the handler has queued the last one.
+void otaTaskFn(void*) {
+  int next = 0;
+  uint32_t written = 0;
+  bool begun = false;
+  for (;;) {
+    hal::taskWait(OTA_POLL_MS);
+    uint8_t st = state.load(std::memory_order_acquire);
+    if (st != OTA_RECEIVING && st != OTA_FINISHING) continue;
+    if (!begun) {
+      next = 0;
+      written = 0;
+      bytesWritten.store(0, std::memory_order_relaxed);
+      if (!hal::otaBegin(imageSize)) { fail(OTA_ERR_SIZE, 0); continue; }
+      hal::sha256Begin();
+      begun = true;
+    }
+
+    OtaError err = OTA_OK;
+    while (!err && full[next].load(std::memory_order_acquire)) {
+      hal::sha256Update(buffers[next], bufferLen[next]);
+      // the first write is where the IDF checks the image header
+      if (!hal::otaWrite(buffers[next], bufferLen[next])) err = written ? OTA_ERR_FLASH : OTA_ERR_IMAGE;
+      written += bufferLen[next];
+      bytesWritten.store(written, std::memory_order_relaxed);
+      full[next].store(false, std::memory_order_release);
+      next = (next + 1) % OTA_BUFFERS;
+    }
+    if (!err) err = (OtaError)abortWith.exchange(OTA_OK);
+    if (!err && st == OTA_RECEIVING && hal::millis() - lastDataMs.load(std::memory_order_relaxed) >= OTA_STALL_MS) {
+      err = OTA_ERR_STALLED;
+    }
+    if (!err && st == OTA_FINISHING) {
+      uint8_t digest[32];
+      hal::sha256Finish(digest);
+      begun = false;
+      uint8_t clear = OTA_OK;
+      if (written != imageSize) err = OTA_ERR_ABORTED;
+      else if (memcmp(digest, expected, sizeof(digest))) err = OTA_ERR_DIGEST;
+      // the handler may have given up meanwhile; once this is claimed it waits instead
+      else if (!abortWith.compare_exchange_strong(clear, OTA_COMMITTING)) err = (OtaError)clear;
+      else if (!hal::otaEnd()) err = OTA_ERR_IMAGE;
+      if (!err) {
+        uint32_t ms = hal::millis() - startMs;
+        uploads.fetch_add(1, std::memory_order_relaxed);
+        lastUploadMs.store(ms, std::memory_order_relaxed);
+        logEvent(LOG_OTA_DONE, 0, written, ms);
+        result.store(OTA_OK, std::memory_order_relaxed);
+        state.store(OTA_RESTART_PENDING, std::memory_order_release);
+        continue;
+      }
+    }
+    if (err) {
+      if (begun) {
+        uint8_t scratch[32];
+        hal::sha256Finish(scratch);
+        begun = false;
+      }
+      fail(err, written);
+    }
+  }
+}
+
+// the refusal is answered by the request handler once the body is in
+OtaError refuse(const void* who, OtaError e) {
+  refusedOwner = who;
+  refusedWhy = e;
+  return e;
+}
+
+int hexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+void rollback(uint8_t boots, uint32_t ranMs) {
+  bool ok = hal::otaRollback();
+  logEvent(LOG_OTA_ROLLBACK, boots, ranMs, ok);
+  store.begin(OTA_NS, false);
+  store.remove(TRIAL_KEY);
+  store.end();
+  onTrial.store(false, std::memory_order_relaxed);
+  restartWanted.store(ok);   // no other image: keep running this one
+}
+
+} // namespace
+
+const char* otaErrorName(OtaError e) {
+  switch (e) {
+    case OTA_OK: return "ok";
+    case OTA_ERR_BUSY: return "busy";
+    case OTA_ERR_SIZE: return "bad size";
+    case OTA_ERR_DIGEST: return "sha256 mismatch";
+    case OTA_ERR_IMAGE: return "not a valid image";
+    case OTA_ERR_FLASH: return "flash error";
+    case OTA_ERR_STALLED: return "stalled";
+    case OTA_ERR_ABORTED: return "incomplete";
+  }
+  return "?";
+}
+
+bool otaParseDigest(const char* hex, uint8_t digest[32]) {
+  if (!hex || strlen(hex) != 64) return false;
+  for (int i = 0; i < 32; i++) {
+    int hi = hexDigit(hex[2 * i]), lo = hexDigit(hex[2 * i + 1]);
+    if (hi < 0 || lo < 0) return false;
+    digest[i] = (uint8_t)(hi << 4 | lo);
+  }
+  return true;
+}
+
+void otaUpdateBegin() {
+  store.begin(OTA_NS, false);
+  bool pending = store.isKey(TRIAL_KEY);
+  uint8_t boots = store.getUChar(TRIAL_KEY, 0) + 1;
+  if (pending && boots <= OTA_TRIAL_BOOTS) store.putUChar(TRIAL_KEY, boots);
+  store.end();
+  if (pending) {
+    healthySinceMs = 0;
+    if (boots > OTA_TRIAL_BOOTS) rollback(boots, 0);
+    else onTrial.store(true, std::memory_order_relaxed);
+  }
+  if (!otaTask) otaTask = hal::taskSpawn("ota", otaTaskFn, nullptr, 4096, 1, 0);
+}
+
+OtaError otaUploadStart(const void* who, uint32_t size, const uint8_t digest[32]) {
+  if (state.load(std::memory_order_acquire) != OTA_IDLE) {
+    if (who == owner) {
+      // the owner's connection is gone and its request's memory serves this one
+      owner = nullptr;
+      abortWith.store(OTA_ERR_ABORTED, std::memory_order_relaxed);
+      hal::taskNotify(otaTask);
+    }
+    return refuse(who, OTA_ERR_BUSY);
+  }
+  if (!size) return refuse(who, OTA_ERR_SIZE);
+  owner = who;
+  fillIndex = 0;
+  fillLen = 0;
+  received = 0;
+  imageSize = size;
+  memcpy(expected, digest, sizeof(expected));
+  startMs = hal::millis();
+  lastDataMs.store(startMs, std::memory_order_relaxed);
+  stallMs.store(0, std::memory_order_relaxed);
+  abortWith.store(OTA_OK, std::memory_order_relaxed);
+  for (std::atomic<bool>& f : full) f.store(false, std::memory_order_relaxed);
+  logEvent(LOG_OTA_START, 0, size);
+  state.store(OTA_RECEIVING, std::memory_order_release);
+  hal::taskNotify(otaTask);
+  return OTA_OK;
+}
+
+OtaError otaUploadData(const void* who, const uint8_t* data, size_t len) {
+  if (who != owner) return OTA_ERR_BUSY;
+  if (len > imageSize - received) {
+    abortWith.store(OTA_ERR_SIZE, std::memory_order_relaxed);
+    return OTA_ERR_SIZE;
+  }
+  bool waiting = false;
+  uint32_t waitStartMs = 0;
+  while (len) {
+    if (state.load(std::memory_order_acquire) != OTA_RECEIVING) return (OtaError)result.load(std::memory_order_relaxed);
+    if (full[fillIndex].load(std::memory_order_acquire)) {
+      // both buffers are waiting for flash: hold the connection for a bit
+      uint32_t now = hal::millis();
+      if (!waiting) {
+        waiting = true;
+        waitStartMs = now;
+      }
+      if (now - waitStartMs >= OTA_HANDLER_WAIT_MS) {
+        abortWith.store(OTA_ERR_FLASH, std::memory_order_relaxed);
+        hal::taskNotify(otaTask);
+        return OTA_ERR_FLASH;
+      }
+      hal::delayMs(1);
+      continue;
+    }
+    if (waiting) {
+      stallMs.fetch_add(hal::millis() - waitStartMs, std::memory_order_relaxed);
+      waiting = false;
+    }
+    size_t n = len < OTA_CHUNK - fillLen ? len : OTA_CHUNK - fillLen;
+    memcpy(buffers[fillIndex] + fillLen, data, n);
+    fillLen += n;
+    data += n;
+    len -= n;
+    received += n;
+    lastDataMs.store(hal::millis(), std::memory_order_relaxed);
+    if (fillLen == OTA_CHUNK) {
+      bufferLen[fillIndex] = fillLen;
+      full[fillIndex].store(true, std::memory_order_release);
+      hal::taskNotify(otaTask);
+      fillIndex = (fillIndex + 1) % OTA_BUFFERS;
+      fillLen = 0;
+    }
+  }
+  return OTA_OK;
+}
+
+OtaError otaUploadFinish(const void* who) {
+  if (who != owner) return who == refusedOwner ? refusedWhy : OTA_ERR_BUSY;
+  owner = nullptr;
+  if (state.load(std::memory_order_acquire) != OTA_RECEIVING) return (OtaError)result.load(std::memory_order_relaxed);
+  if (received != imageSize) {
+    abortWith.store(OTA_ERR_ABORTED, std::memory_order_relaxed);
+    hal::taskNotify(otaTask);
+    return OTA_ERR_ABORTED;
+  }
+  // queue the partial last buffer (waiting for it to be free first)
+  for (uint32_t t0 = hal::millis(); fillLen && full[fillIndex].load(std::memory_order_acquire);) {
+    if (hal::millis() - t0 >= OTA_HANDLER_WAIT_MS) {
+      abortWith.store(OTA_ERR_FLASH, std::memory_order_relaxed);
+      hal::taskNotify(otaTask);
+      return OTA_ERR_FLASH;
+    }
+    hal::delayMs(1);
+  }
+  if (fillLen) {
+    bufferLen[fillIndex] = fillLen;
+    full[fillIndex].store(true, std::memory_order_release);
+  }
+  state.store(OTA_FINISHING, std::memory_order_release);
+  hal::taskNotify(otaTask);
+  for (uint32_t t0 = hal::millis(); hal::millis() - t0 < OTA_HANDLER_WAIT_MS;) {
+    uint8_t st = state.load(std::memory_order_acquire);
+    if (st == OTA_RESTART_PENDING) return OTA_OK;
+    if (st == OTA_IDLE) return (OtaError)result.load(std::memory_order_relaxed);
+    hal::delayMs(2);
+  }
+  // still writing or checking: drop it rather than hold the AsyncTCP task,
+  // unless the ota task is already selecting the image (only the IDF's
+  // image check is left): then its outcome is the answer
+  uint8_t clear = OTA_OK;
+  if (abortWith.compare_exchange_strong(clear, OTA_ERR_FLASH)) {
+    hal::taskNotify(otaTask);
+    return OTA_ERR_FLASH;
+  }
+  while (state.load(std::memory_order_acquire) == OTA_FINISHING) hal::delayMs(2);
+  return state.load(std::memory_order_acquire) == OTA_RESTART_PENDING ? OTA_OK
+                                                                      : (OtaError)result.load(std::memory_order_relaxed);
+}
+
+bool otaUpdateTick(bool healthy) {
+  uint32_t now = hal::millis();
+  if (restartWanted.exchange(false)) return true;
+  if (state.load(std::memory_order_acquire) == OTA_RESTART_PENDING) {
+    if (!trialArmed) {
+      // the new image is on trial from its first boot, even if power goes now
+      store.begin(OTA_NS, false);
+      store.putUChar(TRIAL_KEY, 0);
+      store.end();
+      trialArmed = true;
+      onTrial.store(false, std::memory_order_relaxed);   // this image is on its way out
+      pendingSinceMs = now;
+    }
+    if (now - pendingSinceMs < OTA_RESTART_DELAY_MS) return false;
+    // on the board the restart does not return; the host build carries on
+    trialArmed = false;
+    state.store(OTA_IDLE, std::memory_order_release);
+    return true;
+  }
+  if (!onTrial.load(std::memory_order_relaxed)) return false;
+  if (!healthy) healthySinceMs = 0;
+  else if (!healthySinceMs) healthySinceMs = now | 1;
+  if (healthySinceMs && now - healthySinceMs >= OTA_CONFIRM_MS) {
+    store.begin(OTA_NS, false);
+    store.remove(TRIAL_KEY);
+    store.end();
+    hal::otaConfirm();
+    onTrial.store(false, std::memory_order_relaxed);
+    logEvent(LOG_OTA_CONFIRMED, 0, now);
+  } else if (now >= OTA_TRIAL_TIMEOUT_MS) {
+    rollback(0, now);   // restarts on the next tick
+  }
+  return false;
+}
+
+OtaStats otaStats() {
+  return {uploads.load(std::memory_order_relaxed), failures.load(std::memory_order_relaxed),
+          bytesWritten.load(std::memory_order_relaxed), stallMs.load(std::memory_order_relaxed),
+          lastUploadMs.load(std::memory_order_relaxed), onTrial.load(std::memory_order_relaxed)};
+}
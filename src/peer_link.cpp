@@ -0,0 +1,499 @@
+// src/peer_link.cpp
+// ESP-NOW peer link between controllers: the protocol (PeerLink) and the
+// firmware's node (see include/peer_link.h).
+
+#include <Preferences.h>
+#include <WiFi.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mutex>
+
+#include "event_log.h"
+#include "hal.h"
+#include "peer_link.h"
+#include "relay_timers.h"
+#include "state_json.h"
+
+namespace {
+
+// Frames, little-endian (ESP32 and x86 alike). Every frame starts with the
+// header; origin + seq name it, and seq only ever grows (kept over reboots,
+// see SEQ_BLOCK), so a frame no newer than the last one taken from its
+// origin is a replay. hops counts the nodes that passed it on. On the air
+// each is followed by FRAME_TAG bytes of its HMAC, which a node that passes
+// it on signs again (hops changed).
+const uint8_t FRAME_MAGIC = 0xE5;
+enum FrameType : uint8_t { FRAME_STATE = 1, FRAME_COMMAND, FRAME_ACK };
+
+struct FrameHeader {
+  uint8_t magic;
+  uint8_t network;     // PEER_NETWORK_ID
+  uint8_t type;        // FrameType
+  uint8_t hops;
+  uint16_t origin;     // node that sent it first
+  uint8_t pad[2];
+  uint32_t seq;        // origin's frame number
+};
+struct StateFrame {    // broadcast on change and as the heartbeat
+  FrameHeader h;
+  uint8_t relays;
+  uint8_t pad[3];
+  uint32_t state;
+};
+struct CommandFrame {
+  FrameHeader h;
+  uint16_t dst;        // owner of the relay
+  uint8_t relay;
+  uint8_t op;          // RelayOp: off, on or toggle
+  uint32_t id;         // seq of the first send: the same for every resend
+};
+struct AckFrame {
+  FrameHeader h;
+  uint16_t dst;        // node that sent the command
+  uint8_t result;      // PeerError
+  uint8_t pad;
+  uint32_t id;
+};
+static_assert(sizeof(FrameHeader) == 12 && sizeof(StateFrame) == 20 && sizeof(CommandFrame) == 20 &&
+              sizeof(AckFrame) == 20, "wire format");
+static_assert(offsetof(CommandFrame, dst) == offsetof(AckFrame, dst), "routed on dst alike");
+const size_t FRAME_MAX = sizeof(StateFrame);
+const size_t FRAME_TAG = 8;
+static_assert(FRAME_MAX + FRAME_TAG <= hal::PEER_RADIO_FRAME_MAX, "fits one ESP-NOW frame");
+
+const uint8_t BROADCAST[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+// copies of a frame stop circulating within a few air times
+const uint32_t SEEN_KEEP_MS = 2000;
+const uint32_t APPLIED_KEEP_MS = 1000;   // past the last resend of a command
+// seq numbers are reserved (Hooks::reserve) this many at a time: one NVS
+// write per ~30 min of heartbeats, and a reboot skips at most this many
+const uint32_t SEQ_BLOCK = 1024;
+
+size_t frameSize(uint8_t type) {
+  switch (type) {
+    case FRAME_STATE: return sizeof(StateFrame);
+    case FRAME_COMMAND: return sizeof(CommandFrame);
+    case FRAME_ACK: return sizeof(AckFrame);
+  }
+  return 0;
+}
+
+} // namespace
+
+const char* peerErrorName(PeerError e) {
+  static const char* const NAMES[] = {"ok", "unknown node", "bad relay", "busy", "no answer"};
+  return e < sizeof(NAMES) / sizeof(NAMES[0]) ? NAMES[e] : "?";
+}
+
+// True if the frame was handled before; remembers it otherwise.
+bool PeerLink::seen(uint16_t origin, uint32_t seq, uint32_t nowMs) {
+  for (const Seen& s : seen_) {
+    if (s.origin == origin && s.seq == seq && nowMs - s.ms < SEEN_KEEP_MS) return true;
+  }
+  seen_[seenNext_] = {origin, seq, nowMs};
+  seenNext_ = (seenNext_ + 1) % SEEN_MAX;
+  return false;
+}
+
+// True if seq is past the last one taken from `origin`, which it becomes.
+// An origin not in the table takes the slot heard from longest ago.
+bool PeerLink::fresh(uint16_t origin, uint32_t seq, uint32_t nowMs) {
+  Origin* slot = &origins_[0];
+  for (Origin& o : origins_) {
+    if (o.used && o.node == origin) {
+      if (seq <= o.seq) return false;
+      slot = &o;
+      break;
+    }
+    if (!o.used || (slot->used && nowMs - o.ms > nowMs - slot->ms)) slot = &o;
+  }
+  *slot = {true, origin, seq, nowMs};
+  return true;
+}
+
+uint32_t PeerLink::nextSeq() {
+  if (seq_ == reserved_) {
+    reserved_ = seq_ + SEQ_BLOCK;
+    if (hooks_.reserve) hooks_.reserve(hooks_.ctx, reserved_);
+  }
+  return seq_++;
+}
+
+PeerLink::Peer* PeerLink::heard(uint16_t node, const uint8_t mac[6], uint8_t hops, uint32_t nowMs) {
+  Peer* p = const_cast<Peer*>(peer(node));
+  if (!p) {
+    if (peerCount_ == MAX_PEERS) return nullptr;   // tick() makes room as peers go silent
+    p = &peers_[peerCount_++];
+    *p = Peer{};
+    p->node = node;
+    if (hooks_.peer) hooks_.peer(hooks_.ctx, node, true);
+  }
+  p->heardMs = nowMs;
+  if (hops == 0) {
+    memcpy(p->mac, mac, 6);
+    p->direct = true;
+    p->directMs = nowMs;
+  }
+  p->hops = p->direct ? 0 : hops;
+  return p;
+}
+
+const PeerLink::Applied* PeerLink::findApplied(uint16_t origin, uint32_t id, uint32_t nowMs) const {
+  for (const Applied& a : applied_) {
+    if (a.origin == origin && a.id == id && nowMs - a.ms < APPLIED_KEEP_MS) return &a;
+  }
+  return nullptr;
+}
+
+const PeerLink::Peer* PeerLink::peer(uint16_t node) const {
+  for (int i = 0; i < peerCount_; i++) {
+    if (peers_[i].node == node) return &peers_[i];
+  }
+  return nullptr;
+}
+
+int PeerLink::peers(Peer* out, int max) const {
+  int n = peerCount_ < max ? peerCount_ : max;
+  memcpy(out, peers_, n * sizeof(Peer));
+  return n;
+}
+
+void PeerLink::sign(const uint8_t* frame, size_t len, uint8_t* tag) const {
+  uint8_t mac[32];
+  hal::hmacSha256(key_, keyLen_, frame, len, mac);
+  memcpy(tag, mac, FRAME_TAG);
+}
+
+void PeerLink::sendFrame(const uint8_t mac[6], const void* frame, size_t len) {
+  uint8_t wire[FRAME_MAX + FRAME_TAG];
+  memcpy(wire, frame, len);
+  sign(wire, len, wire + len);
+  if (hooks_.send(hooks_.ctx, mac, wire, len + FRAME_TAG)) stats_.sent++;
+}
+
+// Unicast to `dst` if allowed and it is heard first hand, else broadcast
+// for the nodes in between to pass on.
+void PeerLink::route(uint16_t dst, const void* frame, size_t len, bool unicast) {
+  const Peer* p = unicast ? peer(dst) : nullptr;
+  sendFrame(p && p->direct ? p->mac : BROADCAST, frame, len);
+}
+
+// Passes on a frame of another node's (dst 0: to everyone).
+void PeerLink::forward(uint16_t dst, uint8_t* frame, size_t len) {
+  FrameHeader h;
+  memcpy(&h, frame, sizeof(h));
+  if (h.hops >= PEER_MAX_HOPS) return;
+  h.hops++;
+  memcpy(frame, &h, sizeof(h));
+  stats_.forwarded++;
+  route(dst, frame, len, dst != 0);
+}
+
+// The first send goes straight to the owner if it can; resends are
+// broadcast, in case the direct path is what failed.
+void PeerLink::sendCommand(Pending& p) {
+  CommandFrame f = {};
+  f.h = {FRAME_MAGIC, PEER_NETWORK_ID, FRAME_COMMAND, 0, node_, {}, nextSeq()};
+  if (!p.tries) p.id = f.h.seq;
+  f.dst = p.node;
+  f.id = p.id;
+  f.relay = p.relay;
+  f.op = p.op;
+  route(p.node, &f, sizeof(f), p.tries == 0);
+  p.tries++;
+}
+
+void PeerLink::sendAck(uint16_t dst, uint32_t id, PeerError result) {
+  AckFrame f = {};
+  f.h = {FRAME_MAGIC, PEER_NETWORK_ID, FRAME_ACK, 0, node_, {}, nextSeq()};
+  f.dst = dst;
+  f.id = id;
+  f.result = result;
+  route(dst, &f, sizeof(f), true);
+}
+
+void PeerLink::receive(const uint8_t mac[6], const uint8_t* data, size_t len, uint32_t nowMs) {
+  FrameHeader h;
+  size_t size = len >= sizeof(h) ? (memcpy(&h, data, sizeof(h)), frameSize(h.type)) : 0;
+  if (!size || len < size + FRAME_TAG || h.magic != FRAME_MAGIC || h.network != PEER_NETWORK_ID) {
+    stats_.foreign++;
+    return;
+  }
+  // nothing below (peer list, duplicates, apply, forward) sees a frame
+  // that was not signed with our key
+  uint8_t tag[FRAME_TAG], diff = 0;
+  sign(data, size, tag);
+  for (size_t i = 0; i < FRAME_TAG; i++) diff |= tag[i] ^ data[size + i];
+  if (diff) {
+    stats_.forged++;
+    return;
+  }
+  stats_.received++;
+  if (h.origin == node_) return;   // ours, passed back by a node in between
+  if (seen(h.origin, h.seq, nowMs)) {
+    stats_.duplicates++;
+    return;
+  }
+  if (!fresh(h.origin, h.seq, nowMs)) {
+    stats_.stale++;
+    return;
+  }
+  Peer* p = heard(h.origin, mac, h.hops, nowMs);
+  uint8_t frame[FRAME_MAX];
+  memcpy(frame, data, size);
+
+  if (h.type == FRAME_STATE) {
+    StateFrame f;
+    memcpy(&f, frame, sizeof(f));
+    if (p) {
+      p->relays = f.relays;
+      p->state = f.state;
+    }
+    forward(0, frame, size);
+  } else if (h.type == FRAME_COMMAND) {
+    CommandFrame f;
+    memcpy(&f, frame, sizeof(f));
+    if (f.dst != node_) {
+      forward(f.dst, frame, size);
+      return;
+    }
+    // a resend of a command applied already is only acknowledged again; one
+    // refused for a full queue is tried again
+    PeerError result;
+    if (const Applied* a = findApplied(h.origin, f.id, nowMs)) {
+      result = a->result;
+      stats_.repeats++;
+    } else {
+      result = f.op <= RELAY_OP_TOGGLE ? hooks_.apply(hooks_.ctx, h.origin, f.relay, (RelayOp)f.op) : PEER_BAD_RELAY;
+      if (result == PEER_OK) stats_.applied++;
+      if (result != PEER_BUSY) {
+        applied_[appliedNext_] = {h.origin, f.id, result, nowMs};
+        appliedNext_ = (appliedNext_ + 1) % APPLIED_MAX;
+      }
+    }
+    sendAck(h.origin, f.id, result);
+  } else {
+    AckFrame f;
+    memcpy(&f, frame, sizeof(f));
+    if (f.dst != node_) {
+      forward(f.dst, frame, size);
+      return;
+    }
+    for (Pending& c : pending_) {
+      if (!c.used || c.node != h.origin || c.id != f.id) continue;
+      c.used = false;
+      stats_.answered++;
+      if (hooks_.done) hooks_.done(hooks_.ctx, c.node, c.relay, (PeerError)f.result, nowMs - c.issuedMs);
+      break;
+    }
+  }
+}
+
+PeerError PeerLink::command(uint16_t node, uint8_t relay, RelayOp op, uint32_t nowMs) {
+  const Peer* p = peer(node);
+  if (!p) return PEER_UNKNOWN_NODE;
+  if (relay < 1 || relay > p->relays || op > RELAY_OP_TOGGLE) return PEER_BAD_RELAY;
+  for (Pending& c : pending_) {
+    if (c.used) continue;
+    c = Pending{true, node, 0, relay, op, 0, nowMs, nowMs};
+    sendCommand(c);
+    stats_.commands++;
+    return PEER_OK;
+  }
+  return PEER_BUSY;
+}
+
+void PeerLink::tick(uint32_t nowMs, uint32_t state, uint8_t relays) {
+  if (!stateSent_ || state != sentState_ || relays != sentRelays_ || nowMs - sentMs_ >= PEER_HEARTBEAT_MS) {
+    StateFrame f = {};
+    f.h = {FRAME_MAGIC, PEER_NETWORK_ID, FRAME_STATE, 0, node_, {}, nextSeq()};
+    f.relays = relays;
+    f.state = state;
+    sendFrame(BROADCAST, &f, sizeof(f));
+    stateSent_ = true;
+    sentState_ = state;
+    sentRelays_ = relays;
+    sentMs_ = nowMs;
+  }
+
+  for (Pending& c : pending_) {
+    if (!c.used || nowMs - c.sentMs < PEER_RETRY_MS) continue;
+    if (c.tries > PEER_RETRIES) {
+      c.used = false;
+      stats_.unanswered++;
+      if (hooks_.done) hooks_.done(hooks_.ctx, c.node, c.relay, PEER_NO_ANSWER, nowMs - c.issuedMs);
+      continue;
+    }
+    stats_.resends++;
+    c.sentMs = nowMs;
+    sendCommand(c);
+  }
+
+  for (int i = 0; i < peerCount_;) {
+    Peer& p = peers_[i];
+    if (nowMs - p.heardMs >= PEER_TIMEOUT_MS) {
+      if (hooks_.peer) hooks_.peer(hooks_.ctx, p.node, false);
+      p = peers_[--peerCount_];
+      continue;
+    }
+    if (p.direct && nowMs - p.directMs >= PEER_TIMEOUT_MS) p.direct = false;
+    i++;
+  }
+}
+
+// -------- the firmware's node --------
+
+namespace {
+
+const char* const PEER_NS = "peer";
+const char* const SEQ_KEY = "seq";       // where this node's next boot starts numbering frames
+
+// receive() runs on the WiFi task, tick() on the net task and command() on
+// whichever task took the request
+std::mutex mu;
+PeerLink* here = nullptr;
+uint16_t selfNode = 0;
+
+bool radioSend(void*, const uint8_t mac[6], const uint8_t* frame, size_t len) {
+  return hal::peerRadioSend(mac, frame, len);
+}
+
+PeerError applyHere(void*, uint16_t from, uint8_t relay, RelayOp op) {
+  if (relay < 1 || relay > NUM_RELAYS) return PEER_BAD_RELAY;
+  if (!submitRelayCommand(relay, op, SRC_PEER)) return PEER_BUSY;
+  logEvent(LOG_PEER_COMMAND, relay, from, op);
+  return PEER_OK;
+}
+
+void answered(void*, uint16_t node, uint8_t relay, PeerError result, uint32_t ms) {
+  logEvent(LOG_PEER_ANSWER, result, node, (uint32_t)relay << 16 | (ms < 0xFFFF ? ms : 0xFFFF));
+}
+
+void peerUpDown(void*, uint16_t node, bool up) { logEvent(LOG_PEER, up, node); }
+
+// Written before the numbers are used: a reboot never sends an old seq.
+void reserveSeq(void*, uint32_t upTo) {
+  Preferences store;
+  store.begin(PEER_NS, false);
+  store.putUInt(SEQ_KEY, upTo);
+  store.end();
+}
+
+void onRadio(const uint8_t mac[6], const uint8_t* data, size_t len) {
+  std::lock_guard<std::mutex> lk(mu);
+  if (here) here->receive(mac, data, len, hal::millis());
+}
+
+void writeRelayList(state_json::Writer& w, uint32_t mask, int relays) {
+  w.raw("[");
+  bool first = true;
+  for (int r = 1; r <= relays; r++) {
+    if (!(mask >> (r - 1) & 1)) continue;
+    if (!first) w.raw(",");
+    first = false;
+    w.uinteger(r);
+  }
+  w.raw("]");
+}
+
+size_t errorReply(char* reply, size_t cap, PeerError e) {
+  state_json::Writer w(reply, cap);
+  w.raw("{\"peer_error\":"); w.string(peerErrorName(e)); w.raw("}");
+  return w.finish();
+}
+
+} // namespace
+
+void peerLinkBegin() {
+  if (!PEER_KEY[0]) {
+    logEvent(LOG_PEER, 3, 0);
+    return;
+  }
+  uint16_t node = PEER_NODE_ID;
+  if (!node) {
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    node = mac[4] << 8 | mac[5];
+    if (!node) node = 1;
+  }
+  Preferences store;
+  store.begin(PEER_NS, true);
+  uint32_t seq = store.getUInt(SEQ_KEY, 0);
+  store.end();
+  std::lock_guard<std::mutex> lk(mu);
+  static PeerLink instance(node, {nullptr, radioSend, applyHere, answered, peerUpDown, reserveSeq}, PEER_KEY, seq);
+  here = &instance;
+  selfNode = node;
+  if (!hal::peerRadioBegin(onRadio)) logEvent(LOG_PEER, 2, node);
+}
+
+void peerLinkTick() {
+  std::lock_guard<std::mutex> lk(mu);
+  if (here) here->tick(hal::millis(), relayStateMask(), NUM_RELAYS);
+}
+
+uint16_t peerLinkNode() { return selfNode; }
+
+PeerError peerCommand(uint16_t node, uint8_t relay, RelayOp op, CommandSource source) {
+  if (node == selfNode) {
+    if (relay < 1 || relay > NUM_RELAYS || op > RELAY_OP_TOGGLE) return PEER_BAD_RELAY;
+    return submitRelayCommand(relay, op, source) ? PEER_OK : PEER_BUSY;
+  }
+  std::lock_guard<std::mutex> lk(mu);
+  return here ? here->command(node, relay, op, hal::millis()) : PEER_UNKNOWN_NODE;
+}
+
+PeerLink::Stats peerLinkStats() {
+  std::lock_guard<std::mutex> lk(mu);
+  return here ? here->stats() : PeerLink::Stats{};
+}
+
+size_t peersJson(char* out, size_t cap) {
+  PeerLink::Peer peers[PeerLink::MAX_PEERS];
+  int n = 0;
+  uint32_t now;
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    now = hal::millis();
+    if (here) n = here->peers(peers, PeerLink::MAX_PEERS);
+  }
+  state_json::Writer w(out, cap);
+  w.raw("{\"node\":"); w.uinteger(selfNode);
+  w.raw(",\"peers\":[");
+  for (int i = 0; i < n; i++) {
+    const PeerLink::Peer& p = peers[i];
+    if (i) w.raw(",");
+    w.raw("{\"node\":"); w.uinteger(p.node);
+    w.raw(",\"relays\":"); w.uinteger(p.relays);
+    w.raw(",\"on\":"); writeRelayList(w, p.state, p.relays);
+    w.raw(",\"age_ms\":"); w.uinteger(now - p.heardMs);
+    w.raw(",\"hops\":"); w.uinteger(p.hops);
+    w.raw("}");
+  }
+  w.raw("]}");
+  return w.finish();
+}
+
+size_t peersCommand(const char* text, size_t len, char* reply, size_t cap) {
+  char buf[32];
+  if (len >= sizeof(buf)) return 0;
+  memcpy(buf, text, len);
+  buf[len] = 0;
+  if (!strcmp(buf, "peers")) return peersJson(reply, cap);
+  if (strncmp(buf, "peer:", 5)) return 0;
+
+  char* end;
+  unsigned long node = strtoul(buf + 5, &end, 10);
+  if (end == buf + 5 || *end != ':' || !node || node > 0xFFFF) return errorReply(reply, cap, PEER_UNKNOWN_NODE);
+  const char* relayText = end + 1;
+  unsigned long relay = strtoul(relayText, &end, 10);
+  RelayOp op = RELAY_OP_TOGGLE;
+  if (end == relayText || relay > 32 || (*end && (*end != ':' || !relayTimerParseOp(end + 1, op))))
+    return errorReply(reply, cap, PEER_BAD_RELAY);
+  PeerError e = peerCommand((uint16_t)node, (uint8_t)relay, op, SRC_WS);
+  if (e != PEER_OK) return errorReply(reply, cap, e);
+  state_json::Writer w(reply, cap);
+  w.raw("{\"peer_sent\":"); w.uinteger(node); w.raw("}");
+  return w.finish();
+}
@@ -0,0 +1,81 @@
+// src/power_manager.cpp
+// Supply detection and power profiles (see include/power_manager.h).
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "event_log.h"
+#include "hal.h"
+#include "power_manager.h"
+
+namespace {
+
+const uint32_t MAINS_MAX_MHZ = 240;
+const uint32_t BACKUP_MAX_MHZ = 80;    // lowest clock WiFi still runs at
+const uint32_t BACKUP_MIN_MHZ = 40;    // XTAL: what DFS drops to between wakes
+const uint32_t BATTERY_READ_MS = 1000;
+const uint32_t BATTERY_DIVIDER = 2;
+
+std::atomic<uint8_t> source{POWER_MAINS};
+std::atomic<uint32_t> batteryMv{0};
+
+// net task only
+bool railSeen = true;          // last raw level of the sense pin
+uint32_t railSinceMs = 0;      // ...and when it last changed
+uint32_t nextBatteryMs = 0;
+
+bool railHigh() { return POWER_SENSE_PIN < 0 || hal::gpioRead(POWER_SENSE_PIN); }
+
+void applyProfile(PowerSource s) {
+  if (s == POWER_BACKUP) {
+    WiFi.setSleep(true);   // WIFI_PS_MIN_MODEM: wake for every DTIM beacon
+    hal::powerConfigure(BACKUP_MAX_MHZ, BACKUP_MIN_MHZ, true);
+  } else {
+    WiFi.setSleep(false);
+    hal::powerConfigure(MAINS_MAX_MHZ, MAINS_MAX_MHZ, false);
+  }
+  source.store(s, std::memory_order_relaxed);
+}
+
+} // namespace
+
+void powerManagerBegin() {
+  if (POWER_SENSE_PIN >= 0) hal::pinSetup(POWER_SENSE_PIN, hal::PIN_MODE_INPUT);
+  if (BATTERY_SENSE_PIN >= 0) hal::pinSetup(BATTERY_SENSE_PIN, hal::PIN_MODE_INPUT);
+  // boot straight into the right profile: no debounce, the rail has settled by now
+  railSeen = railHigh();
+  railSinceMs = hal::millis();
+  nextBatteryMs = railSinceMs + BATTERY_READ_MS;
+  applyProfile(railSeen ? POWER_MAINS : POWER_BACKUP);
+  if (!railSeen) logEvent(LOG_POWER_BACKUP);
+}
+
+void powerManagerTick() {
+  uint32_t now = hal::millis();
+  bool high = railHigh();
+  if (high != railSeen) {
+    railSeen = high;
+    railSinceMs = now;
+  }
+  PowerSource cur = powerSource();
+  PowerSource want = railSeen ? POWER_MAINS : POWER_BACKUP;
+  uint32_t hold = want == POWER_BACKUP ? POWER_BACKUP_DEBOUNCE_MS : POWER_MAINS_DEBOUNCE_MS;
+  if (want != cur && now - railSinceMs >= hold) {
+    applyProfile(want);
+    logEvent(want == POWER_BACKUP ? LOG_POWER_BACKUP : LOG_POWER_MAINS, 0, now - railSinceMs);
+    // the IR task gives ADC1 up within one period; read the cell after that
+    nextBatteryMs = now + BATTERY_READ_MS;
+  }
+  if (cur == POWER_BACKUP && BATTERY_SENSE_PIN >= 0 && (int32_t)(now - nextBatteryMs) >= 0) {
+    batteryMv.store((uint32_t)hal::adcRead(BATTERY_SENSE_PIN) * 3300 * BATTERY_DIVIDER / 4095,
+                    std::memory_order_relaxed);
+    nextBatteryMs = now + BATTERY_READ_MS;
+  }
+}
+
+PowerSource powerSource() { return (PowerSource)source.load(std::memory_order_relaxed); }
+
+uint32_t batteryMillivolts() { return batteryMv.load(std::memory_order_relaxed); }
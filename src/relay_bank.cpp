@@ -0,0 +1,85 @@
+// src/relay_bank.cpp
+// Relay output backends (see include/relay_bank.h).
+
+#include "hal.h"
+#include "relay_bank.h"
+
+namespace {
+
+const uint8_t MCP_IODIRA = 0x00;   // IOCON.BANK = 0 register map; B follows A
+const uint8_t MCP_OLATA = 0x14;
+
+} // namespace
+
+// -------- GPIO --------
+
+uint64_t GpioBank::pinBits(uint32_t outputs) const {
+  uint64_t bits = 0;
+  for (int o = 0; o < outputs_; o++) {
+    if (outputs & (1u << o)) bits |= 1ull << defs_[o].pin;
+  }
+  return bits;
+}
+
+void GpioBank::begin(uint32_t high) {
+  uint32_t all = (uint32_t)((1ull << outputs_) - 1);
+  write(high & all, ~high & all);
+  for (int o = 0; o < outputs_; o++) hal::pinSetup(defs_[o].pin, hal::PIN_MODE_OUTPUT);
+}
+
+void GpioBank::write(uint32_t highMask, uint32_t lowMask) {
+  hal::gpioWriteMask(pinBits(highMask), pinBits(lowMask));
+}
+
+// -------- 74HC595 chain --------
+
+void Hc595Bank::shiftOut() {
+  // the first byte out ends up in the far end of the chain
+  uint8_t frame[MAX_OUTPUTS / 8];
+  for (int c = 0; c < chips_; c++) frame[c] = (uint8_t)(shadow_ >> (8 * (chips_ - 1 - c)));
+  hal::spiWrite(frame, chips_);
+}
+
+void Hc595Bank::begin(uint32_t high) {
+  if (RELAY_OE_PIN >= 0) {
+    hal::gpioWrite(RELAY_OE_PIN, true);
+    hal::pinSetup(RELAY_OE_PIN, hal::PIN_MODE_OUTPUT);
+  }
+  hal::spiBegin(RELAY_SPI_SCK, RELAY_SPI_MOSI, RELAY_SPI_CS, RELAY_SPI_HZ);
+  shadow_ = high;
+  shiftOut();
+  if (RELAY_OE_PIN >= 0) hal::gpioWrite(RELAY_OE_PIN, false);
+}
+
+void Hc595Bank::write(uint32_t highMask, uint32_t lowMask) {
+  uint32_t next = (shadow_ | highMask) & ~lowMask;
+  if (next == shadow_) return;
+  shadow_ = next;
+  shiftOut();
+}
+
+// -------- MCP23017 --------
+
+void Mcp23017Bank::writeChip(int chip, uint8_t reg, uint16_t value) {
+  // register pointer, then port A and port B (the pointer advances)
+  uint8_t frame[3] = {reg, (uint8_t)value, (uint8_t)(value >> 8)};
+  if (!hal::i2cWrite(firstAddr_ + chip, frame, sizeof(frame))) errors_++;
+}
+
+void Mcp23017Bank::begin(uint32_t high) {
+  hal::i2cBegin(RELAY_I2C_SDA, RELAY_I2C_SCL, RELAY_I2C_HZ);
+  shadow_ = high;
+  for (int c = 0; c < chips_; c++) {
+    writeChip(c, MCP_OLATA, (uint16_t)(shadow_ >> (16 * c)));
+    writeChip(c, MCP_IODIRA, 0x0000);
+  }
+}
+
+void Mcp23017Bank::write(uint32_t highMask, uint32_t lowMask) {
+  uint32_t next = (shadow_ | highMask) & ~lowMask;
+  for (int c = 0; c < chips_; c++) {
+    uint16_t port = (uint16_t)(next >> (16 * c));
+    if (port != (uint16_t)(shadow_ >> (16 * c))) writeChip(c, MCP_OLATA, port);
+  }
+  shadow_ = next;
+}
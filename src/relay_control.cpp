@@ -0,0 +1,209 @@
+// src/relay_control.cpp
+// Relay command queue + control task (see include/relay_control.h).
+
+#include <string.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "event_log.h"
+#include "hal.h"
+#include "metrics.h"
+#include "mpsc_ring.h"
+#include "relay_bank.h"
+#include "relay_control.h"
+
+namespace {
+
+// SinricPro device ID -> relay: FNV-1a hash into an open-addressed table
+// built at compile time from RELAYS; a hit is confirmed with one strcmp.
+constexpr uint32_t deviceIdHash(const char* s) {
+  uint32_t h = 2166136261u;
+  while (*s) { h ^= (uint8_t)*s++; h *= 16777619u; }
+  return h;
+}
+
+constexpr int deviceSlotCount() {
+  int n = 1;
+  while (n < 2 * NUM_RELAYS) n <<= 1;  // at most half full, so probes end fast
+  return n;
+}
+const int DEVICE_SLOTS = deviceSlotCount();
+
+struct DeviceSlot {
+  uint32_t hash;
+  int8_t relay;  // 0 = empty
+};
+struct DeviceTable {
+  DeviceSlot slot[DEVICE_SLOTS];
+};
+
+constexpr DeviceTable buildDeviceTable() {
+  DeviceTable t{};
+  for (int r = 0; r < NUM_RELAYS; r++) {
+    if (!RELAYS[r].deviceId) continue;
+    uint32_t h = deviceIdHash(RELAYS[r].deviceId);
+    int i = h & (DEVICE_SLOTS - 1);
+    while (t.slot[i].relay) i = (i + 1) & (DEVICE_SLOTS - 1);
+    t.slot[i] = {h, (int8_t)(r + 1)};
+  }
+  return t;
+}
+constexpr DeviceTable DEVICE_TABLE = buildDeviceTable();
+
+constexpr uint32_t cloudRelaysMask() {
+  uint32_t m = 0;
+  for (int r = 0; r < NUM_RELAYS; r++) if (RELAYS[r].deviceId) m |= 1u << r;
+  return m;
+}
+const uint32_t CLOUD_RELAYS_MASK = cloudRelaysMask();  // relays with a SinricPro device
+
+const uint32_t CONTROL_TASK_STACK = 3072;
+const uint8_t CONTROL_TASK_PRIO = 5;
+const int CONTROL_TASK_CORE = 1;
+
+MpscRing<RelayCommand, 32> commands;
+static_assert(RELAY_BATCH_MAX <= 32, "a batch must fit in the command ring");
+hal::TaskHandle controlTask = nullptr;
+
+std::atomic<uint32_t> stateMask{0};
+std::atomic<uint8_t> mode4{RELAY4_MODE_OFF};
+std::atomic<uint32_t> cloudReportMask{0};
+
+// relay n = bank output n-1 (RELAY_BACKEND in config.h)
+#if RELAY_BACKEND == RELAY_BACKEND_GPIO
+RelayBank bank(&RELAYS[0], NUM_RELAYS);
+#else
+static_assert(NUM_RELAYS <= RelayBank::MAX_OUTPUTS, "more relays than the expander bank drives");
+RelayBank bank(NUM_RELAYS);
+#endif
+
+inline bool isManual(CommandSource src) {
+  return src == SRC_WS || src == SRC_HTTP || src == SRC_MQTT || src == SRC_REMOTE || src == SRC_TIMER ||
+         src == SRC_SCENE || src == SRC_PEER || src == SRC_RULE;
+}
+
+// Drives every relay in `drive` to its state in `on`, in one GPIO write or
+// bus transaction (relay_bank.h).
+void writeRelays(uint32_t on, uint32_t drive) {
+  if (RELAY_ACTIVE_LOW) bank.write(~on & drive, on & drive);
+  else bank.write(on & drive, ~on & drive);
+}
+
+// Runs on the control task only. Applies one command to `mask`, adding the
+// relays that must be written to `drive` and those SinricPro should hear
+// about to `report`.
+void applyCommand(const RelayCommand& cmd, uint32_t& mask, uint32_t& drive, uint32_t& report) {
+  uint32_t bit = 1u << (cmd.relay - 1);
+  bool cur = mask & bit;
+
+  if (cmd.op == RELAY_OP_AUTO) {
+    if (cmd.relay == IR_RELAY && cmd.source != SRC_IR) mode4.store(RELAY4_MODE_AUTO);
+    return;
+  }
+  if (cmd.source == SRC_IR && (cmd.relay != IR_RELAY || mode4.load() != RELAY4_MODE_AUTO)) return;
+
+  bool next = cmd.op == RELAY_OP_TOGGLE ? !cur : cmd.op == RELAY_OP_ON;
+  if (cmd.relay == IR_RELAY && isManual(cmd.source)) {
+    mode4.store(next ? RELAY4_MODE_ON : RELAY4_MODE_OFF);
+  }
+
+  // SinricPro expects the pin to be driven even if it already matches
+  if (next == cur && cmd.source != SRC_CLOUD) return;
+  logEvent(LOG_RELAY, cmd.relay, cmd.source, (uint32_t)cur << 1 | next);
+  mask = next ? (mask | bit) : (mask & ~bit);
+  drive |= bit;
+  if (isManual(cmd.source)) report |= bit & CLOUD_RELAYS_MASK;
+}
+
+// Everything queued since the last wake-up is applied as one batch: one GPIO
+// write and one stateMask store, however many relays changed.
+void controlTaskFn(void*) {
+  for (;;) {
+    hal::taskWait(1000);
+    uint32_t mask = stateMask.load(std::memory_order_relaxed);
+    uint32_t drive = 0, report = 0;
+    uint32_t t0 = hal::cycleCount();
+    RelayCommand cmd;
+    int applied = 0;
+    bool user = false;
+    for (; commands.pop(cmd); applied++) {
+      applyCommand(cmd, mask, drive, report);
+      user |= cmd.source != SRC_IR;
+    }
+    if (drive) {
+      writeRelays(mask, drive);
+      stateMask.store(mask, std::memory_order_release);
+      if (report) cloudReportMask.fetch_or(report);
+    }
+    if (user) metricsBootMark(BOOT_FIRST_COMMAND);
+    if (applied) metricsRecord(STAGE_RELAY_WRITE, t0);
+  }
+}
+
+} // namespace
+
+void relayControlStart(uint32_t initialMask, Relay4Mode initialMode) {
+  if (controlTask) return;
+  uint32_t all = (uint32_t)((1ull << NUM_RELAYS) - 1);
+  bank.begin((RELAY_ACTIVE_LOW ? ~initialMask : initialMask) & all);
+  stateMask.store(initialMask & all);
+  mode4.store(initialMode);
+  controlTask = hal::taskSpawn("relays", controlTaskFn, nullptr, CONTROL_TASK_STACK, CONTROL_TASK_PRIO, CONTROL_TASK_CORE);
+}
+
+bool submitRelayCommand(uint8_t relay, RelayOp op, CommandSource source) {
+  if (relay < 1 || relay > NUM_RELAYS) return false;
+  if (!commands.push({relay, op, source})) return false;
+  metricsCountCommand(source);
+  hal::taskNotify(controlTask);
+  return true;
+}
+
+bool submitRelayBatch(const RelayCommand* cmds, int n) {
+  if (n < 0 || n > RELAY_BATCH_MAX) return false;
+  for (int i = 0; i < n; i++) {
+    if (cmds[i].relay < 1 || cmds[i].relay > NUM_RELAYS) return false;
+  }
+  if (!commands.pushBatch(cmds, n)) return false;
+  for (int i = 0; i < n; i++) metricsCountCommand(cmds[i].source);
+  if (n) hal::taskNotify(controlTask);
+  return true;
+}
+
+const char* commandSourceName(CommandSource source) {
+  static const char* const NAMES[NUM_COMMAND_SOURCES] = {"ws", "http", "cloud", "ir", "mqtt", "remote", "timer", "scene",
+                                                                    "peer", "rule"};
+  return source < NUM_COMMAND_SOURCES ? NAMES[source] : "?";
+}
+
+const char* relay4ModeName(Relay4Mode mode) {
+  static const char* const NAMES[] = {"off", "on", "auto"};
+  return mode <= RELAY4_MODE_AUTO ? NAMES[mode] : "?";
+}
+
+uint32_t relayStateMask() { return stateMask.load(std::memory_order_acquire); }
+
+int relayForDeviceId(const char* deviceId) {
+  uint32_t h = deviceIdHash(deviceId);
+  for (int i = h & (DEVICE_SLOTS - 1); DEVICE_TABLE.slot[i].relay; i = (i + 1) & (DEVICE_SLOTS - 1)) {
+    const DeviceSlot& slot = DEVICE_TABLE.slot[i];
+    if (slot.hash == h && !strcmp(RELAYS[slot.relay - 1].deviceId, deviceId)) return slot.relay;
+  }
+  return -1;
+}
+
+const char* relayDeviceId(int relay) {
+  return (relay >= 1 && relay <= NUM_RELAYS) ? RELAYS[relay - 1].deviceId : nullptr;
+}
+
+Relay4Mode relay4Mode() { return (Relay4Mode)mode4.load(); }
+void setRelay4Mode(Relay4Mode m) { mode4.store(m); }
+
+void commandRelay4Mode(Relay4Mode m, CommandSource source) {
+  setRelay4Mode(m);
+  if (m == RELAY4_MODE_OFF) submitRelayCommand(IR_RELAY, RELAY_OP_OFF, source);
+  else if (m == RELAY4_MODE_ON) submitRelayCommand(IR_RELAY, RELAY_OP_ON, source);
+}
+
+uint32_t takeCloudReportMask() { return cloudReportMask.exchange(0); }
@@ -0,0 +1,493 @@
+// src/relay_timers.cpp
+// Timer wheel driven relay timers, auto-off and daily schedules (see include/relay_timers.h).
+
+#include <Preferences.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mutex>
+
+#include "event_log.h"
+#include "hal.h"
+#include "relay_timers.h"
+#include "state_json.h"
+#include "timer_wheel.h"
+
+namespace {
+
+const char* const TIMERS_NS = "timers";
+const char* const LIST_KEY = "list";
+const char* const AUTO_OFF_KEY = "auto_off";
+const uint32_t CLOCK_STEP_S = 2;          // wall clock off from millis() by more than this: re-plan
+const uint32_t CLOCK_CHECK_MS = 1000;
+const char* const KIND_NAMES[] = {"once", "auto_off", "daily"};
+const char* const OP_NAMES[] = {"off", "on", "toggle"};
+
+struct Timer {
+  uint32_t id;            // 0 = free entry
+  RelayTimerKind kind;
+  uint8_t relay;
+  RelayOp op;
+  uint8_t days;           // daily: weekday mask
+  uint16_t minute;        // daily: minute of the day
+  // daily: UTC of the occurrence armed; one-shot/auto-off restored from
+  // NVS: UTC due, applied once the clock is set (0 = none)
+  uint32_t wallDue;
+  uint32_t handle;        // wheel handle, 0 = not armed
+};
+
+// as saved: one record per timer, all of them in one NVS blob
+struct SavedTimer {
+  uint32_t id;
+  uint8_t kind, relay, op, days;
+  uint32_t wallDue;       // one-shot/auto-off: UTC due if the clock was set, else 0
+  uint32_t arg;           // one-shot/auto-off: ms left at the save; daily: minute
+};
+static_assert(sizeof(SavedTimer) == 16, "packed NVS record");
+
+std::mutex mu;
+Timer timers[RELAY_TIMER_MAX];
+TimerWheel<RELAY_TIMER_MAX> wheel;
+uint32_t autoOffS[NUM_RELAYS];
+uint32_t nextId = 1;
+uint32_t tick = 0, tickMs = 0;          // wheel time, and the millis() it corresponds to
+uint32_t lastMask = 0;
+bool clockKnown = false;
+uint32_t clockRefWall = 0, clockRefMs = 0, clockCheckMs = 0;
+bool dirty = false;
+uint32_t dirtyMs = 0;
+uint32_t fired = 0, saves = 0;
+Preferences store;
+
+SavedTimer savedList[RELAY_TIMER_MAX];  // what NVS holds
+size_t savedCount = 0;
+uint32_t savedAutoOff[NUM_RELAYS];
+
+uint32_t ticksFor(uint64_t ms) { return (uint32_t)((ms + RELAY_TIMER_TICK_MS - 1) / RELAY_TIMER_TICK_MS); }
+
+// Wheel tick `ms` from now: rounded up, counting the part of the current
+// tick already gone, so a timer never fires early.
+uint32_t dueIn(uint64_t ms) { return tick + ticksFor(ms + (hal::millis() - tickMs)); }
+
+void markDirty() {
+  if (!dirty) dirtyMs = hal::millis();
+  dirty = true;
+}
+
+void arm(int i, uint32_t dueTick) {
+  Timer& t = timers[i];
+  if (t.handle) wheel.cancel(t.handle);
+  t.handle = wheel.add(dueTick, i);
+}
+
+void release(int i) {
+  if (timers[i].handle) wheel.cancel(timers[i].handle);
+  timers[i] = Timer{};
+  markDirty();
+}
+
+int freeEntry() {
+  for (int i = 0; i < RELAY_TIMER_MAX; i++) {
+    if (!timers[i].id) return i;
+  }
+  return -1;
+}
+
+int findAutoOff(uint8_t relay) {
+  for (int i = 0; i < RELAY_TIMER_MAX; i++) {
+    if (timers[i].id && timers[i].kind == RELAY_TIMER_AUTO_OFF && timers[i].relay == relay) return i;
+  }
+  return -1;
+}
+
+// Next UTC after `after` that is `minute` past local midnight on a day in
+// `days`; mktime() sorts out month ends and DST changes. 0 if none.
+uint32_t nextDaily(uint32_t after, uint16_t minute, uint8_t days) {
+  time_t t = after;
+  struct tm now;
+  localtime_r(&t, &now);
+  for (int d = 0; d <= 7; d++) {
+    struct tm c = now;
+    c.tm_mday += d;
+    c.tm_hour = minute / 60;
+    c.tm_min = minute % 60;
+    c.tm_sec = 0;
+    c.tm_isdst = -1;
+    time_t due = mktime(&c);
+    if (due > (time_t)after && (days >> c.tm_wday & 1)) return (uint32_t)due;
+  }
+  return 0;
+}
+
+void armDaily(int i, uint32_t wall) {
+  Timer& t = timers[i];
+  t.wallDue = nextDaily(wall, t.minute, t.days);
+  if (t.wallDue) arm(i, dueIn((uint64_t)(t.wallDue - wall) * 1000));
+}
+
+// The clock was set or stepped: daily schedules to their next occurrence,
+// restored one-shots to their UTC due time.
+void replan(uint32_t wall, uint32_t now) {
+  clockRefWall = wall;
+  clockRefMs = now;
+  for (int i = 0; i < RELAY_TIMER_MAX; i++) {
+    Timer& t = timers[i];
+    if (!t.id) continue;
+    if (t.kind == RELAY_TIMER_DAILY) {
+      armDaily(i, wall);
+    } else if (t.wallDue) {
+      arm(i, t.wallDue > wall ? dueIn((uint64_t)(t.wallDue - wall) * 1000) : tick);
+      t.wallDue = 0;
+    }
+  }
+}
+
+int addTimer(RelayTimerKind kind, uint8_t relay, RelayOp op) {
+  int i = freeEntry();
+  if (i < 0) return -1;
+  Timer& t = timers[i];
+  t = Timer{};
+  t.id = nextId++;
+  t.kind = kind;
+  t.relay = relay;
+  t.op = op;
+  markDirty();
+  return i;
+}
+
+// Wheel callback (lock held): queue the command, then retire or re-arm.
+void fire(uint32_t i) {
+  Timer& t = timers[i];
+  t.handle = 0;
+  if (!t.id) return;
+  if (!submitRelayCommand(t.relay, t.op, SRC_TIMER)) {
+    arm(i, tick + 1);   // queue full: next tick
+    return;
+  }
+  fired++;
+  logEvent(LOG_TIMER_FIRED, t.relay, t.id, (uint32_t)t.kind << 8 | t.op);
+  if (t.kind == RELAY_TIMER_DAILY) {
+    uint32_t wall = hal::wallClock();
+    armDaily(i, wall > t.wallDue ? wall : t.wallDue);
+  } else {
+    release(i);
+  }
+}
+
+// Auto-off follows the relays, whoever switched them.
+void followRelays(uint32_t mask) {
+  uint32_t changed = mask ^ lastMask;
+  lastMask = mask;
+  for (int r = 1; changed; r++, changed >>= 1) {
+    if (!(changed & 1)) continue;
+    int i = findAutoOff(r);
+    bool on = (mask >> (r - 1)) & 1;
+    if (on && i < 0 && autoOffS[r - 1]) {
+      i = addTimer(RELAY_TIMER_AUTO_OFF, r, RELAY_OP_OFF);
+      if (i >= 0) arm(i, dueIn((uint64_t)autoOffS[r - 1] * 1000));
+    } else if (!on && i >= 0) {
+      release(i);
+    }
+  }
+}
+
+void save() {
+  dirty = false;
+  uint32_t wall = clockKnown ? hal::wallClock() : 0;
+  SavedTimer list[RELAY_TIMER_MAX];
+  size_t n = 0;
+  for (const Timer& t : timers) {
+    if (!t.id) continue;
+    SavedTimer& s = list[n++];
+    s = SavedTimer{t.id, t.kind, t.relay, t.op, t.days, 0, 0};
+    if (t.kind == RELAY_TIMER_DAILY) {
+      s.arg = t.minute;
+    } else {
+      uint32_t leftTicks = t.handle ? wheel.due(t.handle) - tick : 0;
+      if ((int32_t)leftTicks < 0) leftTicks = 0;
+      s.arg = leftTicks * RELAY_TIMER_TICK_MS;
+      s.wallDue = wall ? wall + s.arg / 1000 : t.wallDue;
+    }
+  }
+  bool listChanged = n != savedCount || memcmp(list, savedList, n * sizeof(SavedTimer));
+  bool autoChanged = memcmp(autoOffS, savedAutoOff, sizeof(autoOffS));
+  if (!listChanged && !autoChanged) return;
+  store.begin(TIMERS_NS, false);
+  if (listChanged) {
+    if (n) store.putBytes(LIST_KEY, list, n * sizeof(SavedTimer));
+    else store.remove(LIST_KEY);
+    memcpy(savedList, list, n * sizeof(SavedTimer));
+    savedCount = n;
+  }
+  if (autoChanged) {
+    store.putBytes(AUTO_OFF_KEY, autoOffS, sizeof(autoOffS));
+    memcpy(savedAutoOff, autoOffS, sizeof(autoOffS));
+  }
+  store.end();
+  saves++;
+}
+
+void writeList(state_json::Writer& w) {
+  w.raw("{\"timers\":[");
+  bool first = true;
+  for (const Timer& t : timers) {
+    if (!t.id) continue;
+    if (!first) w.raw(",");
+    first = false;
+    w.raw("{\"id\":"); w.uinteger(t.id);
+    w.raw(",\"kind\":"); w.string(KIND_NAMES[t.kind]);
+    w.raw(",\"relay\":"); w.uinteger(t.relay);
+    w.raw(",\"op\":"); w.string(OP_NAMES[t.op]);
+    if (t.kind == RELAY_TIMER_DAILY) {
+      char at[8];
+      snprintf(at, sizeof(at), "%02u:%02u", t.minute / 60, t.minute % 60);
+      w.raw(",\"at\":"); w.string(at);
+      w.raw(",\"days\":"); w.uinteger(t.days);
+    }
+    w.raw(",\"in_s\":");
+    if (t.handle) {
+      int32_t left = (int32_t)(wheel.due(t.handle) - tick);
+      w.uinteger(left > 0 ? (uint32_t)left * RELAY_TIMER_TICK_MS / 1000 : 0);
+    } else {
+      w.raw("null");
+    }
+    w.raw("}");
+  }
+  w.raw("],\"auto_off_s\":[");
+  for (int r = 0; r < NUM_RELAYS; r++) {
+    if (r) w.raw(",");
+    w.uinteger(autoOffS[r]);
+  }
+  w.raw("],\"clock\":"); w.boolean(clockKnown);
+  w.raw("}");
+}
+
+bool validRelay(uint8_t relay) { return relay >= 1 && relay <= NUM_RELAYS; }
+bool validOp(RelayOp op) { return op == RELAY_OP_OFF || op == RELAY_OP_ON || op == RELAY_OP_TOGGLE; }
+
+// "<a>:<b>..." split in place; returns the field count
+int split(char* s, char** fields, int max) {
+  int n = 0;
+  fields[n++] = s;
+  for (; *s && n < max; s++) {
+    if (*s == ':') { *s = 0; fields[n++] = s + 1; }
+  }
+  return n;
+}
+
+} // namespace
+
+const char* relayTimerErrorName(RelayTimerError e) {
+  static const char* const NAMES[] = {"ok", "bad relay", "bad op", "bad time", "no free timer", "no such timer"};
+  return e < sizeof(NAMES) / sizeof(NAMES[0]) ? NAMES[e] : "?";
+}
+
+void relayTimersBegin() {
+  std::lock_guard<std::mutex> lk(mu);
+  for (Timer& t : timers) t = Timer{};
+  tickMs = hal::millis();
+  tick = 0;
+  wheel.reset(tick);
+  nextId = 1;
+  clockKnown = false;
+  dirty = false;
+
+  store.begin(TIMERS_NS, true);
+  size_t bytes = store.getBytes(LIST_KEY, savedList, sizeof(savedList));
+  memset(savedAutoOff, 0, sizeof(savedAutoOff));
+  store.getBytes(AUTO_OFF_KEY, savedAutoOff, sizeof(savedAutoOff));
+  store.end();
+  savedCount = bytes / sizeof(SavedTimer);
+  memcpy(autoOffS, savedAutoOff, sizeof(autoOffS));
+
+  for (size_t k = 0; k < savedCount; k++) {
+    const SavedTimer& s = savedList[k];
+    if (s.kind > RELAY_TIMER_DAILY || !validRelay(s.relay) || !validOp((RelayOp)s.op)) continue;
+    Timer& t = timers[k];
+    t.id = s.id;
+    t.kind = (RelayTimerKind)s.kind;
+    t.relay = s.relay;
+    t.op = (RelayOp)s.op;
+    t.days = s.days;
+    if (s.id >= nextId) nextId = s.id + 1;
+    if (t.kind == RELAY_TIMER_DAILY) {
+      t.minute = (uint16_t)s.arg;   // armed once the clock is set
+    } else {
+      t.wallDue = s.wallDue;
+      arm(k, dueIn(s.arg));
+    }
+  }
+  // relays restored on with auto-off and nothing pending: start it now
+  lastMask = 0;
+  followRelays(relayStateMask());
+}
+
+void relayTimersTick() {
+  uint32_t now = hal::millis();
+  std::lock_guard<std::mutex> lk(mu);
+  uint32_t n = (now - tickMs) / RELAY_TIMER_TICK_MS;
+  tick += n;
+  tickMs += n * RELAY_TIMER_TICK_MS;
+
+  uint32_t mask = relayStateMask();
+  if (mask != lastMask) followRelays(mask);
+
+  if (!clockKnown || now - clockCheckMs >= CLOCK_CHECK_MS) {
+    clockCheckMs = now;
+    uint32_t wall = hal::wallClock();
+    if (wall) {
+      uint32_t expected = clockRefWall + (now - clockRefMs) / 1000;
+      uint32_t off = wall > expected ? wall - expected : expected - wall;
+      if (!clockKnown || off > CLOCK_STEP_S) replan(wall, now);
+      clockKnown = true;
+    }
+  }
+
+  if (n) wheel.advance(tick, fire);
+  if (dirty && now - dirtyMs >= RELAY_TIMER_SAVE_QUIET_MS) save();
+}
+
+void relayTimersFlush() {
+  std::lock_guard<std::mutex> lk(mu);
+  if (dirty) save();
+}
+
+RelayTimerError relayTimerAddOnce(uint8_t relay, RelayOp op, uint32_t delayS, uint32_t* id) {
+  if (!validRelay(relay)) return RELAY_TIMER_BAD_RELAY;
+  if (!validOp(op)) return RELAY_TIMER_BAD_OP;
+  if (delayS > RELAY_TIMER_MAX_DELAY_S) return RELAY_TIMER_BAD_TIME;
+  std::lock_guard<std::mutex> lk(mu);
+  int i = addTimer(RELAY_TIMER_ONCE, relay, op);
+  if (i < 0) return RELAY_TIMER_FULL;
+  arm(i, dueIn((uint64_t)delayS * 1000));
+  if (id) *id = timers[i].id;
+  return RELAY_TIMER_OK;
+}
+
+RelayTimerError relayTimerAddDaily(uint8_t relay, RelayOp op, uint16_t minute, uint8_t days, uint32_t* id) {
+  if (!validRelay(relay)) return RELAY_TIMER_BAD_RELAY;
+  if (!validOp(op)) return RELAY_TIMER_BAD_OP;
+  days &= RELAY_TIMER_EVERY_DAY;
+  if (minute >= 24 * 60 || !days) return RELAY_TIMER_BAD_TIME;
+  std::lock_guard<std::mutex> lk(mu);
+  int i = addTimer(RELAY_TIMER_DAILY, relay, op);
+  if (i < 0) return RELAY_TIMER_FULL;
+  timers[i].minute = minute;
+  timers[i].days = days;
+  if (clockKnown) armDaily(i, hal::wallClock());
+  if (id) *id = timers[i].id;
+  return RELAY_TIMER_OK;
+}
+
+RelayTimerError relayTimerCancel(uint32_t id) {
+  std::lock_guard<std::mutex> lk(mu);
+  for (int i = 0; i < RELAY_TIMER_MAX; i++) {
+    if (id && timers[i].id == id) { release(i); return RELAY_TIMER_OK; }
+  }
+  return RELAY_TIMER_NOT_FOUND;
+}
+
+RelayTimerError relayTimerSetAutoOff(uint8_t relay, uint32_t seconds) {
+  if (!validRelay(relay)) return RELAY_TIMER_BAD_RELAY;
+  if (seconds > RELAY_TIMER_MAX_DELAY_S) return RELAY_TIMER_BAD_TIME;
+  std::lock_guard<std::mutex> lk(mu);
+  if (autoOffS[relay - 1] == seconds) return RELAY_TIMER_OK;
+  autoOffS[relay - 1] = seconds;
+  markDirty();
+  // a change applies from the next time the relay goes on; off cancels now
+  int i = findAutoOff(relay);
+  if (!seconds && i >= 0) release(i);
+  if (seconds && i < 0 && relayIsOn(relay)) {
+    i = addTimer(RELAY_TIMER_AUTO_OFF, relay, RELAY_OP_OFF);
+    if (i >= 0) arm(i, dueIn((uint64_t)seconds * 1000));
+  }
+  return RELAY_TIMER_OK;
+}
+
+uint32_t relayTimerAutoOff(uint8_t relay) {
+  std::lock_guard<std::mutex> lk(mu);
+  return validRelay(relay) ? autoOffS[relay - 1] : 0;
+}
+
+bool relayTimerParseOp(const char* s, RelayOp& out) {
+  for (int op = RELAY_OP_OFF; op <= RELAY_OP_TOGGLE; op++) {
+    if (!strcmp(s, OP_NAMES[op])) { out = (RelayOp)op; return true; }
+  }
+  return false;
+}
+
+bool relayTimerParseUint(const char* s, uint32_t& out) {
+  if (*s < '0' || *s > '9') return false;   // strtoul would take "", " 5", "+5" and "-5"
+  char* end;
+  unsigned long v = strtoul(s, &end, 10);
+  if (*end || v > 0xFFFFFFFFul) return false;
+  out = (uint32_t)v;
+  return true;
+}
+
+bool relayTimerParseTime(const char* s, uint16_t& minute) {
+  if (strlen(s) != 5 || s[2] != ':') return false;
+  for (int i : {0, 1, 3, 4}) {
+    if (s[i] < '0' || s[i] > '9') return false;
+  }
+  int h = (s[0] - '0') * 10 + (s[1] - '0'), m = (s[3] - '0') * 10 + (s[4] - '0');
+  if (h > 23 || m > 59) return false;
+  minute = (uint16_t)(h * 60 + m);
+  return true;
+}
+
+size_t relayTimersJson(char* out, size_t cap) {
+  state_json::Writer w(out, cap);
+  std::lock_guard<std::mutex> lk(mu);
+  writeList(w);
+  return w.finish();
+}
+
+size_t relayTimersCommand(const char* text, size_t len, char* reply, size_t cap) {
+  char buf[48];
+  if (len >= sizeof(buf)) return 0;
+  memcpy(buf, text, len);
+  buf[len] = 0;
+  if (!strcmp(buf, "timers")) return relayTimersJson(reply, cap);
+
+  char* f[6];
+  int n = split(buf, f, 6);
+  uint32_t relay = 0, v = 0, id = 0;
+  RelayOp op;
+  uint16_t minute;
+  RelayTimerError e;
+  if (!strcmp(f[0], "timer") && n == 4) {
+    if (!relayTimerParseUint(f[1], relay) || relay > 0xFF) e = RELAY_TIMER_BAD_RELAY;
+    else if (!relayTimerParseOp(f[2], op)) e = RELAY_TIMER_BAD_OP;
+    else if (!relayTimerParseUint(f[3], v)) e = RELAY_TIMER_BAD_TIME;
+    else e = relayTimerAddOnce(relay, op, v, &id);
+  } else if (!strcmp(f[0], "daily") && (n == 5 || n == 6)) {
+    // "HH:MM" was split too: f[3] = HH, f[4] = MM
+    char at[8];
+    snprintf(at, sizeof(at), "%s:%s", f[3], f[4]);
+    v = RELAY_TIMER_EVERY_DAY;
+    if (!relayTimerParseUint(f[1], relay) || relay > 0xFF) e = RELAY_TIMER_BAD_RELAY;
+    else if (!relayTimerParseOp(f[2], op)) e = RELAY_TIMER_BAD_OP;
+    else if (!relayTimerParseTime(at, minute) || (n == 6 && (!relayTimerParseUint(f[5], v) || v > 0xFF))) e = RELAY_TIMER_BAD_TIME;
+    else e = relayTimerAddDaily(relay, op, minute, v, &id);
+  } else if (!strcmp(f[0], "cancel") && n == 2) {
+    e = relayTimerParseUint(f[1], id) ? relayTimerCancel(id) : RELAY_TIMER_NOT_FOUND;
+  } else if (!strcmp(f[0], "autooff") && n == 3) {
+    if (!relayTimerParseUint(f[1], relay) || relay > 0xFF) e = RELAY_TIMER_BAD_RELAY;
+    else if (!relayTimerParseUint(f[2], v)) e = RELAY_TIMER_BAD_TIME;
+    else e = relayTimerSetAutoOff(relay, v);
+  } else {
+    return 0;
+  }
+  if (e == RELAY_TIMER_OK) return relayTimersJson(reply, cap);
+  state_json::Writer w(reply, cap);
+  w.raw("{\"timers_error\":"); w.string(relayTimerErrorName(e)); w.raw("}");
+  return w.finish();
+}
+
+RelayTimerStats relayTimerStats() {
+  std::lock_guard<std::mutex> lk(mu);
+  return {(uint32_t)wheel.size(), fired, saves};
+}
@@ -0,0 +1,583 @@
+// src/rules.cpp
+// Automation rules: compiler, bytecode checker/evaluator/decompiler and the
+// firmware's rule set (see include/rules.h).
+
+#include <Preferences.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "event_log.h"
+#include "hal.h"
+#include "mqtt_link.h"
+#include "power_manager.h"
+#include "relay_timers.h"
+#include "rules.h"
+#include "state_json.h"
+#include "wifi_manager.h"
+
+namespace {
+
+const char* const RULES_NS = "rules";
+const char* const CODE_KEY = "code";
+const char* const NAMED_SIGNALS[] = {"ir", "wifi", "cloud", "mqtt", "battery"};   // from RULE_SIG_IR on
+const char* const OP_NAMES[] = {"off", "on", "toggle"};
+const size_t WORD_MAX = 8;
+
+// ---- compiler ----
+
+enum TokenKind : uint8_t { TOK_END, TOK_WORD, TOK_NUMBER, TOK_OPEN, TOK_CLOSE, TOK_BAD };
+
+// Words and numbers split where letters meet digits, so "relay4" and
+// "relay 4", "5m" and "5 m" read alike.
+struct Lexer {
+  const char* p;
+  TokenKind kind;
+  char word[WORD_MAX + 1];
+  uint32_t number;
+
+  void next() {
+    while (*p == ' ' || *p == '\t') p++;
+    if (!*p) { kind = TOK_END; return; }
+    if (*p == '(' || *p == ')') { kind = *p++ == '(' ? TOK_OPEN : TOK_CLOSE; return; }
+    if (*p >= '0' && *p <= '9') {
+      uint64_t v = 0;
+      while (*p >= '0' && *p <= '9') {
+        v = v * 10 + (uint32_t)(*p++ - '0');
+        if (v > 0xFFFFFFFFu) { kind = TOK_BAD; return; }
+      }
+      number = (uint32_t)v;
+      kind = TOK_NUMBER;
+      return;
+    }
+    size_t n = 0;
+    while ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')) {
+      if (n == WORD_MAX) { kind = TOK_BAD; return; }
+      word[n++] = (char)(*p >= 'a' ? *p : *p - 'A' + 'a');
+      p++;
+    }
+    word[n] = 0;
+    kind = n ? TOK_WORD : TOK_BAD;
+  }
+  bool is(const char* w) const { return kind == TOK_WORD && !strcmp(word, w); }
+};
+
+// Recursive descent straight to postfix: or < and < not < input.
+struct Compiler {
+  Lexer lex;
+  uint8_t* code;
+  size_t cap;
+  size_t len;
+  int depth, maxDepth, nesting;
+  int relays;
+  RuleError error;
+
+  bool fail(RuleError e) {
+    if (error == RULE_OK) error = e;
+    return false;
+  }
+  bool emit(uint8_t op, int stack) {
+    if (len == cap || len == 0xFF) return fail(RULE_TOO_LONG);
+    code[len++] = op;
+    depth += stack;
+    if (depth > maxDepth) maxDepth = depth;
+    return depth <= RULE_STACK_MAX || fail(RULE_TOO_LONG);
+  }
+
+  bool input() {
+    if (lex.is("relay")) {
+      lex.next();
+      if (lex.kind != TOK_NUMBER) return fail(RULE_BAD_INPUT);
+      if (lex.number < 1 || lex.number > (uint32_t)relays) return fail(RULE_BAD_INPUT);
+      uint8_t s = (uint8_t)(RULE_SIG_RELAY1 + lex.number - 1);
+      lex.next();
+      return emit(RULE_OP_INPUT | s, 1);
+    }
+    if (lex.kind != TOK_WORD) return fail(RULE_SYNTAX);
+    for (size_t i = 0; i < sizeof(NAMED_SIGNALS) / sizeof(NAMED_SIGNALS[0]); i++) {
+      if (!strcmp(lex.word, NAMED_SIGNALS[i])) {
+        lex.next();
+        return emit(RULE_OP_INPUT | (uint8_t)(RULE_SIG_IR + i), 1);
+      }
+    }
+    return fail(RULE_BAD_INPUT);
+  }
+  bool primary() {
+    if (lex.kind != TOK_OPEN) return input();
+    if (++nesting > RULE_STACK_MAX) return fail(RULE_TOO_LONG);
+    lex.next();
+    if (!condition()) return false;
+    if (lex.kind != TOK_CLOSE) return fail(RULE_SYNTAX);
+    nesting--;
+    lex.next();
+    return true;
+  }
+  bool negation() {
+    if (!lex.is("not")) return primary();
+    if (++nesting > RULE_STACK_MAX) return fail(RULE_TOO_LONG);
+    lex.next();
+    if (!negation()) return false;
+    nesting--;
+    return emit(RULE_OP_NOT, 0);
+  }
+  bool conjunction() {
+    if (!negation()) return false;
+    while (lex.is("and")) {
+      lex.next();
+      if (!negation() || !emit(RULE_OP_AND, -1)) return false;
+    }
+    return true;
+  }
+  bool condition() {
+    if (!conjunction()) return false;
+    while (lex.is("or")) {
+      lex.next();
+      if (!conjunction() || !emit(RULE_OP_OR, -1)) return false;
+    }
+    return true;
+  }
+
+  // relay<n> on|off|toggle [for <n>[s|m|h]]
+  bool action(RuleAction& a) {
+    if (!lex.is("relay")) return fail(RULE_BAD_ACTION);
+    lex.next();
+    if (lex.kind != TOK_NUMBER || lex.number < 1 || lex.number > (uint32_t)relays) return fail(RULE_BAD_ACTION);
+    a.relay = (uint8_t)lex.number;
+    lex.next();
+    if (lex.kind != TOK_WORD || !relayTimerParseOp(lex.word, a.op)) return fail(RULE_BAD_ACTION);
+    lex.next();
+    a.forS = 0;
+    if (lex.is("for")) {
+      lex.next();
+      if (lex.kind != TOK_NUMBER) return fail(RULE_BAD_ACTION);
+      uint64_t s = lex.number;
+      lex.next();
+      if (lex.is("m") || lex.is("min")) s *= 60;
+      else if (lex.is("h")) s *= 3600;
+      else if (!lex.is("s") && lex.kind != TOK_END) return fail(RULE_BAD_ACTION);
+      if (lex.kind == TOK_WORD) lex.next();
+      if (!s || s > RELAY_TIMER_MAX_DELAY_S) return fail(RULE_BAD_ACTION);
+      a.forS = (uint32_t)s;
+    }
+    return lex.kind == TOK_END || fail(RULE_SYNTAX);
+  }
+};
+
+// ---- bytecode ----
+
+size_t putVarint(uint8_t* out, uint32_t v) {
+  size_t n = 0;
+  do {
+    out[n] = (uint8_t)(v & 0x7F);
+    v >>= 7;
+    if (v) out[n] |= 0x80;
+    n++;
+  } while (v);
+  return n;
+}
+
+size_t actionSize(const RuleAction& a) {
+  uint8_t tmp[5];
+  return 2 + (a.forS ? putVarint(tmp, a.forS) : 0);
+}
+
+// Bounded text appender that keeps counting past the end, like snprintf.
+struct Text {
+  char* out;
+  size_t cap;
+  size_t len;
+  void put(const char* s) {
+    for (; *s; s++, len++) {
+      if (len + 1 < cap) out[len] = *s;
+    }
+  }
+  void finish() {
+    if (cap) out[len < cap ? len : cap - 1] = 0;
+  }
+};
+
+// Postfix back to infix: a tree of the condition, printed with parentheses
+// only where precedence needs them.
+struct Decompiler {
+  struct Node {
+    uint8_t op;
+    uint8_t a, b;
+  };
+  Node nodes[0xFF];
+  Text& text;
+
+  explicit Decompiler(Text& t) : text(t) {}
+
+  static int precedence(uint8_t op) {
+    return op & RULE_OP_INPUT ? 4 : op == RULE_OP_NOT ? 3 : op == RULE_OP_AND ? 2 : 1;
+  }
+  void operand(int child, int parent) {
+    bool wrap = precedence(nodes[child].op) < precedence(nodes[parent].op);
+    if (wrap) text.put("(");
+    print(child);
+    if (wrap) text.put(")");
+  }
+  void print(int i) {
+    const Node& n = nodes[i];
+    if (n.op & RULE_OP_INPUT) {
+      char buf[12];
+      text.put(ruleSignalName(n.op & ~RULE_OP_INPUT, buf, sizeof(buf)));
+    } else if (n.op == RULE_OP_NOT) {
+      text.put("not ");
+      operand(n.a, i);
+    } else {
+      operand(n.a, i);
+      text.put(n.op == RULE_OP_AND ? " and " : " or ");
+      operand(n.b, i);
+    }
+  }
+  // A checked condition; returns its root.
+  int build(const uint8_t* cond, size_t len) {
+    uint8_t stack[RULE_STACK_MAX];
+    int sp = 0;
+    for (size_t i = 0; i < len; i++) {
+      Node& n = nodes[i];
+      n.op = cond[i];
+      if (n.op & RULE_OP_INPUT) {
+        stack[sp++] = (uint8_t)i;
+      } else if (n.op == RULE_OP_NOT) {
+        n.a = stack[sp - 1];
+        stack[sp - 1] = (uint8_t)i;
+      } else {
+        n.b = stack[--sp];
+        n.a = stack[sp - 1];
+        stack[sp - 1] = (uint8_t)i;
+      }
+    }
+    return stack[0];
+  }
+};
+
+} // namespace
+
+const char* ruleErrorName(RuleError e) {
+  static const char* const NAMES[] = {"ok", "not if <condition> then <action>", "unknown input",
+                                      "bad action", "too long", "no room for more rules", "no such rule"};
+  return e < sizeof(NAMES) / sizeof(NAMES[0]) ? NAMES[e] : "?";
+}
+
+const char* ruleSignalName(int signal, char* buf, size_t cap) {
+  if (signal >= RULE_SIG_IR && signal < RULE_SIGNALS) return NAMED_SIGNALS[signal - RULE_SIG_IR];
+  snprintf(buf, cap, "relay%d", signal - RULE_SIG_RELAY1 + 1);
+  return buf;
+}
+
+RuleError ruleCompile(const char* text, uint8_t* out, size_t cap, size_t* len, int relays) {
+  if (strlen(text) > 2 * RULE_TEXT_MAX) return RULE_TOO_LONG;
+  if (cap < 4) return RULE_TOO_LONG;
+  Compiler c = {{text, TOK_END, {}, 0}, out + 1, cap - 1, 0, 0, 0, 0, relays, RULE_OK};
+  c.lex.next();
+  if (!c.lex.is("if")) return RULE_SYNTAX;
+  c.lex.next();
+  if (!c.condition()) return c.error;
+  if (!c.lex.is("then")) return RULE_SYNTAX;
+  c.lex.next();
+  RuleAction a;
+  if (!c.action(a)) return c.error;
+
+  size_t n = 1 + c.len;
+  if (n + actionSize(a) > cap) return RULE_TOO_LONG;
+  out[0] = (uint8_t)c.len;
+  out[n++] = (uint8_t)(a.op | (a.forS ? RULE_ACT_FOR : 0));
+  out[n++] = a.relay;
+  if (a.forS) n += putVarint(out + n, a.forS);
+
+  char listed[RULE_TEXT_MAX + 1];
+  if (ruleFormat(out, listed, sizeof(listed)) > RULE_TEXT_MAX) return RULE_TOO_LONG;
+  *len = n;
+  return RULE_OK;
+}
+
+bool ruleDecode(const uint8_t* code, size_t len, size_t at, int relays, RuleInfo& out) {
+  if (at >= len) return false;
+  size_t condLen = code[at];
+  size_t p = at + 1;
+  if (!condLen || p + condLen + 2 > len) return false;
+  int depth = 0;
+  uint64_t inputs = 0;
+  for (; p < at + 1 + condLen; p++) {
+    uint8_t op = code[p];
+    if (op & RULE_OP_INPUT) {
+      int s = op & ~RULE_OP_INPUT;
+      if (s >= RULE_SIGNALS || (s < RULE_SIG_IR && s - RULE_SIG_RELAY1 >= relays)) return false;
+      if (++depth > RULE_STACK_MAX) return false;
+      inputs |= 1ull << s;
+    } else if (op == RULE_OP_NOT) {
+      if (depth < 1) return false;
+    } else if (op == RULE_OP_AND || op == RULE_OP_OR) {
+      if (depth < 2) return false;
+      depth--;
+    } else {
+      return false;
+    }
+  }
+  if (depth != 1) return false;
+
+  uint8_t act = code[p++];
+  RuleAction a = {code[p++], (RelayOp)(act & ~RULE_ACT_FOR), 0};
+  if (a.op > RELAY_OP_TOGGLE || a.relay < 1 || a.relay > relays) return false;
+  if (act & RULE_ACT_FOR) {
+    uint64_t v = 0;
+    for (int shift = 0;; shift += 7) {
+      if (p >= len || shift > 28) return false;
+      uint8_t b = code[p++];
+      v |= (uint64_t)(b & 0x7F) << shift;
+      if (!(b & 0x80)) break;
+    }
+    if (!v || v > RELAY_TIMER_MAX_DELAY_S) return false;
+    a.forS = (uint32_t)v;
+  }
+  out = {at, p - at, inputs, a};
+  return true;
+}
+
+bool ruleEvaluate(const uint8_t* rule, uint64_t signals) {
+  // the stack is a word of bits, top in bit 0
+  uint32_t st = 0;
+  const uint8_t* op = rule + 1;
+  for (const uint8_t* end = op + rule[0]; op < end; op++) {
+    if (*op & RULE_OP_INPUT) {
+      st = st << 1 | (uint32_t)(signals >> (*op & ~RULE_OP_INPUT) & 1);
+    } else if (*op == RULE_OP_NOT) {
+      st ^= 1;
+    } else {
+      uint32_t top = st & 1;
+      st >>= 1;
+      st = *op == RULE_OP_AND ? st & (~1u | top) : st | top;
+    }
+  }
+  return st & 1;
+}
+
+size_t ruleFormat(const uint8_t* rule, char* out, size_t cap) {
+  Text t = {out, cap, 0};
+  Decompiler d(t);
+  t.put("if ");
+  d.print(d.build(rule + 1, rule[0]));
+  const uint8_t* act = rule + 1 + rule[0];
+  char buf[32];
+  RelayOp op = (RelayOp)(act[0] & ~RULE_ACT_FOR);
+  snprintf(buf, sizeof(buf), " then relay%u %s", act[1], op <= RELAY_OP_TOGGLE ? OP_NAMES[op] : "?");
+  t.put(buf);
+  if (act[0] & RULE_ACT_FOR) {
+    uint32_t s = 0;
+    for (int i = 0, shift = 0; i < 5; i++, shift += 7) {
+      s |= (uint32_t)(act[2 + i] & 0x7F) << shift;
+      if (!(act[2 + i] & 0x80)) break;
+    }
+    if (s % 3600 == 0) snprintf(buf, sizeof(buf), " for %luh", (unsigned long)(s / 3600));
+    else if (s % 60 == 0) snprintf(buf, sizeof(buf), " for %lum", (unsigned long)(s / 60));
+    else snprintf(buf, sizeof(buf), " for %lus", (unsigned long)s);
+    t.put(buf);
+  }
+  t.finish();
+  return t.len;
+}
+
+// ---- the firmware's rules ----
+
+namespace {
+
+// per rule, beside the engine
+struct RuleRun {
+  uint32_t fired;
+  uint32_t burstMs;        // start of the current burst window
+  uint8_t burst;           // firings in it
+  bool off;                // switched off for looping
+  uint32_t timer;          // its "for" timer, to restart on the next firing
+};
+
+std::mutex mu;
+RuleEngine<RULES_MAX, RULES_CODE_MAX> engine;
+uint8_t program[RULES_CODE_MAX] = {RULES_CODE_VERSION};   // what NVS has
+size_t programLen = 1;
+RuleRun runs[RULES_MAX];
+std::atomic<uint64_t> pushed{0};   // inputs set through rulesSetInput
+RuleStats stats;
+
+uint64_t readInputs() {
+  uint64_t in = (uint64_t)relayStateMask() << RULE_SIG_RELAY1 | pushed.load(std::memory_order_relaxed);
+  if (wifiManagerState() == WIFI_STATE_CONNECTED) in |= 1ull << RULE_SIG_WIFI;
+  if (mqttLinkConnected()) in |= 1ull << RULE_SIG_MQTT;
+  if (powerSource() == POWER_BACKUP) in |= 1ull << RULE_SIG_BATTERY;
+  return in;
+}
+
+void save() {
+  Preferences store;
+  store.begin(RULES_NS, false);
+  store.putBytes(CODE_KEY, program, programLen);
+  store.end();
+}
+
+// The program changed (lock held): reload it against the inputs as they
+// were last seen, and give every rule that looped another chance.
+void reload() {
+  engine.load(program, programLen, engine.signals());
+  for (RuleRun& r : runs) {
+    r.off = false;
+    r.burst = 0;
+  }
+  stats.rules = engine.count();
+  save();
+}
+
+RelayOp undo(RelayOp op) {
+  return op == RELAY_OP_ON ? RELAY_OP_OFF : op == RELAY_OP_OFF ? RELAY_OP_ON : RELAY_OP_TOGGLE;
+}
+
+// A rule's condition turned true (net task, lock held).
+void fire(int id, const RuleAction& a) {
+  RuleRun& run = runs[id];
+  if (run.off) return;
+  uint32_t now = hal::millis();
+  if (now - run.burstMs >= RULE_BURST_WINDOW_MS) {
+    run.burstMs = now;
+    run.burst = 0;
+  }
+  if (++run.burst > RULE_BURST_MAX) {
+    run.off = true;
+    logEvent(LOG_RULE, (uint8_t)id, 2, (uint32_t)a.relay << 8 | a.op);
+    return;
+  }
+  bool queued = submitRelayCommand(a.relay, a.op, SRC_RULE);
+  if (queued && a.forS) {
+    // firing again restarts the time
+    if (run.timer) relayTimerCancel(run.timer);
+    if (relayTimerAddOnce(a.relay, undo(a.op), a.forS, &run.timer) != RELAY_TIMER_OK) run.timer = 0;
+  }
+  logEvent(LOG_RULE, (uint8_t)id, queued ? 0 : 1, (uint32_t)a.relay << 8 | a.op);
+  run.fired++;
+  stats.fired++;
+}
+
+size_t errorReply(char* reply, size_t cap, RuleError e) {
+  state_json::Writer w(reply, cap);
+  w.raw("{\"rule_error\":"); w.string(ruleErrorName(e)); w.raw("}");
+  return w.finish();
+}
+
+} // namespace
+
+void rulesBegin() {
+  std::lock_guard<std::mutex> lk(mu);
+  Preferences store;
+  store.begin(RULES_NS, true);
+  programLen = store.getBytes(CODE_KEY, program, sizeof(program));
+  store.end();
+  // the relays are restored and nothing is connected yet
+  uint64_t in = (uint64_t)relayStateMask() << RULE_SIG_RELAY1 | pushed.load(std::memory_order_relaxed);
+  if (powerSource() == POWER_BACKUP) in |= 1ull << RULE_SIG_BATTERY;
+  if (!programLen || engine.load(program, programLen, in) != RULE_OK) {   // none, or written by another build
+    program[0] = RULES_CODE_VERSION;
+    programLen = 1;
+    engine.load(program, programLen, in);
+  }
+  memset(runs, 0, sizeof(runs));
+  stats.rules = engine.count();
+}
+
+void rulesTick() {
+  uint64_t in = readInputs();
+  std::lock_guard<std::mutex> lk(mu);
+  if (in == engine.signals()) return;
+  stats.changes++;
+  stats.evaluated += engine.update(in, fire);
+}
+
+void rulesSetInput(RuleSignal signal, bool on) {
+  uint64_t bit = 1ull << signal;
+  if (on) pushed.fetch_or(bit, std::memory_order_relaxed);
+  else pushed.fetch_and(~bit, std::memory_order_relaxed);
+}
+
+RuleError ruleAdd(const char* text, int* id) {
+  uint8_t code[RULE_CODE_MAX];
+  size_t len;
+  RuleError e = ruleCompile(text, code, sizeof(code), &len);
+  if (e != RULE_OK) return e;
+  std::lock_guard<std::mutex> lk(mu);
+  if (engine.count() == RULES_MAX || programLen + len > sizeof(program)) return RULE_FULL;
+  memcpy(program + programLen, code, len);
+  programLen += len;
+  int n = engine.count();
+  runs[n] = RuleRun();
+  reload();
+  if (id) *id = n;
+  return RULE_OK;
+}
+
+RuleError ruleDelete(int id) {
+  std::lock_guard<std::mutex> lk(mu);
+  if (id < 0 || id >= engine.count()) return RULE_NOT_FOUND;
+  RuleInfo info;
+  ruleDecode(program, programLen, (size_t)(engine.rule(id) - engine.program()), NUM_RELAYS, info);
+  memmove(program + info.at, program + info.at + info.size, programLen - info.at - info.size);
+  programLen -= info.size;
+  memmove(&runs[id], &runs[id + 1], (RULES_MAX - id - 1) * sizeof(RuleRun));
+  reload();
+  return RULE_OK;
+}
+
+size_t rulesJson(char* out, size_t cap) {
+  state_json::Writer w(out, cap);
+  std::lock_guard<std::mutex> lk(mu);
+  w.raw("{\"rules\":[");
+  for (int i = 0; i < engine.count(); i++) {
+    char text[RULE_TEXT_MAX + 1];
+    ruleFormat(engine.rule(i), text, sizeof(text));
+    if (i) w.raw(",");
+    w.raw("{\"id\":"); w.uinteger(i);
+    w.raw(",\"rule\":"); w.string(text);
+    w.raw(",\"active\":"); w.boolean(engine.active(i));
+    w.raw(",\"fired\":"); w.uinteger(runs[i].fired);
+    if (runs[i].off) w.raw(",\"off\":true");
+    w.raw("}");
+  }
+  w.raw("],\"code_bytes\":"); w.uinteger(programLen);
+  w.raw(",\"inputs\":[");
+  bool first = true;
+  for (int s = 0; s < RULE_SIGNALS; s++) {
+    if (!(engine.signals() >> s & 1)) continue;
+    char buf[12];
+    if (!first) w.raw(",");
+    first = false;
+    w.string(ruleSignalName(s, buf, sizeof(buf)));
+  }
+  w.raw("]}");
+  return w.finish();
+}
+
+size_t rulesCommand(const char* text, size_t len, char* reply, size_t cap) {
+  char buf[2 * RULE_TEXT_MAX + 16];
+  if (len == 5 && !memcmp(text, "rules", 5)) return rulesJson(reply, cap);
+  bool add = len >= 5 && !memcmp(text, "rule:", 5);
+  bool del = len >= 12 && !memcmp(text, "rule_delete:", 12);
+  if (!add && !del) return 0;
+  if (len >= sizeof(buf)) return errorReply(reply, cap, RULE_TOO_LONG);
+  memcpy(buf, text, len);
+  buf[len] = 0;
+
+  RuleError e;
+  if (add) {
+    e = ruleAdd(buf + 5, nullptr);
+  } else {
+    char* end;
+    long id = strtol(buf + 12, &end, 10);
+    e = end == buf + 12 || *end ? RULE_NOT_FOUND : ruleDelete((int)id);
+  }
+  return e == RULE_OK ? rulesJson(reply, cap) : errorReply(reply, cap, e);
+}
+
+RuleStats rulesStats() {
+  std::lock_guard<std::mutex> lk(mu);
+  return stats;
+}
@@ -0,0 +1,225 @@
+// src/scenes.cpp
+// Named relay scenes applied as one command batch (see include/scenes.h).
+
+#include <Preferences.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mutex>
+
+#include "event_log.h"
+#include "scenes.h"
+#include "state_json.h"
+
+namespace {
+
+const char* const SCENES_NS = "scenes";
+const char* const LIST_KEY = "list";
+const uint32_t ALL_RELAYS = (uint32_t)((1ull << NUM_RELAYS) - 1);
+
+// as saved: all SCENE_MAX slots in one NVS blob, name[0] == 0 = free
+struct Scene {
+  char name[SCENE_NAME_MAX + 1];
+  uint32_t relays;
+  uint32_t on;
+};
+static_assert(sizeof(Scene) == 24, "packed NVS record");
+
+std::mutex mu;
+Scene scenes[SCENE_MAX];
+
+bool validName(const char* name) {
+  size_t n = strlen(name);
+  if (!n || n > SCENE_NAME_MAX) return false;
+  for (const char* c = name; *c; c++) {
+    if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || *c == '_' || *c == '-'))
+      return false;
+  }
+  return true;
+}
+
+int find(const char* name) {
+  for (int i = 0; i < SCENE_MAX; i++) {
+    if (scenes[i].name[0] && !strcmp(scenes[i].name, name)) return i;
+  }
+  return -1;
+}
+
+void save() {
+  Preferences store;
+  store.begin(SCENES_NS, false);
+  store.putBytes(LIST_KEY, scenes, sizeof(scenes));
+  store.end();
+}
+
+// Queues the slot's relays as one batch (lock held).
+SceneError apply(int slot, CommandSource trigger) {
+  const Scene& s = scenes[slot];
+  RelayCommand cmds[RELAY_BATCH_MAX];
+  int n = 0;
+  for (int r = 1; r <= NUM_RELAYS; r++) {
+    uint32_t bit = 1u << (r - 1);
+    if (s.relays & bit) cmds[n++] = {(uint8_t)r, s.on & bit ? RELAY_OP_ON : RELAY_OP_OFF, SRC_SCENE};
+  }
+  bool queued = submitRelayBatch(cmds, n);
+  logEvent(LOG_SCENE, slot, trigger, queued ? s.relays : 0);
+  return queued ? SCENE_OK : SCENE_BUSY;
+}
+
+void writeRelayList(state_json::Writer& w, uint32_t mask) {
+  w.raw("[");
+  bool first = true;
+  for (int r = 1; r <= NUM_RELAYS; r++) {
+    if (!(mask >> (r - 1) & 1)) continue;
+    if (!first) w.raw(",");
+    first = false;
+    w.uinteger(r);
+  }
+  w.raw("]");
+}
+
+size_t errorReply(char* reply, size_t cap, SceneError e) {
+  state_json::Writer w(reply, cap);
+  w.raw("{\"scene_error\":"); w.string(sceneErrorName(e)); w.raw("}");
+  return w.finish();
+}
+
+} // namespace
+
+const char* sceneErrorName(SceneError e) {
+  static const char* const NAMES[] = {"ok", "bad name", "bad relays", "more relays than one batch", "no free scene",
+                                      "no such scene", "busy"};
+  return e < sizeof(NAMES) / sizeof(NAMES[0]) ? NAMES[e] : "?";
+}
+
+void scenesBegin() {
+  std::lock_guard<std::mutex> lk(mu);
+  memset(scenes, 0, sizeof(scenes));
+  Preferences store;
+  store.begin(SCENES_NS, true);
+  if (store.getBytes(LIST_KEY, scenes, sizeof(scenes)) != sizeof(scenes)) memset(scenes, 0, sizeof(scenes));
+  store.end();
+  for (Scene& s : scenes) {
+    s.name[SCENE_NAME_MAX] = 0;
+    if (!validName(s.name) || !(s.relays & ALL_RELAYS)) memset(&s, 0, sizeof(s));   // written by another build
+    s.relays &= ALL_RELAYS;
+    s.on &= s.relays;
+  }
+}
+
+SceneError sceneSave(const char* name, uint32_t relays, uint32_t on) {
+  if (!validName(name)) return SCENE_BAD_NAME;
+  if (!relays || (relays & ~ALL_RELAYS) || (on & ~relays)) return SCENE_BAD_RELAYS;
+  if (__builtin_popcount(relays) > RELAY_BATCH_MAX) return SCENE_TOO_BIG;
+  std::lock_guard<std::mutex> lk(mu);
+  int i = find(name);
+  if (i < 0) {
+    for (i = 0; i < SCENE_MAX && scenes[i].name[0]; i++) {}
+    if (i == SCENE_MAX) return SCENE_FULL;
+  }
+  Scene s = {};
+  strcpy(s.name, name);
+  s.relays = relays;
+  s.on = on;
+  if (memcmp(&s, &scenes[i], sizeof(s))) {
+    scenes[i] = s;
+    save();
+  }
+  return SCENE_OK;
+}
+
+SceneError sceneDelete(const char* name) {
+  std::lock_guard<std::mutex> lk(mu);
+  int i = find(name);
+  if (i < 0) return SCENE_NOT_FOUND;
+  memset(&scenes[i], 0, sizeof(Scene));
+  save();
+  return SCENE_OK;
+}
+
+SceneError sceneApply(const char* name, CommandSource trigger) {
+  std::lock_guard<std::mutex> lk(mu);
+  int i = find(name);
+  return i < 0 ? SCENE_NOT_FOUND : apply(i, trigger);
+}
+
+SceneError sceneApplySlot(int slot, CommandSource trigger) {
+  std::lock_guard<std::mutex> lk(mu);
+  if (slot < 0 || slot >= SCENE_MAX || !scenes[slot].name[0]) return SCENE_NOT_FOUND;
+  return apply(slot, trigger);
+}
+
+bool sceneParseRelays(const char* s, uint32_t& mask) {
+  mask = 0;
+  while (*s) {
+    char* end;
+    long r = strtol(s, &end, 10);
+    if (end == s || r < 1 || r > NUM_RELAYS) return false;
+    mask |= 1u << (r - 1);
+    if (*end == ',') end++;
+    else if (*end) return false;
+    s = end;
+  }
+  return true;
+}
+
+size_t scenesJson(char* out, size_t cap) {
+  state_json::Writer w(out, cap);
+  std::lock_guard<std::mutex> lk(mu);
+  w.raw("{\"scenes\":[");
+  bool first = true;
+  for (int i = 0; i < SCENE_MAX; i++) {
+    const Scene& s = scenes[i];
+    if (!s.name[0]) continue;
+    if (!first) w.raw(",");
+    first = false;
+    w.raw("{\"slot\":"); w.uinteger(i);
+    w.raw(",\"name\":"); w.string(s.name);
+    w.raw(",\"relays\":"); writeRelayList(w, s.relays);
+    w.raw(",\"on\":"); writeRelayList(w, s.on);
+    w.raw("}");
+  }
+  w.raw("]}");
+  return w.finish();
+}
+
+size_t scenesCommand(const char* text, size_t len, char* reply, size_t cap) {
+  char buf[SCENE_NAME_MAX + 140];
+  if (len >= sizeof(buf)) return 0;
+  memcpy(buf, text, len);
+  buf[len] = 0;
+  if (!strcmp(buf, "scenes")) return scenesJson(reply, cap);
+
+  char* colon = strchr(buf, ':');
+  if (!colon) return 0;
+  *colon = 0;
+  char* name = colon + 1;
+  char* rest = strchr(name, ':');
+  if (rest) *rest++ = 0;
+
+  SceneError e;
+  if (!strcmp(buf, "scene") && !rest) {
+    e = sceneApply(name, SRC_WS);
+    if (e == SCENE_OK) {
+      state_json::Writer w(reply, cap);
+      w.raw("{\"scene_applied\":"); w.string(name); w.raw("}");
+      return w.finish();
+    }
+  } else if (!strcmp(buf, "scene_save")) {
+    uint32_t on = relayStateMask(), relays = SCENE_DEFAULT_RELAYS;
+    char* relayList = rest ? strchr(rest, ':') : nullptr;
+    if (relayList) *relayList++ = 0;
+    if ((rest && !sceneParseRelays(rest, on)) || (relayList && !sceneParseRelays(relayList, relays))) {
+      e = SCENE_BAD_RELAYS;
+    } else {
+      e = sceneSave(name, relays, rest ? on : on & relays);
+      if (e == SCENE_OK) return scenesJson(reply, cap);
+    }
+  } else if (!strcmp(buf, "scene_delete") && !rest) {
+    e = sceneDelete(name);
+    if (e == SCENE_OK) return scenesJson(reply, cap);
+  } else {
+    return 0;
+  }
+  return errorReply(reply, cap, e);
+}
@@ -0,0 +1,88 @@
+// src/state_journal.cpp
+// Coalescing NVS journal for relay state (see include/state_journal.h).
+
+#include <Preferences.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "hal.h"
+#include "state_journal.h"
+
+namespace {
+
+const char* const JOURNAL_NS = "relays";
+const char* const JOURNAL_KEY = "state";
+
+Preferences store;
+
+JournalState committed;        // what NVS holds
+JournalState pending;          // latest state seen by journalTick
+uint32_t seq = 0;
+bool dirty = false;
+uint32_t dirtySinceMs = 0;     // first change not yet committed
+uint32_t lastChangeMs = 0;
+uint32_t lastCommitMs = 0;
+std::atomic<uint32_t> commits{0};
+
+// bits 0..31 relay mask, 32..39 relay 4 mode, 40..63 sequence
+uint64_t pack(const JournalState& s, uint32_t n) {
+  return (uint64_t)s.relayMask | ((uint64_t)s.relay4Mode << 32) | ((uint64_t)(n & 0xFFFFFF) << 40);
+}
+
+bool sameState(const JournalState& a, const JournalState& b) {
+  return a.relayMask == b.relayMask && a.relay4Mode == b.relay4Mode;
+}
+
+void commit(uint32_t now) {
+  dirty = false;
+  lastCommitMs = now;
+  if (sameState(pending, committed)) return;  // toggled back: nothing to write
+  store.begin(JOURNAL_NS, false);
+  store.putULong64(JOURNAL_KEY, pack(pending, ++seq));
+  store.end();
+  committed = pending;
+  commits++;
+}
+
+} // namespace
+
+bool journalRestore(JournalState& out) {
+  store.begin(JOURNAL_NS, true);
+  bool found = store.isKey(JOURNAL_KEY);
+  uint64_t v = store.getULong64(JOURNAL_KEY, 0);
+  store.end();
+
+  out = JournalState();
+  if (found) {
+    uint32_t allRelays = (uint32_t)((1ull << NUM_RELAYS) - 1);
+    uint8_t mode = (v >> 32) & 0xFF;
+    out.relayMask = (uint32_t)v & allRelays;
+    out.relay4Mode = mode <= RELAY4_MODE_AUTO ? (Relay4Mode)mode : RELAY4_MODE_OFF;
+    seq = (v >> 40) & 0xFFFFFF;
+  }
+  committed = pending = out;
+  return found;
+}
+
+void journalTick() {
+  uint32_t now = hal::millis();
+  JournalState cur;
+  cur.relayMask = relayStateMask();
+  cur.relay4Mode = relay4Mode();
+  if (!sameState(cur, pending)) {
+    pending = cur;
+    lastChangeMs = now;
+    if (!dirty) { dirty = true; dirtySinceMs = now; }
+  }
+  if (!dirty || now - lastCommitMs < JOURNAL_MIN_INTERVAL_MS) return;
+  if (now - lastChangeMs >= JOURNAL_QUIET_MS || now - dirtySinceMs >= JOURNAL_MAX_DEFER_MS) commit(now);
+}
+
+void journalFlush() {
+  pending.relayMask = relayStateMask();
+  pending.relay4Mode = relay4Mode();
+  commit(hal::millis());
+}
+
+uint32_t journalCommitCount() { return commits; }
@@ -0,0 +1,256 @@
+// src/wifi_manager.cpp
+// STA/AP connection state machine (see include/wifi_manager.h).
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "config.h"
+#include "event_log.h"
+#include "hal.h"
+#include "metrics.h"
+#include "wifi_manager.h"
+
+namespace {
+
+struct Credentials {
+  char ssid[33];
+  char pass[65];
+};
+
+// candidate 0: saved (may be empty), candidate 1: FALLBACK_SSID
+Credentials candidates[2];
+int candidate = 0;
+int failedRounds = 0;
+
+// Where the last good join went ("fast" in the wifi namespace, next to the
+// credentials). Only used for the network it was learnt on.
+struct FastConnect {
+  uint32_t ssidHash;   // FNV-1a of the SSID; 0 = nothing cached
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t reserved;
+  uint32_t ip, gateway, mask, dns;   // the lease, for WIFI_REUSE_IP
+};
+const char* const FAST_KEY = "fast";
+FastConnect fast{};
+bool directed = false;      // the attempt in flight goes to the cached BSSID/channel
+bool directedFailed = false;  // ...and failed this round: scan instead
+Preferences store;
+
+std::atomic<uint32_t> lastJoinMs{0};
+std::atomic<uint32_t> directedJoins{0}, scanJoins{0}, directedMisses{0};
+std::atomic<bool> lastDirected{false};
+
+std::atomic<WifiState> state{WIFI_STATE_AP_ONLY};
+std::atomic<bool> apUp{false};
+char apSsid[33] = "";
+
+uint32_t attemptStartMs = 0;
+uint32_t retryAtMs = 0;
+uint32_t offlineSinceMs = 0;
+uint32_t connectedAtMs = 0;
+
+// credentials from /save (web server task), picked up by the next tick
+std::mutex pendingMu;
+Credentials pending;
+std::atomic<bool> havePending{false};
+
+void setCredentials(Credentials& c, const char* ssid, const char* pass) {
+  strncpy(c.ssid, ssid ? ssid : "", sizeof(c.ssid) - 1);
+  c.ssid[sizeof(c.ssid) - 1] = 0;
+  strncpy(c.pass, pass ? pass : "", sizeof(c.pass) - 1);
+  c.pass[sizeof(c.pass) - 1] = 0;
+}
+
+void startAp() {
+  WiFi.mode(WIFI_AP_STA);
+  // on the router's channel, where the other controllers are (peer_link.h)
+  WiFi.softAP(apSsid, nullptr, fast.channel ? fast.channel : PEER_CHANNEL);
+  apUp = true;
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  logEvent(LOG_WIFI_AP_UP, 0, mac[4] << 8 | mac[5]);
+}
+
+void stopAp() {
+  WiFi.softAPdisconnect(true);
+  WiFi.mode(WIFI_STA);
+  apUp = false;
+  logEvent(LOG_WIFI_AP_DOWN);
+}
+
+uint32_t ssidHash(const char* ssid) {
+  uint32_t h = 2166136261u;
+  for (; *ssid; ssid++) h = (h ^ (uint8_t)*ssid) * 16777619u;
+  return h ? h : 1;
+}
+
+void startAttempt(uint32_t now) {
+  if (!candidates[candidate].ssid[0]) candidate = 1;  // nothing saved
+  const Credentials& c = candidates[candidate];
+  WiFi.mode(apUp ? WIFI_AP_STA : WIFI_STA);
+  directed = !directedFailed && fast.channel && fast.ssidHash == ssidHash(c.ssid);
+  if (directed) {
+    if (WIFI_REUSE_IP && fast.ip) WiFi.config(IPAddress(fast.ip), IPAddress(fast.gateway), IPAddress(fast.mask), IPAddress(fast.dns));
+    WiFi.begin(c.ssid, c.pass, fast.channel, fast.bssid);
+  } else {
+    if (WIFI_REUSE_IP) WiFi.config(IPAddress(), IPAddress(), IPAddress());   // back to DHCP
+    WiFi.begin(c.ssid, c.pass);
+  }
+  attemptStartMs = now;
+  state = WIFI_STATE_CONNECTING;
+  logEvent(LOG_WIFI_JOIN, candidate, directed ? fast.channel : 0);
+}
+
+// After a join: remember where it went, writing NVS only if that changed.
+void learnFastConnect(const char* ssid) {
+  FastConnect f{};
+  f.ssidHash = ssidHash(ssid);
+  memcpy(f.bssid, WiFi.BSSID(), sizeof(f.bssid));
+  f.channel = (uint8_t)WiFi.channel();
+  if (WIFI_REUSE_IP) {
+    f.ip = WiFi.localIP();
+    f.gateway = WiFi.gatewayIP();
+    f.mask = WiFi.subnetMask();
+    f.dns = WiFi.dnsIP();
+  }
+  if (!memcmp(&f, &fast, sizeof(f))) return;
+  fast = f;
+  store.begin("wifi", false);
+  store.putBytes(FAST_KEY, &fast, sizeof(fast));
+  store.end();
+}
+
+void attemptFailed(uint32_t now) {
+  WiFi.disconnect();
+  if (directed) {
+    // the router is not where it was: same candidate, full scan
+    directedFailed = true;
+    directedMisses.fetch_add(1, std::memory_order_relaxed);
+    startAttempt(now);
+    return;
+  }
+  if (++candidate < 2) { startAttempt(now); return; }
+
+  // every candidate failed: wait before the next round, doubling each time
+  candidate = 0;
+  directedFailed = false;
+  uint32_t backoff = WIFI_BACKOFF_MAX_MS;
+  if (failedRounds < 16) backoff = min(WIFI_BACKOFF_MAX_MS, WIFI_BACKOFF_MIN_MS << failedRounds);
+  failedRounds++;
+  retryAtMs = now + backoff;
+  state = WIFI_STATE_BACKOFF;
+  logEvent(LOG_WIFI_BACKOFF, 0, backoff);
+}
+
+void connectNow(const Credentials& c) {
+  candidates[0] = c;
+  candidate = 0;
+  failedRounds = 0;
+  directedFailed = false;
+  uint32_t now = hal::millis();
+  if (state == WIFI_STATE_CONNECTED) offlineSinceMs = now;
+  WiFi.disconnect();
+  startAttempt(now);
+}
+
+} // namespace
+
+void wifiManagerBegin(const char* ssid, const char* pass, bool forceAp) {
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  snprintf(apSsid, sizeof(apSsid), "%s%02X%02X", AP_PREFIX, mac[4], mac[5]);
+
+  setCredentials(candidates[0], ssid, pass);
+  setCredentials(candidates[1], FALLBACK_SSID, FALLBACK_PASS);
+  candidate = 0;
+  failedRounds = 0;
+  WiFi.setAutoReconnect(false);  // retries are ours, with backoff
+  store.begin("wifi", true);
+  if (store.getBytes(FAST_KEY, &fast, sizeof(fast)) != sizeof(fast)) fast = FastConnect{};
+  store.end();
+
+  uint32_t now = hal::millis();
+  offlineSinceMs = now;
+  if (forceAp) {
+    state = WIFI_STATE_AP_ONLY;
+    startAp();
+    return;
+  }
+  if (apUp) stopAp();
+  startAttempt(now);
+}
+
+void wifiManagerConnect(const char* ssid, const char* pass) {
+  std::lock_guard<std::mutex> lk(pendingMu);
+  setCredentials(pending, ssid, pass);
+  havePending = true;
+}
+
+void wifiManagerTick() {
+  if (havePending.exchange(false)) {
+    std::lock_guard<std::mutex> lk(pendingMu);
+    connectNow(pending);
+  }
+  uint32_t now = hal::millis();
+  switch (state.load()) {
+    case WIFI_STATE_AP_ONLY:
+      return;
+
+    case WIFI_STATE_CONNECTING: {
+      wl_status_t st = WiFi.status();
+      if (st == WL_CONNECTED) {
+        state = WIFI_STATE_CONNECTED;
+        failedRounds = 0;
+        directedFailed = false;
+        connectedAtMs = now;
+        lastJoinMs.store(now - attemptStartMs, std::memory_order_relaxed);
+        lastDirected.store(directed, std::memory_order_relaxed);
+        (directed ? directedJoins : scanJoins).fetch_add(1, std::memory_order_relaxed);
+        logEvent(LOG_WIFI_CONNECTED, directed, now - offlineSinceMs, logIp(WiFi.localIP()));
+        metricsBootMark(BOOT_STA_CONNECTED);
+        learnFastConnect(candidates[candidate].ssid);
+        return;
+      }
+      if (st == WL_NO_SSID_AVAIL || st == WL_CONNECT_FAILED ||
+          now - attemptStartMs >= (directed ? WIFI_FAST_CONNECT_TIMEOUT_MS : WIFI_CONNECT_TIMEOUT_MS)) {
+        attemptFailed(now);
+      }
+      break;
+    }
+
+    case WIFI_STATE_BACKOFF:
+      if ((int32_t)(now - retryAtMs) >= 0) startAttempt(now);
+      break;
+
+    case WIFI_STATE_CONNECTED:
+      if (WiFi.status() != WL_CONNECTED) {
+        logEvent(LOG_WIFI_LOST);
+        offlineSinceMs = now;
+        candidate = 0;
+        WiFi.disconnect();
+        startAttempt(now);
+        break;
+      }
+      if (apUp && now - connectedAtMs >= WIFI_AP_LINGER_MS) stopAp();
+      return;
+  }
+
+  // still offline: bring the setup AP up next to the STA retries
+  if (!apUp && now - offlineSinceMs >= WIFI_AP_FALLBACK_MS) startAp();
+}
+
+WifiState wifiManagerState() { return state; }
+
+WifiJoinStats wifiManagerJoinStats() {
+  return {lastJoinMs.load(std::memory_order_relaxed), directedJoins.load(std::memory_order_relaxed),
+          scanJoins.load(std::memory_order_relaxed), directedMisses.load(std::memory_order_relaxed),
+          lastDirected.load(std::memory_order_relaxed)};
+}
+bool wifiManagerApUp() { return apUp; }
+const char* wifiManagerApSsid() { return apSsid; }
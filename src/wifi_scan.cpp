@@ -0,0 +1,106 @@
+// src/wifi_scan.cpp
+// Async WiFi scan + cache (see include/wifi_scan.h).
+
+#include <WiFi.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "hal.h"
+#include "state_json.h"
+#include "wifi_scan.h"
+
+namespace {
+
+// written by wifiScanPoll (net task), read by the web server's task
+std::mutex cacheMu;
+ScanEntry results[SCAN_MAX_RESULTS];
+int resultCount = 0;
+bool haveResults = false;
+uint32_t lastScanMs = 0;
+
+std::atomic<bool> requested{false};
+std::atomic<bool> running{false};
+
+void writeEntry(state_json::Writer& w, const ScanEntry& e) {
+  w.raw("{\"ssid\":"); w.string(e.ssid);
+  w.raw(",\"rssi\":"); w.integer(e.rssi);
+  w.raw(",\"secure\":"); w.boolean(e.secure);
+  w.raw("}");
+}
+
+bool cacheFresh() {
+  std::lock_guard<std::mutex> lk(cacheMu);
+  return haveResults && hal::millis() - lastScanMs < SCAN_CACHE_TTL_MS;
+}
+
+} // namespace
+
+bool wifiScanRequest() {
+  if (running) return true;
+  if (cacheFresh()) return false;
+  requested = true;
+  return true;
+}
+
+bool wifiScanPoll() {
+  if (!running) {
+    if (!requested.exchange(false) || cacheFresh()) return false;
+    if (WiFi.scanNetworks(true) != WIFI_SCAN_FAILED) running = true;
+    return false;
+  }
+  int16_t n = WiFi.scanComplete();
+  if (n == WIFI_SCAN_RUNNING) return false;
+  if (n < 0) {                 // failed: keep the old cache, next request retries
+    running = false;
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lk(cacheMu);
+    resultCount = 0;
+    for (int i = 0; i < n && resultCount < SCAN_MAX_RESULTS; i++) {
+      ScanEntry& e = results[resultCount++];
+      strncpy(e.ssid, WiFi.SSID(i).c_str(), sizeof(e.ssid) - 1);
+      e.ssid[sizeof(e.ssid) - 1] = 0;
+      e.rssi = WiFi.RSSI(i);
+      e.secure = (WiFi.encryptionType(i) != WIFI_AUTH_OPEN);
+    }
+    haveResults = true;
+    lastScanMs = hal::millis();
+  }
+  WiFi.scanDelete();
+  running = false;
+  return true;
+}
+
+bool wifiScanRunning() { return running || requested; }
+
+int wifiScanCount() {
+  std::lock_guard<std::mutex> lk(cacheMu);
+  return resultCount;
+}
+
+size_t wifiScanJson(char* out, size_t cap) {
+  std::lock_guard<std::mutex> lk(cacheMu);
+  state_json::Writer w(out, cap);
+  w.raw("[");
+  for (int i = 0; i < resultCount; i++) {
+    if (i) w.raw(",");
+    writeEntry(w, results[i]);
+  }
+  w.raw("]");
+  return w.finish();
+}
+
+size_t wifiScanEntryJson(char* out, size_t cap, int i) {
+  std::lock_guard<std::mutex> lk(cacheMu);
+  if (i < 0 || i >= resultCount) return 0;
+  state_json::Writer w(out, cap);
+  w.raw("{\"scan\":");
+  writeEntry(w, results[i]);
+  w.raw(",\"i\":"); w.integer(i);
+  w.raw(",\"n\":"); w.integer(resultCount);
+  w.raw("}");
+  return w.finish();
+}
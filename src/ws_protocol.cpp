@@ -0,0 +1,73 @@
+// src/ws_protocol.cpp
+// Binary WS command frames and acks (see include/ws_protocol.h).
+
+#include <string.h>
+
+#include "ws_protocol.h"
+
+namespace ws_protocol {
+
+WsAckResult toRelayCommand(const WsCommand& cmd, RelayCommand& out) {
+  switch (cmd.op) {
+    case WS_OP_OFF:
+    case WS_OP_ON:
+    case WS_OP_TOGGLE:
+      if (cmd.arg < 1 || cmd.arg > NUM_RELAYS) return WS_ACK_BAD_ARG;
+      out = {cmd.arg, cmd.op == WS_OP_OFF ? RELAY_OP_OFF : cmd.op == WS_OP_ON ? RELAY_OP_ON : RELAY_OP_TOGGLE, SRC_WS};
+      return WS_ACK_OK;
+    case WS_OP_MODE:
+      // a manual OFF/ON on IR_RELAY sets the mode, like commandRelay4Mode()
+      if (cmd.arg == RELAY4_MODE_OFF) out = {IR_RELAY, RELAY_OP_OFF, SRC_WS};
+      else if (cmd.arg == RELAY4_MODE_ON) out = {IR_RELAY, RELAY_OP_ON, SRC_WS};
+      else if (cmd.arg == RELAY4_MODE_AUTO) out = {IR_RELAY, RELAY_OP_AUTO, SRC_WS};
+      else return WS_ACK_BAD_ARG;
+      return WS_ACK_OK;
+    default:
+      return WS_ACK_BAD_OP;
+  }
+}
+
+bool parseText(const char* text, size_t len, WsCommand& out) {
+  if (len < 8 || len > 10 || memcmp(text, "toggle:", 7)) return false;
+  int r = 0;
+  for (size_t i = 7; i < len; i++) {
+    if (text[i] < '0' || text[i] > '9') return false;
+    r = r * 10 + (text[i] - '0');
+  }
+  if (r < 1 || r > NUM_RELAYS) return false;
+  out = {0, WS_OP_TOGGLE, (uint8_t)r};
+  return true;
+}
+
+size_t execute(const uint8_t* data, size_t len, uint8_t* ack, size_t cap) {
+  if (cap < 3) return 0;
+  ack[0] = WS_ACK_MAGIC;
+  int n = frameCount(data, len);
+  if (n < 0 || cap < 3 + 3 * (size_t)n) {
+    ack[1] = WS_FRAME_MALFORMED;
+    ack[2] = 0;
+    return 3;
+  }
+
+  RelayCommand batch[WS_CMD_BATCH_MAX];
+  int queued = 0;
+  uint8_t* entry = ack + 3;
+  for (int i = 0; i < n; i++, entry += 3) {
+    WsCommand cmd = frameCommand(data, i);
+    WsAckResult res = toRelayCommand(cmd, batch[queued]);
+    if (res == WS_ACK_OK) queued++;
+    entry[0] = (uint8_t)cmd.seq;
+    entry[1] = (uint8_t)(cmd.seq >> 8);
+    entry[2] = res;
+  }
+  if (queued && !submitRelayBatch(batch, queued)) {
+    for (int i = 0; i < n; i++) {
+      if (ack[3 + 3 * i + 2] == WS_ACK_OK) ack[3 + 3 * i + 2] = WS_ACK_BUSY;
+    }
+  }
+  ack[1] = WS_FRAME_OK;
+  ack[2] = (uint8_t)n;
+  return 3 + 3 * n;
+}
+
+} // namespace ws_protocol
@@ -0,0 +1,231 @@
+// src/ws_stream.cpp
+// WebSocket state + IR telemetry stream (see include/ws_stream.h).
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "event_log.h"
+#include "hal.h"
+#include "metrics.h"
+#include "relay_control.h"
+#include "state_json.h"
+#include "ws_stream.h"
+
+namespace {
+
+// {"seq":4294967295,"relay_states":[...],"relay4_mode":"auto"} or the delta
+// form, whose per-relay entries ("32":false,) are the larger of the two
+const size_t FRAME_MAX = 64 + 12 * NUM_RELAYS;
+
+struct ClientSlot {
+  bool used = false;
+  uint32_t id = 0;
+  bool resync = false;          // owes a snapshot
+  uint32_t irPeriodMs = 0;      // 0 = not subscribed
+  uint32_t nextIrMs = 0;
+  uint32_t metricsPeriodMs = 0;
+  uint32_t nextMetricsMs = 0;
+  bool stalled = false;         // send queue was full last time
+  uint32_t stalledSinceMs = 0;
+};
+
+// Claimed by the AsyncTCP task, served by the net task. Nothing is sent while
+// slotsMu is held: the library takes its own lock to queue a frame, and holds
+// it while it delivers the events that land in here.
+std::mutex slotsMu;
+ClientSlot slots[WS_STREAM_MAX_CLIENTS];
+
+AsyncWebSocket* socket = nullptr;
+
+// net task only
+std::atomic<uint32_t> seq{0};
+uint32_t streamedMask = 0;
+Relay4Mode streamedMode = RELAY4_MODE_OFF;
+char metricsFrame[METRICS_JSON_MAX];
+
+inline bool due(uint32_t periodMs, uint32_t nextMs, uint32_t now) {
+  return periodMs && (int32_t)(now - nextMs) >= 0;
+}
+
+// "<digits>" -> period clamped to [minMs, maxMs], 0 stays 0 (unsubscribe)
+uint32_t parsePeriod(const char* text, size_t len, uint32_t minMs, uint32_t maxMs) {
+  uint32_t period = 0;
+  for (size_t i = 0; i < len && text[i] >= '0' && text[i] <= '9' && period <= maxMs; i++) {
+    period = period * 10 + (text[i] - '0');
+  }
+  return period ? min(max(period, minMs), maxMs) : 0;
+}
+
+ClientSlot* findSlot(uint32_t id) {
+  for (ClientSlot& s : slots) {
+    if (s.used && s.id == id) return &s;
+  }
+  return nullptr;
+}
+
+size_t snapshotJson(char* out, size_t cap, uint32_t mask, Relay4Mode mode) {
+  state_json::Writer w(out, cap);
+  w.raw("{\"seq\":"); w.uinteger(seq);
+  w.raw(",\"relay_states\":[");
+  for (int i = 0; i < NUM_RELAYS; i++) {
+    if (i) w.raw(",");
+    w.boolean((mask >> i) & 1u);
+  }
+  w.raw("],\"relay4_mode\":"); w.string(relay4ModeName(mode));
+  w.raw("}");
+  return w.finish();
+}
+
+size_t deltaJson(char* out, size_t cap, uint32_t mask, uint32_t changed, Relay4Mode mode, bool modeChanged) {
+  state_json::Writer w(out, cap);
+  w.raw("{\"seq\":"); w.uinteger(seq);
+  w.raw(",\"d\":{");
+  bool first = true;
+  for (int i = 0; i < NUM_RELAYS; i++) {
+    if (!((changed >> i) & 1u)) continue;
+    if (!first) w.raw(",");
+    first = false;
+    w.raw("\""); w.integer(i + 1); w.raw("\":");
+    w.boolean((mask >> i) & 1u);
+  }
+  w.raw("}");
+  if (modeChanged) { w.raw(",\"relay4_mode\":"); w.string(relay4ModeName(mode)); }
+  w.raw("}");
+  return w.finish();
+}
+
+} // namespace
+
+void wsStreamBegin(AsyncWebSocket* ws) {
+  socket = ws;
+  streamedMask = relayStateMask();
+  streamedMode = relay4Mode();
+}
+
+bool wsStreamConnected(uint32_t clientId) {
+  std::lock_guard<std::mutex> lk(slotsMu);
+  if (findSlot(clientId)) return true;
+  for (ClientSlot& s : slots) {
+    if (s.used) continue;
+    s = ClientSlot();
+    s.used = true;
+    s.id = clientId;
+    s.resync = true;   // first frame is a snapshot
+    return true;
+  }
+  return false;
+}
+
+void wsStreamDisconnected(uint32_t clientId) {
+  std::lock_guard<std::mutex> lk(slotsMu);
+  if (ClientSlot* s = findSlot(clientId)) s->used = false;
+}
+
+bool wsStreamCommand(uint32_t clientId, const char* text, size_t len) {
+  bool status = len == 6 && !strncmp(text, "status", 6);
+  bool ir = len > 3 && !strncmp(text, "ir:", 3);
+  bool metrics = len > 8 && !strncmp(text, "metrics:", 8);
+  if (!status && !ir && !metrics) return false;
+  std::lock_guard<std::mutex> lk(slotsMu);
+  ClientSlot* s = findSlot(clientId);
+  if (!s) return true;
+  if (status) {
+    s->resync = true;
+  } else if (ir) {
+    s->irPeriodMs = parsePeriod(text + 3, len - 3, WS_IR_MIN_PERIOD_MS, WS_IR_MAX_PERIOD_MS);
+    s->nextIrMs = hal::millis();
+  } else {
+    s->metricsPeriodMs = parsePeriod(text + 8, len - 8, WS_METRICS_MIN_PERIOD_MS, WS_IR_MAX_PERIOD_MS);
+    s->nextMetricsMs = hal::millis();
+  }
+  return true;
+}
+
+void wsStreamTick(int irValue) {
+  if (!socket) return;
+  uint32_t now = hal::millis();
+
+  // one delta per tick, whatever happened since the last one
+  uint32_t mask = relayStateMask();
+  Relay4Mode mode = relay4Mode();
+  uint32_t changed = mask ^ streamedMask;
+  bool modeChanged = mode != streamedMode;
+  char delta[FRAME_MAX];
+  size_t deltaLen = 0;
+  if (changed || modeChanged) {
+    seq++;
+    deltaLen = deltaJson(delta, sizeof(delta), mask, changed, mode, modeChanged);
+    streamedMask = mask;
+    streamedMode = mode;
+  }
+
+  ClientSlot work[WS_STREAM_MAX_CLIENTS];
+  int n = 0;
+  {
+    std::lock_guard<std::mutex> lk(slotsMu);
+    for (ClientSlot& s : slots) {
+      if (!s.used) continue;
+      bool periodic = due(s.irPeriodMs, s.nextIrMs, now) || due(s.metricsPeriodMs, s.nextMetricsMs, now);
+      if (!s.resync && !deltaLen && !periodic) continue;
+      work[n++] = s;
+      s.resync = false;   // taken; handed back below if it could not be sent
+    }
+  }
+  if (!n) return;
+
+  char snapshot[FRAME_MAX];
+  size_t snapshotLen = 0;
+  char ir[24];
+  int irLen = snprintf(ir, sizeof(ir), "{\"ir\":%d}", irValue);
+  size_t metricsLen = 0;
+  for (int i = 0; i < n; i++) {
+    ClientSlot& c = work[i];
+    if (!socket->availableForWrite(c.id)) {
+      // queue full: this client misses the frame, so it owes a snapshot
+      c.resync = true;
+      if (!c.stalled) {
+        c.stalled = true;
+        c.stalledSinceMs = now;
+      } else if (now - c.stalledSinceMs >= WS_STALL_DROP_MS) {
+        logEvent(LOG_WS_STALLED, 0, c.id, now - c.stalledSinceMs);
+        socket->close(c.id);
+      }
+      continue;
+    }
+    c.stalled = false;
+    if (c.resync) {
+      if (!snapshotLen) snapshotLen = snapshotJson(snapshot, sizeof(snapshot), mask, mode);
+      c.resync = !socket->text(c.id, snapshot, snapshotLen);
+    } else if (deltaLen) {
+      c.resync = !socket->text(c.id, delta, deltaLen);
+    }
+    if (due(c.irPeriodMs, c.nextIrMs, now) && socket->text(c.id, ir, irLen)) {
+      c.nextIrMs = now + c.irPeriodMs;
+    }
+    if (due(c.metricsPeriodMs, c.nextMetricsMs, now)) {
+      if (!metricsLen) {
+        MetricsGauges g;
+        g.wsClients = socket->count();
+        g.irValue = irValue;
+        metricsLen = metricsJson(metricsFrame, sizeof(metricsFrame), g);
+      }
+      if (socket->text(c.id, metricsFrame, metricsLen)) c.nextMetricsMs = now + c.metricsPeriodMs;
+    }
+  }
+
+  std::lock_guard<std::mutex> lk(slotsMu);
+  for (int i = 0; i < n; i++) {
+    ClientSlot* s = findSlot(work[i].id);
+    if (!s) continue;   // disconnected meanwhile
+    s->resync |= work[i].resync;
+    s->stalled = work[i].stalled;
+    s->stalledSinceMs = work[i].stalledSinceMs;
+    if (s->irPeriodMs == work[i].irPeriodMs) s->nextIrMs = work[i].nextIrMs;
+    if (s->metricsPeriodMs == work[i].metricsPeriodMs) s->nextMetricsMs = work[i].nextMetricsMs;
+  }
+}
+
+uint32_t wsStreamSeq() { return seq; }
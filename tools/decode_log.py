@@ -0,0 +1,159 @@
+# tools/decode_log.py
+# Decodes a binary event log dump (include/event_log.h): GET /log?format=bin
+# from a board, or a file saved from it (the `log` bench case writes one).
+# Event numbers are read from the LogEventType enum in include/event_log.h,
+# so the tool follows the firmware as types are added.
+#
+#   python tools/decode_log.py --url http://192.168.1.50/log?format=bin
+#   python tools/decode_log.py dump.bin [--ago] [--type LOG_RELAY]
+
+import argparse
+import os
+import re
+import struct
+import sys
+import urllib.request
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+HEADER = struct.Struct("<4sHHII")   # LogDumpHeader
+RECORD = struct.Struct("<IHBBII")   # LogRecord
+SOURCES = ["ws", "http", "cloud", "ir", "mqtt", "remote", "timer", "scene", "peer", "rule"]   # CommandSource order
+MODES = ["off", "on", "auto"]                     # Relay4Mode order
+OTA_ERRORS = ["ok", "busy", "bad size", "sha256 mismatch", "not a valid image", "flash error", "stalled",
+              "incomplete"]                       # OtaError order
+TIMER_KINDS = ["timer", "auto-off", "schedule"]  # RelayTimerKind order
+OPS = ["off", "on", "toggle"]                     # RelayOp order
+PEER_ERRORS = ["ok", "unknown node", "bad relay", "busy", "no answer"]  # PeerError order
+BOOT_MILESTONES = ["relays_restored", "setup_done", "sta_connected", "first_command",
+                   "cloud_ready"]                 # BootMilestone order
+
+
+def event_names():
+    with open(os.path.join(ROOT, "include", "event_log.h")) as f:
+        body = re.search(r"enum LogEventType[^{]*\{(.*?)\};", f.read(), re.S).group(1)
+    body = re.sub(r"//.*", "", body)
+    return [n.strip() for n in body.split(",") if n.strip() and not n.strip().endswith("_COUNT")]
+
+
+def ap_prefix():
+    try:
+        with open(os.path.join(ROOT, "include", "config.h")) as f:
+            return re.search(r'AP_PREFIX\s*=\s*"([^"]*)"', f.read()).group(1)
+    except (OSError, AttributeError):
+        return "ESP32-Setup-"
+
+
+def ip(v):
+    return "%d.%d.%d.%d" % (v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, v >> 24)
+
+
+def pick(table, i):
+    return table[i] if i < len(table) else "?"
+
+
+# same wording as eventLogFormat() in src/event_log.cpp
+FORMATS = {
+    "LOG_BOOT": lambda a, v1, v2: "boot, %d bytes free" % v1,
+    "LOG_RESTORED": lambda a, v1, v2: "restored relay state 0x%02X, relay 4 %s" % (v1, pick(MODES, a)),
+    "LOG_BOOT_BUTTON": lambda a, v1, v2: "BOOT pressed -> forced AP mode for setup",
+    "LOG_RELAY": lambda a, v1, v2: "relay %d %s -> %s (%s)" % (
+        a, "on" if v2 & 2 else "off", "on" if v2 & 1 else "off", pick(SOURCES, v1)),
+    "LOG_CLOUD_STARTED": lambda a, v1, v2: "SinricPro started",
+    "LOG_CLOUD_COMMAND": lambda a, v1, v2: "SinricPro: relay %d -> %s" % (a, "ON" if v1 else "OFF"),
+    "LOG_WS_CONNECT": lambda a, v1, v2: "WS client %d connected from %s" % (v1, ip(v2)),
+    "LOG_WS_DISCONNECT": lambda a, v1, v2: "WS client %d disconnected" % v1,
+    "LOG_WS_STALLED": lambda a, v1, v2: "WS client %d stalled for %d ms, closing" % (v1, v2),
+    "LOG_IR_FALLBACK": lambda a, v1, v2: "IR: ADC DMA unavailable, falling back to 1 kHz analogRead",
+    "LOG_WIFI_AP_UP": lambda a, v1, v2: "WiFi: AP '%s%02X%02X' up" % (ap_prefix(), (v1 >> 8) & 0xFF, v1 & 0xFF),
+    "LOG_WIFI_AP_DOWN": lambda a, v1, v2: "WiFi: AP down",
+    "LOG_WIFI_JOIN": lambda a, v1, v2: "WiFi: joining the %s network%s" % (
+        "fallback" if a else "saved", " on channel %d (cached)" % v1 if v1 else ""),
+    "LOG_WIFI_BACKOFF": lambda a, v1, v2: "WiFi: no network, retry in %d ms" % v1,
+    "LOG_WIFI_CONNECTED": lambda a, v1, v2: "WiFi: STA connected after %d ms offline%s, IP: %s" % (
+        v1, " (no scan)" if a else "", ip(v2)),
+    "LOG_WIFI_LOST": lambda a, v1, v2: "WiFi: STA lost",
+    "LOG_MQTT_CONNECTED": lambda a, v1, v2: "MQTT connected",
+    "LOG_MQTT_FAILED": lambda a, v1, v2: "MQTT connect failed (%d), retry in %d ms" % (
+        v1 - (1 << 32) if v1 & 0x80000000 else v1, v2),
+    "LOG_POWER_BACKUP": lambda a, v1, v2: "power: mains lost for %d ms -> battery profile" % v1,
+    "LOG_POWER_MAINS": lambda a, v1, v2: "power: mains back for %d ms -> mains profile" % v1,
+    "LOG_REMOTE_KEY": lambda a, v1, v2: "remote: code 0x%08X (%s)" % (v1, "key %d" % a if a else "no key"),
+    "LOG_CLOUD_RESYNC": lambda a, v1, v2: "SinricPro: back after %d ms, %d relay report(s) pending" % (v1, a),
+    "LOG_CLOUD_CONFLICT": lambda a, v1, v2: "SinricPro: relay %d -> %s refused, local change not reported yet" % (
+        a, "ON" if v1 else "OFF"),
+    "LOG_OTA_START": lambda a, v1, v2: "update: receiving %d bytes" % v1,
+    "LOG_OTA_DONE": lambda a, v1, v2: "update: %d bytes verified in %d ms, restarting into it" % (v1, v2),
+    "LOG_OTA_FAILED": lambda a, v1, v2: "update: failed (%s) after %d bytes" % (
+        OTA_ERRORS[a] if a < len(OTA_ERRORS) else a, v1),
+    "LOG_OTA_CONFIRMED": lambda a, v1, v2: "update: new firmware confirmed %d ms after boot" % v1,
+    "LOG_OTA_ROLLBACK": lambda a, v1, v2: "update: new firmware unconfirmed after %s, %s" % (
+        "%d boots" % a if a else "%d ms" % v1, "rolling back" if v2 else "no previous image to roll back to"),
+    "LOG_BOOT_MILESTONE": lambda a, v1, v2: "boot: %s at %d ms" % (
+        BOOT_MILESTONES[a] if a < len(BOOT_MILESTONES) else a, v1),
+    "LOG_TIMER_FIRED": lambda a, v1, v2: "%s %d: relay %d %s" % (
+        TIMER_KINDS[v2 >> 8] if v2 >> 8 < len(TIMER_KINDS) else "timer", v1, a,
+        OPS[v2 & 0xFF] if v2 & 0xFF < len(OPS) else "?"),
+    "LOG_SCENE": lambda a, v1, v2: ("scene %d applied (%s): relays 0x%02X" % (a, pick(SOURCES, v1), v2) if v2
+                                    else "scene %d (%s): refused, queue full" % (a, pick(SOURCES, v1))),
+    "LOG_PEER": lambda a, v1, v2: "peer %d: %s" % (v1, pick(["silent, dropped", "heard", "ESP-NOW failed to start", "link off: no PEER_KEY"], a)),
+    "LOG_PEER_COMMAND": lambda a, v1, v2: "peer %d: relay %d %s" % (v1, a, pick(OPS, v2)),
+    "LOG_PEER_ANSWER": lambda a, v1, v2: "peer %d relay %d: %s after %d ms" % (v1, v2 >> 16, pick(PEER_ERRORS, a), v2 & 0xFFFF),
+    "LOG_RULE": lambda a, v1, v2: ("rule %d: switched off, looping" % a if v1 == 2 else "rule %d: relay %d %s%s" % (
+        a, v2 >> 8, pick(OPS, v2 & 0xFF), " refused, queue full" if v1 else "")),
+}
+
+
+def decode(data):
+    if len(data) < HEADER.size:
+        raise ValueError("dump too short (%d bytes)" % len(data))
+    magic, size, count, now_ms, total = HEADER.unpack_from(data)
+    if magic != b"EVL1" or size != RECORD.size:
+        raise ValueError("not an event log dump (magic %r, record size %d)" % (magic, size))
+    if len(data) < HEADER.size + count * size:
+        raise ValueError("dump truncated: %d of %d records" % ((len(data) - HEADER.size) // size, count))
+    records = [RECORD.unpack_from(data, HEADER.size + i * size) for i in range(count)]
+    return now_ms, total, records
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode a binary event log dump (GET /log?format=bin).")
+    ap.add_argument("file", nargs="?", help="dump file ('-' for stdin)")
+    ap.add_argument("--url", help="fetch the dump from the board instead, e.g. http://<ip>/log?format=bin")
+    ap.add_argument("--ago", action="store_true", help="show times as seconds before the dump")
+    ap.add_argument("--type", action="append", help="only these event types (LOG_RELAY, ...); repeatable")
+    args = ap.parse_args()
+
+    if args.url:
+        with urllib.request.urlopen(args.url, timeout=5) as r:
+            data = r.read()
+    elif args.file == "-":
+        data = sys.stdin.buffer.read()
+    elif args.file:
+        with open(args.file, "rb") as f:
+            data = f.read()
+    else:
+        ap.error("give a dump file or --url")
+
+    names = event_names()
+    now_ms, total, records = decode(data)
+    print("# %d of %d events, dumped at %.3f s" % (len(records), total, now_ms / 1000.0))
+    prev = None
+    for time_ms, seq, type_, a, v1, v2 in records:
+        if prev is not None and (prev + 1) & 0xFFFF != seq:
+            print("# %d events missing" % ((seq - prev - 1) & 0xFFFF))
+        prev = seq
+        name = names[type_] if type_ < len(names) else "event %d" % type_
+        if args.type and name not in args.type:
+            continue
+        fmt = FORMATS.get(name)
+        text = fmt(a, v1, v2) if fmt else "%s a=%d v1=%d v2=%d" % (name, a, v1, v2)
+        if args.ago:
+            stamp = "-%9.3f" % (((now_ms - time_ms) & 0xFFFFFFFF) / 1000.0)
+        else:
+            stamp = "%9.3f" % (time_ms / 1000.0)
+        print("%s %s" % (stamp, text))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,60 @@
+# tools/embed_web_ui.py
+# PlatformIO pre-build script: gzips web/index.html into include/web_ui_gz.h
+# as a const (flash-resident) byte array plus an ETag derived from its content.
+# Also runs standalone: `python tools/embed_web_ui.py`.
+
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 (provided by PlatformIO/SCons)
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+SRC = os.path.join(PROJECT_DIR, "web", "index.html")
+OUT = os.path.join(PROJECT_DIR, "include", "web_ui_gz.h")
+
+
+def render(gz, etag):
+    lines = [
+        "#pragma once",
+        "",
+        "// include/web_ui_gz.h",
+        "// Generated by tools/embed_web_ui.py from web/index.html -- do not edit.",
+        "",
+        "#include <stddef.h>",
+        "#include <stdint.h>",
+        "",
+        "#ifndef PROGMEM",
+        "#define PROGMEM",
+        "#endif",
+        "",
+        '#define WEB_UI_ETAG "\\"%s\\""' % etag,
+        "const size_t WEB_UI_GZ_LEN = %d;" % len(gz),
+        "const uint8_t WEB_UI_GZ[] PROGMEM = {",
+    ]
+    for i in range(0, len(gz), 16):
+        lines.append("  " + ", ".join("0x%02x" % b for b in gz[i:i + 16]) + ",")
+    lines.append("};")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    with open(SRC, "rb") as f:
+        html = f.read()
+    gz = gzip.compress(html, compresslevel=9, mtime=0)  # mtime=0: same input -> same bytes
+    etag = hashlib.sha256(gz).hexdigest()[:16]
+    text = render(gz, etag)
+
+    if os.path.exists(OUT):
+        with open(OUT) as f:
+            if f.read() == text:
+                return  # unchanged: don't trigger a rebuild
+    with open(OUT, "w") as f:
+        f.write(text)
+    print("web UI: %d -> %d bytes gzip, etag %s" % (len(html), len(gz), etag))
+
+
+main()
@@ -0,0 +1,123 @@
+# tools/http_load.py
+# Local load generator for the web server: N concurrent clients for a few
+# seconds each, reporting requests/s and latency percentiles. Runs against a
+# board on the LAN (STA or setup AP) or the host build (`program serve`).
+#
+#   python tools/http_load.py --host 192.168.1.50            # board
+#   python tools/http_load.py --host 127.0.0.1 --port 8080   # native `serve`
+#
+# http: GET --path on a fresh connection per request (the server closes
+# after each response). ws: "status" round trips on one open /ws socket per
+# client. Standard library only.
+
+import argparse
+import asyncio
+import base64
+import os
+import statistics
+import struct
+import time
+
+
+async def http_client(args, stop, lat, errors):
+    req = ("GET %s HTTP/1.1\r\nHost: %s\r\n\r\n" % (args.path, args.host)).encode()
+    while not stop.is_set():
+        t0 = time.perf_counter()
+        try:
+            reader, writer = await asyncio.wait_for(asyncio.open_connection(args.host, args.port), args.timeout)
+            writer.write(req)
+            resp = await asyncio.wait_for(reader.read(), args.timeout)  # to EOF
+            writer.close()
+            if resp.startswith(b"HTTP/1.1 200"):
+                lat.append((time.perf_counter() - t0) * 1000)
+                continue
+        except (OSError, asyncio.TimeoutError):
+            pass
+        errors.append(1)
+        await asyncio.sleep(0.05)
+
+
+async def ws_read_frame(reader):
+    head = await reader.readexactly(2)
+    n = head[1] & 0x7F
+    if n == 126:
+        n = struct.unpack(">H", await reader.readexactly(2))[0]
+    elif n == 127:
+        n = struct.unpack(">Q", await reader.readexactly(8))[0]
+    return head[0] & 0x0F, await reader.readexactly(n)
+
+
+def ws_text_frame(text):
+    data = text.encode()
+    mask = os.urandom(4)
+    return bytes([0x81, 0x80 | len(data)]) + mask + bytes(b ^ mask[i % 4] for i, b in enumerate(data))
+
+
+async def ws_client(args, stop, lat, errors):
+    try:
+        reader, writer = await asyncio.wait_for(asyncio.open_connection(args.host, args.port), args.timeout)
+        key = base64.b64encode(os.urandom(16)).decode()
+        writer.write(("GET /ws HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                      "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n" % (args.host, key)).encode())
+        head = await asyncio.wait_for(reader.readuntil(b"\r\n\r\n"), args.timeout)
+        if not head.startswith(b"HTTP/1.1 101"):
+            raise OSError("no upgrade")
+        await asyncio.wait_for(ws_read_frame(reader), args.timeout)  # state sent on connect
+    except (OSError, asyncio.TimeoutError, asyncio.IncompleteReadError):
+        errors.append(1)
+        return
+    frame = ws_text_frame("status")
+    try:
+        while not stop.is_set():
+            t0 = time.perf_counter()
+            writer.write(frame)
+            while True:   # skip unrelated pushes (scan results)
+                op, data = await asyncio.wait_for(ws_read_frame(reader), args.timeout)
+                if op == 1 and data.startswith(b'{"relay_states"'):
+                    break
+                if op == 8:
+                    raise OSError("closed by server")
+            lat.append((time.perf_counter() - t0) * 1000)
+    except (OSError, asyncio.TimeoutError, asyncio.IncompleteReadError):
+        errors.append(1)
+    writer.close()
+
+
+async def run_level(args, clients):
+    stop = asyncio.Event()
+    lat, errors = [], []
+    client = http_client if args.mode == "http" else ws_client
+    t0 = time.perf_counter()
+    tasks = [asyncio.create_task(client(args, stop, lat, errors)) for _ in range(clients)]
+    await asyncio.sleep(args.seconds)
+    stop.set()
+    await asyncio.gather(*tasks)
+    return lat, len(errors), time.perf_counter() - t0
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument("--host", required=True)
+    ap.add_argument("--port", type=int, default=80)
+    ap.add_argument("--mode", choices=["http", "ws"], default="http")
+    ap.add_argument("--path", default="/status", help="http mode: GET path")
+    ap.add_argument("--clients", default="1,8,32", help="comma-separated concurrency levels")
+    ap.add_argument("--seconds", type=float, default=5.0, help="per level")
+    ap.add_argument("--timeout", type=float, default=5.0)
+    args = ap.parse_args()
+
+    print("%s %s:%d%s" % (args.mode, args.host, args.port, args.path if args.mode == "http" else "/ws"))
+    for clients in [int(c) for c in args.clients.split(",")]:
+        lat, errors, secs = asyncio.run(run_level(args, clients))
+        if not lat:
+            print("%3d clients: no successful requests, %d errors" % (clients, errors))
+            continue
+        lat.sort()
+        p = lambda q: lat[min(len(lat) - 1, int(q * (len(lat) - 1) + 0.5))]
+        print("%3d clients: %7.1f req/s  avg=%.1f p50=%.1f p99=%.1f max=%.1f ms  (%d ok, %d errors)"
+              % (clients, len(lat) / secs, statistics.mean(lat), p(0.5), p(0.99), lat[-1], len(lat), errors))
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
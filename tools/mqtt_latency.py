@@ -0,0 +1,85 @@
+# tools/mqtt_latency.py
+# End-to-end MQTT check against a real board through a local broker
+# (mosquitto): publishes <base>/relay/<n>/set and times the retained
+# <base>/relay/<n>/state echo, i.e. broker -> ESP32 -> relay -> broker.
+#
+#   pip install paho-mqtt
+#   python tools/mqtt_latency.py --host 192.168.1.10 [-n 50] [--relay 1]
+
+import argparse
+import statistics
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument("--host", required=True, help="broker address")
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--base", default="home/esp32-relays", help="MQTT_BASE_TOPIC from config.h")
+    ap.add_argument("--relay", type=int, default=1)
+    ap.add_argument("-n", type=int, default=50, help="round trips")
+    ap.add_argument("--user")
+    ap.add_argument("--password")
+    args = ap.parse_args()
+
+    state_topic = "%s/relay/%d/state" % (args.base, args.relay)
+    set_topic = "%s/relay/%d/set" % (args.base, args.relay)
+    status_topic = "%s/status" % args.base
+
+    lock = threading.Condition()
+    seen = {"state": None, "at": 0.0, "status": None}
+
+    def on_message(client, userdata, msg):
+        with lock:
+            if msg.topic == state_topic:
+                seen["state"] = msg.payload.decode()
+                seen["at"] = time.perf_counter()
+            elif msg.topic == status_topic:
+                seen["status"] = msg.payload.decode()
+            lock.notify_all()
+
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.subscribe([(state_topic, 0), (status_topic, 0)])
+    client.loop_start()
+
+    with lock:
+        lock.wait_for(lambda: seen["status"] is not None and seen["state"] is not None, timeout=5)
+    print("device status: %s, relay %d: %s" % (seen["status"], args.relay, seen["state"]))
+    if seen["status"] != "online":
+        print("device is not online")
+        return 1
+
+    samples, lost = [], 0
+    for i in range(args.n):
+        want = "OFF" if seen["state"] == "ON" else "ON"
+        t0 = time.perf_counter()
+        with lock:
+            seen["at"] = 0.0
+            client.publish(set_topic, want)
+            ok = lock.wait_for(lambda: seen["state"] == want and seen["at"] >= t0, timeout=2)
+        if ok:
+            samples.append((seen["at"] - t0) * 1000)
+        else:
+            lost += 1
+        time.sleep(0.05)
+
+    client.loop_stop()
+    if samples:
+        samples.sort()
+        p = lambda q: samples[min(len(samples) - 1, int(q * (len(samples) - 1) + 0.5))]
+        print("set -> state: n=%d min=%.1f avg=%.1f p50=%.1f p99=%.1f max=%.1f ms"
+              % (len(samples), samples[0], statistics.mean(samples), p(0.5), p(0.99), samples[-1]))
+    if lost:
+        print("%d command(s) got no state echo within 2 s" % lost)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
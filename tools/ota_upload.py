@@ -0,0 +1,143 @@
+# tools/ota_upload.py
+# Uploads a firmware image to one board or a list of them over the local
+# HTTP server (POST /update, see include/ota_update.h), streaming the file
+# with its SHA-256 and reporting throughput per board. Runs against the host
+# build too (`program serve`, where the "restart" is only counted).
+#
+#   python tools/ota_upload.py .pio/build/nodemcu-32s/firmware.bin 192.168.1.50 192.168.1.51
+#   python tools/ota_upload.py firmware.bin --hosts-file boards.txt --parallel 4 --wait
+#   python tools/ota_upload.py firmware.bin 127.0.0.1 --port 8080       # native `serve`
+#
+# Boards answer 200 once the image is written and verified, then restart into
+# it; with --wait the tool also waits for each one to serve /status again.
+# A board that fails to confirm the new image rolls back by itself. Exit
+# status is the number of boards that failed. Boards refuse updates (403)
+# until OTA_PASSWORD is set in their config.h. Standard library only.
+
+import argparse
+import base64
+import concurrent.futures
+import hashlib
+import os
+import socket
+import sys
+import threading
+import time
+
+CHUNK = 16384
+print_lock = threading.Lock()
+
+
+def say(msg):
+    with print_lock:
+        print(msg, flush=True)
+
+
+def read_response(sock):
+    data = b""
+    while True:
+        part = sock.recv(4096)
+        if not part:
+            break
+        data += part
+    head, _, body = data.partition(b"\r\n\r\n")
+    try:
+        status = int(head.split(b" ", 2)[1])
+    except (IndexError, ValueError):
+        status = 0
+    return status, body.decode(errors="replace").strip()
+
+
+def upload(args, host, image, digest):
+    headers = ("POST /update HTTP/1.1\r\nHost: %s\r\nContent-Type: application/octet-stream\r\n"
+               "Content-Length: %d\r\nX-Firmware-SHA256: %s\r\n" % (host, len(image), digest))
+    if args.password:
+        auth = base64.b64encode(("%s:%s" % (args.user, args.password)).encode()).decode()
+        headers += "Authorization: Basic %s\r\n" % auth
+    headers += "\r\n"
+    t0 = time.perf_counter()
+    next_report = t0 + 1
+    try:
+        with socket.create_connection((host, args.port), timeout=args.timeout) as sock:
+            sock.sendall(headers.encode())
+            for off in range(0, len(image), CHUNK):
+                sock.sendall(image[off:off + CHUNK])
+                now = time.perf_counter()
+                if args.progress and now >= next_report:
+                    say("  %s: %3d%%  %.1f KB/s" % (host, 100 * (off + CHUNK) // len(image),
+                                                     (off + CHUNK) / 1024 / (now - t0)))
+                    next_report = now + 1
+            status, text = read_response(sock)
+    except OSError as e:
+        return False, "%s: %s" % (host, e)
+    secs = time.perf_counter() - t0
+    if status != 200:
+        return False, "%s: HTTP %d %s" % (host, status, text)
+    msg = "%s: ok, %d bytes in %.1f s (%.1f KB/s)" % (host, len(image), secs, len(image) / 1024 / secs)
+    if args.wait:
+        back = wait_for_status(args, host)
+        if back is None:
+            return False, msg + ", not back after %d s" % args.wait_seconds
+        msg += ", serving again after %.1f s" % back
+    return True, msg
+
+
+def wait_for_status(args, host):
+    t0 = time.perf_counter()
+    time.sleep(1)   # the board restarts ~0.5 s after answering
+    while time.perf_counter() - t0 < args.wait_seconds:
+        try:
+            with socket.create_connection((host, args.port), timeout=2) as sock:
+                sock.sendall(("GET /status HTTP/1.1\r\nHost: %s\r\n\r\n" % host).encode())
+                if read_response(sock)[0] == 200:
+                    return time.perf_counter() - t0
+        except OSError:
+            pass
+        time.sleep(1)
+    return None
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Stream a firmware image to boards over HTTP (POST /update).")
+    ap.add_argument("firmware", help=".bin app image (not the merged flash image)")
+    ap.add_argument("hosts", nargs="*", help="board addresses")
+    ap.add_argument("--hosts-file", help="file with one address per line (# comments)")
+    ap.add_argument("--port", type=int, default=80)
+    ap.add_argument("--user", default="ota", help="OTA_USER")
+    ap.add_argument("--password", default=os.environ.get("OTA_PASSWORD", ""),
+                    help="OTA_PASSWORD, sent as HTTP Basic auth (default: $OTA_PASSWORD)")
+    ap.add_argument("--parallel", type=int, default=1, help="boards updated at once")
+    ap.add_argument("--timeout", type=float, default=30.0, help="socket timeout, s")
+    ap.add_argument("--wait", action="store_true", help="wait for each board to come back after the restart")
+    ap.add_argument("--wait-seconds", type=int, default=60)
+    ap.add_argument("--no-progress", dest="progress", action="store_false")
+    args = ap.parse_args()
+
+    hosts = list(args.hosts)
+    if args.hosts_file:
+        with open(args.hosts_file) as f:
+            hosts += [l.split("#")[0].strip() for l in f if l.split("#")[0].strip()]
+    if not hosts:
+        ap.error("no hosts given")
+
+    with open(args.firmware, "rb") as f:
+        image = f.read()
+    if not image or image[0] != 0xE9:
+        print("%s does not start with an app image header (0xE9)" % args.firmware, file=sys.stderr)
+        return 1
+    digest = hashlib.sha256(image).hexdigest()
+    print("%s: %d bytes, sha256 %s, %d board%s" % (args.firmware, len(image), digest, len(hosts),
+                                                   "" if len(hosts) == 1 else "s"))
+
+    failed = 0
+    with concurrent.futures.ThreadPoolExecutor(max_workers=max(1, args.parallel)) as pool:
+        for ok, msg in pool.map(lambda h: upload(args, h, image, digest), hosts):
+            failed += not ok
+            say(("  " if ok else "  FAILED ") + msg)
+    if len(hosts) > 1:
+        print("%d/%d updated" % (len(hosts) - failed, len(hosts)))
+    return failed
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())